@@ -0,0 +1,685 @@
+/*
+ *	ectpbench
+ *	~~~~~~~~~
+ *
+ * Microbenchmarks for ECTP frame building, validation and forward message
+ * walking, and for Ethernet address conversion. Results are printed as CSV,
+ * one row per case, and can be compared against an earlier run.
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+/*
+ * Frame building and validation live in ectpping.c, so it's built in here
+ * with its main() renamed, and the code is benchmarked exactly as ectpping
+ * uses it.
+ */
+#define main ectpping_main
+#include "ectpping.c"
+#undef main
+
+
+/*
+ * Benchmark timing and limits
+ */
+enum {
+	BENCH_RUNS		= 5,	/* median of this many timed runs */
+	BENCH_DEFAULT_MIN_MS	= 50,	/* minimum duration of each run */
+	BENCH_MTU		= 16000,
+	BENCH_CASES_MAX		= 256,
+	BENCH_NAME_MAXSZ	= 32,
+};
+
+
+/*
+ * Matrix of hop counts (forward messages) and payload or frame sizes
+ */
+static const unsigned int bench_hops[] = { 1, 2, 8, 32, 128 };
+static const unsigned int bench_sizes[] = { 64, 512, 1500, 9000 };
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+
+/*
+ * State shared by a benchmark's operations
+ */
+struct bench_ctx {
+	unsigned int hops;
+	unsigned int size;
+	struct ether_addr *fwdaddrs;
+	uint8_t *data;
+	uint8_t *pkt_buf;
+	unsigned int pkt_buf_sz;
+	unsigned int pkt_len;
+	enum enet_ntop_format ntop_fmt;
+	const char *pton_str;
+};
+
+
+typedef void (*bench_op_fn)(struct bench_ctx *ctx, const uint64_t iters);
+
+
+/*
+ * A previous run's result, to compare against
+ */
+struct bench_result {
+	char name[BENCH_NAME_MAXSZ];
+	char variant[BENCH_NAME_MAXSZ];
+	unsigned int hops;
+	unsigned int bytes;
+	double ns_per_op;
+};
+
+
+struct bench_options {
+	uint64_t min_run_ns;
+	const char *baseline_file;
+};
+
+
+/*
+ * Function prototypes
+ */
+
+static uint64_t bench_now_ns(void);
+
+static uint64_t time_op(bench_op_fn op, struct bench_ctx *ctx,
+			const uint64_t iters);
+
+static double measure_op(const struct bench_options *opts, bench_op_fn op,
+			 struct bench_ctx *ctx, uint64_t *iters);
+
+static int cmp_double(const void *a, const void *b);
+
+static void run_case(const struct bench_options *opts,
+		     const char *name,
+		     const char *variant,
+		     const unsigned int hops,
+		     const unsigned int bytes,
+		     bench_op_fn op,
+		     struct bench_ctx *ctx);
+
+static bool setup_ctx(struct bench_ctx *ctx,
+		      const unsigned int hops,
+		      const unsigned int size);
+
+static void free_ctx(struct bench_ctx *ctx);
+
+static void op_ectp_build_packet(struct bench_ctx *ctx, const uint64_t iters);
+
+static void op_build_ectp_frame(struct bench_ctx *ctx, const uint64_t iters);
+
+static void op_ectp_pkt_valid(struct bench_ctx *ctx, const uint64_t iters);
+
+static void op_fwd_walk(struct bench_ctx *ctx, const uint64_t iters);
+
+static void op_enet_pton(struct bench_ctx *ctx, const uint64_t iters);
+
+static void op_enet_ntop(struct bench_ctx *ctx, const uint64_t iters);
+
+static void bench_packets(const struct bench_options *opts);
+
+static void bench_addrs(const struct bench_options *opts);
+
+static void load_baseline(const char *file);
+
+static const struct bench_result *find_baseline(const char *name,
+						const char *variant,
+						const unsigned int hops,
+						const unsigned int bytes);
+
+static void print_bench_usage(void);
+
+
+/*
+ * Global Variables
+ */
+
+/*
+ * Results are folded into here, so the work can't be optimised away
+ */
+volatile unsigned int bench_sink;
+
+
+struct bench_result baseline[BENCH_CASES_MAX];
+unsigned int num_baseline;
+
+
+int main(int argc, char *argv[])
+{
+	struct bench_options opts = {
+		.min_run_ns = BENCH_DEFAULT_MIN_MS * 1000000ULL,
+		.baseline_file = NULL,
+	};
+	int opt;
+
+
+	while ((opt = getopt(argc, argv, ":m:c:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			if (!parse_time_ns(optarg, 1000000ULL,
+				&opts.min_run_ns) || (opts.min_run_ns == 0)) {
+				fprintf(stderr, "-m: Bad option argument\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'c':
+			opts.baseline_file = optarg;
+			break;
+		case 'h':
+		default:
+			print_bench_usage();
+			return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (opts.baseline_file != NULL)
+		load_baseline(opts.baseline_file);
+
+	ectpping_pid = getpid();
+
+	crc32c_init();
+
+	printf("bench,variant,hops,bytes,iters,ns_per_op,ops_per_sec,"
+		"mbytes_per_sec");
+	if (opts.baseline_file != NULL)
+		printf(",baseline_ns_per_op,change_pct");
+	putchar('\n');
+
+	bench_packets(&opts);
+
+	bench_addrs(&opts);
+
+	return EXIT_SUCCESS;
+
+}
+
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec now;
+
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+
+}
+
+
+/*
+ * Time iters operations, in nanoseconds
+ */
+static uint64_t time_op(bench_op_fn op, struct bench_ctx *ctx,
+			const uint64_t iters)
+{
+	uint64_t start_ns;
+
+
+	start_ns = bench_now_ns();
+
+	op(ctx, iters);
+
+	return bench_now_ns() - start_ns;
+
+}
+
+
+static int cmp_double(const void *a, const void *b)
+{
+	const double *x = a, *y = b;
+
+
+	return (*x > *y) - (*x < *y);
+
+}
+
+
+/*
+ * Find how many iterations take at least the minimum run time, then
+ * return the median time per operation of several runs of that many
+ */
+static double measure_op(const struct bench_options *opts, bench_op_fn op,
+			 struct bench_ctx *ctx, uint64_t *iters)
+{
+	double ns_per_op[BENCH_RUNS];
+	uint64_t elapsed_ns;
+	unsigned int i;
+
+
+	*iters = 1;
+
+	while (true) {
+		elapsed_ns = time_op(op, ctx, *iters);
+		if (elapsed_ns >= opts->min_run_ns)
+			break;
+		if (elapsed_ns < (opts->min_run_ns / 64))
+			*iters *= 16;
+		else
+			*iters *= 2;
+	}
+
+	for (i = 0; i < BENCH_RUNS; i++)
+		ns_per_op[i] = (double)time_op(op, ctx, *iters) / *iters;
+
+	qsort(ns_per_op, BENCH_RUNS, sizeof(double), cmp_double);
+
+	return ns_per_op[BENCH_RUNS / 2];
+
+}
+
+
+/*
+ * Measure one case and print its row
+ */
+static void run_case(const struct bench_options *opts,
+		     const char *name,
+		     const char *variant,
+		     const unsigned int hops,
+		     const unsigned int bytes,
+		     bench_op_fn op,
+		     struct bench_ctx *ctx)
+{
+	const struct bench_result *base;
+	uint64_t iters;
+	double ns_per_op;
+
+
+	ns_per_op = measure_op(opts, op, ctx, &iters);
+
+	printf("%s,%s,%u,%u,%llu,%.2f,%.0f,%.2f", name, variant, hops, bytes,
+		(unsigned long long)iters, ns_per_op, 1e9 / ns_per_op,
+		(bytes * 1e3) / ns_per_op);
+
+	if (opts->baseline_file != NULL) {
+		base = find_baseline(name, variant, hops, bytes);
+		if (base != NULL)
+			printf(",%.2f,%+.1f", base->ns_per_op,
+				((ns_per_op - base->ns_per_op) * 100.0) /
+				base->ns_per_op);
+		else
+			printf(",,");
+	}
+
+	putchar('\n');
+
+	fflush(stdout);
+
+}
+
+
+/*
+ * Set up the forward addresses, payload and packet buffer for a point in
+ * the matrix. The packet buffer starts off holding a reply, as it would
+ * arrive back after all the hops.
+ */
+static bool setup_ctx(struct bench_ctx *ctx,
+		      const unsigned int hops,
+		      const unsigned int size)
+{
+	unsigned int i;
+
+
+	memset(ctx, 0, sizeof(struct bench_ctx));
+
+	ctx->hops = hops;
+	ctx->size = size;
+
+	ctx->fwdaddrs = calloc(hops, sizeof(struct ether_addr));
+	ctx->data = malloc(size);
+	ctx->pkt_buf_sz = BENCH_MTU + ETH_HLEN;
+	ctx->pkt_buf = calloc(1, ctx->pkt_buf_sz);
+
+	if ((ctx->fwdaddrs == NULL) || (ctx->data == NULL) ||
+	    (ctx->pkt_buf == NULL)) {
+		free_ctx(ctx);
+		return false;
+	}
+
+	for (i = 0; i < hops; i++) {
+		ctx->fwdaddrs[i].ether_addr_octet[0] = 0x02;
+		ctx->fwdaddrs[i].ether_addr_octet[4] = i >> 8;
+		ctx->fwdaddrs[i].ether_addr_octet[5] = i;
+	}
+
+	pattern_fill(ctx->data, size, PATTERN_PRBS);
+
+	ctx->pkt_len = ectp_calc_packet_size(hops, size);
+
+	ectp_build_packet(hops * ECTP_FWDMSG_SZ, ctx->fwdaddrs, hops,
+		ectpping_pid, ctx->data, size, ctx->pkt_buf, ctx->pkt_buf_sz,
+		0x00);
+
+	return true;
+
+}
+
+
+static void free_ctx(struct bench_ctx *ctx)
+{
+
+
+	free(ctx->fwdaddrs);
+	free(ctx->data);
+	free(ctx->pkt_buf);
+
+	ctx->fwdaddrs = NULL;
+	ctx->data = NULL;
+	ctx->pkt_buf = NULL;
+
+}
+
+
+static void op_ectp_build_packet(struct bench_ctx *ctx, const uint64_t iters)
+{
+	uint64_t i;
+
+
+	for (i = 0; i < iters; i++) {
+		ectp_build_packet(0, ctx->fwdaddrs, ctx->hops, ectpping_pid,
+			ctx->data, ctx->size, ctx->pkt_buf, ctx->pkt_buf_sz,
+			0x00);
+		bench_sink += ctx->pkt_buf[ctx->pkt_len - 1];
+	}
+
+}
+
+
+/*
+ * Build a whole probe frame as the tx thread does, using the global
+ * program parameters set up by bench_packets()
+ */
+static void op_build_ectp_frame(struct bench_ctx *ctx, const uint64_t iters)
+{
+	struct ectpping_payload eping_payload = {
+		.seq_num = 0,
+	};
+	unsigned int frame_len;
+	uint64_t i;
+
+
+	for (i = 0; i < iters; i++) {
+		eping_payload.seq_num++;
+		build_ectp_frame(&prog_parms, ctx->pkt_buf, ctx->pkt_buf_sz,
+			(uint8_t *)&eping_payload, sizeof(eping_payload),
+			&frame_len);
+		bench_sink += frame_len;
+	}
+
+}
+
+
+static void op_ectp_pkt_valid(struct bench_ctx *ctx, const uint64_t iters)
+{
+	uint8_t *ectp_data;
+	unsigned int ectp_data_size = 0;
+	uint64_t i;
+
+
+	for (i = 0; i < iters; i++) {
+		bench_sink += ectp_pkt_valid((struct ectp_packet *)ctx->pkt_buf,
+			ctx->pkt_len, &prog_parms, &ectp_data,
+			&ectp_data_size);
+		bench_sink += ectp_data_size;
+	}
+
+}
+
+
+/*
+ * Walk the forward messages as the chain of loopback assistants does,
+ * each reading its forward address and stepping the skipcount on, until
+ * the reply message is reached
+ */
+static void op_fwd_walk(struct bench_ctx *ctx, const uint64_t iters)
+{
+	struct ectp_packet *ectp_pkt = (struct ectp_packet *)ctx->pkt_buf;
+	struct ectp_message *ectp_msg;
+	uint64_t i;
+
+
+	for (i = 0; i < iters; i++) {
+		ectp_set_skipcount(ectp_pkt, 0);
+
+		ectp_msg = ectp_get_curr_msg_ptr(ectp_pkt);
+		while (ectp_get_msg_type(ectp_msg) == ECTP_FWDMSG) {
+			if (ectp_fwdaddr_ok(ectp_get_fwdaddr(ectp_msg)))
+				bench_sink += ectp_get_fwdaddr(ectp_msg)[5];
+			ectp_inc_skipcount(ectp_pkt);
+			ectp_msg = ectp_get_curr_msg_ptr(ectp_pkt);
+		}
+
+		bench_sink += ectp_get_rplymsg_rcpt_num(ectp_msg);
+	}
+
+}
+
+
+static void op_enet_pton(struct bench_ctx *ctx, const uint64_t iters)
+{
+	struct ether_addr addr;
+	uint64_t i;
+
+
+	for (i = 0; i < iters; i++) {
+		bench_sink += enet_pton(ctx->pton_str, &addr);
+		bench_sink += addr.ether_addr_octet[5];
+	}
+
+}
+
+
+static void op_enet_ntop(struct bench_ctx *ctx, const uint64_t iters)
+{
+	const struct ether_addr addr = {
+		{ 0x00, 0x1b, 0x21, 0x3c, 0x9d, 0xf8 },
+	};
+	char buf[ENET_PADDR_MAXSZ];
+	uint64_t i;
+
+
+	for (i = 0; i < iters; i++) {
+		bench_sink += enet_ntop(&addr, ctx->ntop_fmt, buf, sizeof(buf));
+		bench_sink += buf[0];
+	}
+
+}
+
+
+/*
+ * Packet building, validation and forward message walking, across the
+ * hops and sizes matrix. For ectp_build_packet() the size is the payload,
+ * for build_ectp_frame() it's the frame, as with -s.
+ */
+static void bench_packets(const struct bench_options *opts)
+{
+	struct bench_ctx ctx;
+	unsigned int h, s;
+	unsigned int frame_len;
+	const uint8_t build_info[] = "ectpbench";
+
+
+	memset(&prog_parms, 0, sizeof(prog_parms));
+	prog_parms.mtu = BENCH_MTU;
+	prog_parms.dstmac.ether_addr_octet[0] = 0x02;
+	prog_parms.srcmac.ether_addr_octet[0] = 0x02;
+	prog_parms.srcmac.ether_addr_octet[5] = 0x01;
+	prog_parms.uc_dstmac = true;
+	prog_parms.fill = true;
+	prog_parms.fill_pattern = PATTERN_PRBS;
+
+	if (build_ectp_user_data(&prog_parms, build_info, sizeof(build_info))
+		!= BUILD_ECTP_USER_DATA_GOOD) {
+		fprintf(stderr, "Failed to allocate probe payload\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (h = 0; h < ARRAY_SIZE(bench_hops); h++) {
+		for (s = 0; s < ARRAY_SIZE(bench_sizes); s++) {
+			if (!setup_ctx(&ctx, bench_hops[h], bench_sizes[s])) {
+				fprintf(stderr, "Failed to allocate buffers\n");
+				exit(EXIT_FAILURE);
+			}
+
+			run_case(opts, "ectp_build_packet", "-", ctx.hops,
+				ctx.pkt_len, op_ectp_build_packet, &ctx);
+
+			run_case(opts, "ectp_pkt_valid", "-", ctx.hops,
+				ctx.pkt_len, op_ectp_pkt_valid, &ctx);
+
+			run_case(opts, "fwd_walk", "-", ctx.hops,
+				ctx.pkt_len, op_fwd_walk, &ctx);
+
+			prog_parms.fwdaddrs = ctx.fwdaddrs;
+			prog_parms.num_fwdaddrs = ctx.hops;
+			prog_parms.frame_size = ctx.size;
+
+			prog_parms.crc = false;
+			build_ectp_frame(&prog_parms, ctx.pkt_buf,
+				ctx.pkt_buf_sz, (uint8_t *)&ctx,
+				sizeof(struct ectpping_payload), &frame_len);
+
+			run_case(opts, "build_ectp_frame", "nocrc", ctx.hops,
+				frame_len, op_build_ectp_frame, &ctx);
+
+			prog_parms.crc = true;
+			run_case(opts, "build_ectp_frame", "crc32c", ctx.hops,
+				frame_len, op_build_ectp_frame, &ctx);
+			prog_parms.crc = false;
+
+			prog_parms.fwdaddrs = NULL;
+			prog_parms.num_fwdaddrs = 0;
+
+			free_ctx(&ctx);
+		}
+	}
+
+	free(prog_parms.ectp_user_data);
+
+}
+
+
+/*
+ * Address conversion, for each format
+ */
+static void bench_addrs(const struct bench_options *opts)
+{
+	static const struct {
+		const char *name;
+		enum enet_ntop_format fmt;
+	} ntop_fmts[] = {
+		{ "802canon", ENET_NTOP_802CANON },
+		{ "802canonlc", ENET_NTOP_802CANONLC },
+		{ "unix", ENET_NTOP_UNIX },
+		{ "sununix", ENET_NTOP_SUNUNIX },
+		{ "cisco", ENET_NTOP_CISCO },
+		{ "packed", ENET_NTOP_PACKED },
+		{ "packedlc", ENET_NTOP_PACKEDLC },
+	};
+	static const struct {
+		const char *name;
+		const char *str;
+	} pton_strs[] = {
+		{ "colon", "00:1b:21:3c:9d:f8" },
+		{ "hyphen", "00-1B-21-3C-9D-F8" },
+	};
+	struct bench_ctx ctx;
+	unsigned int i;
+
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	for (i = 0; i < ARRAY_SIZE(pton_strs); i++) {
+		ctx.pton_str = pton_strs[i].str;
+		run_case(opts, "enet_pton", pton_strs[i].name, 0,
+			strlen(pton_strs[i].str), op_enet_pton, &ctx);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ntop_fmts); i++) {
+		ctx.ntop_fmt = ntop_fmts[i].fmt;
+		run_case(opts, "enet_ntop", ntop_fmts[i].name, 0,
+			ETH_ALEN, op_enet_ntop, &ctx);
+	}
+
+}
+
+
+/*
+ * Read an earlier run's CSV, to print the change against it
+ */
+static void load_baseline(const char *file)
+{
+	struct bench_result *res;
+	char line[256];
+	FILE *fp;
+
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		perror(file);
+		exit(EXIT_FAILURE);
+	}
+
+	num_baseline = 0;
+
+	while ((num_baseline < BENCH_CASES_MAX) &&
+	       (fgets(line, sizeof(line), fp) != NULL)) {
+		res = &baseline[num_baseline];
+		if (sscanf(line, "%31[^,],%31[^,],%u,%u,%*u,%lf", res->name,
+			res->variant, &res->hops, &res->bytes,
+			&res->ns_per_op) != 5)
+			continue;	/* header, or not a result */
+		num_baseline++;
+	}
+
+	fclose(fp);
+
+}
+
+
+static const struct bench_result *find_baseline(const char *name,
+						const char *variant,
+						const unsigned int hops,
+						const unsigned int bytes)
+{
+	unsigned int i;
+
+
+	for (i = 0; i < num_baseline; i++) {
+		if ((strcmp(baseline[i].name, name) == 0) &&
+		    (strcmp(baseline[i].variant, variant) == 0) &&
+		    (baseline[i].hops == hops) &&
+		    (baseline[i].bytes == bytes))
+			return &baseline[i];
+	}
+
+	return NULL;
+
+}
+
+
+static void print_bench_usage(void)
+{
+
+
+	fprintf(stderr, "Usage: ectpbench [-m <time>] [-c <baseline.csv>]\n");
+	fprintf(stderr, "-m <time>\t: Minimum duration of each timed run, in "
+			"milliseconds unless\n");
+	fprintf(stderr, "\t\t  suffixed with s, ms, us or ns. Default is "
+			"%ums.\n", BENCH_DEFAULT_MIN_MS);
+	fprintf(stderr, "-c <file>\t: Compare against the CSV from an earlier "
+			"run, adding the\n");
+	fprintf(stderr, "\t\t  baseline ns/op and the percentage change.\n");
+	fprintf(stderr, "Results are CSV on stdout, the median of %u runs "
+			"per case.\n", BENCH_RUNS);
+
+}
+
+/* EOF */
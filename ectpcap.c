@@ -0,0 +1,668 @@
+/*
+ *	ectpcap
+ *	~~~~~~~
+ *
+ * Reads a pcap or pcapng capture of ECTP frames, such as one written by
+ * ectpping -C or by tcpdump, matches each ectpping probe with its replies,
+ * and prints the loss and round trip statistics of each ectpping run in
+ * it. Round trip times are measured between the probe's and the reply's
+ * capture timestamps, or from the send time in the reply's payload when
+ * the probe isn't in the capture.
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include <unistd.h>
+#include <net/ethernet.h>
+
+#include "libenetaddr.h"
+#include "libectp.h"
+#include "libhist.h"
+#include "libpcapng.h"
+
+
+/*
+ * The start of an ectpping probe's ECTP data, as ectpping lays it out, so
+ * captures are read on the same kind of host they were made on
+ */
+struct ectpping_payload {
+	uint32_t seq_num;
+	uint32_t crc32c;
+	struct timeval tv;
+	uint32_t path_id;
+};
+
+
+/*
+ * An ECTP frame that is an ectpping probe or reply
+ */
+enum FRAME_KIND {
+	FRAME_OTHER,
+	FRAME_PROBE,
+	FRAME_REPLY,
+};
+
+
+struct frame_info {
+	uint64_t prober;		/* mac, in 48 bits, first octet lowest */
+	uint16_t rcpt_num;
+	uint32_t seq;
+	uint64_t sent_ns;		/* from the payload, wall clock */
+};
+
+
+enum {
+	PROBE_SEEN		= 0x01,	/* the probe is in the capture */
+	PROBE_ANSWERED		= 0x02,
+	PROBE_USED		= 0x04,	/* the table slot is in use */
+};
+
+
+/*
+ * A probe, keyed by who sent it and its sequence number
+ */
+struct probe_entry {
+	uint64_t prober;
+	uint32_t seq;
+	uint16_t rcpt_num;
+	uint16_t flags;
+	uint64_t tx_ns;
+	uint64_t rx_ns;			/* the first reply's */
+};
+
+
+/*
+ * Open addressed, grown to keep it at most half full
+ */
+struct probe_table {
+	struct probe_entry *entries;
+	size_t size;			/* a power of 2 */
+	size_t used;
+};
+
+
+/*
+ * The probes of one ectpping run, told apart by the prober's mac and
+ * receipt number
+ */
+struct flow_stats {
+	uint64_t prober;
+	uint16_t rcpt_num;
+	uint64_t probes;		/* in the capture */
+	uint64_t answered;
+	uint64_t uncaptured;		/* replies to probes not in the capture */
+	uint64_t first_tx_ns;
+	uint64_t last_tx_ns;
+	struct hist rtt_ns;
+};
+
+
+struct flows {
+	struct flow_stats *flows;
+	unsigned int num_flows;
+	unsigned int alloced;
+};
+
+
+/*
+ * Function prototypes
+ */
+
+void print_usage(void);
+
+enum FRAME_KIND parse_frame(const struct pcap_frame *frame,
+			    struct frame_info *fi);
+
+uint64_t mac_bytes_to_u64(const uint8_t bytes[ETH_ALEN]);
+
+void mac_u64_to_bytes(const uint64_t mac, uint8_t bytes[ETH_ALEN]);
+
+bool init_probe_table(struct probe_table *pt);
+
+size_t hash_probe(const uint64_t prober, const uint16_t rcpt_num,
+		  const uint32_t seq);
+
+struct probe_entry *find_probe(struct probe_table *pt,
+			       const struct frame_info *fi);
+
+bool grow_probe_table(struct probe_table *pt);
+
+void add_probe(struct probe_entry *pe, const struct frame_info *fi,
+	       const uint64_t ts_ns);
+
+void add_reply(struct probe_entry *pe, const struct frame_info *fi,
+	       const uint64_t ts_ns,
+	       uint64_t *dups);
+
+struct flow_stats *find_flow(struct flows *flows, const uint64_t prober,
+			     const uint16_t rcpt_num);
+
+void add_flow_probe(struct flow_stats *fs, const struct probe_entry *pe);
+
+void merge_flow_stats(struct flow_stats *total, const struct flow_stats *fs);
+
+void print_flow_stats(const char *label, const struct flow_stats *fs);
+
+
+int main(int argc, char *argv[])
+{
+	struct pcap_reader pr;
+	struct pcap_frame frame;
+	struct frame_info fi;
+	struct probe_table probes;
+	struct probe_entry *pe;
+	struct flows flows = { NULL, 0, 0 };
+	struct flow_stats *fs, *total;
+	char macpbuf[ENET_PADDR_MAXSZ];
+	char label[ENET_PADDR_MAXSZ + 32];
+	uint8_t mac[ETH_ALEN];
+	enum PCAP_NEXT next;
+	enum FRAME_KIND kind;
+	uint64_t frames = 0, probe_frames = 0, reply_frames = 0, dups = 0;
+	size_t i;
+	int opt;
+
+
+	while ((opt = getopt(argc, argv, "h")) != -1) {
+		switch (opt) {
+		case 'h':
+		default:
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != (argc - 1)) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	switch (pcap_map(&pr, argv[optind])) {
+	case PCAP_MAP_GOOD:
+		break;
+	case PCAP_MAP_BADHDR:
+		fprintf(stderr, "%s: not a pcap or pcapng capture\n",
+			argv[optind]);
+		return EXIT_FAILURE;
+	case PCAP_MAP_BADFILE:
+	default:
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (!init_probe_table(&probes)) {
+		fprintf(stderr, "Failed to allocate probe table\n");
+		return EXIT_FAILURE;
+	}
+
+	while ((next = pcap_next(&pr, &frame)) == PCAP_NEXT_GOOD) {
+		frames++;
+
+		kind = parse_frame(&frame, &fi);
+		if (kind == FRAME_OTHER)
+			continue;
+
+		if ((probes.used * 2) >= probes.size) {
+			if (!grow_probe_table(&probes)) {
+				fprintf(stderr, "Failed to allocate probe "
+					"table\n");
+				return EXIT_FAILURE;
+			}
+		}
+
+		pe = find_probe(&probes, &fi);
+
+		if (kind == FRAME_PROBE) {
+			probe_frames++;
+			add_probe(pe, &fi, frame.ts_ns);
+		} else {
+			reply_frames++;
+			add_reply(pe, &fi, frame.ts_ns, &dups);
+		}
+
+		if (!(pe->flags & PROBE_USED)) {
+			pe->flags |= PROBE_USED;
+			probes.used++;
+		}
+	}
+
+	if (next == PCAP_NEXT_BAD)
+		fprintf(stderr, "%s: truncated or corrupt block at offset "
+			"%zu, stopped there\n", argv[optind], pr.pos);
+
+	/* replies may be captured ahead of their probes, so match at the end */
+	for (i = 0; i < probes.size; i++) {
+		pe = &probes.entries[i];
+		if (!(pe->flags & PROBE_USED))
+			continue;
+		fs = find_flow(&flows, pe->prober, pe->rcpt_num);
+		if (fs == NULL) {
+			fprintf(stderr, "Failed to allocate flow statistics\n");
+			return EXIT_FAILURE;
+		}
+		add_flow_probe(fs, pe);
+	}
+
+	printf("ECTPCAP %s: %llu frames, %llu probes, %llu replies, "
+		"%llu duplicate replies\n", argv[optind],
+		(unsigned long long)frames, (unsigned long long)probe_frames,
+		(unsigned long long)reply_frames, (unsigned long long)dups);
+
+	if (flows.num_flows == 1) {
+		print_flow_stats(NULL, &flows.flows[0]);
+	} else if (flows.num_flows > 1) {
+		total = malloc(sizeof(struct flow_stats));
+		if (total == NULL) {
+			fprintf(stderr, "Failed to allocate flow statistics\n");
+			return EXIT_FAILURE;
+		}
+		memset(total, 0, sizeof(struct flow_stats));
+		hist_init(&total->rtt_ns);
+
+		for (i = 0; i < flows.num_flows; i++) {
+			fs = &flows.flows[i];
+			mac_u64_to_bytes(fs->prober, mac);
+			enet_ntop((const struct ether_addr *)mac,
+				ENET_NTOP_UNIX, macpbuf, ENET_PADDR_MAXSZ);
+			snprintf(label, sizeof(label), "%s rcpt %u", macpbuf,
+				fs->rcpt_num);
+			print_flow_stats(label, fs);
+			merge_flow_stats(total, fs);
+		}
+		print_flow_stats("all probers", total);
+
+		free(total);
+	}
+
+	free(flows.flows);
+	free(probes.entries);
+
+	pcap_unmap(&pr);
+
+	return EXIT_SUCCESS;
+
+}
+
+
+void print_usage(void)
+{
+
+
+	fprintf(stderr, "Usage: ectpcap <pcap or pcapng capture>\n");
+
+}
+
+
+/*
+ * Tell an ectpping probe, as sent, from a reply, as returned, from
+ * anything else, including probes part way along their forward path.
+ * Ethernet frames, with or without a VLAN tag, are understood.
+ */
+enum FRAME_KIND parse_frame(const struct pcap_frame *frame,
+			    struct frame_info *fi)
+{
+	const struct ectp_packet *ectp_pkt;
+	struct ectp_message *msg;
+	struct ectpping_payload payload;
+	unsigned int off = ETH_HLEN, pkt_len, skipcount, msg_off;
+	uint16_t ethtype;
+	bool probe;
+
+
+	if ((frame->linktype != PCAPNG_LINKTYPE_ETHERNET) ||
+	    (frame->caplen < ETH_HLEN))
+		return FRAME_OTHER;
+
+	ethtype = (frame->data[12] << 8) | frame->data[13];
+
+	if (ethtype == ETHERTYPE_VLAN) {
+		if (frame->caplen < (ETH_HLEN + 4))
+			return FRAME_OTHER;
+		ethtype = (frame->data[16] << 8) | frame->data[17];
+		off += 4;
+	}
+
+	if (ethtype != ETHERTYPE_LOOPBACK)
+		return FRAME_OTHER;
+
+	ectp_pkt = (const struct ectp_packet *)&frame->data[off];
+	pkt_len = frame->caplen - off;
+
+	if (pkt_len < ECTP_PACKET_MIN_SZ)
+		return FRAME_OTHER;
+
+	skipcount = ectp_get_skipcount(ectp_pkt);
+
+	if (!ectp_skipc_basicchk_ok(skipcount, pkt_len))
+		return FRAME_OTHER;
+
+	/* the reply message follows any forward messages */
+	msg_off = skipcount;
+	while (true) {
+		if ((ECTP_PACKET_HDR_SZ + msg_off + ECTP_MSG_FUNC_SZ) > pkt_len)
+			return FRAME_OTHER;
+		msg = ectp_get_msg_ptr(msg_off, ectp_pkt);
+		if (ectp_get_msg_type(msg) == ECTP_RPLYMSG)
+			break;
+		if (ectp_get_msg_type(msg) != ECTP_FWDMSG)
+			return FRAME_OTHER;
+		msg_off += ECTP_FWDMSG_SZ;
+	}
+
+	probe = (msg_off != skipcount);
+
+	if (probe && (skipcount != 0))
+		return FRAME_OTHER;
+
+	if ((ECTP_PACKET_HDR_SZ + msg_off + ECTP_MSG_FUNC_SZ +
+	     sizeof(struct ectp_reply_message) +
+	     sizeof(struct ectpping_payload)) > pkt_len)
+		return FRAME_OTHER;
+
+	fi->rcpt_num = ectp_get_rplymsg_rcpt_num(msg);
+
+	memcpy(&payload, ectp_get_rplymsg_data_ptr(msg),
+		sizeof(struct ectpping_payload));
+	fi->seq = payload.seq_num;
+	fi->sent_ns = ((uint64_t)payload.tv.tv_sec * 1000000000ULL) +
+		((uint64_t)payload.tv.tv_usec * 1000ULL);
+
+	/* a probe is from its prober, and its replies go back to it */
+	fi->prober = mac_bytes_to_u64(probe ? &frame->data[ETH_ALEN] :
+		&frame->data[0]);
+
+	return probe ? FRAME_PROBE : FRAME_REPLY;
+
+}
+
+
+uint64_t mac_bytes_to_u64(const uint8_t bytes[ETH_ALEN])
+{
+	uint64_t mac = 0;
+	unsigned int i;
+
+
+	for (i = 0; i < ETH_ALEN; i++)
+		mac |= (uint64_t)bytes[i] << (i * 8);
+
+	return mac;
+
+}
+
+
+void mac_u64_to_bytes(const uint64_t mac, uint8_t bytes[ETH_ALEN])
+{
+	unsigned int i;
+
+
+	for (i = 0; i < ETH_ALEN; i++)
+		bytes[i] = mac >> (i * 8);
+
+}
+
+
+bool init_probe_table(struct probe_table *pt)
+{
+
+
+	pt->size = 65536;
+	pt->used = 0;
+	pt->entries = calloc(pt->size, sizeof(struct probe_entry));
+
+	return pt->entries != NULL;
+
+}
+
+
+size_t hash_probe(const uint64_t prober, const uint16_t rcpt_num,
+		  const uint32_t seq)
+{
+	uint64_t h;
+
+
+	h = (prober ^ ((uint64_t)rcpt_num << 48)) * 0x9e3779b97f4a7c15ULL;
+	h ^= seq * 0xc2b2ae3d27d4eb4fULL;
+
+	return h ^ (h >> 29);
+
+}
+
+
+/*
+ * The probe's entry, or the empty slot it would have
+ */
+struct probe_entry *find_probe(struct probe_table *pt,
+			       const struct frame_info *fi)
+{
+	struct probe_entry *pe;
+	size_t i;
+
+
+	i = hash_probe(fi->prober, fi->rcpt_num, fi->seq) & (pt->size - 1);
+
+	while (true) {
+		pe = &pt->entries[i];
+		if (!(pe->flags & PROBE_USED))
+			return pe;
+		if ((pe->seq == fi->seq) && (pe->prober == fi->prober) &&
+		    (pe->rcpt_num == fi->rcpt_num))
+			return pe;
+		i = (i + 1) & (pt->size - 1);
+	}
+
+}
+
+
+bool grow_probe_table(struct probe_table *pt)
+{
+	struct probe_table new_pt;
+	struct probe_entry *pe;
+	struct frame_info fi;
+	size_t i;
+
+
+	new_pt.size = pt->size * 2;
+	new_pt.used = pt->used;
+	new_pt.entries = calloc(new_pt.size, sizeof(struct probe_entry));
+	if (new_pt.entries == NULL)
+		return false;
+
+	for (i = 0; i < pt->size; i++) {
+		if (!(pt->entries[i].flags & PROBE_USED))
+			continue;
+		fi.prober = pt->entries[i].prober;
+		fi.rcpt_num = pt->entries[i].rcpt_num;
+		fi.seq = pt->entries[i].seq;
+		pe = find_probe(&new_pt, &fi);
+		*pe = pt->entries[i];
+	}
+
+	free(pt->entries);
+	*pt = new_pt;
+
+	return true;
+
+}
+
+
+/*
+ * The probe's capture time replaces the payload's send time that any
+ * earlier reply left
+ */
+void add_probe(struct probe_entry *pe, const struct frame_info *fi,
+	       const uint64_t ts_ns)
+{
+
+
+	if (pe->flags & PROBE_SEEN)
+		return;
+
+	if (!(pe->flags & PROBE_USED)) {
+		pe->prober = fi->prober;
+		pe->rcpt_num = fi->rcpt_num;
+		pe->seq = fi->seq;
+	}
+
+	pe->flags |= PROBE_SEEN;
+	pe->tx_ns = (ts_ns != 0) ? ts_ns : fi->sent_ns;
+
+}
+
+
+void add_reply(struct probe_entry *pe, const struct frame_info *fi,
+	       const uint64_t ts_ns,
+	       uint64_t *dups)
+{
+
+
+	if (pe->flags & PROBE_ANSWERED) {
+		(*dups)++;
+		return;
+	}
+
+	if (!(pe->flags & PROBE_USED)) {
+		pe->prober = fi->prober;
+		pe->rcpt_num = fi->rcpt_num;
+		pe->seq = fi->seq;
+		pe->tx_ns = fi->sent_ns;
+	}
+
+	pe->flags |= PROBE_ANSWERED;
+	pe->rx_ns = ts_ns;
+
+}
+
+
+struct flow_stats *find_flow(struct flows *flows, const uint64_t prober,
+			     const uint16_t rcpt_num)
+{
+	struct flow_stats *fs;
+	unsigned int i, new_alloced;
+
+
+	for (i = 0; i < flows->num_flows; i++) {
+		fs = &flows->flows[i];
+		if ((fs->prober == prober) && (fs->rcpt_num == rcpt_num))
+			return fs;
+	}
+
+	if (flows->num_flows == flows->alloced) {
+		new_alloced = (flows->alloced > 0) ? flows->alloced * 2 : 4;
+		fs = realloc(flows->flows,
+			new_alloced * sizeof(struct flow_stats));
+		if (fs == NULL)
+			return NULL;
+		flows->flows = fs;
+		flows->alloced = new_alloced;
+	}
+
+	fs = &flows->flows[flows->num_flows++];
+
+	memset(fs, 0, sizeof(struct flow_stats));
+	fs->prober = prober;
+	fs->rcpt_num = rcpt_num;
+	hist_init(&fs->rtt_ns);
+
+	return fs;
+
+}
+
+
+void add_flow_probe(struct flow_stats *fs, const struct probe_entry *pe)
+{
+	int64_t rtt_ns;
+
+
+	if (pe->flags & PROBE_SEEN) {
+		fs->probes++;
+		if ((fs->first_tx_ns == 0) || (pe->tx_ns < fs->first_tx_ns))
+			fs->first_tx_ns = pe->tx_ns;
+		if (pe->tx_ns > fs->last_tx_ns)
+			fs->last_tx_ns = pe->tx_ns;
+	}
+
+	if (!(pe->flags & PROBE_ANSWERED))
+		return;
+
+	if (pe->flags & PROBE_SEEN)
+		fs->answered++;
+	else
+		fs->uncaptured++;
+
+	/* a reply timestamped before its probe's send time counts as 0 */
+	rtt_ns = pe->rx_ns - pe->tx_ns;
+	hist_add(&fs->rtt_ns, (rtt_ns > 0) ? rtt_ns : 0);
+
+}
+
+
+void merge_flow_stats(struct flow_stats *total, const struct flow_stats *fs)
+{
+
+
+	total->probes += fs->probes;
+	total->answered += fs->answered;
+	total->uncaptured += fs->uncaptured;
+
+	if ((fs->probes > 0) && ((total->first_tx_ns == 0) ||
+	    (fs->first_tx_ns < total->first_tx_ns)))
+		total->first_tx_ns = fs->first_tx_ns;
+	if (fs->last_tx_ns > total->last_tx_ns)
+		total->last_tx_ns = fs->last_tx_ns;
+
+	hist_merge(&total->rtt_ns, &fs->rtt_ns);
+
+}
+
+
+void print_flow_stats(const char *label, const struct flow_stats *fs)
+{
+
+
+	if (label != NULL)
+		printf("%s: ", label);
+
+	printf("%llu probes, %llu answered", (unsigned long long)fs->probes,
+		(unsigned long long)fs->answered);
+
+	if (fs->probes > 0)
+		printf(", %f%% packet loss, over %.3f sec",
+			((fs->probes - fs->answered) * 100.0) / fs->probes,
+			(fs->last_tx_ns - fs->first_tx_ns) / 1e9);
+
+	if (fs->uncaptured > 0)
+		printf(", %llu replies to probes not captured",
+			(unsigned long long)fs->uncaptured);
+
+	putchar('\n');
+
+	if (fs->rtt_ns.count == 0)
+		return;
+
+	printf("round-trip (usec) min/avg/max = %.3f/%.3f/%.3f, "
+		"p50/p90/p99/p99.9 = %.3f/%.3f/%.3f/%.3f\n",
+		fs->rtt_ns.min / 1e3, hist_mean(&fs->rtt_ns) / 1e3,
+		fs->rtt_ns.max / 1e3,
+		hist_percentile(&fs->rtt_ns, 50.0) / 1e3,
+		hist_percentile(&fs->rtt_ns, 90.0) / 1e3,
+		hist_percentile(&fs->rtt_ns, 99.0) / 1e3,
+		hist_percentile(&fs->rtt_ns, 99.9) / 1e3);
+
+}
+
+/* EOF */
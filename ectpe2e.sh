@@ -0,0 +1,184 @@
+#!/bin/sh
+#
+#	ectpe2e.sh
+#	~~~~~~~~~~
+#
+# End to end ECTP loopback harness, needing no physical network. A veth
+# pair is created with its far end in a network namespace, where ectpresp
+# answers as the loopback assistant, and ectpping is run through it at a
+# sweep of rates and frame sizes for each of its tx/rx engines. Results
+# are printed as CSV, one row per run, with the achieved packet rates, loss
+# and round trip percentiles.
+#
+# Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+# All rights reserved.
+#
+# Licensed under the GNU General Public Licence (GPL) Version 2 only.
+# This explicitly does not include later versions, such as revisions of 2 or
+# Version 3, and later versions.
+# See the accompanying LICENSE file for full terms and conditions.
+#
+
+NS=ectpe2e
+VETH=ectpe2e0
+PEER=ectpe2e1
+MTU=9000
+HAVE_FQ=yes
+
+DURATION=3
+RATES="1000 10000 50000"
+SIZES="60 512 1514"
+ENGINES="sleep spin hybrid txtime fanout busypoll"
+
+usage()
+{
+	cat >&2 <<EOF
+Usage: ectpe2e.sh [-d <secs>] [-r "<pps> ..."] [-s "<bytes> ..."]
+		  [-e "<engine> ..."]
+-d <secs>	: Duration of each run. Default is $DURATION.
+-r <rates>	: Probe rates, in packets per second. Default is "$RATES".
+-s <sizes>	: Frame sizes, as ectpping -s. Default is "$SIZES".
+-e <engines>	: tx/rx engines to run, from sleep, spin and hybrid pacing,
+		  txtime (SO_TXTIME, skipped without fq), fanout (2 lb rx
+		  workers), busypoll (-Y rx spinning) and rt (-R real-time
+		  mode).
+		  Default is "$ENGINES".
+Needs root, and ectpping and ectpresp built in the current directory.
+EOF
+	exit 1
+}
+
+#
+# ectpping options for an engine
+#
+engine_opts()
+{
+	case "$1" in
+	sleep)		echo "-P sleep" ;;
+	spin)		echo "-P spin" ;;
+	hybrid)		echo "-P hybrid" ;;
+	txtime)		echo "-T 200us" ;;
+	fanout)		echo "-W 2:lb" ;;
+	busypoll)	echo "-Y 2ms" ;;
+	rt)		echo "-R 50" ;;
+	*)		return 1 ;;
+	esac
+}
+
+setup()
+{
+	ip netns add $NS || exit 1
+	ip link add $VETH mtu $MTU type veth peer name $PEER mtu $MTU || exit 1
+	ip link set $PEER netns $NS
+	ip link set $VETH up
+	ip -n $NS link set $PEER up
+
+	# for SO_TXTIME launch times, which ectpping -T won't run without
+	if ! tc qdisc replace dev $VETH root fq; then
+		echo "ectpe2e.sh: no fq qdisc, skipping the txtime runs" >&2
+		HAVE_FQ=no
+	fi
+
+	ip netns exec $NS ./ectpresp $PEER 2>"$WORKDIR/ectpresp.log" &
+	RESP_PID=$!
+
+	RESP_MAC=$(ip -n $NS link show $PEER | awk '/link\/ether/ { print $2 }')
+
+	# wait for the responder's socket
+	sleep 0.5
+}
+
+cleanup()
+{
+	[ -n "$RESP_PID" ] && kill $RESP_PID 2>/dev/null && wait $RESP_PID
+	[ -s "$WORKDIR/ectpresp.log" ] && cat "$WORKDIR/ectpresp.log" >&2
+	ip link del $VETH 2>/dev/null
+	ip netns del $NS 2>/dev/null
+	rm -rf "$WORKDIR"
+}
+
+#
+# Print the CSV row for a run from ectpping's output. Round trip times are
+# in usecs, percentiles by nearest rank.
+#
+summarise()
+{
+	engine=$1 rate=$2 size=$3 out=$4
+
+	grep -o 'time=-\?[0-9.]*' "$out" | cut -d= -f2 | sort -n | awk \
+		-v engine="$engine" -v rate="$rate" -v size="$size" \
+		-v secs="$DURATION" -v stats="$(grep 'packets transmitted' "$out" | head -1)" '
+	function pct(p,    i) {
+		if (n == 0)
+			return ""
+		i = int((p * n) / 100)
+		if (i < (p * n) / 100)
+			i++
+		if (i < 1)
+			i = 1
+		return sprintf("%.1f", v[i] * 1e6)
+	}
+	{ v[++n] = $1 }
+	END {
+		split(stats, f, " ")
+		txed = f[1] + 0
+		rxed = f[4] + 0
+		loss = (txed > 0) ? ((txed - rxed) * 100) / txed : 0
+		if (loss < 0)
+			loss = 0
+		printf("%s,%u,%u,%u,%u,%u,%.0f,%.0f,%.3f,%s,%s,%s,%s,%s\n",
+			engine, rate, size, secs, txed, rxed, txed / secs,
+			rxed / secs, loss, pct(50), pct(90), pct(99),
+			pct(99.9), pct(100))
+	}'
+}
+
+while getopts "d:r:s:e:h" opt; do
+	case $opt in
+	d)	DURATION=$OPTARG ;;
+	r)	RATES=$OPTARG ;;
+	s)	SIZES=$OPTARG ;;
+	e)	ENGINES=$OPTARG ;;
+	*)	usage ;;
+	esac
+done
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "ectpe2e.sh: needs root, for network namespaces and -I" >&2
+	exit 1
+fi
+
+if [ ! -x ./ectpping ] || [ ! -x ./ectpresp ]; then
+	echo "ectpe2e.sh: build ectpping and ectpresp first (make e2e)" >&2
+	exit 1
+fi
+
+for engine in $ENGINES; do
+	if ! engine_opts $engine >/dev/null; then
+		echo "ectpe2e.sh: unknown engine $engine" >&2
+		usage
+	fi
+done
+
+WORKDIR=$(mktemp -d) || exit 1
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+setup
+
+echo "engine,rate_pps,frame_size,secs,txed,rxed,tx_pps,rx_pps,loss_pct,"\
+"rtt_p50_us,rtt_p90_us,rtt_p99_us,rtt_p999_us,rtt_max_us"
+
+for engine in $ENGINES; do
+	[ $engine = txtime ] && [ $HAVE_FQ = no ] && continue
+	for rate in $RATES; do
+		for size in $SIZES; do
+			echo "ectpe2e.sh: $engine, $rate pps, $size bytes" >&2
+			out="$WORKDIR/$engine-$rate-$size.out"
+			timeout -s INT $DURATION ./ectpping -i $VETH -n \
+				-I $((1000000000 / rate))ns -s $size \
+				$(engine_opts $engine) $RESP_MAC >"$out" 2>&1
+			summarise $engine $rate $size "$out"
+		done
+	done
+done
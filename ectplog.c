@@ -0,0 +1,459 @@
+/*
+ *	ectplog
+ *	~~~~~~~
+ *
+ * Reads an ectpping probe log (-w), and prints the loss and round trip
+ * statistics of the whole run, optionally per slice of time and per
+ * responder. The log is mapped and decoded in a single pass, with round
+ * trip times kept in fixed size histograms, so memory use doesn't grow
+ * with the number of probes.
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <net/ethernet.h>
+
+#include "libenetaddr.h"
+#include "libhist.h"
+#include "libprobelog.h"
+
+
+/*
+ * Probe and reply counts, and round trip times, of some set of probes
+ */
+struct log_stats {
+	uint64_t probes;
+	uint64_t answered;
+	struct hist rtt_ns;
+};
+
+
+/*
+ * Replies per responder, grown as responders turn up, and from those the
+ * log had no room for
+ */
+struct responder_counts {
+	uint64_t *replies;
+	unsigned int alloced;
+	uint64_t unknown_replies;
+};
+
+
+/*
+ * Function prototypes
+ */
+
+void print_usage(void);
+
+bool parse_slice(const char *str, uint64_t *ns);
+
+void init_log_stats(struct log_stats *stats);
+
+void add_log_rec(struct log_stats *stats, const struct probelog_rec *rec);
+
+void print_log_header(const char *path, const struct probelog_hdr *hdr);
+
+void print_log_stats(const char *label, const struct log_stats *stats,
+		     const uint64_t first_tx_ns,
+		     const uint64_t last_tx_ns);
+
+void print_slice_hdr(void);
+
+void print_slice(const uint64_t start_ns, const struct log_stats *stats);
+
+bool count_responder(struct responder_counts *counts,
+		     const unsigned int responder);
+
+void print_responders(const struct probelog_reader *plr,
+		      const struct responder_counts *counts);
+
+
+int main(int argc, char *argv[])
+{
+	struct probelog_reader plr;
+	struct probelog_rec rec;
+	struct log_stats *total, *ifaces, *slice = NULL;
+	struct responder_counts responders = { NULL, 0, 0 };
+	enum PROBELOG_NEXT next;
+	uint64_t slice_ns = 0, slice_start_ns = 0;
+	uint64_t first_tx_ns = 0, last_tx_ns = 0;
+	bool per_responder = false;
+	unsigned int i;
+	int opt;
+
+
+	while ((opt = getopt(argc, argv, "s:rh")) != -1) {
+		switch (opt) {
+		case 's':
+			if (!parse_slice(optarg, &slice_ns)) {
+				fprintf(stderr, "Bad slice - %s.\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'r':
+			per_responder = true;
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != (argc - 1)) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	switch (probelog_map(&plr, argv[optind])) {
+	case PROBELOG_MAP_GOOD:
+		break;
+	case PROBELOG_MAP_BADHDR:
+		fprintf(stderr, "%s: not an ectpping probe log\n",
+			argv[optind]);
+		return EXIT_FAILURE;
+	case PROBELOG_MAP_NOMEM:
+		fprintf(stderr, "Failed to allocate responder table\n");
+		return EXIT_FAILURE;
+	case PROBELOG_MAP_BADFILE:
+	default:
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	total = malloc(sizeof(struct log_stats));
+	ifaces = malloc(plr.hdr.num_ifaces * sizeof(struct log_stats));
+	if (slice_ns > 0)
+		slice = malloc(sizeof(struct log_stats));
+	if ((total == NULL) || (ifaces == NULL) ||
+	    ((slice_ns > 0) && (slice == NULL))) {
+		fprintf(stderr, "Failed to allocate statistics\n");
+		return EXIT_FAILURE;
+	}
+
+	init_log_stats(total);
+	for (i = 0; i < plr.hdr.num_ifaces; i++)
+		init_log_stats(&ifaces[i]);
+
+	print_log_header(argv[optind], &plr.hdr);
+
+	if (slice != NULL) {
+		init_log_stats(slice);
+		print_slice_hdr();
+	}
+
+	while ((next = probelog_next(&plr, &rec)) == PROBELOG_NEXT_GOOD) {
+		if (total->probes == 0) {
+			first_tx_ns = rec.tx_ns;
+			slice_start_ns = rec.tx_ns;
+		}
+		if (rec.tx_ns > last_tx_ns)
+			last_tx_ns = rec.tx_ns;
+
+		add_log_rec(total, &rec);
+		add_log_rec(&ifaces[rec.iface], &rec);
+
+		/*
+		 * slices go by transmit time, in log order, so a probe of
+		 * another interface logged a little late joins the slice
+		 * being gathered
+		 */
+		if (slice != NULL) {
+			if (rec.tx_ns >= (slice_start_ns + slice_ns)) {
+				print_slice(slice_start_ns - first_tx_ns, slice);
+				init_log_stats(slice);
+				slice_start_ns += ((rec.tx_ns - slice_start_ns) /
+					slice_ns) * slice_ns;
+			}
+			add_log_rec(slice, &rec);
+		}
+
+		if (per_responder && rec.answered &&
+		    !count_responder(&responders, rec.responder)) {
+			fprintf(stderr, "Failed to allocate responder "
+				"counts\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((slice != NULL) && (slice->probes > 0))
+		print_slice(slice_start_ns - first_tx_ns, slice);
+
+	if (next == PROBELOG_NEXT_BAD)
+		fprintf(stderr, "%s: truncated or corrupt record at offset "
+			"%zu, stopped there\n", argv[optind], plr.pos);
+
+	if (plr.hdr.num_ifaces > 1) {
+		for (i = 0; i < plr.hdr.num_ifaces; i++)
+			print_log_stats(plr.hdr.ifaces[i], &ifaces[i],
+				first_tx_ns, last_tx_ns);
+		print_log_stats("all interfaces", total, first_tx_ns,
+			last_tx_ns);
+	} else {
+		print_log_stats(NULL, total, first_tx_ns, last_tx_ns);
+	}
+
+	if (per_responder)
+		print_responders(&plr, &responders);
+
+	free(responders.replies);
+	free(slice);
+	free(ifaces);
+	free(total);
+
+	probelog_unmap(&plr);
+
+	return EXIT_SUCCESS;
+
+}
+
+
+void print_usage(void)
+{
+
+
+	fprintf(stderr, "Usage: ectplog [-s <slice>] [-r] <probe log>\n");
+	fprintf(stderr, "-s <slice>\t: Also print the statistics of each "
+			"<slice> of transmit\n");
+	fprintf(stderr, "\t\t  time, in seconds unless suffixed with s, ms, "
+			"us or ns.\n");
+	fprintf(stderr, "-r\t\t: Print the replies from each responder.\n");
+
+}
+
+
+/*
+ * Convert a time slice, in seconds unless suffixed, as ectpping's times
+ */
+bool parse_slice(const char *str, uint64_t *ns)
+{
+	unsigned long long val;
+	uint64_t unit_ns;
+	char *endptr;
+
+
+	if ((*str < '0') || (*str > '9'))
+		return false;
+
+	val = strtoull(str, &endptr, 10);
+
+	if (*endptr == '\0')
+		unit_ns = 1000000000ULL;
+	else if (strcmp(endptr, "s") == 0)
+		unit_ns = 1000000000ULL;
+	else if (strcmp(endptr, "ms") == 0)
+		unit_ns = 1000000ULL;
+	else if (strcmp(endptr, "us") == 0)
+		unit_ns = 1000ULL;
+	else if (strcmp(endptr, "ns") == 0)
+		unit_ns = 1ULL;
+	else
+		return false;
+
+	if ((val == 0) || (val > (UINT64_MAX / unit_ns)))
+		return false;
+
+	*ns = val * unit_ns;
+
+	return true;
+
+}
+
+
+void init_log_stats(struct log_stats *stats)
+{
+
+
+	stats->probes = 0;
+	stats->answered = 0;
+	hist_init(&stats->rtt_ns);
+
+}
+
+
+void add_log_rec(struct log_stats *stats, const struct probelog_rec *rec)
+{
+
+
+	stats->probes++;
+
+	if (!rec->answered)
+		return;
+
+	stats->answered++;
+
+	/* a reply timestamped before its probe's send time counts as 0 */
+	hist_add(&stats->rtt_ns, (rec->rtt_ns > 0) ? rec->rtt_ns : 0);
+
+}
+
+
+void print_log_header(const char *path, const struct probelog_hdr *hdr)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+	char started[64];
+	struct tm tm;
+	time_t secs;
+	unsigned int i;
+
+
+	enet_ntop((const struct ether_addr *)hdr->dstmac, ENET_NTOP_UNIX,
+		macpbuf, ENET_PADDR_MAXSZ);
+
+	secs = hdr->start_ns / 1000000000ULL;
+	localtime_r(&secs, &tm);
+	strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", &tm);
+
+	printf("ECTPLOG %s: ECTPPING %s using ", path, macpbuf);
+
+	for (i = 0; i < hdr->num_ifaces; i++)
+		printf("%s%.*s", (i == 0) ? "" : ", ", PROBELOG_IFNAMSIZ,
+			hdr->ifaces[i]);
+
+	printf(", interval %.6f sec, started %s\n", hdr->interval_ns / 1e9,
+		started);
+
+}
+
+
+void print_log_stats(const char *label, const struct log_stats *stats,
+		     const uint64_t first_tx_ns,
+		     const uint64_t last_tx_ns)
+{
+
+
+	if (label != NULL)
+		printf("%s: ", label);
+
+	printf("%llu probes, %llu answered", (unsigned long long)stats->probes,
+		(unsigned long long)stats->answered);
+
+	if (stats->probes > 0)
+		printf(", %f%% packet loss",
+			((stats->probes - stats->answered) * 100.0) /
+			stats->probes);
+
+	printf(", over %.3f sec\n", (last_tx_ns - first_tx_ns) / 1e9);
+
+	if (stats->answered == 0)
+		return;
+
+	printf("round-trip (usec) min/avg/max = %.3f/%.3f/%.3f, "
+		"p50/p90/p99/p99.9 = %.3f/%.3f/%.3f/%.3f\n",
+		stats->rtt_ns.min / 1e3, hist_mean(&stats->rtt_ns) / 1e3,
+		stats->rtt_ns.max / 1e3,
+		hist_percentile(&stats->rtt_ns, 50.0) / 1e3,
+		hist_percentile(&stats->rtt_ns, 90.0) / 1e3,
+		hist_percentile(&stats->rtt_ns, 99.0) / 1e3,
+		hist_percentile(&stats->rtt_ns, 99.9) / 1e3);
+
+}
+
+
+void print_slice_hdr(void)
+{
+
+
+	printf("%12s %10s %10s %9s %11s %11s %11s\n", "start sec", "probes",
+		"answered", "loss %", "p50 usec", "p99 usec", "max usec");
+
+}
+
+
+void print_slice(const uint64_t start_ns, const struct log_stats *stats)
+{
+
+
+	printf("%12.3f %10llu %10llu %9.3f", start_ns / 1e9,
+		(unsigned long long)stats->probes,
+		(unsigned long long)stats->answered,
+		((stats->probes - stats->answered) * 100.0) / stats->probes);
+
+	if (stats->answered > 0)
+		printf(" %11.3f %11.3f %11.3f\n",
+			hist_percentile(&stats->rtt_ns, 50.0) / 1e3,
+			hist_percentile(&stats->rtt_ns, 99.0) / 1e3,
+			stats->rtt_ns.max / 1e3);
+	else
+		printf(" %11s %11s %11s\n", "-", "-", "-");
+
+}
+
+
+bool count_responder(struct responder_counts *counts,
+		     const unsigned int responder)
+{
+	unsigned int new_alloced;
+	uint64_t *replies;
+
+
+	if (responder == PROBELOG_RESPONDER_UNKNOWN) {
+		counts->unknown_replies++;
+		return true;
+	}
+
+	if (responder >= counts->alloced) {
+		new_alloced = (counts->alloced > 0) ? counts->alloced * 2 : 16;
+		while (new_alloced <= responder)
+			new_alloced *= 2;
+
+		replies = realloc(counts->replies,
+			new_alloced * sizeof(uint64_t));
+		if (replies == NULL)
+			return false;
+
+		memset(&replies[counts->alloced], 0,
+			(new_alloced - counts->alloced) * sizeof(uint64_t));
+
+		counts->replies = replies;
+		counts->alloced = new_alloced;
+	}
+
+	counts->replies[responder]++;
+
+	return true;
+
+}
+
+
+void print_responders(const struct probelog_reader *plr,
+		      const struct responder_counts *counts)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+	uint8_t mac[ETH_ALEN];
+	unsigned int i;
+
+
+	for (i = 0; i < plr->num_responders; i++) {
+		probelog_mac_to_bytes(probelog_responder(plr, i), mac);
+		enet_ntop((const struct ether_addr *)mac, ENET_NTOP_UNIX,
+			macpbuf, ENET_PADDR_MAXSZ);
+		printf("responder %s: %llu replies\n", macpbuf,
+			(unsigned long long)((i < counts->alloced) ?
+				counts->replies[i] : 0));
+	}
+
+	if (counts->unknown_replies > 0)
+		printf("responders after the first %u: %llu replies\n",
+			PROBELOG_RESPONDERS_MAX,
+			(unsigned long long)counts->unknown_replies);
+
+}
+
+/* EOF */
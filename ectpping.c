@@ -14,10 +14,16 @@
  *
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdarg.h>
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -25,6 +31,11 @@
 #include <sys/ioctl.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -33,20 +44,220 @@
 #include <net/if.h>
 #include <net/if_arp.h>
 #include <netinet/ether.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 
 #include "libenetaddr.h"
 #include "libectp.h"
+#include "librategov.h"
+#include "libpacer.h"
+#include "libseqtrack.h"
+#include "libdispersion.h"
+#include "libpattern.h"
+#include "libcrc32c.h"
+#include "libhist.h"
+#include "libcpulist.h"
+#include "libsockstat.h"
+#include "libprobelog.h"
+#include "libpcapng.h"
+#include "libstatshm.h"
+#include "libmetrics.h"
+#include "libquality.h"
+#include "libqdisc.h"
+#include "ectpprobes.h"
+
+/* fanout types, from linux/if_packet.h which clashes with glibc's */
+#ifndef PACKET_FANOUT_HASH
+#define PACKET_FANOUT_HASH	0
+#define PACKET_FANOUT_LB	1
+#define PACKET_FANOUT_CPU	2
+#endif
+
+/* from asm-generic/socket.h, newer than some libc headers */
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL	69
+#endif
 
 /*
  * Struct defs
  */
 
+/*
+ * What ectpping has been asked to do
+ */
+enum ECTPPING_MODE {
+	ECTPPING_MODE_PING,		/* one probe per interval */
+	ECTPPING_MODE_TRAIN,		/* packet train per interval */
+	ECTPPING_MODE_THROUGHPUT,	/* RFC 2544 throughput search */
+	ECTPPING_MODE_PMTU,		/* path MTU discovery */
+	ECTPPING_MODE_HOPS,		/* hop by hop latency */
+	ECTPPING_MODE_MATRIX,		/* all pairs latency matrix */
+	ECTPPING_MODE_DAEMON,		/* targets set over a control socket */
+};
+
+
+enum MATRIX_FORMAT {
+	MATRIX_FORMAT_TEXT,
+	MATRIX_FORMAT_CSV,
+	MATRIX_FORMAT_JSON,
+};
+
+
+/*
+ * RFC 2544 throughput test limits and defaults. Frame sizes include the
+ * FCS, as they do in RFC 2544.
+ */
+enum {
+	TPUT_SIZES_MAX		= 32,
+	TPUT_TRIALS_MAX		= 24,
+	TPUT_DRAIN_MS		= 2000,	/* RFC 2544 wait after each trial */
+	TPUT_DEFAULT_MAX_PPS	= 1000000,
+	ETH_WIRE_OVERHEAD	= 20,	/* preamble, SFD and inter frame gap */
+};
+
+#define TPUT_DEFAULT_SIZES	"64,128,256,512,1024,1280,1518,9000"
+
+
+/*
+ * Path MTU discovery probing
+ */
+enum {
+	PMTU_PROBES		= 3,	/* per frame size tried */
+	PMTU_TIMEOUT_MS		= 500,
+	PMTU_POLL_MS		= 5,
+};
+
+
+/*
+ * All pairs latency matrix limits and timing
+ */
+enum {
+	MATRIX_MAX_ASSISTANTS	= 64,
+	MATRIX_DISCOVERY_PROBES	= 3,
+	MATRIX_DISCOVERY_MS	= 1500,
+	MATRIX_DRAIN_MS		= 500,
+};
+
+
+/*
+ * Receive workers, each reading its own socket in a PACKET_FANOUT group
+ */
+enum {
+	RX_WORKERS_MAX		= 64,
+};
+
+
+/*
+ * Interfaces probed through at once
+ */
+enum {
+	IFACES_MAX		= 16,
+};
+
+
+/*
+ * A probe still unanswered after the loss timeout is settled as lost, for
+ * the probe log and the statistics segment, as is one whose seqtrack slot
+ * is about to be reused
+ */
+enum {
+	PROBE_LOSS_TIMEOUT_MS		= 3000,
+};
+
+
+/*
+ * Probe log writer timing
+ */
+enum {
+	PROBE_LOG_DRAIN_MS		= 10,
+	PROBE_LOG_FLUSH_MS		= 1000,
+};
+
+
+/*
+ * How often the jitter and loss burst statistics catch up on the settled
+ * probes
+ */
+enum {
+	QUALITY_DRAIN_MS		= 100,
+};
+
+
+/*
+ * Capture writer timing, and the size of each tx thread's and rx worker's
+ * capture ring, enough for several drains of full sized frames
+ */
+enum {
+	CAPTURE_DRAIN_MS		= 10,
+	CAPTURE_FLUSH_MS		= 1000,
+	CAPTURE_RING_SZ			= 4 * 1024 * 1024,
+};
+
+
+/*
+ * How often the statistics segment is updated
+ */
+enum {
+	STATS_PUBLISH_MS		= 100,
+};
+
+
+/*
+ * Daemon mode limits. Targets are tracked in the statistics segment.
+ */
+enum {
+	DAEMON_TARGETS_MAX		= STATSHM_PATHS_MAX,
+	DAEMON_HOPS_MAX			= STATSHM_PATH_HOPS_MAX,
+	DAEMON_CTL_CLIENTS_MAX		= 8,
+	DAEMON_CTL_LINE_MAX		= 1024,
+};
+
+#define DAEMON_CTL_DEFAULT_PATH		"/run/ectpping.ctl"
+
+
+/*
+ * Real-time mode thread stacks. Stacks are sized explicitly, as with
+ * mlockall() the whole of the default 8MB would be locked for each thread,
+ * and the part a thread may use is touched before it starts work.
+ */
+enum {
+	RT_THREAD_STACK_SZ	= 512 * 1024,
+	RT_STACK_PREFAULT_SZ	= 256 * 1024,
+};
+
+
+/*
+ * Why received frames weren't taken as replies
+ */
+enum RX_REJECT {
+	RX_REJECT_TOOSMALL,
+	RX_REJECT_BADSKIPCOUNT,
+	RX_REJECT_BADMSGTYPE,
+	RX_REJECT_WRONGRCPTNUM,
+	RX_REJECT_SHORTPAYLOAD,		/* too short for an ectpping payload */
+	RX_REJECT_REASONS,
+};
+
+
+/*
+ * One of the interfaces being probed through
+ */
+struct iface_info {
+	char iface[IFNAMSIZ];
+	int ifindex;
+	struct ether_addr srcmac;
+	int mtu;
+};
+
+
 /*
  * Program parameters in internal program format
  */
 struct program_parameters {
+	enum ECTPPING_MODE mode;
 	char iface[IFNAMSIZ];
 	int ifindex;
+	int mtu;
 	struct ether_addr srcmac;
 	struct ether_addr dstmac;
 	bool uc_dstmac;
@@ -54,9 +265,44 @@ struct program_parameters {
 	unsigned int ectp_user_data_size;
 	bool no_resolve;
 	bool zero_pkt_output;
-	unsigned int interval_ms;
+	uint64_t interval_ns;
+	enum PACER_MODE pacing_mode;
+	uint64_t pacing_spin_ns;
+	bool txtime;
+	uint64_t txtime_lead_ns;
 	struct ether_addr *fwdaddrs;
 	unsigned int num_fwdaddrs;
+	uint64_t rate_pps;
+	unsigned int rate_burst;
+	unsigned int frame_size;	/* pad frames to at least this */
+	bool fill;			/* fill_pattern rather than build info */
+	enum PATTERN fill_pattern;
+	bool crc;			/* CRC32C the ectp data */
+	unsigned int train_len;
+	unsigned int tput_sizes[TPUT_SIZES_MAX];
+	unsigned int num_tput_sizes;
+	uint64_t tput_trial_ns;		/* also latency matrix duration */
+	double tput_loss_pct;
+	enum MATRIX_FORMAT matrix_format;
+	unsigned int rx_workers;
+	int rx_fanout;			/* PACKET_FANOUT_* type */
+	struct iface_info ifaces[IFACES_MAX];	/* iface etc. are the 1st */
+	unsigned int num_ifaces;
+	bool rt;			/* real-time mode */
+	int rt_prio;			/* SCHED_FIFO priority */
+	bool tx_cpus_set;		/* else the interface's CPUs */
+	cpu_set_t tx_cpus;
+	bool rx_cpus_set;
+	cpu_set_t rx_cpus;
+	uint64_t rx_spin_ns;		/* spin before blocking, 0 never */
+	unsigned int busy_poll_us;	/* SO_BUSY_POLL */
+	uint64_t report_interval_ns;	/* 0 for no interval reports */
+	char *probe_log_file;		/* NULL for no probe log */
+	char *capture_file;		/* NULL for no pcapng capture */
+	char *stats_shm_name;		/* NULL for no statistics segment */
+	char *metrics_addr;		/* NULL for no metrics endpoint */
+	char *ctl_path;			/* daemon mode control socket */
+	bool dst_given;			/* else the default multicast */
 };
 
 
@@ -64,31 +310,274 @@ struct program_parameters {
  * Program options in external user format
  */
 struct program_options {
-	char iface[IFNAMSIZ];
+	char ifaces[IFACES_MAX][IFNAMSIZ];
+	unsigned int num_ifaces;	/* 0 means the default */
 	enum { ucast, mcast, bcast } dst_type;
 	char *uc_dst_str; /* mac address or /etc/ethers hostname string */
 	bool no_resolve;
 	bool zero_pkt_output;
-	unsigned int interval_ms;
+	uint64_t interval_ns;
+	enum PACER_MODE pacing_mode;
+	uint64_t pacing_spin_ns;
+	bool txtime;
+	uint64_t txtime_lead_ns;
 	char *fwdaddrs_str;
+	char *fwdaddrs_file;
+	uint64_t rate_pps;
+	unsigned int rate_burst;
+	unsigned int train_len;
+	unsigned int train_frame_size;	/* 0 means interface MTU */
+	unsigned int frame_size;	/* 0 means smallest possible */
+	bool fill;
+	enum PATTERN fill_pattern;
+	bool crc;
+	enum ECTPPING_MODE mode;
+	char *tput_sizes_str;
+	uint64_t tput_trial_ns;
+	double tput_loss_pct;
+	enum MATRIX_FORMAT matrix_format;
+	unsigned int rx_workers;
+	int rx_fanout;
+	bool rt;
+	int rt_prio;
+	bool tx_cpus_set;
+	cpu_set_t tx_cpus;
+	bool rx_cpus_set;
+	cpu_set_t rx_cpus;
+	uint64_t rx_spin_ns;
+	unsigned int busy_poll_us;
+	uint64_t report_interval_ns;
+	char *probe_log_file;
+	char *capture_file;
+	char *stats_shm_name;
+	char *metrics_addr;
+	char *ctl_path;
 };
 
 
+struct probe_iface;
+
+
 /*
  * Arguments passed to the TX thread
  */
 struct tx_thread_arguments {
 	struct program_parameters *prog_parms;
 	int *tx_sockfd;
+	struct probe_iface *pif;	/* interface probed through */
+	struct pcapng_ring *capture_ring;	/* NULL without -C */
 };
 
 
 /*
- * Arguments passed to the RX thread
+ * Reply statistics, sharded per rx worker. A shard is only updated by its
+ * own worker, and is cache line aligned so workers don't contend. The
+ * counts are read while the workers run, so they're updated with relaxed
+ * atomic adds.
+ */
+struct rx_stats {
+	unsigned int rxed_pkts;
+	unsigned int corrupted_pkts;
+	struct timeval min_rtt;
+	struct timeval max_rtt;
+	struct timeval sum_rtts;
+	unsigned int spun_pkts;		/* received while spinning */
+	unsigned int rejected[RX_REJECT_REASONS];
+	unsigned int rx_errors;		/* failed receives */
+} __attribute__((aligned(64)));
+
+
+/*
+ * Arguments passed to the RX threads
  */
 struct rx_thread_arguments {
 	struct program_parameters *prog_parms;
 	int *rx_sockfd;
+	struct rx_stats *stats;		/* this worker's shard */
+	struct probe_iface *pif;
+	struct pcapng_ring *capture_ring;	/* NULL without -C */
+};
+
+
+/*
+ * SO_TXTIME transmit statistics
+ */
+struct txtime_stats {
+	uint64_t queued;		/* frames sent with a launch time */
+	uint64_t queued_late;		/* launch time already passed */
+	uint64_t missed;		/* kernel reported deadline misses */
+	uint64_t invalid;		/* kernel rejected launch time */
+	uint64_t send_errors;
+	uint64_t last_err_launch_ns;	/* launch time of last reported error */
+};
+
+
+/*
+ * An interface's counts of where probes went, as of an interval report,
+ * so the next report can show what changed
+ */
+struct iface_counters {
+	uint64_t txed;
+	uint64_t rxed;
+	uint64_t corrupted;
+	uint64_t rejected;
+	uint64_t rx_errors;
+	uint64_t tx_errors;
+	uint64_t rx_drops;
+};
+
+
+/*
+ * A daemon mode target, probed every interval through every interface
+ */
+struct daemon_target {
+	uint32_t id;
+	unsigned int num_hops;
+	struct ether_addr hops[DAEMON_HOPS_MAX];	/* destination first */
+};
+
+
+/*
+ * Daemon mode's targets, interval and rate. A published plan is never
+ * changed: the control thread publishes a changed copy in its place, so
+ * the tx threads and the statistics publisher pick up the latest with a
+ * single atomic load. Each records the generation it has moved on to, and
+ * a replaced plan is freed once they all have moved past it.
+ */
+struct probe_plan {
+	uint64_t gen;
+	uint64_t interval_ns;
+	uint64_t rate_pps;
+	unsigned int rate_burst;
+	unsigned int num_targets;
+	struct daemon_target targets[DAEMON_TARGETS_MAX];
+	struct probe_plan *retired_next;	/* control thread only */
+};
+
+
+/*
+ * A control socket connection, and the command line it's part way through
+ */
+struct ctl_client {
+	int fd;
+	uid_t uid;
+	char line[DAEMON_CTL_LINE_MAX];
+	unsigned int line_len;
+	bool discarding;		/* the rest of an overlong line */
+};
+
+
+/*
+ * Everything used to probe through one interface. Each interface has its
+ * own sockets, tx thread, rx workers and statistics, and its threads run
+ * on the CPUs local to its NIC.
+ */
+struct probe_iface {
+	struct program_parameters parms;
+	cpu_set_t cpus;			/* where its threads run */
+	bool cpus_local;		/* cpus are the NIC's local CPUs */
+	int tx_sockfd;
+	int *rx_sockfds;
+	pthread_t tx_thread_hdl;
+	bool tx_thread_started;
+	_Atomic bool tx_thread_stopped;	/* it's finished or been cancelled */
+	pthread_t *rx_thread_hdls;
+	unsigned int num_rx_threads;
+	struct tx_thread_arguments tx_thread_args;
+	struct rx_thread_arguments *rx_thread_args;
+	struct rx_stats *rx_stats_shards;
+	unsigned int txed_pkts;
+	struct rategov rategov;
+	struct rategov_share rategov_share;
+	struct pacer pacer;
+	struct txtime_stats txtime_stats;
+	struct seqtrack probe_track;
+	struct dispersion_agg train_agg;
+	uint32_t train_first_seq;	/* tx thread, of the last train sent */
+	bool train_pending;		/* tx thread, it's to be evaluated */
+	bool busy_poll_set;		/* SO_BUSY_POLL accepted */
+	uint64_t threads_start_ns;
+	uint64_t rx_cpu_ns;		/* rx threads' CPU time */
+	uint64_t rx_elapsed_ns;		/* over this much time */
+	struct sockstat_rx *rx_sockstats;	/* per rx socket */
+	struct sockstat_txerrs tx_errs;
+	struct iface_counters last_report;
+	uint64_t log_cursor;		/* next probe to log */
+	uint64_t log_overruns;		/* slot reused before logging */
+	uint64_t stats_cursor;		/* next probe to publish */
+	uint64_t stats_overruns;
+	uint64_t quality_cursor;	/* next probe to add to quality */
+	uint64_t quality_overruns;
+	struct quality quality;		/* under quality_mutex */
+	struct quality interval_quality;	/* under quality_mutex */
+	_Atomic uint64_t plan_gen;	/* daemon plan the tx thread is on */
+	struct program_parameters target_parms;	/* tx thread only */
+	struct ether_addr target_fwdaddrs[DAEMON_HOPS_MAX];
+};
+
+
+/*
+ * What real-time mode managed to apply, for the startup report
+ */
+struct rt_status {
+	bool mlocked;
+	int mlock_errno;
+	bool sched_refused;		/* fell back to inherited scheduling */
+};
+
+
+/*
+ * Limits on packet train length
+ */
+enum {
+	TRAIN_LEN_MIN		= 2,
+	TRAIN_LEN_MAX		= 4096,
+};
+
+
+/*
+ * Number of in-flight probes tracked by sequence number. Must be larger
+ * than the longest train.
+ */
+enum {
+	PROBE_TRACK_SIZE	= 65536,
+};
+
+
+/*
+ * Outcome of one RFC 2544 throughput trial
+ */
+struct tput_trial {
+	uint64_t offered_pps;
+	uint64_t sent;
+	uint64_t answered;
+	uint64_t lost;
+	double achieved_pps;
+	double loss_pct;
+};
+
+
+/*
+ * Outcome of the throughput search for one frame size
+ */
+struct tput_result {
+	unsigned int size;
+	bool tested;			/* false if too small or too big */
+	bool sender_limited;		/* couldn't offer any more */
+	unsigned int trials;
+	double throughput_pps;
+	double loss_pct;		/* at the throughput rate */
+};
+
+
+/*
+ * Path MTU discovery result for one prefix of the route
+ */
+struct pmtu_result {
+	bool reachable;			/* smallest frames came back */
+	bool inconsistent;		/* result didn't hold up when re-probed */
+	unsigned int max_frame_size;	/* excluding FCS */
+	unsigned int probed_sizes;
 };
 
 
@@ -97,7 +586,37 @@ struct rx_thread_arguments {
  */
 struct ectpping_payload {
 	uint32_t seq_num;
+	uint32_t crc32c;	/* of all the ectp data, 0 while computing */
 	struct timeval tv;
+	uint32_t path_id;	/* route prefix, in hop by hop mode */
+};
+
+
+/*
+ * Probe path to one hop of the route and back, in hop by hop mode
+ */
+struct hop_path {
+	struct ether_addr hop;
+	struct program_parameters parms;	/* routed via hop and back */
+	struct ether_addr *fwdaddrs;
+	uint64_t sent;				/* tx thread only */
+	uint64_t answered;			/* under stats_mutex */
+	struct hist rtt_ns;			/* under stats_mutex */
+};
+
+
+/*
+ * Probe path for one ordered pair of assistants, or an assistant's
+ * baseline, in latency matrix mode
+ */
+struct matrix_path {
+	struct program_parameters parms;
+	struct ether_addr fwdaddrs[2];
+	uint64_t sent;				/* tx thread only */
+	uint64_t answered;			/* under stats_mutex */
+	uint64_t *rtt_ns;			/* under stats_mutex */
+	unsigned int num_rtts;			/* under stats_mutex */
+	unsigned int alloced_rtts;		/* under stats_mutex */
 };
 
 
@@ -117,6 +636,180 @@ void set_sigint_hdlr(struct sigaction *sigint_action);
 
 void sigint_hdlr(int signum);
 
+void finish_ectpping(void);
+
+void print_ping_stats(const char *label,
+		      const unsigned int txed_pkts,
+		      const struct rx_stats *rx_totals);
+
+void print_iface_stats(struct probe_iface *pif);
+
+void print_host_drop_stats(struct probe_iface *pif);
+
+void *report_thread(void *arg);
+
+int start_aux_threads(void);
+
+enum OPEN_PROBE_LOG {
+	OPEN_PROBE_LOG_GOOD,
+	OPEN_PROBE_LOG_BAD,
+};
+enum OPEN_PROBE_LOG open_probe_log(const struct program_parameters
+					*prog_parms);
+
+void *log_thread(void *arg);
+
+void drain_probe_log(const bool final);
+
+bool next_settled_probe(struct probe_iface *pif,
+			uint64_t *cursor,
+			const uint64_t sent,
+			const uint64_t now_ns,
+			const bool final,
+			struct seqtrack_entry *entry,
+			uint64_t *overruns);
+
+void print_probe_log_stats(const struct program_parameters *prog_parms);
+
+void *quality_thread(void *arg);
+
+void drain_quality(const bool final);
+
+void print_quality_stats(struct probe_iface *pif);
+
+void print_interval_quality(struct probe_iface *pif,
+			    const uint64_t elapsed_ns);
+
+enum OPEN_CAPTURE {
+	OPEN_CAPTURE_GOOD,
+	OPEN_CAPTURE_BAD,
+};
+enum OPEN_CAPTURE open_capture(const struct program_parameters *prog_parms);
+
+void *capture_thread(void *arg);
+
+void drain_capture(void);
+
+void close_capture(void);
+
+void capture_rxed_frame(struct pcapng_ring *capture_ring,
+			const struct probe_iface *pif,
+			const struct ether_addr *srcmac,
+			const uint64_t rx_ns,
+			const uint8_t *pkt_buf,
+			const unsigned int pkt_len);
+
+void print_capture_stats(const struct program_parameters *prog_parms);
+
+enum OPEN_STATS_SHM {
+	OPEN_STATS_SHM_GOOD,
+	OPEN_STATS_SHM_NOMEM,
+	OPEN_STATS_SHM_BADNAME,
+	OPEN_STATS_SHM_BADSHM,
+};
+enum OPEN_STATS_SHM open_stats_shm(const struct program_parameters
+					*prog_parms);
+
+void *stats_thread(void *arg);
+
+void publish_stats(const bool final);
+
+void add_settled_probe(const unsigned int iface,
+		       const struct seqtrack_entry *entry);
+
+enum OPEN_METRICS {
+	OPEN_METRICS_GOOD,
+	OPEN_METRICS_NOMEM,
+	OPEN_METRICS_BADADDR,
+	OPEN_METRICS_BADSOCKET,
+};
+enum OPEN_METRICS open_metrics(const struct program_parameters *prog_parms);
+
+void *metrics_thread(void *arg);
+
+void print_metrics_stats(const struct program_parameters *prog_parms);
+
+enum OPEN_DAEMON {
+	OPEN_DAEMON_GOOD,
+	OPEN_DAEMON_NOMEM,
+	OPEN_DAEMON_BADPATH,
+	OPEN_DAEMON_BADSOCKET,
+};
+enum OPEN_DAEMON open_daemon(const struct program_parameters *prog_parms);
+
+void *ctl_thread(void *arg);
+
+bool ctl_client_input(struct ctl_client *client);
+
+void ctl_command(struct ctl_client *client, char *line);
+
+void ctl_reply(const struct ctl_client *client, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+void ctl_add(struct ctl_client *client, char *args[],
+	     const unsigned int num_args);
+
+void ctl_set(struct ctl_client *client, char *args[],
+	     const unsigned int num_args);
+
+void ctl_remove(struct ctl_client *client, char *args[],
+		const unsigned int num_args);
+
+void ctl_interval(struct ctl_client *client, char *args[],
+		  const unsigned int num_args);
+
+void ctl_rate(struct ctl_client *client, char *args[],
+	      const unsigned int num_args);
+
+void ctl_list(struct ctl_client *client);
+
+bool parse_target_hops(char *args[],
+		       const unsigned int num_args,
+		       struct daemon_target *target);
+
+int find_plan_target(const struct probe_plan *plan, const char *id_str);
+
+struct probe_plan *copy_plan(void);
+
+void publish_plan(struct probe_plan *plan);
+
+void reclaim_plans(void);
+
+void tx_probe_daemon(struct tx_thread_arguments *tx_args,
+		     uint8_t tx_frame_buf[],
+		     const unsigned int tx_frame_buf_sz,
+		     struct ectpping_payload *eping_payload,
+		     const uint64_t launch_ns);
+
+void sync_stats_paths(void);
+
+void format_path(const struct statshm_path *path,
+		 char *buf,
+		 const size_t buf_sz);
+
+void print_daemon_stats(void);
+
+void print_interval_report(const uint64_t elapsed_ns);
+
+void sample_rx_sockstats(struct probe_iface *pif);
+
+void get_iface_counters(struct probe_iface *pif,
+			struct iface_counters *counters);
+
+void print_rategov_stats(const struct rategov_share *share);
+
+void print_pacer_stats(const struct pacer *pacer, const bool txtime);
+
+enum BUILD_ECTP_USER_DATA {
+	BUILD_ECTP_USER_DATA_GOOD,
+	BUILD_ECTP_USER_DATA_NOMEM,
+};
+enum BUILD_ECTP_USER_DATA build_ectp_user_data(struct program_parameters
+						   *prog_parms,
+					       const uint8_t build_info[],
+					       const unsigned int
+						   build_info_size);
+
 enum GET_PROG_PARMS {
 	GET_PROG_PARMS_GOOD,
 	GET_PROG_PARMS_BADIFINDEX,
@@ -133,6 +826,7 @@ enum GET_CLI_OPTS {
 	GET_CLI_OPTS_BAD_UNKNOWN_OPT,
 	GET_CLI_OPTS_BAD_MISSING_ARG,
 	GET_CLI_OPTS_BAD_NEED_UID_0,
+	GET_CLI_OPTS_BAD_OPT_ARG,
 };
 enum GET_CLI_OPTS get_cli_opts(const int argc,
 			       char *argv[],
@@ -142,6 +836,43 @@ enum GET_CLI_OPTS get_cli_opts(const int argc,
 enum GET_CLI_OPTS get_cli_opts_eh(const enum GET_CLI_OPTS ret,
 				  int *erropt);
 
+bool parse_time_ns(const char *str,
+		   const uint64_t default_unit_ns,
+		   uint64_t *ns);
+
+bool parse_pacing_mode(const char *str,
+		       enum PACER_MODE *mode,
+		       uint64_t *spin_ns);
+
+bool parse_train_opt(const char *str,
+		     unsigned int *train_len,
+		     unsigned int *frame_size);
+
+bool parse_mode(const char *str, enum ECTPPING_MODE *mode);
+
+bool parse_matrix_format(const char *str, enum MATRIX_FORMAT *format);
+
+bool parse_rx_workers(const char *str,
+		      unsigned int *workers,
+		      int *fanout);
+
+const char *fanout_name(const int fanout);
+
+bool parse_rt_prio(const char *str, int *prio);
+
+bool parse_rx_spin(const char *str,
+		   uint64_t *spin_ns,
+		   unsigned int *busy_poll_us);
+
+bool parse_thread_cpus(const char *str,
+		       cpu_set_t *tx_cpus,
+		       cpu_set_t *rx_cpus);
+
+bool parse_size_list(const char *str,
+		     unsigned int sizes[],
+		     const unsigned int max_sizes,
+		     unsigned int *num_sizes);
+
 void print_help(void);
 
 enum PROCESS_PROG_OPTS {
@@ -149,6 +880,13 @@ enum PROCESS_PROG_OPTS {
 	PROCESS_PROG_OPTS_BAD_IFACE,
 	PROCESS_PROG_OPTS_BAD_IFMAC,
 	PROCESS_PROG_OPTS_BAD_DSTMACFMT,
+	PROCESS_PROG_OPTS_BAD_IFMTU,
+	PROCESS_PROG_OPTS_BAD_FRAMESIZE,
+	PROCESS_PROG_OPTS_BAD_SIZELIST,
+	PROCESS_PROG_OPTS_BAD_NEED_UCAST,
+	PROCESS_PROG_OPTS_BAD_FWDADDRS,
+	PROCESS_PROG_OPTS_BAD_MULTI_IFACE,
+	PROCESS_PROG_OPTS_BAD_CPUS,
 	PROCESS_PROG_OPTS_BAD
 };
 enum PROCESS_PROG_OPTS process_prog_opts(const struct program_options
@@ -159,13 +897,35 @@ enum PROCESS_PROG_OPTS process_prog_opts(const struct program_options
 enum PROCESS_PROG_OPTS process_prog_opts_eh(const enum PROCESS_PROG_OPTS ret,
 					    const char *errmsg);
 
+enum PROCESS_PROG_OPTS process_fwdaddrs_opts(const struct program_options
+						 *prog_opts,
+					     struct program_parameters
+						 *prog_parms,
+					     const char **errmsg);
+
+/*
+ * Where a forward address list couldn't be parsed
+ */
+enum {
+	FWDADDR_TOKEN_MAX	= 256,
+};
+struct fwdaddrs_err {
+	unsigned int line;
+	char token[FWDADDR_TOKEN_MAX];
+};
+
 enum GET_PROG_OPT_FWDADDRS {
 	GET_PROG_OPT_FWDADDRS_GOOD,
-	GET_PROG_OPT_FWDADDRS_BAD
+	GET_PROG_OPT_FWDADDRS_BADADDR,	/* not a MAC address or host */
+	GET_PROG_OPT_FWDADDRS_TOOLONG,	/* token too long */
+	GET_PROG_OPT_FWDADDRS_BADREAD,
+	GET_PROG_OPT_FWDADDRS_NOMEM,
 };
-enum GET_PROG_OPT_FWDADDRS get_prog_opt_fwdaddrs(const char *fwdaddrs_str,
-			 			 struct ether_addr **fwdaddrs,
-						 unsigned int *num_fwdaddrs);
+enum GET_PROG_OPT_FWDADDRS get_prog_opt_fwdaddrs(FILE *src,
+						 struct ether_addr **fwdaddrs,
+						 unsigned int *num_fwdaddrs,
+						 unsigned int *alloced,
+						 struct fwdaddrs_err *err);
 
 
 enum DO_IFREQ_IOCTL {
@@ -195,7 +955,24 @@ enum GET_IFMAC get_ifmac(const char iface[IFNAMSIZ],
 			 struct ether_addr *ifmac);
 
 
-void open_sockets(int *tx_sockfd, int *rx_sockfd, const int ifindex);
+enum GET_IFMTU {
+	GET_IFMTU_GOOD,
+	GET_IFMTU_BADIFACE
+};
+enum GET_IFMTU get_ifmtu(const char iface[IFNAMSIZ], int *ifmtu);
+
+
+uint64_t get_ifspeed_mbps(const char iface[IFNAMSIZ]);
+
+bool get_iface_cpus(const char iface[IFNAMSIZ], cpu_set_t *cpus);
+
+
+int open_sockets(int *tx_sockfd,
+		 int rx_sockfds[],
+		 const unsigned int num_rx_sockfds,
+		 const int ifindex,
+		 const int rx_fanout_id,
+		 const int rx_fanout);
 
 
 enum OPEN_TX_SKT {
@@ -214,32 +991,297 @@ enum OPEN_RX_SKT {
 enum OPEN_RX_SKT open_rx_socket(int *sockfd, const int rx_ifindex);
 
 
-void prepare_thread_args(struct tx_thread_arguments *tx_thread_args,
-			 struct rx_thread_arguments *rx_thread_args,
-			 struct program_parameters *prog_parms,
-			 int *tx_sockfd,
-			 int *rx_sockfd);
+enum ENABLE_RX_FANOUT {
+	ENABLE_RX_FANOUT_GOOD,
+	ENABLE_RX_FANOUT_BAD,		/* setsockopt(PACKET_FANOUT) failed */
+};
+enum ENABLE_RX_FANOUT enable_rx_fanout(int *rx_sockfd,
+				       const int fanout_id,
+				       const int fanout);
 
-void build_ectp_eth_hdr(const struct ether_addr *srcmac,
-			const struct ether_addr *dstmac,
-			struct ether_header *eth_hdr);
 
-enum BUILD_ECTP_FRAME {
-	BUILD_ECTP_FRAME_GOOD,
-	BUILD_ECTP_FRAME_BADBUFSIZE,
-	BUILD_ECTP_FRAME_NOMEM
+enum ENABLE_TX_TXTIME {
+	ENABLE_TX_TXTIME_GOOD,
+	ENABLE_TX_TXTIME_BAD,		/* setsockopt(SO_TXTIME) failed */
 };
-enum BUILD_ECTP_FRAME build_ectp_frame(
-				   const struct program_parameters *prog_parms,
-				   uint8_t frame_buf[],
-				   const unsigned int frame_buf_sz,
+enum ENABLE_TX_TXTIME enable_tx_txtime(int *tx_sockfd);
+
+bool txtime_qdisc_ok(const char *iface, const int ifindex);
+
+
+enum ENABLE_RX_BUSY_POLL {
+	ENABLE_RX_BUSY_POLL_GOOD,
+	ENABLE_RX_BUSY_POLL_BAD,	/* setsockopt(SO_BUSY_POLL) failed */
+};
+enum ENABLE_RX_BUSY_POLL enable_rx_busy_poll(int *rx_sockfd,
+					     const unsigned int usecs);
+
+void enable_iface_busy_poll(struct probe_iface *pif);
+
+void sample_rx_cpu_time(struct probe_iface *pif);
+
+void print_rx_cpu_stats(const struct probe_iface *pif);
+
+
+enum SEND_TXTIME_FRAME {
+	SEND_TXTIME_FRAME_GOOD,
+	SEND_TXTIME_FRAME_LATE,		/* queued, but launch time passed */
+	SEND_TXTIME_FRAME_BAD,		/* sendmsg() failed */
+};
+enum SEND_TXTIME_FRAME send_txtime_frame(int *tx_sockfd,
+					 const uint8_t frame_buf[],
+					 const unsigned int frame_len,
+					 const uint64_t launch_ns,
+					 struct txtime_stats *stats);
+
+void process_tx_errqueue(int *tx_sockfd, struct txtime_stats *stats);
+
+void print_txtime_stats(const struct txtime_stats *stats,
+			const uint64_t lead_ns);
+
+void mono_ns_to_timeval(const uint64_t mono_ns, struct timeval *tv);
+
+
+enum SETUP_PROBE_IFACES {
+	SETUP_PROBE_IFACES_GOOD,
+	SETUP_PROBE_IFACES_NOMEM,
+};
+enum SETUP_PROBE_IFACES setup_probe_ifaces(const struct program_parameters
+					       *prog_parms);
+
+void prepare_thread_args(struct probe_iface *pif);
+
+int start_iface_threads(struct probe_iface *pif,
+			pthread_attr_t *threads_attrs);
+
+int create_thread(pthread_t *thread_hdl,
+		  pthread_attr_t *threads_attrs,
+		  void *(*start_routine)(void *),
+		  void *arg);
+
+enum SETUP_THREADS_ATTRS {
+	SETUP_THREADS_ATTRS_GOOD,
+	SETUP_THREADS_ATTRS_BAD,
+};
+enum SETUP_THREADS_ATTRS setup_threads_attrs(pthread_attr_t *threads_attrs,
+					     const struct program_parameters
+						*prog_parms);
+
+void lock_memory(void);
+
+void prefault_stack(void);
+
+void print_rt_report(const struct program_parameters *prog_parms);
+
+void print_thread_sched(const char *name, const pthread_t thread_hdl);
+
+void close_all_sockets(void);
+
+void init_rx_stats(struct rx_stats *stats);
+
+void merge_rx_stats(const struct rx_stats shards[],
+		    const unsigned int num_shards,
+		    struct rx_stats *total);
+
+void print_rx_worker_stats(const struct program_parameters *prog_parms,
+			   const struct rx_stats shards[],
+			   const unsigned int num_shards);
+
+void build_ectp_eth_hdr(const struct ether_addr *srcmac,
+			const struct ether_addr *dstmac,
+			struct ether_header *eth_hdr);
+
+enum BUILD_ECTP_FRAME {
+	BUILD_ECTP_FRAME_GOOD,
+	BUILD_ECTP_FRAME_BADBUFSIZE
+};
+enum BUILD_ECTP_FRAME build_ectp_frame(
+				   const struct program_parameters *prog_parms,
+				   uint8_t frame_buf[],
+				   const unsigned int frame_buf_sz,
 				   const uint8_t *prog_data,
 				   const unsigned int prog_data_size,
 				   unsigned int *ectp_frame_len);
 
-void *tx_thread(struct tx_thread_arguments *tx_thread_args);
+void *tx_thread(void *arg);
+
+void tx_thread_stopped(void *arg);
+
+unsigned int tx_frame_buf_size(const struct program_parameters *prog_parms);
+
+bool build_probe(struct tx_thread_arguments *tx_args,
+		 uint8_t frame_buf[],
+		 const unsigned int frame_buf_sz,
+		 const struct ectpping_payload *eping_payload,
+		 unsigned int *frame_len,
+		 uint64_t *tx_ns);
+
+void track_probe(struct tx_thread_arguments *tx_args,
+		 const uint8_t frame_buf[],
+		 const unsigned int frame_len,
+		 const struct ectpping_payload *eping_payload,
+		 const uint64_t tx_ns);
+
+int send_probe(struct tx_thread_arguments *tx_args,
+	       const uint8_t frame_buf[],
+	       const unsigned int frame_len,
+	       const uint32_t seq_num,
+	       const uint64_t tx_ns,
+	       const uint64_t launch_ns);
+
+bool tx_probe(struct tx_thread_arguments *tx_args,
+	      uint8_t tx_frame_buf[],
+	      const unsigned int tx_frame_buf_sz,
+	      struct ectpping_payload *eping_payload,
+	      const uint64_t launch_ns);
+
+void tx_probe_train(struct tx_thread_arguments *tx_args,
+		    uint8_t tx_frame_buf[],
+		    const unsigned int tx_frame_buf_sz,
+		    struct ectpping_payload *eping_payload,
+		    const uint64_t launch_ns);
+
+void eval_probe_train(struct probe_iface *pif,
+		      const struct program_parameters *prog_parms,
+		      const uint32_t first_seq,
+		      const unsigned int train_len);
+
+void eval_last_train(struct probe_iface *pif);
+
+void print_train_stats(const struct dispersion_agg *agg);
+
+void run_throughput_test(struct tx_thread_arguments *tx_args,
+			 uint8_t tx_frame_buf[],
+			 const unsigned int tx_frame_buf_sz,
+			 struct ectpping_payload *eping_payload);
+
+void throughput_search(struct tx_thread_arguments *tx_args,
+		       uint8_t tx_frame_buf[],
+		       const unsigned int tx_frame_buf_sz,
+		       struct ectpping_payload *eping_payload,
+		       const unsigned int size,
+		       struct tput_result *result);
+
+void throughput_trial(struct tx_thread_arguments *tx_args,
+		      uint8_t tx_frame_buf[],
+		      const unsigned int tx_frame_buf_sz,
+		      struct ectpping_payload *eping_payload,
+		      const uint64_t offered_pps,
+		      struct tput_trial *trial);
+
+void print_throughput_table(const struct program_parameters *prog_parms,
+			    const struct tput_result results[],
+			    const unsigned int num_results);
+
+enum GET_ROUTE_HOPS {
+	GET_ROUTE_HOPS_GOOD,
+	GET_ROUTE_HOPS_NOMEM,
+};
+enum GET_ROUTE_HOPS get_route_hops(const struct program_parameters *prog_parms,
+				   struct ether_addr **hops,
+				   unsigned int *num_hops);
+
+void set_prefix_route(struct program_parameters *prog_parms,
+		      const struct ether_addr hops[],
+		      const unsigned int prefix_len,
+		      struct ether_addr fwdaddrs_buf[]);
+
+void run_pmtu_discovery(struct tx_thread_arguments *tx_args,
+			uint8_t tx_frame_buf[],
+			const unsigned int tx_frame_buf_sz,
+			struct ectpping_payload *eping_payload);
+
+void pmtu_search(struct tx_thread_arguments *tx_args,
+		 uint8_t tx_frame_buf[],
+		 const unsigned int tx_frame_buf_sz,
+		 struct ectpping_payload *eping_payload,
+		 struct pmtu_result *result);
+
+unsigned int pmtu_probe_size(struct tx_thread_arguments *tx_args,
+			     uint8_t tx_frame_buf[],
+			     const unsigned int tx_frame_buf_sz,
+			     struct ectpping_payload *eping_payload,
+			     const unsigned int frame_size,
+			     struct pmtu_result *result);
+
+void print_pmtu_results(const struct program_parameters *prog_parms,
+			const struct ether_addr hops[],
+			const struct pmtu_result results[],
+			const unsigned int num_hops);
+
+enum SETUP_HOP_PATHS {
+	SETUP_HOP_PATHS_GOOD,
+	SETUP_HOP_PATHS_NOMEM,
+};
+enum SETUP_HOP_PATHS setup_hop_paths(const struct program_parameters
+					 *prog_parms);
+
+void tx_probe_hops(struct tx_thread_arguments *tx_args,
+		   uint8_t tx_frame_buf[],
+		   const unsigned int tx_frame_buf_sz,
+		   struct ectpping_payload *eping_payload,
+		   const uint64_t launch_ns);
+
+void record_hop_reply(const struct ectpping_payload *eping_payload,
+		      const struct timespec *pkt_arrived);
+
+void print_hop_stats(const struct program_parameters *prog_parms);
+
+void run_latency_matrix(struct tx_thread_arguments *tx_args,
+			uint8_t tx_frame_buf[],
+			const unsigned int tx_frame_buf_sz,
+			struct ectpping_payload *eping_payload);
+
+void get_route_assistants(const struct program_parameters *prog_parms);
 
-void *rx_thread(struct rx_thread_arguments *rx_thread_args);
+void discover_assistants(struct tx_thread_arguments *tx_args,
+			 uint8_t tx_frame_buf[],
+			 const unsigned int tx_frame_buf_sz,
+			 struct ectpping_payload *eping_payload);
+
+void add_matrix_assistant(const struct program_parameters *prog_parms,
+			  const struct ether_addr *assistant);
+
+enum SETUP_MATRIX_PATHS {
+	SETUP_MATRIX_PATHS_GOOD,
+	SETUP_MATRIX_PATHS_NOMEM,
+};
+enum SETUP_MATRIX_PATHS setup_matrix_paths(const struct program_parameters
+					       *prog_parms);
+
+void record_matrix_reply(const struct ectpping_payload *eping_payload,
+			 const struct timespec *pkt_arrived);
+
+int cmp_u64(const void *a, const void *b);
+
+bool matrix_path_median(struct matrix_path *mp, double *median_ns);
+
+void print_latency_matrix(const struct program_parameters *prog_parms);
+
+void print_latency_matrix_text(const struct program_parameters *prog_parms,
+			       const unsigned int n,
+			       const double baseline_ns[],
+			       const bool have_baseline[],
+			       const double latency_us[],
+			       const bool have_latency[],
+			       const double loss_pct[]);
+
+void print_latency_matrix_csv(const unsigned int n,
+			      const double latency_us[],
+			      const bool have_latency[]);
+
+void print_latency_matrix_json(const unsigned int n,
+			       const double baseline_ns[],
+			       const bool have_baseline[],
+			       const double latency_us[],
+			       const bool have_latency[],
+			       const double loss_pct[]);
+
+void *rx_thread(void *arg);
+
+void set_payload_crc(uint8_t ectp_data[], const unsigned int ectp_data_size);
+
+bool payload_crc_good(uint8_t ectp_data[], const unsigned int ectp_data_size);
 
 enum ECTP_PKT_VALID {
 	ECTP_PKT_VALID_GOOD,
@@ -255,7 +1297,8 @@ enum ECTP_PKT_VALID ectp_pkt_valid(const struct ectp_packet *ectp_pkt,
 				   unsigned int *ectp_data_size);
 
 void print_rxed_packet(const struct program_parameters *prog_parms,
-		       const struct timeval *pkt_arrived,
+		       struct rx_stats *stats,
+		       const struct timespec *pkt_arrived,
 		       const struct ether_addr *srcmac,
 		       const unsigned int pkt_len,
 		       const struct ectp_packet *ectp_pkt,
@@ -265,17 +1308,26 @@ void print_rxed_packet(const struct program_parameters *prog_parms,
 void print_ectp_src_rt(const struct ectp_packet *ectp_pkt, bool resolve);
 
 void process_rxed_frames(int *rx_sockfd,
-			 const struct program_parameters *prog_parms);
+			 const struct program_parameters *prog_parms,
+			 struct probe_iface *pif,
+			 struct rx_stats *stats,
+			 struct pcapng_ring *capture_ring);
+
+enum RX_REJECT rx_reject_reason(const enum ECTP_PKT_VALID valid);
 
 void rx_new_packet(int *sockfd,
 		  unsigned char *pkt_buf,
 		  const unsigned int pkt_buf_sz,
-		  struct timeval *pkt_arrived,
+		  struct timespec *pkt_arrived,
 		  unsigned char *pkt_type,
 		  unsigned int *pkt_len,
-		  struct ether_addr *srcmac);
+		  struct ether_addr *srcmac,
+		  const uint64_t spin_ns,
+		  bool *spun);
 
-void close_sockets(int *tx_sockfd, int *rx_sockfd);
+void close_sockets(int *tx_sockfd,
+		   int rx_sockfds[],
+		   const unsigned int num_rx_sockfds);
 
 enum CLOSE_TX_SKT {
 	CLOSE_TX_SKT_GOOD,
@@ -306,30 +1358,139 @@ pid_t ectpping_pid;
 
 
 /*
- * tx & rx thread handles
+ * The interfaces being probed through, each with its own tx thread, rx
+ * workers and stats
  */
-pthread_t tx_thread_hdl;
-pthread_t rx_thread_hdl;
+struct probe_iface *probe_ifaces;
+unsigned int num_probe_ifaces;
 
 
 /*
- * rtt and other stats
+ * Real-time mode results
  */
-unsigned int txed_pkts = 0;
-unsigned int rxed_pkts = 0;
-struct timeval min_rtt = {
-	.tv_sec = INT_MAX,
-	.tv_usec = INT_MAX,
-};
-struct timeval max_rtt = {
-	.tv_sec = 0,
-	.tv_usec = 0,
-};
-struct timeval sum_rtts = {
-	.tv_sec = 0,
-	.tv_usec = 0,
+struct rt_status rt_status;
+
+
+/*
+ * Interval report thread, when -O is used
+ */
+pthread_t report_thread_hdl;
+bool report_thread_started;
+
+
+/*
+ * Probe log, when -w is used, and its writer thread
+ */
+struct probelog_writer probe_log;
+bool probe_log_opened;
+pthread_t log_thread_hdl;
+bool log_thread_started;
+
+
+/*
+ * Jitter and loss burst statistics thread, in ping and train modes, and
+ * what serialises it with the interval reports
+ */
+pthread_t quality_thread_hdl;
+bool quality_thread_started;
+pthread_mutex_t quality_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ * pcapng capture of every probe and reply, when -C is used, the tx
+ * threads' and rx workers' rings of captured frames, and the thread
+ * writing them out
+ */
+struct pcapng_writer capture;
+bool capture_opened;
+struct pcapng_ring *capture_rings;
+unsigned int num_capture_rings;
+pthread_t capture_thread_hdl;
+bool capture_thread_started;
+
+
+/*
+ * Statistics segment, when -M or -E is used, the snapshot its publisher
+ * thread builds, and the thread. Without -M, the segment is private.
+ */
+struct statshm_writer stats_shm;
+struct statshm_stats *stats_snap;
+bool stats_shm_opened;
+pthread_t stats_thread_hdl;
+bool stats_thread_started;
+
+
+/*
+ * Metrics endpoint, when -E is used, and its thread, which reads the
+ * statistics segment into its own snapshot
+ */
+struct metrics_server metrics;
+struct statshm_reader metrics_reader;
+struct statshm_stats *metrics_snap;
+bool metrics_opened;
+pthread_t metrics_thread_hdl;
+bool metrics_thread_started;
+
+
+/*
+ * Daemon mode's current probe plan, the plans replaced but perhaps still
+ * in use, the control socket and its thread. The statistics publisher's
+ * plan generation is alongside the tx threads' in their probe_ifaces.
+ */
+_Atomic(struct probe_plan *) probe_plan;
+struct probe_plan *retired_plans;
+uint32_t last_target_id;
+int ctl_sockfd = -1;
+bool ctl_opened;
+pthread_t ctl_thread_hdl;
+bool ctl_thread_started;
+struct statshm_reader ctl_reader;
+struct statshm_stats *ctl_snap;
+_Atomic uint64_t stats_plan_gen;
+unsigned int stats_path_hint;
+
+
+/*
+ * Serialises sampling the rx sockets' kernel counters, which reading resets
+ */
+pthread_mutex_t sockstats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ * Names of the rx rejection reasons, for the statistics
+ */
+const char *rx_reject_names[RX_REJECT_REASONS] = {
+	[RX_REJECT_TOOSMALL] = "too small",
+	[RX_REJECT_BADSKIPCOUNT] = "bad skipcount",
+	[RX_REJECT_BADMSGTYPE] = "bad message type",
+	[RX_REJECT_WRONGRCPTNUM] = "wrong receipt number",
+	[RX_REJECT_SHORTPAYLOAD] = "short payload",
 };
 
+
+/*
+ * Stats shared between threads
+ */
+pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ * Hop by hop mode probe paths, one per hop of the route
+ */
+struct hop_path *hop_paths;
+unsigned int num_hop_paths;
+
+/*
+ * Latency matrix assistants and probe paths. The assistants are added
+ * under stats_mutex, and num_matrix_paths is only set once the paths
+ * are ready for the rx thread.
+ */
+struct ether_addr matrix_assistants[MATRIX_MAX_ASSISTANTS];
+unsigned int num_matrix_assistants;
+_Atomic bool matrix_discovering;
+struct matrix_path *matrix_paths;
+_Atomic unsigned int num_matrix_paths;
+
 /*
  * Program parameters (needs to be global so signal handler can see it)
  */
@@ -342,32 +1503,141 @@ struct program_parameters prog_parms;
 int main(int argc, char *argv[])
 {
     struct sigaction sigint_action;
-    int tx_sockfd, rx_sockfd;
-    struct tx_thread_arguments tx_thread_args;
-    struct rx_thread_arguments rx_thread_args;
+    struct probe_iface *pif;
     unsigned char ectp_data[] =
         __BASE_FILE__ ", built " __TIMESTAMP__ ", using GCC version "
         __VERSION__;
     int ret;
+    unsigned int i;
     pthread_attr_t threads_attrs;
-	pthread_t rx_thread_hdl;
+    sigset_t aux_sigs, old_sigs;
 
     get_prog_parms(argc, argv, &prog_parms);
 
-    prog_parms.ectp_user_data = ectp_data;
-    prog_parms.ectp_user_data_size = sizeof(ectp_data);
+    if (build_ectp_user_data(&prog_parms, ectp_data, sizeof(ectp_data)) !=
+        BUILD_ECTP_USER_DATA_GOOD) {
+        fprintf(stderr, "Failed to allocate probe payload\n");
+        return EXIT_FAILURE;
+    }
+
+    crc32c_init();
 
-	ret = open_sockets(&tx_sockfd, &rx_sockfd, prog_parms.ifindex);
-	if (ret == -1) {
-		perror("Failed to open sockets");
-		if (tx_sockfd != -1 || rx_sockfd != -1) {
-			close_sockets(&tx_sockfd, &rx_sockfd);
-		}
-		return EXIT_FAILURE;
-	}
+    if ((prog_parms.mode == ECTPPING_MODE_HOPS) &&
+        (setup_hop_paths(&prog_parms) != SETUP_HOP_PATHS_GOOD)) {
+        fprintf(stderr, "Failed to allocate hop by hop probe paths\n");
+        return EXIT_FAILURE;
+    }
+
+    if (setup_probe_ifaces(&prog_parms) != SETUP_PROBE_IFACES_GOOD) {
+        fprintf(stderr, "Failed to allocate interface state\n");
+        return EXIT_FAILURE;
+    }
+
+    if ((prog_parms.probe_log_file != NULL) &&
+        (open_probe_log(&prog_parms) != OPEN_PROBE_LOG_GOOD)) {
+        fprintf(stderr, "Failed to open probe log %s: %s\n",
+            prog_parms.probe_log_file, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if ((prog_parms.capture_file != NULL) &&
+        (open_capture(&prog_parms) != OPEN_CAPTURE_GOOD)) {
+        fprintf(stderr, "Failed to open capture %s: %s\n",
+            prog_parms.capture_file, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* daemon mode's per target statistics are kept in the segment */
+    if ((prog_parms.stats_shm_name != NULL) ||
+        (prog_parms.metrics_addr != NULL) ||
+        (prog_parms.mode == ECTPPING_MODE_DAEMON)) {
+        switch (open_stats_shm(&prog_parms)) {
+        case OPEN_STATS_SHM_GOOD:
+            break;
+        case OPEN_STATS_SHM_NOMEM:
+            fprintf(stderr, "Failed to allocate statistics snapshot\n");
+            return EXIT_FAILURE;
+        case OPEN_STATS_SHM_BADNAME:
+            fprintf(stderr, "Bad statistics segment name %s\n",
+                prog_parms.stats_shm_name);
+            return EXIT_FAILURE;
+        case OPEN_STATS_SHM_BADSHM:
+        default:
+            fprintf(stderr, "Failed to create statistics segment %s: %s\n",
+                (prog_parms.stats_shm_name != NULL) ?
+                    prog_parms.stats_shm_name : "in memory", strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (prog_parms.metrics_addr != NULL) {
+        switch (open_metrics(&prog_parms)) {
+        case OPEN_METRICS_GOOD:
+            break;
+        case OPEN_METRICS_NOMEM:
+            fprintf(stderr, "Failed to allocate metrics snapshot\n");
+            return EXIT_FAILURE;
+        case OPEN_METRICS_BADADDR:
+            fprintf(stderr, "Bad metrics endpoint %s\n",
+                prog_parms.metrics_addr);
+            return EXIT_FAILURE;
+        case OPEN_METRICS_BADSOCKET:
+        default:
+            fprintf(stderr, "Failed to listen for metrics on %s: %s\n",
+                prog_parms.metrics_addr, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (prog_parms.mode == ECTPPING_MODE_DAEMON) {
+        switch (open_daemon(&prog_parms)) {
+        case OPEN_DAEMON_GOOD:
+            break;
+        case OPEN_DAEMON_NOMEM:
+            fprintf(stderr, "Failed to allocate probe plan\n");
+            return EXIT_FAILURE;
+        case OPEN_DAEMON_BADPATH:
+            fprintf(stderr, "Bad control socket path %s\n",
+                prog_parms.ctl_path);
+            return EXIT_FAILURE;
+        case OPEN_DAEMON_BADSOCKET:
+        default:
+            fprintf(stderr, "Failed to listen for control on %s: %s\n",
+                prog_parms.ctl_path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (i = 0; i < num_probe_ifaces; i++) {
+        pif = &probe_ifaces[i];
+
+        ret = open_sockets(&pif->tx_sockfd, pif->rx_sockfds,
+            pif->parms.rx_workers, pif->parms.ifindex, (getpid() + i) & 0xffff,
+            pif->parms.rx_fanout);
+        if (ret == -1) {
+            perror("Failed to open sockets");
+            close_all_sockets();
+            return EXIT_FAILURE;
+        }
+
+        if (pif->parms.txtime &&
+            (enable_tx_txtime(&pif->tx_sockfd) != ENABLE_TX_TXTIME_GOOD)) {
+            perror("Failed to enable SO_TXTIME");
+            close_all_sockets();
+            return EXIT_FAILURE;
+        }
+
+        if (pif->parms.txtime &&
+            !txtime_qdisc_ok(pif->parms.iface, pif->parms.ifindex)) {
+            close_all_sockets();
+            return EXIT_FAILURE;
+        }
+
+        if (pif->parms.busy_poll_us > 0)
+            enable_iface_busy_poll(pif);
 
-    prepare_thread_args(&tx_thread_args, &rx_thread_args, &prog_parms,
-        &tx_sockfd, &rx_sockfd);
+        prepare_thread_args(pif);
+    }
 
     setup_sigint_hdlr(&sigint_action);
 
@@ -381,38 +1651,49 @@ int main(int argc, char *argv[])
         return ret;
     }
 
-    ret = pthread_attr_setschedpolicy(&threads_attrs, SCHED_FIFO);
-    if (ret != 0) {
-        fprintf(stderr, "Failed to set thread scheduling policy\n");
+    if (setup_threads_attrs(&threads_attrs, &prog_parms) !=
+        SETUP_THREADS_ATTRS_GOOD) {
+        fprintf(stderr, "Failed to set real-time thread attributes\n");
         pthread_attr_destroy(&threads_attrs);
-        return ret;
+        return EXIT_FAILURE;
     }
 
-	// Create the transmitter thread
-	ret = pthread_create(&tx_thread_hdl, &threads_attrs, tx_thread, &tx_thread_args);
-	if (ret != 0) {
-		fprintf(stderr, "Failed to create tx thread\n");
-		if (pthread_attr_destroy(&threads_attrs) != 0) {
-			fprintf(stderr, "Failed to destroy thread attributes\n");
-		}
-		return ret;
-	}
+    if (prog_parms.rt)
+        lock_memory();
+
+    // Create each interface's transmitter and receiver threads
+    for (i = 0; i < num_probe_ifaces; i++) {
+        ret = start_iface_threads(&probe_ifaces[i], &threads_attrs);
+        if (ret != 0) {
+            pthread_attr_destroy(&threads_attrs);
+            return ret;
+        }
+    }
+
+    if (prog_parms.rt)
+        print_rt_report(&prog_parms);
 
-    // Create the receiver thread
-    ret = pthread_create(&rx_thread_hdl, &threads_attrs, rx_thread, &rx_thread_args);
+    // SIGINT is left to the other threads, as finish_ectpping() joins these
+    sigemptyset(&aux_sigs);
+    sigaddset(&aux_sigs, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &aux_sigs, &old_sigs);
+    ret = start_aux_threads();
+    pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
     if (ret != 0) {
-        fprintf(stderr, "Failed to create rx thread\n");
         pthread_attr_destroy(&threads_attrs);
         return ret;
     }
 
-    // Wait for threads to finish
-    pthread_join(tx_thread_hdl, NULL);
-    pthread_join(rx_thread_hdl, NULL);
+    // The tx threads only finish by themselves when their test is complete
+    for (i = 0; i < num_probe_ifaces; i++)
+        pthread_join(probe_ifaces[i].tx_thread_hdl, NULL);
+
+    // Stops and joins the rx threads
+    finish_ectpping();
 
     pthread_attr_destroy(&threads_attrs);
 
-    close_sockets(&tx_sockfd, &rx_sockfd);
+    close_all_sockets();
 
     return EXIT_SUCCESS;
 }
@@ -456,14 +1737,39 @@ void print_ethaddr_hostname(const struct ether_addr *ethaddr, bool resolve)
  */
 void print_prog_header(const struct program_parameters *prog_parms)
 {
+	char cpus[CPULIST_STR_MAXSZ];
+	unsigned int i;
 
 
 	printf("ECTPPING ");
 
-	print_ethaddr_hostname(&prog_parms->dstmac,
-		!prog_parms->no_resolve);
+	if (prog_parms->mode == ECTPPING_MODE_DAEMON)
+		printf("daemon, control socket %s", prog_parms->ctl_path);
+	else
+		print_ethaddr_hostname(&prog_parms->dstmac,
+			!prog_parms->no_resolve);
 		
-	printf(" using %s\n", prog_parms->iface);
+	for (i = 0; i < num_probe_ifaces; i++) {
+		printf("%s%s", (i == 0) ? " using " : ", ",
+			probe_ifaces[i].parms.iface);
+		if (probe_ifaces[i].cpus_local) {
+			cpulist_format(&probe_ifaces[i].cpus, cpus,
+				sizeof(cpus));
+			printf(" (cpus %s)", cpus);
+		}
+	}
+
+	if (prog_parms->crc)
+		printf(", payload crc32c (%s)", crc32c_impl_name());
+
+	if (prog_parms->rx_workers > 1)
+		printf(", %u rx workers (%s fanout)", prog_parms->rx_workers,
+			fanout_name(prog_parms->rx_fanout));
+
+	if (prog_parms->rx_spin_ns > 0)
+		printf(", rx spin %.3f usec", prog_parms->rx_spin_ns / 1e3);
+
+	putchar('\n');
 
 }
 
@@ -489,12 +1795,126 @@ void set_sigint_hdlr(struct sigaction *sigint_action)
  */
 void sigint_hdlr(int signum)
 {
-    pthread_cancel(tx_thread_hdl);
+    unsigned int i;
+
+    for (i = 0; i < num_probe_ifaces; i++) {
+        if (probe_ifaces[i].tx_thread_started)
+            pthread_cancel(probe_ifaces[i].tx_thread_hdl);
+    }
+
+    finish_ectpping();
+}
+
+
+/*
+ * Stop the rx threads, print the statistics and exit. Called once the tx
+ * threads have stopped, either via SIGINT or because their test has
+ * completed.
+ */
+void finish_ectpping(void)
+{
+    struct rx_stats rx_totals, iface_rx_totals;
+    unsigned int txed_pkts = 0;
+    bool in_flight = false;
+    struct probe_iface *pif;
+    unsigned int i, j;
+
+    signal(SIGINT, SIG_IGN);
+
+    /* a cancelled tx thread still finishes sending its current probe */
+    for (i = 0; i < num_probe_ifaces; i++) {
+        while (probe_ifaces[i].tx_thread_started &&
+               !atomic_load(&probe_ifaces[i].tx_thread_stopped))
+            usleep(1000);
+    }
+
+    if (ctl_thread_started) {
+        pthread_cancel(ctl_thread_hdl);
+        pthread_join(ctl_thread_hdl, NULL);
+    }
+
+    if (ctl_opened) {
+        close(ctl_sockfd);
+        unlink(prog_parms.ctl_path);
+    }
+
+    if (metrics_thread_started) {
+        pthread_cancel(metrics_thread_hdl);
+        pthread_join(metrics_thread_hdl, NULL);
+    }
+
+    if (report_thread_started) {
+        pthread_cancel(report_thread_hdl);
+        pthread_join(report_thread_hdl, NULL);
+    }
+
+    if (log_thread_started) {
+        pthread_cancel(log_thread_hdl);
+        pthread_join(log_thread_hdl, NULL);
+    }
+
+    if (capture_thread_started) {
+        pthread_cancel(capture_thread_hdl);
+        pthread_join(capture_thread_hdl, NULL);
+    }
+
+    if (stats_thread_started) {
+        pthread_cancel(stats_thread_hdl);
+        pthread_join(stats_thread_hdl, NULL);
+    }
+
+    if (quality_thread_started) {
+        pthread_cancel(quality_thread_hdl);
+        pthread_join(quality_thread_hdl, NULL);
+    }
+
+    for (i = 0; i < num_probe_ifaces; i++) {
+        if (seqtrack_in_flight(&probe_ifaces[i].probe_track) > 0)
+            in_flight = true;
+    }
 
-    if (rxed_pkts != txed_pkts)
+    if (in_flight)
         usleep(100000); /* 100ms delay to try to catch an in-flight pkt */
 
-    pthread_cancel(rx_thread_hdl);
+    for (i = 0; i < num_probe_ifaces; i++)
+        sample_rx_cpu_time(&probe_ifaces[i]);
+
+    for (i = 0; i < num_probe_ifaces; i++) {
+        for (j = 0; j < probe_ifaces[i].num_rx_threads; j++)
+            pthread_cancel(probe_ifaces[i].rx_thread_hdls[j]);
+    }
+
+    for (i = 0; i < num_probe_ifaces; i++) {
+        for (j = 0; j < probe_ifaces[i].num_rx_threads; j++)
+            pthread_join(probe_ifaces[i].rx_thread_hdls[j], NULL);
+    }
+
+    for (i = 0; i < num_probe_ifaces; i++)
+        sample_rx_sockstats(&probe_ifaces[i]);
+
+    if (prog_parms.mode == ECTPPING_MODE_TRAIN) {
+        for (i = 0; i < num_probe_ifaces; i++)
+            eval_last_train(&probe_ifaces[i]);
+    }
+
+    if (probe_log_opened) {
+        drain_probe_log(true);
+        probelog_close(&probe_log);
+    }
+
+    if (quality_thread_started)
+        drain_quality(true);
+
+    if (capture_opened)
+        close_capture();
+
+    if (metrics_opened)
+        metrics_close(&metrics);
+
+    if (stats_shm_opened) {
+        publish_stats(true);
+        statshm_close(&stats_shm);
+    }
 
     if (prog_parms.fwdaddrs != NULL)
         free(prog_parms.fwdaddrs);
@@ -504,32 +1924,50 @@ void sigint_hdlr(int signum)
     fflush(NULL);
 
     printf("---- ");
-    print_ethaddr_hostname(&prog_parms.dstmac, !prog_parms.no_resolve);
+    if (prog_parms.mode == ECTPPING_MODE_DAEMON)
+        printf("daemon");
+    else
+        print_ethaddr_hostname(&prog_parms.dstmac, !prog_parms.no_resolve);
     printf(" ECTPPING Statistics ----\n");
 
+    init_rx_stats(&rx_totals);
+
     pthread_mutex_lock(&stats_mutex);
-    printf("%d packets transmitted, %d packets received", txed_pkts, rxed_pkts);
-    if (txed_pkts > 0) {
-        if (rxed_pkts <= txed_pkts)
-            printf(", %f%% packet loss\n", ((txed_pkts - rxed_pkts) / (txed_pkts * 1.0)) * 100);
-        else
-            printf(", %.2f times packet increase\n", (rxed_pkts / (txed_pkts * 1.0)));
-
-        if (rxed_pkts > 0) {
-            long sum_rtts_sec_avg = (sum_rtts.tv_sec * 1000000) / rxed_pkts;
-            printf("round-trip (sec)  min/avg/max/total = "
-                   "%ld.%06ld/%ld.%06ld/%ld.%06ld/%ld.%06ld\n",
-                   min_rtt.tv_sec, min_rtt.tv_usec,
-                   sum_rtts.tv_sec / rxed_pkts,
-                   (sum_rtts_sec_avg < 1000000 ? (sum_rtts.tv_usec / rxed_pkts) + sum_rtts_sec_avg : sum_rtts.tv_usec / rxed_pkts),
-                   max_rtt.tv_sec, max_rtt.tv_usec,
-                   sum_rtts.tv_sec, sum_rtts.tv_usec);
-        }
-    } else {
-        putchar('\n');
+    for (i = 0; i < num_probe_ifaces; i++) {
+        merge_rx_stats(probe_ifaces[i].rx_stats_shards,
+            probe_ifaces[i].num_rx_threads, &rx_totals);
+        txed_pkts += probe_ifaces[i].txed_pkts;
     }
     pthread_mutex_unlock(&stats_mutex);
 
+    if (num_probe_ifaces == 1) {
+        print_ping_stats(NULL, txed_pkts, &rx_totals);
+        print_iface_stats(&probe_ifaces[0]);
+    } else {
+        for (i = 0; i < num_probe_ifaces; i++) {
+            pif = &probe_ifaces[i];
+            init_rx_stats(&iface_rx_totals);
+            merge_rx_stats(pif->rx_stats_shards, pif->num_rx_threads,
+                &iface_rx_totals);
+            print_ping_stats(pif->parms.iface, pif->txed_pkts,
+                &iface_rx_totals);
+            print_iface_stats(pif);
+        }
+        print_ping_stats("all interfaces", txed_pkts, &rx_totals);
+    }
+
+    if (probe_log_opened)
+        print_probe_log_stats(&prog_parms);
+
+    if (capture_opened)
+        print_capture_stats(&prog_parms);
+
+    if (metrics_opened)
+        print_metrics_stats(&prog_parms);
+
+    if (ctl_opened)
+        print_daemon_stats();
+
     fflush(NULL);
 
     exit(EXIT_SUCCESS);
@@ -537,658 +1975,6245 @@ void sigint_hdlr(int signum)
 
 
 /*
- * Routine to collect program parameters from various sources e.g. cli
- * options, .rc file
+ * Print the packet counts, loss and round trip times, labelled when
+ * there is more than one interface
  */
-enum GET_PROG_PARMS get_prog_parms(const int argc,
-				   char *argv[],
-				   struct program_parameters *prog_parms)
+void print_ping_stats(const char *label,
+		      const unsigned int txed_pkts,
+		      const struct rx_stats *rx_totals)
 {
-	struct program_options prog_opts;
-	int erropt;
-	const char *errmsg;
-	enum PROCESS_PROG_OPTS process_prog_opts_ret;
+	long sum_rtts_sec_avg;
 
-	set_default_prog_opts(&prog_opts);
 
-	get_cli_opts_eh(get_cli_opts(argc, argv, &prog_opts, &erropt), &erropt);
+	if (label != NULL)
+		printf("%s: ", label);
 
-	process_prog_opts_ret = process_prog_opts(&prog_opts, prog_parms,
-			&errmsg);
-	process_prog_opts_eh(process_prog_opts_ret, errmsg);
+	printf("%d packets transmitted, %d packets received", txed_pkts,
+		rx_totals->rxed_pkts);
 
-	return GET_PROG_PARMS_GOOD;
+	if (prog_parms.crc)
+		printf(", %d corrupted", rx_totals->corrupted_pkts);
+
+	if (txed_pkts == 0) {
+		putchar('\n');
+		return;
+	}
+
+	if ((rx_totals->rxed_pkts + rx_totals->corrupted_pkts) <= txed_pkts)
+		printf(", %f%% packet loss\n",
+			((txed_pkts - rx_totals->rxed_pkts -
+			  rx_totals->corrupted_pkts) / (txed_pkts * 1.0)) * 100);
+	else
+		printf(", %.2f times packet increase\n",
+			(rx_totals->rxed_pkts / (txed_pkts * 1.0)));
+
+	if (rx_totals->rxed_pkts == 0)
+		return;
+
+	sum_rtts_sec_avg = (rx_totals->sum_rtts.tv_sec * 1000000) /
+		rx_totals->rxed_pkts;
+
+	printf("round-trip (sec)  min/avg/max/total = "
+		"%ld.%06ld/%ld.%06ld/%ld.%06ld/%ld.%06ld\n",
+		rx_totals->min_rtt.tv_sec, rx_totals->min_rtt.tv_usec,
+		rx_totals->sum_rtts.tv_sec / rx_totals->rxed_pkts,
+		(sum_rtts_sec_avg < 1000000 ?
+			(rx_totals->sum_rtts.tv_usec / rx_totals->rxed_pkts) +
+			sum_rtts_sec_avg :
+			rx_totals->sum_rtts.tv_usec / rx_totals->rxed_pkts),
+		rx_totals->max_rtt.tv_sec, rx_totals->max_rtt.tv_usec,
+		rx_totals->sum_rtts.tv_sec, rx_totals->sum_rtts.tv_usec);
 
 }
 
 
 /*
- * Set some reasonable program option defaults
- */ 
-void set_default_prog_opts(struct program_options *prog_opts)
+ * Print the rest of an interface's results and statistics
+ */
+void print_iface_stats(struct probe_iface *pif)
 {
-	char *default_iface = "eth0";
+	const struct program_parameters *prog_parms = &pif->parms;
 
 
-	memset(prog_opts, 0, sizeof(struct program_options));
+	if (pif->num_rx_threads > 1)
+		print_rx_worker_stats(prog_parms, pif->rx_stats_shards,
+			pif->num_rx_threads);
 
-	/* default interface */
-	strncpy(prog_opts->iface, default_iface, IFNAMSIZ);
-	prog_opts->iface[IFNAMSIZ-1] = '\0';
+	if (quality_thread_started)
+		print_quality_stats(pif);
 
-	prog_opts->dst_type = mcast;
+	print_rx_cpu_stats(pif);
 
-	prog_opts->no_resolve = false;
+	print_host_drop_stats(pif);
 
-	prog_opts->zero_pkt_output = false;
+	if (prog_parms->mode == ECTPPING_MODE_TRAIN)
+		print_train_stats(&pif->train_agg);
 
-	prog_opts->interval_ms = 1000;
+	if (prog_parms->mode == ECTPPING_MODE_HOPS)
+		print_hop_stats(prog_parms);
 
-	prog_opts->fwdaddrs_str = NULL;
+	if (prog_parms->mode == ECTPPING_MODE_MATRIX)
+		print_latency_matrix(prog_parms);
+
+	print_pacer_stats(&pif->pacer, prog_parms->txtime);
+
+	if (prog_parms->txtime)
+		print_txtime_stats(&pif->txtime_stats,
+			prog_parms->txtime_lead_ns);
+
+	print_rategov_stats(&pif->rategov_share);
 
 }
 
 
 /*
- * Routine to collect program options from *argv[];
+ * Print how much CPU the rx threads used, and with rx spinning how many
+ * replies were caught before blocking, to weigh one against the other
  */
-enum GET_CLI_OPTS get_cli_opts(const int argc,
-			       char *argv[],
-			       struct program_options *prog_opts,
-			       int *erropt)
+void print_rx_cpu_stats(const struct probe_iface *pif)
 {
-	int opt;
+	const struct program_parameters *prog_parms = &pif->parms;
+	unsigned int replies = 0, spun = 0;
+	unsigned int i;
 
 
-	opterr = 0;
+	if (pif->rx_elapsed_ns == 0)
+		return;
 
-	while ((opt = getopt(argc, argv, ":i:bnzI:f:h")) != -1) {
-		switch (opt) {
-		case 'i':
-			strncpy(prog_opts->iface, optarg, IFNAMSIZ);
-			prog_opts->iface[IFNAMSIZ-1] = 0;
-			break;
-		case 'b':
-			prog_opts->dst_type = bcast;
-			break;
-		case 'n':
-			prog_opts->no_resolve = true;
-			break;
-		case 'z':
-			prog_opts->zero_pkt_output = true;
-			break;
-		case 'I':
-			if (getuid() != 0) {
-				*erropt = 'I';
-				return GET_CLI_OPTS_BAD_NEED_UID_0;
-			}
-			prog_opts->interval_ms = atoi(optarg);
-			break;
-		case 'f':
-			prog_opts->fwdaddrs_str = optarg;
-			break;
-		case '?':
-			*erropt = optopt;
-			return GET_CLI_OPTS_BAD_UNKNOWN_OPT;
-			break;
-		case ':':
-			*erropt = optopt;
-			return GET_CLI_OPTS_BAD_MISSING_ARG;
-			break;
-		case 'h':
-			return GET_CLI_OPTS_BAD_HELP;
-		}
+	printf("rx cpu time %.6f sec over %.3f sec, %.2f%% of a CPU\n",
+		pif->rx_cpu_ns / 1e9, pif->rx_elapsed_ns / 1e9,
+		(pif->rx_cpu_ns * 100.0) / pif->rx_elapsed_ns);
+
+	if (prog_parms->rx_spin_ns == 0)
+		return;
+
+	for (i = 0; i < pif->num_rx_threads; i++) {
+		replies += pif->rx_stats_shards[i].rxed_pkts +
+			pif->rx_stats_shards[i].corrupted_pkts;
+		spun += pif->rx_stats_shards[i].spun_pkts;
 	}
 
-	/* first non-opt is assumed to be dest mac addr */
-	if (optind < argc) { 
-		prog_opts->dst_type = ucast;
-		prog_opts->uc_dst_str = argv[optind];
+	printf("rx spin %.3f usec", prog_parms->rx_spin_ns / 1e3);
+
+	if (pif->busy_poll_set)
+		printf(", SO_BUSY_POLL %u usec", prog_parms->busy_poll_us);
+
+	printf(", %u of %u replies caught spinning\n", spun, replies);
+
+}
+
+
+/*
+ * Print what the kernel and ectpping itself dropped or rejected on this
+ * host, and how much of any loss that could account for. What it can't is
+ * down to the network. The rx socket also sees our own transmitted
+ * frames, and rejected frames may be replies to another ectpping, so the
+ * host's share is an upper bound.
+ */
+void print_host_drop_stats(struct probe_iface *pif)
+{
+	struct rx_stats rx_totals;
+	struct sockstat_rx sock_totals;
+	struct iface_counters counters;
+	uint64_t lost, host;
+	unsigned int i;
+	int err;
+
+
+	init_rx_stats(&rx_totals);
+	merge_rx_stats(pif->rx_stats_shards, pif->num_rx_threads, &rx_totals);
+
+	sockstat_rx_init(&sock_totals);
+	for (i = 0; i < pif->parms.rx_workers; i++)
+		sockstat_rx_add(&sock_totals, &pif->rx_sockstats[i]);
+
+	get_iface_counters(pif, &counters);
+
+	printf("rx socket %llu frames, %llu dropped",
+		(unsigned long long)sock_totals.packets,
+		(unsigned long long)sock_totals.drops);
+
+	if (sock_totals.has_freeze_q_cnt)
+		printf(", %llu queue freezes",
+			(unsigned long long)sock_totals.freeze_q_cnt);
+
+	if (sock_totals.rcvbuf > 0)
+		printf(", queue peak %u of %u bytes", sock_totals.rmem_peak,
+			sock_totals.rcvbuf);
+
+	printf(", %u receive errors\n", rx_totals.rx_errors);
+
+	printf("rx rejected");
+	for (i = 0; i < RX_REJECT_REASONS; i++)
+		printf("%s %u %s", (i == 0) ? "" : ",", rx_totals.rejected[i],
+			rx_reject_names[i]);
+	printf("; %llu duplicate, %llu stale replies\n",
+		(unsigned long long)atomic_load(&pif->probe_track.duplicates),
+		(unsigned long long)atomic_load(&pif->probe_track.stale));
+
+	printf("tx errors %llu", (unsigned long long)counters.tx_errors);
+	for (err = 1; err < SOCKSTAT_ERRNO_MAX; err++) {
+		if (sockstat_txerrs_count(&pif->tx_errs, err) == 0)
+			continue;
+		printf(", %s %llu", sockstat_errno_name(err),
+			(unsigned long long)sockstat_txerrs_count(&pif->tx_errs,
+				err));
 	}
+	putchar('\n');
 
-	return GET_CLI_OPTS_GOOD;
+	if (counters.txed <= (counters.rxed + counters.corrupted))
+		return;
+
+	lost = counters.txed - counters.rxed - counters.corrupted;
+	host = counters.tx_errors + counters.rx_drops + counters.rejected +
+		counters.rx_errors;
+	if (host > lost)
+		host = lost;
+
+	printf("%llu lost: up to %llu on this host (%llu send errors, "
+		"%llu rx socket drops, %llu rejected, %llu receive errors), "
+		"at least %llu in the network\n",
+		(unsigned long long)lost, (unsigned long long)host,
+		(unsigned long long)counters.tx_errors,
+		(unsigned long long)counters.rx_drops,
+		(unsigned long long)counters.rejected,
+		(unsigned long long)counters.rx_errors,
+		(unsigned long long)(lost - host));
 
 }
 
 
 /*
- * Error handler for get_cli_opts()
- *
+ * Interval report thread, printing what changed on each interface every
+ * report interval until cancelled
  */
-enum GET_CLI_OPTS get_cli_opts_eh(const enum GET_CLI_OPTS ret,
-				  int *erropt)
+void *report_thread(void *arg)
 {
+	const uint64_t interval_ns = prog_parms.report_interval_ns;
+	uint64_t start_ns, next_ns;
+	struct timespec next_ts;
+	unsigned int i;
+	int cancel_state;
 
 
-	switch (ret) {
-	case GET_CLI_OPTS_BAD_UNKNOWN_OPT:
-		fprintf(stderr, "-%c: Unknown option\n", *erropt);	
-		exit(EXIT_FAILURE);
-		break;
-	case GET_CLI_OPTS_BAD_MISSING_ARG:
-		fprintf(stderr, "-%c: Missing option argument\n", *erropt);	
-		exit(EXIT_FAILURE);
-		break;
-	case GET_CLI_OPTS_BAD_NEED_UID_0:
-		fprintf(stderr, "-%c: Need to be root user (getuid() == 0) to "
-				"use this option\n",
-			*erropt);	
-		exit(EXIT_FAILURE);
-		break;
-	case GET_CLI_OPTS_BAD_HELP:
-		print_help();
-		exit(EXIT_FAILURE);
-		break;
-	default:
-		return ret;
+	for (i = 0; i < num_probe_ifaces; i++)
+		get_iface_counters(&probe_ifaces[i],
+			&probe_ifaces[i].last_report);
+
+	start_ns = pacer_now_ns();
+	next_ns = start_ns;
+
+	while (true) {
+		next_ns += interval_ns;
+		next_ts.tv_sec = next_ns / 1000000000ULL;
+		next_ts.tv_nsec = next_ns % 1000000000ULL;
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_ts,
+			NULL);
+
+		/* not mid report, holding the stdout lock, when cancelled */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+		print_interval_report(next_ns - start_ns);
+		pthread_setcancelstate(cancel_state, NULL);
 	}
 
+	return NULL;
+
 }
 
-void print_help(void)
+
+/*
+ * Print each interface's counts for the interval just ended, and its rx
+ * queue occupancy and probes in flight now
+ */
+void print_interval_report(const uint64_t elapsed_ns)
 {
+	struct iface_counters now, *last;
+	struct probe_iface *pif;
+	uint32_t rmem_alloc, rcvbuf;
+	unsigned int i, j;
 
 
-	fprintf(stderr, "\n%s\n\n", ectpping_version);
+	flockfile(stdout);
 
-	fprintf(stderr, "ectpping [options] [<unicast MAC address>|"
-			"</etc/ethers hostname>]\n\n");
+	for (i = 0; i < num_probe_ifaces; i++) {
+		pif = &probe_ifaces[i];
+		last = &pif->last_report;
 
-	fprintf(stderr, "ECTPPING options\n");
-	fprintf(stderr, "-i <intf>\t: Network interface to use. Default is "
-			"eth0.\n");
-	fprintf(stderr, "-b\t\t: Use broadcast ECTP packet instead of "
-			"multicast ECTP packet.\n");
-	fprintf(stderr, "-n\t\t: Don't resolve names using /etc/ethers.\n"
-			"\t\t  See ethers(5) for details.\n");
-	fprintf(stderr, "-z\t\t: Zero output of per packet "
-				"responses.\n");
-	fprintf(stderr, "-I <ms>\t\t: Milliseconds between packet "
-			"transmits. Default is 1000.\n");
-	fprintf(stderr, "\t\t  Need to be root i.e. getuid() == 0 to use this "
-			"option.\n");
-	fprintf(stderr, "-f \"fwdaddr1 ... fwdaddrN\"\n\t\t: "
-			"List of up to 10 forward addresses in the ECTP packet.\n");
-	fprintf(stderr, "\t\t  The first forward address specified is not used"
-			" as the first\n");
-	fprintf(stderr, "\t\t  ECTP hop i.e. the destination MAC address in "
-		        "the address \n");
-        fprintf(stderr, "\t\t  the transmitted ECTP packet header. That will need to be\n");
-        fprintf(stderr, "\t\t  specified separately on the command line.\n");
-        fprintf(stderr, "\t\t  To have the ECTP packet follow a complete loop, "
-			"specify this\n");
-       	fprintf(stderr, "\t\t  host's outgoing interface MAC address as the "
-			"last hop.\n");
+		sample_rx_sockstats(pif);
+		get_iface_counters(pif, &now);
 
-	fprintf(stderr, "\n");
+		rmem_alloc = 0;
+		rcvbuf = 0;
+		for (j = 0; j < pif->parms.rx_workers; j++) {
+			rmem_alloc += pif->rx_sockstats[j].rmem_alloc;
+			rcvbuf += pif->rx_sockstats[j].rcvbuf;
+		}
 
-}	
+		printf("[%.3f sec] %s: %llu txed, %llu rxed, %llu corrupted, "
+			"%llu rejected, %llu tx errors, %llu rx drops, "
+			"%llu rx errors, rx queue %u of %u bytes, "
+			"%llu of %u in flight\n", elapsed_ns / 1e9,
+			pif->parms.iface,
+			(unsigned long long)(now.txed - last->txed),
+			(unsigned long long)(now.rxed - last->rxed),
+			(unsigned long long)(now.corrupted - last->corrupted),
+			(unsigned long long)(now.rejected - last->rejected),
+			(unsigned long long)(now.tx_errors - last->tx_errors),
+			(unsigned long long)(now.rx_drops - last->rx_drops),
+			(unsigned long long)(now.rx_errors - last->rx_errors),
+			rmem_alloc, rcvbuf,
+			(unsigned long long)seqtrack_in_flight(
+				&pif->probe_track),
+			pif->probe_track.size);
+
+		if (quality_thread_started)
+			print_interval_quality(pif, elapsed_ns);
+
+		*last = now;
+	}
+
+	fflush(stdout);
+
+	funlockfile(stdout);
+
+}
 
 
 /*
- * Routine to convert collected program options into internal program
- * parameters
+ * Total an interface's counts. The rx workers may still be running, so
+ * their shards are read as they stand.
  */
-enum PROCESS_PROG_OPTS process_prog_opts(const struct program_options
-						*prog_opts,
-					 struct program_parameters *prog_parms,
-					 const char **errmsg)
+void get_iface_counters(struct probe_iface *pif,
+			struct iface_counters *counters)
 {
-	const uint8_t bcast_addr[ETH_ALEN] = { 0xff, 0xff, 0xff,
-					       0xff, 0xff, 0xff };
-	const uint8_t lc_mcaddr[ETH_ALEN] = ECTP_LA_MCADDR;
+	const struct rx_stats *shard;
+	unsigned int i, j;
 
-	
-	
 
-	memset(prog_parms, 0, sizeof(struct program_parameters));
+	memset(counters, 0, sizeof(struct iface_counters));
 
-	if (get_ifindex(prog_opts->iface, &prog_parms->ifindex)
-		!= GET_IFINDEX_GOOD) {
-		*errmsg = prog_opts->iface;
-		return PROCESS_PROG_OPTS_BAD_IFACE;
-	}
+	pthread_mutex_lock(&stats_mutex);
+	counters->txed = pif->txed_pkts;
+	pthread_mutex_unlock(&stats_mutex);
 
-	if (get_ifmac(prog_opts->iface, &prog_parms->srcmac)
-		!= GET_IFMAC_GOOD) {
-		*errmsg = prog_opts->iface;
-		return PROCESS_PROG_OPTS_BAD_IFMAC;
+	for (i = 0; i < pif->parms.rx_workers; i++) {
+		shard = &pif->rx_stats_shards[i];
+		counters->rxed += __atomic_load_n(&shard->rxed_pkts,
+			__ATOMIC_RELAXED);
+		counters->corrupted += __atomic_load_n(&shard->corrupted_pkts,
+			__ATOMIC_RELAXED);
+		counters->rx_errors += __atomic_load_n(&shard->rx_errors,
+			__ATOMIC_RELAXED);
+		for (j = 0; j < RX_REJECT_REASONS; j++)
+			counters->rejected += __atomic_load_n(
+				&shard->rejected[j], __ATOMIC_RELAXED);
+
+		counters->rx_drops += pif->rx_sockstats[i].drops;
 	}
 
-	strncpy(prog_parms->iface, prog_opts->iface, IFNAMSIZ);
-	prog_parms->iface[IFNAMSIZ-1] = '\0';
+	counters->tx_errors = sockstat_txerrs_total(&pif->tx_errs);
 
-	switch (prog_opts->dst_type) {
-	case ucast:
-		prog_parms->uc_dstmac = true;
-		if (ether_hostton(prog_opts->uc_dst_str,
-			&prog_parms->dstmac) == 0) {
-			break;
+}
+
+
+/*
+ * Start the threads that run alongside the tx and rx threads, the interval
+ * reporter, the probe log and capture writers, the statistics publisher,
+ * the metrics endpoint, the jitter and loss burst statistics and the
+ * daemon's control socket, as they've been asked for
+ */
+int start_aux_threads(void)
+{
+	int ret;
+
+
+	if (prog_parms.report_interval_ns > 0) {
+		ret = pthread_create(&report_thread_hdl, NULL, report_thread,
+			NULL);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create interval report "
+				"thread\n");
+			return ret;
 		}
-		if (enet_pton(prog_opts->uc_dst_str,
-			&prog_parms->dstmac) !=
-			ENET_PTON_GOOD) {
-			return PROCESS_PROG_OPTS_BAD_DSTMACFMT;
+		report_thread_started = true;
+	}
+
+	if (probe_log_opened) {
+		ret = pthread_create(&log_thread_hdl, NULL, log_thread, NULL);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create probe log thread\n");
+			return ret;
 		}
-		break;
-	case bcast:
-		prog_parms->uc_dstmac = false;
-		memcpy(&prog_parms->dstmac, bcast_addr,
-			sizeof(struct ether_addr));
-		break;
-	case mcast:
-	default:
-		prog_parms->uc_dstmac = false;
-		memcpy(&prog_parms->dstmac, lc_mcaddr,
-			sizeof(struct ether_addr));
-		break;
+		log_thread_started = true;
 	}
 
-	prog_parms->no_resolve = prog_opts->no_resolve;
+	if (capture_opened) {
+		ret = pthread_create(&capture_thread_hdl, NULL,
+			capture_thread, NULL);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create capture thread\n");
+			return ret;
+		}
+		capture_thread_started = true;
+	}
 
-	prog_parms->zero_pkt_output = prog_opts->zero_pkt_output;
+	if (stats_shm_opened) {
+		ret = pthread_create(&stats_thread_hdl, NULL, stats_thread,
+			NULL);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create statistics thread\n");
+			return ret;
+		}
+		stats_thread_started = true;
+	}
 
-	prog_parms->interval_ms = prog_opts->interval_ms;
+	if (metrics_opened) {
+		ret = pthread_create(&metrics_thread_hdl, NULL, metrics_thread,
+			NULL);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create metrics thread\n");
+			return ret;
+		}
+		metrics_thread_started = true;
+	}
 
-	if (prog_opts->fwdaddrs_str != NULL) {
-		get_prog_opt_fwdaddrs(prog_opts->fwdaddrs_str,
-			&prog_parms->fwdaddrs,
-			&prog_parms->num_fwdaddrs);
-	} else {
-		prog_parms->fwdaddrs = NULL;
-		prog_parms->num_fwdaddrs = 0;
+	/* consecutive probes in the other modes take different paths */
+	if ((prog_parms.mode == ECTPPING_MODE_PING) ||
+	    (prog_parms.mode == ECTPPING_MODE_TRAIN)) {
+		ret = pthread_create(&quality_thread_hdl, NULL, quality_thread,
+			NULL);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create jitter statistics "
+				"thread\n");
+			return ret;
+		}
+		quality_thread_started = true;
 	}
 
-	return PROCESS_PROG_OPTS_GOOD;
+	if (ctl_opened) {
+		ret = pthread_create(&ctl_thread_hdl, NULL, ctl_thread, NULL);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create control thread\n");
+			return ret;
+		}
+		ctl_thread_started = true;
+	}
+
+	return 0;
 
 }
 
 
 /*
- * Error handler for process_prog_opts() routine
+ * Create the probe log and write its header
  */
-enum PROCESS_PROG_OPTS process_prog_opts_eh(const enum PROCESS_PROG_OPTS ret,
-					    const char *errmsg)
+enum OPEN_PROBE_LOG open_probe_log(const struct program_parameters
+					*prog_parms)
 {
+	struct probelog_hdr hdr;
+	struct timespec now_ts;
+	unsigned int i;
 
 
-	switch (ret) {
-	case PROCESS_PROG_OPTS_BAD_IFACE: 
-		fprintf(stderr, "Unknown interface or interface "
-				"inaccessible (got CAP_NET_RAW?) - %s.\n",
-				errmsg);
-		exit (EXIT_FAILURE);
-		break;
-	case PROCESS_PROG_OPTS_BAD_IFMAC:
-		fprintf(stderr, "Error retrieving interface MAC address.\n");
-		exit (EXIT_FAILURE);
-		break;
-	case PROCESS_PROG_OPTS_BAD_DSTMACFMT:
-		fprintf(stderr, "Bad destination MAC address format.\n");
-		exit (EXIT_FAILURE);
-		break;
-	default:
-		return ret;
-	}
+	memset(&hdr, 0, sizeof(hdr));
+
+	clock_gettime(CLOCK_REALTIME, &now_ts);
+	hdr.start_ns = ((uint64_t)now_ts.tv_sec * 1000000000ULL) +
+		now_ts.tv_nsec;
+	hdr.interval_ns = prog_parms->interval_ns;
+	memcpy(hdr.dstmac, &prog_parms->dstmac, ETH_ALEN);
+
+	hdr.num_ifaces = num_probe_ifaces;
+	for (i = 0; i < num_probe_ifaces; i++)
+		memcpy(hdr.ifaces[i], probe_ifaces[i].parms.iface, IFNAMSIZ);
+
+	if (probelog_open(&probe_log, prog_parms->probe_log_file, &hdr) !=
+		PROBELOG_OPEN_GOOD)
+		return OPEN_PROBE_LOG_BAD;
+
+	probe_log_opened = true;
+
+	return OPEN_PROBE_LOG_GOOD;
 
 }
 
 
 /*
- * routine to convert fwdaddr string into an array of mac addresses
- * n.b. allocates space for the array via calloc if there is at least one
- * mac address, so free() must be called on *fwdaddrs at some point in the
- * future
+ * Probe log writer thread. Probes are logged from the seqtrack rings once
+ * their outcome is known, so logging adds nothing to the tx and rx paths.
  */
-enum GET_PROG_OPT_FWDADDRS get_prog_opt_fwdaddrs(const char *fwdaddrs_str,
-						 struct ether_addr **fwdaddrs,
-						 unsigned int *num_fwdaddrs)
+void *log_thread(void *arg)
 {
-	char fa_str[10][50];
-	struct ether_addr *j;
-	unsigned int i, k;
+	const struct timespec drain_ts = {
+		.tv_sec = 0,
+		.tv_nsec = PROBE_LOG_DRAIN_MS * 1000000L,
+	};
+	unsigned int drains = 0;
+	int cancel_state;
 
 
-	*fwdaddrs = calloc(10, ETH_ALEN);
-	if (*fwdaddrs == NULL)
-		return GET_PROG_OPT_FWDADDRS_BAD;
+	while (true) {
+		nanosleep(&drain_ts, NULL);
 
-	memset(fa_str, 0, sizeof(fa_str));
+		/* not cancelled part way through a record or write */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
 
-	sscanf(fwdaddrs_str, "%s %s %s %s %s %s %s %s %s %s", fa_str[0],
-		fa_str[1], fa_str[2], fa_str[3], fa_str[4], fa_str[5],
-		fa_str[6], fa_str[7], fa_str[8], fa_str[9]);
+		drain_probe_log(false);
 
-	j = *fwdaddrs;
-	k = 0;
-	for (i = 0; i < 10; i++) {
-		if (enet_pton(fa_str[i], j) == ENET_PTON_GOOD) {
-			j++;
-			k++;
-		} else {
-			if (ether_hostton(fa_str[i], j) == 0) {
-				j++;
-				k++;
-			}
+		if (++drains == (PROBE_LOG_FLUSH_MS / PROBE_LOG_DRAIN_MS)) {
+			probelog_flush(&probe_log);
+			drains = 0;
 		}
+
+		pthread_setcancelstate(cancel_state, NULL);
 	}
 
-	*num_fwdaddrs = k;
+	return NULL;
+
+}
+
+
+/*
+ * Log each interface's probes, in sequence order, up to the first one
+ * whose outcome isn't known yet. final logs every one left, the
+ * unanswered as lost.
+ */
+void drain_probe_log(const bool final)
+{
+	struct probe_iface *pif;
+	struct seqtrack_entry entry;
+	struct timespec now_ts;
+	uint64_t now_ns, sent;
+	unsigned int i;
 
-	return GET_PROG_OPT_FWDADDRS_GOOD;
+
+	clock_gettime(CLOCK_REALTIME, &now_ts);
+	now_ns = ((uint64_t)now_ts.tv_sec * 1000000000ULL) + now_ts.tv_nsec;
+
+	for (i = 0; i < num_probe_ifaces; i++) {
+		pif = &probe_ifaces[i];
+
+		sent = atomic_load(&pif->probe_track.sent);
+
+		while (next_settled_probe(pif, &pif->log_cursor, sent, now_ns,
+			final, &entry, &pif->log_overruns))
+			probelog_write(&probe_log, i, entry.seq, entry.tx_ns,
+				entry.state == SEQTRACK_STATE_ANSWERED,
+				(int64_t)(entry.rx_ns - entry.tx_ns),
+				entry.rx_tag);
+	}
 
 }
 
 
 /*
- * Routine to perform the specified interface ioctl
+ * Move cursor on to the next of an interface's probes, in sequence order,
+ * if its outcome is known yet, and return it in entry. final settles every
+ * one left, the unanswered as lost. Probes whose slots were reused before
+ * the cursor got to them are counted in overruns.
  */
-enum DO_IFREQ_IOCTL do_ifreq_ioctl(const int ioctl_request,
-				   const char iface[IFNAMSIZ],
-				   struct ifreq *ifr)
+bool next_settled_probe(struct probe_iface *pif,
+			uint64_t *cursor,
+			const uint64_t sent,
+			const uint64_t now_ns,
+			const bool final,
+			struct seqtrack_entry *entry,
+			uint64_t *overruns)
 {
-	int sockfd;
-	int ioctlret;
-	int enable = 1;
+	const uint64_t timeout_ns = PROBE_LOSS_TIMEOUT_MS * 1000000ULL;
 
 
+	for (; *cursor < sent; (*cursor)++) {
+		if (!seqtrack_lookup(&pif->probe_track, (uint32_t)*cursor,
+			entry)) {
+			(*overruns)++;
+			continue;
+		}
 
-	sockfd = socket(AF_PACKET, SOCK_RAW, 0);
-	if (sockfd == -1)
-		return DO_IFREQ_IOCTL_BADSOCKET;
+		/* stay well clear of the transmitter reusing slots */
+		if ((entry->state != SEQTRACK_STATE_ANSWERED) && !final &&
+		    ((entry->tx_ns + timeout_ns) > now_ns) &&
+		    ((sent - *cursor) < (pif->probe_track.size / 2)))
+			return false;
 
-	
-	if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable)) < 0) {
-    	perror("setsockopt");
-    	exit(EXIT_FAILURE);
-	}	
+		(*cursor)++;
 
-	memset(ifr, 0, sizeof(struct ifreq));
+		return true;
+	}
 
-	strncpy(ifr->ifr_name, iface, IFNAMSIZ);
-	ifr->ifr_name[IFNAMSIZ-1] = 0;
+	return false;
 
-	ioctlret = ioctl(sockfd, ioctl_request, ifr);
+}
 
-	if (close(sockfd) == -1)
-		return DO_IFREQ_IOCTL_BADSOCKET;
 
-	if (ioctlret == -1)
-		return DO_IFREQ_IOCTL_BADIOCTL;
-	else
-		return DO_IFREQ_IOCTL_GOOD;
+/*
+ * Jitter and loss burst statistics thread. Like the probe log, they're
+ * added up from the seqtrack rings once each probe's outcome is known, in
+ * sequence order, so nothing is added to the tx and rx paths.
+ */
+void *quality_thread(void *arg)
+{
+	const struct timespec drain_ts = {
+		.tv_sec = 0,
+		.tv_nsec = QUALITY_DRAIN_MS * 1000000L,
+	};
+	int cancel_state;
+
+
+	while (true) {
+		nanosleep(&drain_ts, NULL);
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+		drain_quality(false);
+		pthread_setcancelstate(cancel_state, NULL);
+	}
+
+	return NULL;
+
+}
+
+
+/*
+ * Add each interface's settled probes to its jitter and loss burst
+ * statistics. final settles every one left, the unanswered as lost, and
+ * ends any burst of losses still going.
+ */
+void drain_quality(const bool final)
+{
+	struct probe_iface *pif;
+	struct seqtrack_entry entry;
+	struct timespec now_ts;
+	uint64_t now_ns, sent;
+	int64_t rtt_ns;
+	unsigned int i;
+
+
+	clock_gettime(CLOCK_REALTIME, &now_ts);
+	now_ns = ((uint64_t)now_ts.tv_sec * 1000000000ULL) + now_ts.tv_nsec;
+
+	pthread_mutex_lock(&quality_mutex);
+
+	for (i = 0; i < num_probe_ifaces; i++) {
+		pif = &probe_ifaces[i];
+
+		sent = atomic_load(&pif->probe_track.sent);
+
+		while (next_settled_probe(pif, &pif->quality_cursor, sent,
+			now_ns, final, &entry, &pif->quality_overruns)) {
+			/* as for the statistics segment */
+			rtt_ns = entry.rx_ns - entry.tx_ns;
+			if (rtt_ns < 0)
+				rtt_ns = 0;
+			quality_add(&pif->quality,
+				entry.state == SEQTRACK_STATE_ANSWERED,
+				rtt_ns);
+			quality_add(&pif->interval_quality,
+				entry.state == SEQTRACK_STATE_ANSWERED,
+				rtt_ns);
+		}
+
+		if (final)
+			quality_end(&pif->quality);
+	}
+
+	pthread_mutex_unlock(&quality_mutex);
+
+}
+
+
+/*
+ * Print an interface's jitter, round trip deviation and loss bursts, and
+ * the Gilbert-Elliott model of its losses
+ */
+void print_quality_stats(struct probe_iface *pif)
+{
+	const struct quality *q = &pif->quality;
+	const char *sep = " ";
+	uint64_t min, max;
+	double p, r;
+	unsigned int i;
+
+
+	if (q->answered > 0)
+		printf("jitter (RFC 3550) %.3f usec, round-trip mdev %.3f usec, "
+			"over %llu answered probes\n", q->jitter_ns / 1e3,
+			quality_mdev_ns(q) / 1e3,
+			(unsigned long long)q->answered);
+
+	if (q->bursts > 0) {
+		printf("%llu loss bursts, length avg/max = %.3f/%llu, "
+			"lengths", (unsigned long long)q->bursts,
+			(double)q->burst_lost / q->bursts,
+			(unsigned long long)q->max_burst);
+		for (i = 0; i < QUALITY_BURST_BUCKETS; i++) {
+			if (q->burst_hist[i] == 0)
+				continue;
+			min = quality_burst_bucket_min(i);
+			max = quality_burst_bucket_min(i + 1) - 1;
+			if (i == (QUALITY_BURST_BUCKETS - 1))
+				printf("%s%llu+ x%llu", sep,
+					(unsigned long long)min,
+					(unsigned long long)q->burst_hist[i]);
+			else if (min == max)
+				printf("%s%llu x%llu", sep,
+					(unsigned long long)min,
+					(unsigned long long)q->burst_hist[i]);
+			else
+				printf("%s%llu-%llu x%llu", sep,
+					(unsigned long long)min,
+					(unsigned long long)max,
+					(unsigned long long)q->burst_hist[i]);
+			sep = ", ";
+		}
+		putchar('\n');
+	}
+
+	if (quality_gilbert(q, &p, &r)) {
+		printf("Gilbert-Elliott p %.6f r %.6f", p, r);
+		if ((p > 0.0) && (r > 0.0))
+			printf(", mean runs %.3f answered, %.3f lost", 1.0 / p,
+				1.0 / r);
+		putchar('\n');
+	}
+
+	if (pif->quality_overruns > 0)
+		printf("%llu probes not counted in the jitter and loss bursts "
+			"before their slot was reused\n",
+			(unsigned long long)pif->quality_overruns);
+
+}
+
+
+/*
+ * Print the jitter, round trip deviation and loss bursts of the probes
+ * settled since the last report. A burst still going is counted once it
+ * ends.
+ */
+void print_interval_quality(struct probe_iface *pif,
+			    const uint64_t elapsed_ns)
+{
+	struct quality delta;
+	double p, r;
+
+
+	drain_quality(false);
+
+	pthread_mutex_lock(&quality_mutex);
+	delta = pif->interval_quality;
+	quality_next_interval(&pif->interval_quality);
+	pthread_mutex_unlock(&quality_mutex);
+
+	printf("[%.3f sec] %s: %llu answered, %llu lost in %llu bursts, "
+		"jitter %.3f usec, mdev %.3f usec", elapsed_ns / 1e9,
+		pif->parms.iface, (unsigned long long)delta.answered,
+		(unsigned long long)delta.lost,
+		(unsigned long long)delta.bursts, delta.jitter_ns / 1e3,
+		quality_mdev_ns(&delta) / 1e3);
+
+	if (quality_gilbert(&delta, &p, &r))
+		printf(", Gilbert-Elliott p %.6f r %.6f", p, r);
+
+	putchar('\n');
+
+}
+
+
+/*
+ * Print how much was logged, and whether any of it was lost
+ */
+void print_probe_log_stats(const struct program_parameters *prog_parms)
+{
+	uint64_t overruns = 0;
+	unsigned int i;
+
+
+	for (i = 0; i < num_probe_ifaces; i++)
+		overruns += probe_ifaces[i].log_overruns;
+
+	printf("probe log %s: %llu probes, %llu bytes",
+		prog_parms->probe_log_file,
+		(unsigned long long)probe_log.records,
+		(unsigned long long)probe_log.bytes);
+
+	if (overruns > 0)
+		printf(", %llu not logged before their slot was reused",
+			(unsigned long long)overruns);
+
+	if (probe_log.err != 0)
+		printf(", write failed: %s", strerror(probe_log.err));
+
+	putchar('\n');
+
+}
+
+
+/*
+ * Create the pcapng capture, with an interface description per probe
+ * interface, in the same order, and a capture ring for each tx thread and
+ * rx worker
+ */
+enum OPEN_CAPTURE open_capture(const struct program_parameters *prog_parms)
+{
+	const char *ifaces[IFACES_MAX];
+	struct probe_iface *pif;
+	unsigned int i, j, n = 0;
+
+
+	for (i = 0; i < num_probe_ifaces; i++) {
+		ifaces[i] = probe_ifaces[i].parms.iface;
+		n += 1 + probe_ifaces[i].parms.rx_workers;
+	}
+
+	capture_rings = calloc(n, sizeof(struct pcapng_ring));
+	if (capture_rings == NULL)
+		return OPEN_CAPTURE_BAD;
+
+	for (num_capture_rings = 0; num_capture_rings < n;
+	     num_capture_rings++) {
+		if (pcapng_ring_init(&capture_rings[num_capture_rings],
+			CAPTURE_RING_SZ) != PCAPNG_RING_INIT_GOOD) {
+			while (num_capture_rings > 0)
+				pcapng_ring_free(
+					&capture_rings[--num_capture_rings]);
+			errno = ENOMEM;
+			return OPEN_CAPTURE_BAD;
+		}
+	}
+
+	if (pcapng_open(&capture, prog_parms->capture_file, ifaces,
+		num_probe_ifaces) != PCAPNG_OPEN_GOOD) {
+		for (i = 0; i < num_capture_rings; i++)
+			pcapng_ring_free(&capture_rings[i]);
+		num_capture_rings = 0;
+		return OPEN_CAPTURE_BAD;
+	}
+
+	n = 0;
+	for (i = 0; i < num_probe_ifaces; i++) {
+		pif = &probe_ifaces[i];
+		pif->tx_thread_args.capture_ring = &capture_rings[n++];
+		for (j = 0; j < pif->parms.rx_workers; j++)
+			pif->rx_thread_args[j].capture_ring =
+				&capture_rings[n++];
+	}
+
+	capture_opened = true;
+
+	return OPEN_CAPTURE_GOOD;
+
+}
+
+
+/*
+ * Capture writer thread. The tx threads and rx workers only put frames in
+ * their own capture rings, so the file is never written from the tx and
+ * rx paths.
+ */
+void *capture_thread(void *arg)
+{
+	const struct timespec drain_ts = {
+		.tv_sec = 0,
+		.tv_nsec = CAPTURE_DRAIN_MS * 1000000L,
+	};
+	unsigned int drains = 0;
+	int cancel_state;
+
+
+	while (true) {
+		nanosleep(&drain_ts, NULL);
+
+		/* not cancelled part way through a frame or write */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+		drain_capture();
+
+		if (++drains == (CAPTURE_FLUSH_MS / CAPTURE_DRAIN_MS)) {
+			pcapng_flush(&capture);
+			drains = 0;
+		}
+
+		pthread_setcancelstate(cancel_state, NULL);
+	}
+
+	return NULL;
+
+}
+
+
+/*
+ * Move the frames in every capture ring into the capture
+ */
+void drain_capture(void)
+{
+	unsigned int i;
+
+
+	for (i = 0; i < num_capture_rings; i++)
+		pcapng_drain(&capture, &capture_rings[i]);
+
+}
+
+
+/*
+ * Write out what's left in the capture rings, once the tx threads and rx
+ * workers have stopped, and close the capture
+ */
+void close_capture(void)
+{
+	unsigned int i;
+
+
+	drain_capture();
+
+	pcapng_close(&capture);
+
+	for (i = 0; i < num_capture_rings; i++)
+		pcapng_ring_free(&capture_rings[i]);
+
+}
+
+
+/*
+ * Capture a received reply. The rx sockets are SOCK_DGRAM, so its
+ * Ethernet header is put back from what the kernel says of it.
+ */
+void capture_rxed_frame(struct pcapng_ring *capture_ring,
+			const struct probe_iface *pif,
+			const struct ether_addr *srcmac,
+			const uint64_t rx_ns,
+			const uint8_t *pkt_buf,
+			const unsigned int pkt_len)
+{
+	struct ether_header eth_hdr;
+
+
+	memcpy(eth_hdr.ether_dhost, &pif->parms.srcmac, ETH_ALEN);
+	memcpy(eth_hdr.ether_shost, srcmac, ETH_ALEN);
+	eth_hdr.ether_type = htons(ETHERTYPE_LOOPBACK);
+
+	pcapng_ring_put(capture_ring, pif - probe_ifaces, rx_ns, &eth_hdr,
+		ETH_HLEN, pkt_buf, pkt_len);
+
+}
+
+
+void print_capture_stats(const struct program_parameters *prog_parms)
+{
+	uint64_t dropped = 0;
+	unsigned int i;
+
+
+	for (i = 0; i < num_capture_rings; i++)
+		dropped += atomic_load(&capture_rings[i].dropped);
+
+	printf("capture %s: %llu frames, %llu bytes",
+		prog_parms->capture_file,
+		(unsigned long long)capture.frames,
+		(unsigned long long)capture.bytes);
+
+	if (dropped > 0)
+		printf(", %llu dropped with their ring full",
+			(unsigned long long)dropped);
+
+	if (capture.err != 0)
+		printf(", write failed: %s", strerror(capture.err));
+
+	putchar('\n');
+
+}
+
+
+/*
+ * Create the statistics segment, and publish a first, empty, snapshot
+ */
+enum OPEN_STATS_SHM open_stats_shm(const struct program_parameters
+					*prog_parms)
+{
+	struct statshm_iface *si;
+	struct timespec now_ts;
+	unsigned int i;
+
+
+	stats_snap = malloc(sizeof(struct statshm_stats));
+	if (stats_snap == NULL)
+		return OPEN_STATS_SHM_NOMEM;
+
+	memset(stats_snap, 0, sizeof(struct statshm_stats));
+
+	clock_gettime(CLOCK_REALTIME, &now_ts);
+	stats_snap->pid = getpid();
+	stats_snap->start_ns = ((uint64_t)now_ts.tv_sec * 1000000000ULL) +
+		now_ts.tv_nsec;
+	stats_snap->update_ns = stats_snap->start_ns;
+	stats_snap->interval_ns = prog_parms->interval_ns;
+	memcpy(stats_snap->dstmac, &prog_parms->dstmac, ETH_ALEN);
+	stats_snap->running = 1;
+
+	stats_snap->num_ifaces = num_probe_ifaces;
+	for (i = 0; i < num_probe_ifaces; i++) {
+		si = &stats_snap->ifaces[i];
+		memcpy(si->name, probe_ifaces[i].parms.iface, IFNAMSIZ);
+		hist_init(&si->rtt_ns);
+	}
+
+	switch (statshm_create(&stats_shm, prog_parms->stats_shm_name)) {
+	case STATSHM_CREATE_GOOD:
+		break;
+	case STATSHM_CREATE_BADNAME:
+		return OPEN_STATS_SHM_BADNAME;
+	case STATSHM_CREATE_BADSHM:
+	default:
+		return OPEN_STATS_SHM_BADSHM;
+	}
+
+	statshm_publish(&stats_shm, stats_snap);
+
+	stats_shm_opened = true;
+
+	return OPEN_STATS_SHM_GOOD;
+
+}
+
+
+/*
+ * Statistics publisher thread. Like the probe log, it works from the
+ * seqtrack rings and counters the tx and rx threads already keep, so
+ * publishing adds nothing to their paths.
+ */
+void *stats_thread(void *arg)
+{
+	const struct timespec publish_ts = {
+		.tv_sec = 0,
+		.tv_nsec = STATS_PUBLISH_MS * 1000000L,
+	};
+	int cancel_state;
+
+
+	while (true) {
+		nanosleep(&publish_ts, NULL);
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+		publish_stats(false);
+		pthread_setcancelstate(cancel_state, NULL);
+	}
+
+	return NULL;
+
+}
+
+
+/*
+ * Bring the snapshot up to date and publish it. final settles every probe
+ * left and marks the snapshot as the last.
+ */
+void publish_stats(const bool final)
+{
+	struct statshm_iface *si;
+	struct probe_iface *pif;
+	struct iface_counters counters;
+	struct seqtrack_entry entry;
+	struct timespec now_ts;
+	uint64_t now_ns, sent;
+	unsigned int i;
+
+
+	clock_gettime(CLOCK_REALTIME, &now_ts);
+	now_ns = ((uint64_t)now_ts.tv_sec * 1000000000ULL) + now_ts.tv_nsec;
+
+	/* before settling, so probes to newly added targets are counted */
+	if (prog_parms.mode == ECTPPING_MODE_DAEMON)
+		sync_stats_paths();
+
+	for (i = 0; i < num_probe_ifaces; i++) {
+		pif = &probe_ifaces[i];
+		si = &stats_snap->ifaces[i];
+
+		sent = atomic_load(&pif->probe_track.sent);
+
+		while (next_settled_probe(pif, &pif->stats_cursor, sent,
+			now_ns, final, &entry, &pif->stats_overruns))
+			add_settled_probe(i, &entry);
+
+		sample_rx_sockstats(pif);
+		get_iface_counters(pif, &counters);
+
+		si->txed = counters.txed;
+		si->rxed = counters.rxed;
+		si->corrupted = counters.corrupted;
+		si->rejected = counters.rejected;
+		si->rx_errors = counters.rx_errors;
+		si->rx_drops = counters.rx_drops;
+		si->tx_errors = counters.tx_errors;
+		si->duplicates = atomic_load_explicit(
+			&pif->probe_track.duplicates, memory_order_relaxed);
+		si->in_flight = seqtrack_in_flight(&pif->probe_track);
+		si->overruns = pif->stats_overruns;
+	}
+
+	stats_snap->update_ns = now_ns;
+	stats_snap->updates++;
+	stats_snap->running = !final;
+
+	statshm_publish(&stats_shm, stats_snap);
+
+}
+
+
+/*
+ * Count a settled probe against its interface, and its responder if it
+ * was answered
+ */
+void add_settled_probe(const unsigned int iface,
+		       const struct seqtrack_entry *entry)
+{
+	struct statshm_iface *si = &stats_snap->ifaces[iface];
+	struct statshm_path *path = NULL;
+	struct statshm_target *target;
+	uint8_t mac[ETH_ALEN];
+	int64_t rtt_ns;
+
+
+	/* in daemon mode, probes are tagged with their target's id */
+	if (stats_snap->num_paths > 0)
+		path = statshm_find_path(stats_snap, entry->tx_tag,
+			&stats_path_hint);
+
+	if (entry->state != SEQTRACK_STATE_ANSWERED) {
+		si->lost++;
+		if (path != NULL)
+			path->lost++;
+		return;
+	}
+
+	si->answered++;
+
+	/* a reply timestamped before its probe's send time counts as 0 */
+	rtt_ns = entry->rx_ns - entry->tx_ns;
+	if (rtt_ns < 0)
+		rtt_ns = 0;
+
+	hist_add(&si->rtt_ns, rtt_ns);
+
+	if (path != NULL) {
+		path->answered++;
+		path->rtt_sum_ns += rtt_ns;
+		if ((uint64_t)rtt_ns < path->rtt_min_ns)
+			path->rtt_min_ns = rtt_ns;
+		if ((uint64_t)rtt_ns > path->rtt_max_ns)
+			path->rtt_max_ns = rtt_ns;
+	}
+
+	probelog_mac_to_bytes(entry->rx_tag, mac);
+
+	target = statshm_find_target(stats_snap, mac, iface);
+	if (target == NULL) {
+		stats_snap->untracked_replies++;
+		return;
+	}
+
+	target->replies++;
+	target->rtt_sum_ns += rtt_ns;
+	if ((uint64_t)rtt_ns < target->rtt_min_ns)
+		target->rtt_min_ns = rtt_ns;
+	if ((uint64_t)rtt_ns > target->rtt_max_ns)
+		target->rtt_max_ns = rtt_ns;
+	target->last_rx_ns = entry->rx_ns;
+
+}
+
+
+/*
+ * Listen for metrics scrapes, served from the statistics segment
+ */
+enum OPEN_METRICS open_metrics(const struct program_parameters *prog_parms)
+{
+
+
+	metrics_snap = malloc(sizeof(struct statshm_stats));
+	if (metrics_snap == NULL)
+		return OPEN_METRICS_NOMEM;
+
+	statshm_attach_local(&metrics_reader, &stats_shm);
+
+	switch (metrics_listen(&metrics, prog_parms->metrics_addr)) {
+	case METRICS_LISTEN_GOOD:
+		break;
+	case METRICS_LISTEN_BADADDR:
+		return OPEN_METRICS_BADADDR;
+	case METRICS_LISTEN_BADSOCKET:
+	default:
+		return OPEN_METRICS_BADSOCKET;
+	}
+
+	metrics_opened = true;
+
+	return OPEN_METRICS_GOOD;
+
+}
+
+
+/*
+ * Metrics endpoint thread. A scrape only reads the statistics segment,
+ * like ectpstat, so it never holds up the publisher, let alone the tx
+ * and rx threads. It's only cancelled while waiting for a connection.
+ */
+void *metrics_thread(void *arg)
+{
+	const struct timespec retry_ts = {
+		.tv_sec = 0,
+		.tv_nsec = 100 * 1000000L,
+	};
+	int cancel_state;
+	int fd;
+
+
+	while (true) {
+		fd = metrics_accept(&metrics);
+		if (fd == -1) {
+			/* e.g. out of fds, so don't spin */
+			if ((errno != EINTR) && (errno != ECONNABORTED))
+				nanosleep(&retry_ts, NULL);
+			continue;
+		}
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+		metrics_serve(&metrics, fd, &metrics_reader, metrics_snap);
+		pthread_setcancelstate(cancel_state, NULL);
+	}
+
+	return NULL;
+
+}
+
+
+void print_metrics_stats(const struct program_parameters *prog_parms)
+{
+
+
+	printf("metrics %s: %llu requests, %llu failed\n",
+		prog_parms->metrics_addr,
+		(unsigned long long)metrics.requests,
+		(unsigned long long)metrics.errors);
+
+}
+
+
+/*
+ * Publish the first probe plan, with the command line's destination and
+ * route as its target if one was given, and listen on the control socket,
+ * replacing any socket left there by an earlier run. Only the socket's
+ * owner may connect.
+ */
+enum OPEN_DAEMON open_daemon(const struct program_parameters *prog_parms)
+{
+	struct probe_plan *plan;
+	struct ether_addr *hops;
+	unsigned int num_hops;
+	struct sockaddr_un sun;
+	struct stat st;
+	mode_t old_umask;
+	int saved_errno;
+	int ret;
+
+
+	plan = calloc(1, sizeof(struct probe_plan));
+	ctl_snap = malloc(sizeof(struct statshm_stats));
+	if ((plan == NULL) || (ctl_snap == NULL))
+		return OPEN_DAEMON_NOMEM;
+
+	plan->gen = 1;
+	plan->interval_ns = prog_parms->interval_ns;
+	plan->rate_pps = prog_parms->rate_pps;
+	plan->rate_burst = prog_parms->rate_burst;
+
+	if (prog_parms->dst_given) {
+		if (get_route_hops(prog_parms, &hops, &num_hops) !=
+			GET_ROUTE_HOPS_GOOD)
+			return OPEN_DAEMON_NOMEM;
+		/* longer routes were refused with the options */
+		plan->targets[0].id = ++last_target_id;
+		plan->targets[0].num_hops = num_hops;
+		memcpy(plan->targets[0].hops, hops, num_hops * ETH_ALEN);
+		plan->num_targets = 1;
+		free(hops);
+	}
+
+	atomic_store_explicit(&probe_plan, plan, memory_order_release);
+
+	statshm_attach_local(&ctl_reader, &stats_shm);
+
+	if ((*prog_parms->ctl_path == '\0') ||
+	    (strlen(prog_parms->ctl_path) >= sizeof(sun.sun_path)))
+		return OPEN_DAEMON_BADPATH;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, prog_parms->ctl_path);
+
+	if ((lstat(prog_parms->ctl_path, &st) == 0) && S_ISSOCK(st.st_mode))
+		unlink(prog_parms->ctl_path);
+
+	ctl_sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (ctl_sockfd == -1)
+		return OPEN_DAEMON_BADSOCKET;
+
+	/* still single threaded, so the umask can be borrowed */
+	old_umask = umask(0077);
+	ret = bind(ctl_sockfd, (struct sockaddr *)&sun, sizeof(sun));
+	umask(old_umask);
+
+	if ((ret == -1) || (listen(ctl_sockfd, DAEMON_CTL_CLIENTS_MAX) == -1)) {
+		saved_errno = errno;
+		close(ctl_sockfd);
+		ctl_sockfd = -1;
+		errno = saved_errno;
+		return OPEN_DAEMON_BADSOCKET;
+	}
+
+	ctl_opened = true;
+
+	return OPEN_DAEMON_GOOD;
+
+}
+
+
+/*
+ * Control socket thread. Commands only publish new probe plans, so the tx
+ * threads carry on probing while they're applied, and no sockets, sequence
+ * numbers or statistics are disturbed. A few clients are served at once,
+ * a line at a time. It's only cancelled while waiting for input.
+ */
+void *ctl_thread(void *arg)
+{
+	const struct timeval send_timeout = {
+		.tv_sec = 1,
+		.tv_usec = 0,
+	};
+	struct ctl_client clients[DAEMON_CTL_CLIENTS_MAX];
+	struct pollfd pfds[DAEMON_CTL_CLIENTS_MAX + 1];
+	unsigned int num_clients = 0;
+	struct ucred cred;
+	socklen_t cred_len;
+	int cancel_state;
+	unsigned int i;
+	int fd;
+
+
+	while (true) {
+		pfds[0].fd = ctl_sockfd;
+		pfds[0].events = (num_clients < DAEMON_CTL_CLIENTS_MAX) ?
+			POLLIN : 0;
+		for (i = 0; i < num_clients; i++) {
+			pfds[i + 1].fd = clients[i].fd;
+			pfds[i + 1].events = POLLIN;
+		}
+
+		/* wakes up now and then to free replaced plans */
+		if (poll(pfds, num_clients + 1, 1000) == -1)
+			continue;
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+		/* backwards, so a client that's gone can take the last's place */
+		for (i = num_clients; i > 0; i--) {
+			if (pfds[i].revents == 0)
+				continue;
+			if (!ctl_client_input(&clients[i - 1])) {
+				close(clients[i - 1].fd);
+				clients[i - 1] = clients[--num_clients];
+			}
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			fd = accept4(ctl_sockfd, NULL, NULL, SOCK_CLOEXEC);
+			if (fd != -1) {
+				setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+					&send_timeout, sizeof(send_timeout));
+				memset(&clients[num_clients], 0,
+					sizeof(struct ctl_client));
+				clients[num_clients].fd = fd;
+				cred_len = sizeof(cred);
+				if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred,
+					&cred_len) == 0)
+					clients[num_clients].uid = cred.uid;
+				else
+					clients[num_clients].uid = (uid_t)-1;
+				num_clients++;
+			}
+		}
+
+		reclaim_plans();
+
+		pthread_setcancelstate(cancel_state, NULL);
+	}
+
+	return NULL;
+
+}
+
+
+/*
+ * Run each complete command line a client has sent. false once the client
+ * has gone.
+ */
+bool ctl_client_input(struct ctl_client *client)
+{
+	char buf[DAEMON_CTL_LINE_MAX];
+	ssize_t len, i;
+
+
+	len = recv(client->fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (len == -1)
+		return (errno == EAGAIN) || (errno == EINTR);
+	if (len == 0)
+		return false;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] == '\n') {
+			if (client->discarding) {
+				ctl_reply(client, "error line too long");
+			} else {
+				client->line[client->line_len] = '\0';
+				ctl_command(client, client->line);
+			}
+			client->line_len = 0;
+			client->discarding = false;
+		} else if (client->line_len == (DAEMON_CTL_LINE_MAX - 1)) {
+			client->discarding = true;
+		} else if (!client->discarding) {
+			client->line[client->line_len++] = buf[i];
+		}
+	}
+
+	return true;
+
+}
+
+
+/*
+ * Run a command line. Each command is answered with "ok", perhaps with a
+ * result, after any lines of output, or with "error" and why.
+ */
+void ctl_command(struct ctl_client *client, char *line)
+{
+	char *args[DAEMON_HOPS_MAX + 2];
+	unsigned int num_args = 0;
+	char *saveptr, *tok;
+
+
+	for (tok = strtok_r(line, " \t\r", &saveptr); tok != NULL;
+	     tok = strtok_r(NULL, " \t\r", &saveptr)) {
+		if (num_args == (sizeof(args) / sizeof(args[0]))) {
+			ctl_reply(client, "error too many arguments");
+			return;
+		}
+		args[num_args++] = tok;
+	}
+
+	if (num_args == 0)
+		return;
+
+	if (strcmp(args[0], "add") == 0) {
+		ctl_add(client, &args[1], num_args - 1);
+	} else if (strcmp(args[0], "set") == 0) {
+		ctl_set(client, &args[1], num_args - 1);
+	} else if (strcmp(args[0], "remove") == 0) {
+		ctl_remove(client, &args[1], num_args - 1);
+	} else if (strcmp(args[0], "interval") == 0) {
+		ctl_interval(client, &args[1], num_args - 1);
+	} else if (strcmp(args[0], "rate") == 0) {
+		ctl_rate(client, &args[1], num_args - 1);
+	} else if (strcmp(args[0], "list") == 0) {
+		ctl_list(client);
+	} else if (strcmp(args[0], "stop") == 0) {
+		ctl_reply(client, "ok");
+		/* the other threads take SIGINT, as for ^C */
+		kill(getpid(), SIGINT);
+	} else if (strcmp(args[0], "help") == 0) {
+		ctl_reply(client, "add <dest> [<hop> ...]\tprobe <dest>, and "
+			"then each <hop>, and back");
+		ctl_reply(client, "set <id> <dest> [<hop> ...]\tchange a "
+			"target, keeping its statistics");
+		ctl_reply(client, "remove <id>");
+		ctl_reply(client, "interval <time>\tin ms unless suffixed");
+		ctl_reply(client, "rate <pps> [<burst>]\t0 for no limit");
+		ctl_reply(client, "list");
+		ctl_reply(client, "stop");
+		ctl_reply(client, "ok");
+	} else {
+		ctl_reply(client, "error unknown command %s, try help",
+			args[0]);
+	}
+
+}
+
+
+/*
+ * Send a line to a client. One that won't take it within the send
+ * timeout misses it.
+ */
+void ctl_reply(const struct ctl_client *client, const char *fmt, ...)
+{
+	char buf[DAEMON_CTL_LINE_MAX];
+	va_list ap;
+	size_t len;
+	ssize_t ret;
+	size_t sent = 0;
+
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+	va_end(ap);
+
+	len = strlen(buf);
+	buf[len++] = '\n';
+
+	while (sent < len) {
+		ret = send(client->fd, &buf[sent], len - sent, MSG_NOSIGNAL);
+		if ((ret == -1) && (errno == EINTR))
+			continue;
+		if (ret <= 0)
+			break;
+		sent += ret;
+	}
+
+}
+
+
+void ctl_add(struct ctl_client *client, char *args[],
+	     const unsigned int num_args)
+{
+	const struct probe_plan *cur = atomic_load_explicit(&probe_plan,
+		memory_order_relaxed);
+	struct daemon_target target;
+	struct probe_plan *plan;
+
+
+	if ((num_args == 0) || (num_args > DAEMON_HOPS_MAX)) {
+		ctl_reply(client, "error usage: add <dest> [<hop> ...], up to "
+			"%u addresses", DAEMON_HOPS_MAX);
+		return;
+	}
+
+	if (!parse_target_hops(args, num_args, &target)) {
+		ctl_reply(client, "error bad address");
+		return;
+	}
+
+	if (cur->num_targets == DAEMON_TARGETS_MAX) {
+		ctl_reply(client, "error already %u targets",
+			DAEMON_TARGETS_MAX);
+		return;
+	}
+
+	plan = copy_plan();
+	if (plan == NULL) {
+		ctl_reply(client, "error out of memory");
+		return;
+	}
+
+	target.id = ++last_target_id;
+	plan->targets[plan->num_targets++] = target;
+
+	publish_plan(plan);
+
+	ctl_reply(client, "ok %u", target.id);
+
+}
+
+
+void ctl_set(struct ctl_client *client, char *args[],
+	     const unsigned int num_args)
+{
+	const struct probe_plan *cur = atomic_load_explicit(&probe_plan,
+		memory_order_relaxed);
+	struct daemon_target target;
+	struct probe_plan *plan;
+	int idx;
+
+
+	if ((num_args < 2) || (num_args > (DAEMON_HOPS_MAX + 1))) {
+		ctl_reply(client, "error usage: set <id> <dest> [<hop> ...], "
+			"up to %u addresses", DAEMON_HOPS_MAX);
+		return;
+	}
+
+	idx = find_plan_target(cur, args[0]);
+	if (idx == -1) {
+		ctl_reply(client, "error no target %s", args[0]);
+		return;
+	}
+
+	if (!parse_target_hops(&args[1], num_args - 1, &target)) {
+		ctl_reply(client, "error bad address");
+		return;
+	}
+
+	plan = copy_plan();
+	if (plan == NULL) {
+		ctl_reply(client, "error out of memory");
+		return;
+	}
+
+	target.id = plan->targets[idx].id;
+	plan->targets[idx] = target;
+
+	publish_plan(plan);
+
+	ctl_reply(client, "ok");
+
+}
+
+
+void ctl_remove(struct ctl_client *client, char *args[],
+		const unsigned int num_args)
+{
+	const struct probe_plan *cur = atomic_load_explicit(&probe_plan,
+		memory_order_relaxed);
+	struct probe_plan *plan;
+	int idx;
+
+
+	if (num_args != 1) {
+		ctl_reply(client, "error usage: remove <id>");
+		return;
+	}
+
+	idx = find_plan_target(cur, args[0]);
+	if (idx == -1) {
+		ctl_reply(client, "error no target %s", args[0]);
+		return;
+	}
+
+	plan = copy_plan();
+	if (plan == NULL) {
+		ctl_reply(client, "error out of memory");
+		return;
+	}
+
+	plan->num_targets--;
+	memmove(&plan->targets[idx], &plan->targets[idx + 1],
+		(plan->num_targets - idx) * sizeof(struct daemon_target));
+
+	publish_plan(plan);
+
+	ctl_reply(client, "ok");
+
+}
+
+
+/*
+ * The same rule applies as to -I, only root may change the interval
+ */
+void ctl_interval(struct ctl_client *client, char *args[],
+		  const unsigned int num_args)
+{
+	struct probe_plan *plan;
+	uint64_t interval_ns;
+
+
+	if (num_args != 1) {
+		ctl_reply(client, "error usage: interval <time>");
+		return;
+	}
+
+	if (client->uid != 0) {
+		ctl_reply(client, "error only root may change the interval");
+		return;
+	}
+
+	if (!parse_time_ns(args[0], 1000000ULL, &interval_ns) ||
+	    (interval_ns == 0)) {
+		ctl_reply(client, "error bad interval %s", args[0]);
+		return;
+	}
+
+	plan = copy_plan();
+	if (plan == NULL) {
+		ctl_reply(client, "error out of memory");
+		return;
+	}
+
+	plan->interval_ns = interval_ns;
+
+	publish_plan(plan);
+
+	ctl_reply(client, "ok");
+
+}
+
+
+void ctl_rate(struct ctl_client *client, char *args[],
+	      const unsigned int num_args)
+{
+	struct probe_plan *plan;
+	unsigned long long rate_pps;
+	unsigned long burst = 0;
+	char *endptr;
+
+
+	if ((num_args < 1) || (num_args > 2)) {
+		ctl_reply(client, "error usage: rate <pps> [<burst>]");
+		return;
+	}
+
+	rate_pps = strtoull(args[0], &endptr, 10);
+	if ((*args[0] < '0') || (*args[0] > '9') || (*endptr != '\0')) {
+		ctl_reply(client, "error bad rate %s", args[0]);
+		return;
+	}
+
+	if (num_args == 2) {
+		burst = strtoul(args[1], &endptr, 10);
+		if ((*args[1] < '0') || (*args[1] > '9') ||
+		    (*endptr != '\0') || (burst == 0) || (burst > UINT_MAX)) {
+			ctl_reply(client, "error bad burst %s", args[1]);
+			return;
+		}
+	}
+
+	plan = copy_plan();
+	if (plan == NULL) {
+		ctl_reply(client, "error out of memory");
+		return;
+	}
+
+	plan->rate_pps = rate_pps;
+	if (burst > 0)
+		plan->rate_burst = burst;
+
+	publish_plan(plan);
+
+	ctl_reply(client, "ok");
+
+}
+
+
+/*
+ * List the targets, with their statistics as last published, then the
+ * interval and rate
+ */
+void ctl_list(struct ctl_client *client)
+{
+	const struct probe_plan *plan = atomic_load_explicit(&probe_plan,
+		memory_order_relaxed);
+	const struct daemon_target *target;
+	const struct statshm_path *path;
+	struct statshm_path new_path;
+	char buf[DAEMON_CTL_LINE_MAX];
+	bool have_stats;
+	unsigned int i, hint = 0;
+
+
+	have_stats = (statshm_read(&ctl_reader, ctl_snap) ==
+		STATSHM_READ_GOOD);
+
+	for (i = 0; i < plan->num_targets; i++) {
+		target = &plan->targets[i];
+
+		path = NULL;
+		if (have_stats)
+			path = statshm_find_path(ctl_snap, target->id, &hint);
+
+		/* added since, or a route changed since */
+		if ((path == NULL) || (path->num_hops != target->num_hops) ||
+		    (memcmp(path->hops, target->hops,
+			target->num_hops * ETH_ALEN) != 0)) {
+			memset(&new_path, 0, sizeof(new_path));
+			if (path != NULL)
+				new_path = *path;
+			new_path.id = target->id;
+			new_path.num_hops = target->num_hops;
+			memcpy(new_path.hops, target->hops,
+				target->num_hops * ETH_ALEN);
+			path = &new_path;
+		}
+
+		format_path(path, buf, sizeof(buf));
+		ctl_reply(client, "%s", buf);
+	}
+
+	if (plan->rate_pps > 0)
+		ctl_reply(client, "interval %.6f sec, rate %llu pps, burst %u",
+			plan->interval_ns / 1e9,
+			(unsigned long long)plan->rate_pps, plan->rate_burst);
+	else
+		ctl_reply(client, "interval %.6f sec, rate unlimited",
+			plan->interval_ns / 1e9);
+
+	ctl_reply(client, "ok");
+
+}
+
+
+/*
+ * A destination and route, each a MAC address or an /etc/ethers hostname
+ */
+bool parse_target_hops(char *args[],
+		       const unsigned int num_args,
+		       struct daemon_target *target)
+{
+	unsigned int i;
+
+
+	memset(target, 0, sizeof(struct daemon_target));
+
+	for (i = 0; i < num_args; i++) {
+		if ((enet_pton(args[i], &target->hops[i]) != ENET_PTON_GOOD) &&
+		    (ether_hostton(args[i], &target->hops[i]) != 0))
+			return false;
+	}
+
+	target->num_hops = num_args;
+
+	return true;
+
+}
+
+
+/*
+ * Index of the target with the id in the plan, or -1
+ */
+int find_plan_target(const struct probe_plan *plan, const char *id_str)
+{
+	unsigned long id;
+	char *endptr;
+	unsigned int i;
+
+
+	id = strtoul(id_str, &endptr, 10);
+	if ((*id_str < '0') || (*id_str > '9') || (*endptr != '\0'))
+		return -1;
+
+	for (i = 0; i < plan->num_targets; i++) {
+		if (plan->targets[i].id == id)
+			return i;
+	}
+
+	return -1;
+
+}
+
+
+/*
+ * A copy of the current plan to change and publish. Only the control
+ * thread changes the plan.
+ */
+struct probe_plan *copy_plan(void)
+{
+	struct probe_plan *plan;
+
+
+	plan = malloc(sizeof(struct probe_plan));
+	if (plan == NULL)
+		return NULL;
+
+	memcpy(plan, atomic_load_explicit(&probe_plan, memory_order_relaxed),
+		sizeof(struct probe_plan));
+
+	return plan;
+
+}
+
+
+/*
+ * Replace the current plan, which is retired until nothing can still be
+ * using it
+ */
+void publish_plan(struct probe_plan *plan)
+{
+	struct probe_plan *old;
+
+
+	old = atomic_load_explicit(&probe_plan, memory_order_relaxed);
+
+	plan->gen = old->gen + 1;
+	plan->retired_next = NULL;
+
+	atomic_store_explicit(&probe_plan, plan, memory_order_release);
+
+	old->retired_next = retired_plans;
+	retired_plans = old;
+
+	reclaim_plans();
+
+}
+
+
+/*
+ * Free the retired plans older than any the tx threads and statistics
+ * publisher may still be using. Each moves on to a new plan before saying
+ * so, so one older than all their generations is out of reach.
+ */
+void reclaim_plans(void)
+{
+	struct probe_plan **pp = &retired_plans;
+	struct probe_plan *plan;
+	uint64_t min_gen, gen;
+	unsigned int i;
+
+
+	min_gen = atomic_load_explicit(&stats_plan_gen, memory_order_acquire);
+
+	for (i = 0; i < num_probe_ifaces; i++) {
+		gen = atomic_load_explicit(&probe_ifaces[i].plan_gen,
+			memory_order_acquire);
+		if (gen < min_gen)
+			min_gen = gen;
+	}
+
+	while (*pp != NULL) {
+		plan = *pp;
+		if (plan->gen < min_gen) {
+			*pp = plan->retired_next;
+			free(plan);
+		} else {
+			pp = &plan->retired_next;
+		}
+	}
+
+}
+
+
+/*
+ * Send a probe to each of the daemon's targets, one after the other, as
+ * in hop by hop mode. A new plan's interval and rate are taken up first,
+ * so a new interval starts after the current one.
+ */
+void tx_probe_daemon(struct tx_thread_arguments *tx_args,
+		     uint8_t tx_frame_buf[],
+		     const unsigned int tx_frame_buf_sz,
+		     struct ectpping_payload *eping_payload,
+		     const uint64_t launch_ns)
+{
+	struct tx_thread_arguments target_args = *tx_args;
+	struct probe_iface *pif = tx_args->pif;
+	const struct daemon_target *target;
+	const struct probe_plan *plan;
+	unsigned int i;
+
+
+	plan = atomic_load_explicit(&probe_plan, memory_order_acquire);
+
+	if (plan->gen != atomic_load_explicit(&pif->plan_gen,
+		memory_order_relaxed)) {
+		pacer_set_interval(&pif->pacer, plan->interval_ns);
+		rategov_set_rate(&pif->rategov, plan->rate_pps,
+			plan->rate_burst);
+		atomic_store_explicit(&pif->plan_gen, plan->gen,
+			memory_order_release);
+	}
+
+	if (plan->num_targets == 0)
+		return;
+
+	rategov_wait(&pif->rategov_share, plan->num_targets);
+
+	target_args.prog_parms = &pif->target_parms;
+
+	for (i = 0; i < plan->num_targets; i++) {
+		target = &plan->targets[i];
+		set_prefix_route(&pif->target_parms, target->hops,
+			target->num_hops, pif->target_fwdaddrs);
+		eping_payload->path_id = target->id;
+		tx_probe(&target_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, launch_ns);
+	}
+
+}
+
+
+/*
+ * Bring the statistics' paths into line with the probe plan, keeping the
+ * counts of the targets still in it. The unsettled probes of a removed
+ * target are dropped along with it.
+ */
+void sync_stats_paths(void)
+{
+	struct statshm_path paths[STATSHM_PATHS_MAX];
+	const struct daemon_target *target;
+	const struct probe_plan *plan;
+	struct statshm_path *path;
+	unsigned int i, hint = 0;
+
+
+	plan = atomic_load_explicit(&probe_plan, memory_order_acquire);
+
+	if (plan->gen == atomic_load_explicit(&stats_plan_gen,
+		memory_order_relaxed))
+		return;
+
+	for (i = 0; i < plan->num_targets; i++) {
+		target = &plan->targets[i];
+
+		path = statshm_find_path(stats_snap, target->id, &hint);
+		if (path != NULL) {
+			paths[i] = *path;
+		} else {
+			memset(&paths[i], 0, sizeof(struct statshm_path));
+			paths[i].id = target->id;
+			paths[i].rtt_min_ns = UINT64_MAX;
+		}
+
+		memset(paths[i].hops, 0, sizeof(paths[i].hops));
+		memcpy(paths[i].hops, target->hops,
+			target->num_hops * ETH_ALEN);
+		paths[i].num_hops = target->num_hops;
+	}
+
+	memcpy(stats_snap->paths, paths,
+		plan->num_targets * sizeof(struct statshm_path));
+	stats_snap->num_paths = plan->num_targets;
+	stats_snap->interval_ns = plan->interval_ns;
+
+	atomic_store_explicit(&stats_plan_gen, plan->gen,
+		memory_order_release);
+
+}
+
+
+/*
+ * A target's route and statistics, on one line
+ */
+void format_path(const struct statshm_path *path,
+		 char *buf,
+		 const size_t buf_sz)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+	const uint64_t settled = path->answered + path->lost;
+	size_t len;
+	unsigned int i;
+
+
+	len = snprintf(buf, buf_sz, "target %u", path->id);
+
+	for (i = 0; (i < path->num_hops) && (len < buf_sz); i++) {
+		enet_ntop((const struct ether_addr *)path->hops[i],
+			ENET_NTOP_UNIX, macpbuf, ENET_PADDR_MAXSZ);
+		len += snprintf(&buf[len], buf_sz - len, "%s%s",
+			(i == 0) ? " " : ((i == 1) ? " via " : ", "), macpbuf);
+	}
+
+	if (len >= buf_sz)
+		return;
+
+	len += snprintf(&buf[len], buf_sz - len, ": %llu answered, %llu lost",
+		(unsigned long long)path->answered,
+		(unsigned long long)path->lost);
+
+	if ((settled > 0) && (len < buf_sz))
+		len += snprintf(&buf[len], buf_sz - len, " (%.3f%%)",
+			(path->lost * 100.0) / settled);
+
+	if ((path->answered > 0) && (len < buf_sz))
+		snprintf(&buf[len], buf_sz - len, ", round-trip (usec) "
+			"min/avg/max = %.3f/%.3f/%.3f",
+			path->rtt_min_ns / 1e3,
+			(path->rtt_sum_ns / path->answered) / 1e3,
+			path->rtt_max_ns / 1e3);
+
+}
+
+
+void print_daemon_stats(void)
+{
+	char buf[DAEMON_CTL_LINE_MAX];
+	unsigned int i;
+
+
+	for (i = 0; i < stats_snap->num_paths; i++) {
+		format_path(&stats_snap->paths[i], buf, sizeof(buf));
+		printf("%s\n", buf);
+	}
+
+}
+
+
+/*
+ * Print how the replies were spread across the rx workers
+ */
+void print_rx_worker_stats(const struct program_parameters *prog_parms,
+			   const struct rx_stats shards[],
+			   const unsigned int num_shards)
+{
+	unsigned int i;
+
+
+	printf("%u rx workers (%s fanout), replies per worker ", num_shards,
+		fanout_name(prog_parms->rx_fanout));
+
+	for (i = 0; i < num_shards; i++)
+		printf("%s%u", (i > 0) ? "/" : "",
+			shards[i].rxed_pkts + shards[i].corrupted_pkts);
+
+	putchar('\n');
+
+}
+
+
+/*
+ * Print what the transmit rate governor did, if it was enabled
+ */
+void print_rategov_stats(const struct rategov_share *share)
+{
+	uint64_t delayed, wait_ns;
+
+
+	if (!rategov_limited(share->gov))
+		return;
+
+	delayed = atomic_load(&share->delayed);
+	wait_ns = atomic_load(&share->wait_ns);
+
+	printf("rate governor %llu pps (share %llu pps), burst %u, "
+		"%llu transmits delayed, %llu.%06llu sec total wait\n",
+		(unsigned long long)share->gov->rate_pps,
+		(unsigned long long)rategov_share_rate(share),
+		share->gov->burst,
+		(unsigned long long)delayed,
+		(unsigned long long)(wait_ns / 1000000000ULL),
+		(unsigned long long)((wait_ns % 1000000000ULL) / 1000));
+
+}
+
+
+/*
+ * Print the packet train capacity estimates aggregated across trains
+ */
+void print_train_stats(const struct dispersion_agg *agg)
+{
+	struct dispersion_summary capacity, adr;
+
+
+	printf("%u trains, %u with usable dispersion", agg->trains,
+		agg->valid);
+	if (agg->kept < agg->valid)
+		printf(", summarised from a sample of %u", agg->kept);
+	putchar('\n');
+
+	if (!dispersion_agg_capacity(agg, &capacity) ||
+	    !dispersion_agg_adr(agg, &adr))
+		return;
+
+	printf("bottleneck capacity (Mbit/s) median/q1/q3 = "
+		"%.3f/%.3f/%.3f\n",
+		capacity.median / 1e6, capacity.q1 / 1e6, capacity.q3 / 1e6);
+
+	printf("available capacity (Mbit/s) median/q1/q3 = "
+		"%.3f/%.3f/%.3f\n",
+		adr.median / 1e6, adr.q1 / 1e6, adr.q3 / 1e6);
+
+}
+
+
+/*
+ * Print how closely the transmit schedule was achieved. With SO_TXTIME
+ * that's when frames were queued for the kernel to send at their launch
+ * times.
+ */
+void print_pacer_stats(const struct pacer *pacer, const bool txtime)
+{
+	const char *what = txtime ? "queue" : "send";
+
+
+	if (pacer->intervals == 0)
+		return;
+
+	printf("tx pacing (%s) interval %llu.%09llu sec, "
+		"inter-%s min/avg/max/mdev = %.3f/%.3f/%.3f/%.3f usec\n",
+		pacer_mode_name(pacer->mode),
+		(unsigned long long)(pacer->interval_ns / 1000000000ULL),
+		(unsigned long long)(pacer->interval_ns % 1000000000ULL),
+		what, pacer->min_ivl_ns / 1000.0,
+		pacer->mean_ivl_ns / 1000.0,
+		pacer->max_ivl_ns / 1000.0,
+		pacer_ivl_mdev_ns(pacer) / 1000.0);
+
+	printf("tx pacing lateness avg/max = %.3f/%.3f usec, "
+		"%llu deadlines skipped\n",
+		(pacer->sum_late_ns / (pacer->intervals + 1.0)) / 1000.0,
+		pacer->max_late_ns / 1000.0,
+		(unsigned long long)pacer->skipped);
+
+}
+
+
+/*
+ * Print what happened to frames given launch times with SO_TXTIME
+ */
+void print_txtime_stats(const struct txtime_stats *stats,
+			const uint64_t lead_ns)
+{
+
+
+	printf("txtime lead %.3f usec: %llu frames queued, %llu queued late, "
+		"%llu send errors\n",
+		lead_ns / 1000.0,
+		(unsigned long long)stats->queued,
+		(unsigned long long)stats->queued_late,
+		(unsigned long long)stats->send_errors);
+
+	printf("txtime kernel reports: %llu deadlines missed, "
+		"%llu invalid launch times\n",
+		(unsigned long long)stats->missed,
+		(unsigned long long)stats->invalid);
+
+}
+
+
+/*
+ * Prepare the filler carried after the ectpping payload. It's sized for the
+ * largest frame the interface allows, and trimmed to the frame size when
+ * each frame is built, so it's only filled in once. Without a pattern the
+ * filler is the build information, and frames are padded with zeros.
+ */
+enum BUILD_ECTP_USER_DATA build_ectp_user_data(struct program_parameters
+						   *prog_parms,
+					       const uint8_t build_info[],
+					       const unsigned int
+						   build_info_size)
+{
+	const unsigned int max_size = prog_parms->mtu + ETH_HLEN;
+
+
+	prog_parms->ectp_user_data = calloc(1, max_size);
+	if (prog_parms->ectp_user_data == NULL)
+		return BUILD_ECTP_USER_DATA_NOMEM;
+
+	if (prog_parms->fill) {
+		pattern_fill(prog_parms->ectp_user_data, max_size,
+			prog_parms->fill_pattern);
+		prog_parms->ectp_user_data_size = max_size;
+	} else {
+		prog_parms->ectp_user_data_size =
+			(build_info_size < max_size) ? build_info_size :
+			max_size;
+		memcpy(prog_parms->ectp_user_data, build_info,
+			prog_parms->ectp_user_data_size);
+	}
+
+	return BUILD_ECTP_USER_DATA_GOOD;
+
+}
+
+
+/*
+ * Routine to collect program parameters from various sources e.g. cli
+ * options, .rc file
+ */
+enum GET_PROG_PARMS get_prog_parms(const int argc,
+				   char *argv[],
+				   struct program_parameters *prog_parms)
+{
+	struct program_options prog_opts;
+	int erropt;
+	const char *errmsg;
+	enum PROCESS_PROG_OPTS process_prog_opts_ret;
+
+	set_default_prog_opts(&prog_opts);
+
+	get_cli_opts_eh(get_cli_opts(argc, argv, &prog_opts, &erropt), &erropt);
+
+	process_prog_opts_ret = process_prog_opts(&prog_opts, prog_parms,
+			&errmsg);
+	process_prog_opts_eh(process_prog_opts_ret, errmsg);
+
+	return GET_PROG_PARMS_GOOD;
+
+}
+
+
+/*
+ * Set some reasonable program option defaults
+ */ 
+void set_default_prog_opts(struct program_options *prog_opts)
+{
+	char *default_iface = "eth0";
+
+
+	memset(prog_opts, 0, sizeof(struct program_options));
+
+	/* default interface, unless any are given */
+	strncpy(prog_opts->ifaces[0], default_iface, IFNAMSIZ);
+	prog_opts->ifaces[0][IFNAMSIZ-1] = '\0';
+
+	prog_opts->num_ifaces = 0;
+
+	prog_opts->dst_type = mcast;
+
+	prog_opts->no_resolve = false;
+
+	prog_opts->zero_pkt_output = false;
+
+	prog_opts->interval_ns = 1000000000ULL;
+
+	prog_opts->pacing_mode = PACER_MODE_SLEEP;
+
+	prog_opts->pacing_spin_ns = 0;
+
+	prog_opts->txtime = false;
+
+	prog_opts->txtime_lead_ns = 0;
+
+	prog_opts->train_len = 0;
+
+	prog_opts->train_frame_size = 0;
+
+	prog_opts->frame_size = 0;
+
+	prog_opts->fill = false;
+
+	prog_opts->fill_pattern = PATTERN_ZEROS;
+
+	prog_opts->crc = false;
+
+	prog_opts->mode = ECTPPING_MODE_PING;
+
+	prog_opts->tput_sizes_str = TPUT_DEFAULT_SIZES;
+
+	prog_opts->tput_trial_ns = 5000000000ULL;
+
+	prog_opts->tput_loss_pct = 0.0;
+
+	prog_opts->matrix_format = MATRIX_FORMAT_TEXT;
+
+	prog_opts->rx_workers = 1;
+
+	prog_opts->rx_fanout = PACKET_FANOUT_CPU;
+
+	prog_opts->rt = false;
+
+	prog_opts->tx_cpus_set = false;
+
+	prog_opts->rx_cpus_set = false;
+
+	prog_opts->rx_spin_ns = 0;
+
+	prog_opts->busy_poll_us = 0;
+
+	prog_opts->report_interval_ns = 0;
+
+	prog_opts->fwdaddrs_str = NULL;
+
+	prog_opts->fwdaddrs_file = NULL;
+
+	prog_opts->probe_log_file = NULL;
+
+	prog_opts->capture_file = NULL;
+
+	prog_opts->stats_shm_name = NULL;
+	prog_opts->metrics_addr = NULL;
+
+	prog_opts->ctl_path = NULL;
+
+	prog_opts->rate_pps = 0;
+
+	prog_opts->rate_burst = 1;
+
+}
+
+
+/*
+ * Routine to collect program options from *argv[];
+ */
+enum GET_CLI_OPTS get_cli_opts(const int argc,
+			       char *argv[],
+			       struct program_options *prog_opts,
+			       int *erropt)
+{
+	int opt;
+	char *endptr;
+	unsigned long ul;
+
+
+	opterr = 0;
+
+	while ((opt = getopt(argc, argv, ":i:bnzI:P:T:t:s:p:cm:S:D:L:F:W:Y:R:a:O:w:C:M:E:U:f:H:r:B:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			if (prog_opts->num_ifaces == IFACES_MAX) {
+				*erropt = 'i';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			strncpy(prog_opts->ifaces[prog_opts->num_ifaces], optarg,
+				IFNAMSIZ);
+			prog_opts->ifaces[prog_opts->num_ifaces][IFNAMSIZ-1] = 0;
+			prog_opts->num_ifaces++;
+			break;
+		case 'b':
+			prog_opts->dst_type = bcast;
+			break;
+		case 'n':
+			prog_opts->no_resolve = true;
+			break;
+		case 'z':
+			prog_opts->zero_pkt_output = true;
+			break;
+		case 'I':
+			if (getuid() != 0) {
+				*erropt = 'I';
+				return GET_CLI_OPTS_BAD_NEED_UID_0;
+			}
+			if (!parse_time_ns(optarg, 1000000ULL,
+				&prog_opts->interval_ns) ||
+				(prog_opts->interval_ns == 0)) {
+				*erropt = 'I';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'P':
+			if (!parse_pacing_mode(optarg, &prog_opts->pacing_mode,
+				&prog_opts->pacing_spin_ns)) {
+				*erropt = 'P';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'T':
+			if (!parse_time_ns(optarg, 1000ULL,
+				&prog_opts->txtime_lead_ns)) {
+				*erropt = 'T';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			prog_opts->txtime = true;
+			break;
+		case 't':
+			if (!parse_train_opt(optarg, &prog_opts->train_len,
+				&prog_opts->train_frame_size)) {
+				*erropt = 't';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 's':
+			if ((*optarg < '0') || (*optarg > '9')) {
+				*erropt = 's';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			ul = strtoul(optarg, &endptr, 10);
+			if ((*endptr != '\0') || (ul < ETH_ZLEN) ||
+			    (ul > UINT_MAX)) {
+				*erropt = 's';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			prog_opts->frame_size = ul;
+			break;
+		case 'p':
+			if (!pattern_parse(optarg,
+				&prog_opts->fill_pattern)) {
+				*erropt = 'p';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			prog_opts->fill = true;
+			break;
+		case 'c':
+			prog_opts->crc = true;
+			break;
+		case 'm':
+			if (!parse_mode(optarg, &prog_opts->mode)) {
+				*erropt = 'm';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			/* sends at arbitrary rates, so same rule as -I */
+			if ((prog_opts->mode == ECTPPING_MODE_THROUGHPUT) &&
+			    (getuid() != 0)) {
+				*erropt = 'm';
+				return GET_CLI_OPTS_BAD_NEED_UID_0;
+			}
+			break;
+		case 'S':
+			prog_opts->tput_sizes_str = optarg;
+			break;
+		case 'D':
+			if (!parse_time_ns(optarg, 1000000000ULL,
+				&prog_opts->tput_trial_ns) ||
+			    (prog_opts->tput_trial_ns == 0)) {
+				*erropt = 'D';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'F':
+			if (!parse_matrix_format(optarg,
+				&prog_opts->matrix_format)) {
+				*erropt = 'F';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'W':
+			if (!parse_rx_workers(optarg, &prog_opts->rx_workers,
+				&prog_opts->rx_fanout)) {
+				*erropt = 'W';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'Y':
+			if (!parse_rx_spin(optarg, &prog_opts->rx_spin_ns,
+				&prog_opts->busy_poll_us)) {
+				*erropt = 'Y';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'O':
+			if (!parse_time_ns(optarg, 1000000000ULL,
+				&prog_opts->report_interval_ns) ||
+			    (prog_opts->report_interval_ns == 0)) {
+				*erropt = 'O';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'R':
+			if (!parse_rt_prio(optarg, &prog_opts->rt_prio)) {
+				*erropt = 'R';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			prog_opts->rt = true;
+			break;
+		case 'a':
+			if (!parse_thread_cpus(optarg, &prog_opts->tx_cpus,
+				&prog_opts->rx_cpus)) {
+				*erropt = 'a';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			prog_opts->tx_cpus_set = true;
+			prog_opts->rx_cpus_set = true;
+			break;
+		case 'L':
+			prog_opts->tput_loss_pct = strtod(optarg, &endptr);
+			if ((*optarg == '\0') || (*endptr != '\0') ||
+			    (prog_opts->tput_loss_pct < 0.0) ||
+			    (prog_opts->tput_loss_pct > 100.0)) {
+				*erropt = 'L';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'f':
+			prog_opts->fwdaddrs_str = optarg;
+			break;
+		case 'H':
+			prog_opts->fwdaddrs_file = optarg;
+			break;
+		case 'w':
+			prog_opts->probe_log_file = optarg;
+			break;
+		case 'C':
+			prog_opts->capture_file = optarg;
+			break;
+		case 'M':
+			prog_opts->stats_shm_name = optarg;
+			break;
+		case 'E':
+			prog_opts->metrics_addr = optarg;
+			break;
+		case 'U':
+			prog_opts->ctl_path = optarg;
+			break;
+		case 'r':
+			prog_opts->rate_pps = strtoull(optarg, &endptr, 10);
+			if ((*optarg == '\0') || (*endptr != '\0')) {
+				*erropt = 'r';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case 'B':
+			prog_opts->rate_burst = strtoul(optarg, &endptr, 10);
+			if ((*optarg == '\0') || (*endptr != '\0') ||
+			    (prog_opts->rate_burst == 0)) {
+				*erropt = 'B';
+				return GET_CLI_OPTS_BAD_OPT_ARG;
+			}
+			break;
+		case '?':
+			*erropt = optopt;
+			return GET_CLI_OPTS_BAD_UNKNOWN_OPT;
+			break;
+		case ':':
+			*erropt = optopt;
+			return GET_CLI_OPTS_BAD_MISSING_ARG;
+			break;
+		case 'h':
+			return GET_CLI_OPTS_BAD_HELP;
+		}
+	}
+
+	/* first non-opt is assumed to be dest mac addr */
+	if (optind < argc) { 
+		prog_opts->dst_type = ucast;
+		prog_opts->uc_dst_str = argv[optind];
+	}
+
+	return GET_CLI_OPTS_GOOD;
+
+}
+
+
+/*
+ * Error handler for get_cli_opts()
+ *
+ */
+enum GET_CLI_OPTS get_cli_opts_eh(const enum GET_CLI_OPTS ret,
+				  int *erropt)
+{
+
+
+	switch (ret) {
+	case GET_CLI_OPTS_BAD_UNKNOWN_OPT:
+		fprintf(stderr, "-%c: Unknown option\n", *erropt);	
+		exit(EXIT_FAILURE);
+		break;
+	case GET_CLI_OPTS_BAD_MISSING_ARG:
+		fprintf(stderr, "-%c: Missing option argument\n", *erropt);	
+		exit(EXIT_FAILURE);
+		break;
+	case GET_CLI_OPTS_BAD_NEED_UID_0:
+		fprintf(stderr, "-%c: Need to be root user (getuid() == 0) to "
+				"use this option\n",
+			*erropt);	
+		exit(EXIT_FAILURE);
+		break;
+	case GET_CLI_OPTS_BAD_OPT_ARG:
+		fprintf(stderr, "-%c: Bad option argument\n", *erropt);
+		exit(EXIT_FAILURE);
+		break;
+	case GET_CLI_OPTS_BAD_HELP:
+		print_help();
+		exit(EXIT_FAILURE);
+		break;
+	default:
+		return ret;
+	}
+
+}
+
+/*
+ * Convert a time string such as "250us" into nanoseconds. Supported
+ * suffixes are s, ms, us and ns. Without a suffix, the value is in units of
+ * default_unit_ns.
+ */
+bool parse_time_ns(const char *str,
+		   const uint64_t default_unit_ns,
+		   uint64_t *ns)
+{
+	unsigned long long val;
+	uint64_t unit_ns;
+	char *endptr;
+
+
+	if ((*str < '0') || (*str > '9'))
+		return false;
+
+	val = strtoull(str, &endptr, 10);
+
+	if (*endptr == '\0')
+		unit_ns = default_unit_ns;
+	else if (strcmp(endptr, "s") == 0)
+		unit_ns = 1000000000ULL;
+	else if (strcmp(endptr, "ms") == 0)
+		unit_ns = 1000000ULL;
+	else if (strcmp(endptr, "us") == 0)
+		unit_ns = 1000ULL;
+	else if (strcmp(endptr, "ns") == 0)
+		unit_ns = 1ULL;
+	else
+		return false;
+
+	if ((unit_ns != 0) && (val > (UINT64_MAX / unit_ns)))
+		return false;
+
+	*ns = val * unit_ns;
+
+	return true;
+
+}
+
+
+/*
+ * Convert a pacing mode string, "sleep", "spin", or "hybrid" with an
+ * optional ":<spin time>" suffix
+ */
+bool parse_pacing_mode(const char *str,
+		       enum PACER_MODE *mode,
+		       uint64_t *spin_ns)
+{
+	const char hybrid[] = "hybrid";
+
+
+	*spin_ns = 0;
+
+	if (strcmp(str, "sleep") == 0) {
+		*mode = PACER_MODE_SLEEP;
+	} else if (strcmp(str, "spin") == 0) {
+		*mode = PACER_MODE_SPIN;
+	} else if (strncmp(str, hybrid, sizeof(hybrid) - 1) == 0) {
+		*mode = PACER_MODE_HYBRID;
+		str += sizeof(hybrid) - 1;
+		if (*str == ':') {
+			if (!parse_time_ns(str + 1, 1000ULL, spin_ns))
+				return false;
+		} else if (*str != '\0') {
+			return false;
+		}
+	} else {
+		return false;
+	}
+
+	return true;
+
+}
+
+
+/*
+ * Convert a packet train option, "<frames>[:<frame bytes>]"
+ */
+bool parse_train_opt(const char *str,
+		     unsigned int *train_len,
+		     unsigned int *frame_size)
+{
+	unsigned long val;
+	char *endptr;
+
+
+	if ((*str < '0') || (*str > '9'))
+		return false;
+
+	val = strtoul(str, &endptr, 10);
+	if ((val < TRAIN_LEN_MIN) || (val > TRAIN_LEN_MAX))
+		return false;
+	*train_len = val;
+
+	*frame_size = 0;
+
+	if (*endptr == ':') {
+		str = endptr + 1;
+		if ((*str < '0') || (*str > '9'))
+			return false;
+		val = strtoul(str, &endptr, 10);
+		if ((val == 0) || (val > UINT_MAX))
+			return false;
+		*frame_size = val;
+	}
+
+	return (*endptr == '\0');
+
+}
+
+
+/*
+ * Convert a test mode name
+ */
+bool parse_mode(const char *str, enum ECTPPING_MODE *mode)
+{
+
+
+	if (strcmp(str, "ping") == 0)
+		*mode = ECTPPING_MODE_PING;
+	else if (strcmp(str, "throughput") == 0)
+		*mode = ECTPPING_MODE_THROUGHPUT;
+	else if (strcmp(str, "pmtu") == 0)
+		*mode = ECTPPING_MODE_PMTU;
+	else if (strcmp(str, "hops") == 0)
+		*mode = ECTPPING_MODE_HOPS;
+	else if (strcmp(str, "matrix") == 0)
+		*mode = ECTPPING_MODE_MATRIX;
+	else if (strcmp(str, "daemon") == 0)
+		*mode = ECTPPING_MODE_DAEMON;
+	else
+		return false;
+
+	return true;
+
+}
+
+
+/*
+ * Convert a latency matrix output format name
+ */
+bool parse_matrix_format(const char *str, enum MATRIX_FORMAT *format)
+{
+
+
+	if (strcmp(str, "text") == 0)
+		*format = MATRIX_FORMAT_TEXT;
+	else if (strcmp(str, "csv") == 0)
+		*format = MATRIX_FORMAT_CSV;
+	else if (strcmp(str, "json") == 0)
+		*format = MATRIX_FORMAT_JSON;
+	else
+		return false;
+
+	return true;
+
+}
+
+
+/*
+ * Convert an rx workers option, "<workers>|auto[:hash|cpu|lb]". auto is
+ * one worker per online CPU.
+ */
+bool parse_rx_workers(const char *str,
+		      unsigned int *workers,
+		      int *fanout)
+{
+	const char auto_str[] = "auto";
+	unsigned long val;
+	char *endptr;
+	long cpus;
+
+
+	if (strncmp(str, auto_str, sizeof(auto_str) - 1) == 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (cpus < 1)
+			val = 1;
+		else if (cpus > RX_WORKERS_MAX)
+			val = RX_WORKERS_MAX;
+		else
+			val = cpus;
+		endptr = (char *)str + sizeof(auto_str) - 1;
+	} else {
+		if ((*str < '0') || (*str > '9'))
+			return false;
+		val = strtoul(str, &endptr, 10);
+		if ((val == 0) || (val > RX_WORKERS_MAX))
+			return false;
+	}
+
+	*workers = val;
+
+	*fanout = PACKET_FANOUT_CPU;
+
+	if (*endptr == ':') {
+		str = endptr + 1;
+		if (strcmp(str, "hash") == 0)
+			*fanout = PACKET_FANOUT_HASH;
+		else if (strcmp(str, "cpu") == 0)
+			*fanout = PACKET_FANOUT_CPU;
+		else if (strcmp(str, "lb") == 0)
+			*fanout = PACKET_FANOUT_LB;
+		else
+			return false;
+		return true;
+	}
+
+	return (*endptr == '\0');
+
+}
+
+
+const char *fanout_name(const int fanout)
+{
+
+
+	switch (fanout) {
+	case PACKET_FANOUT_HASH:
+		return "hash";
+	case PACKET_FANOUT_LB:
+		return "lb";
+	case PACKET_FANOUT_CPU:
+	default:
+		return "cpu";
+	}
+
+}
+
+
+/*
+ * Convert an rx spin option, "<spin time>[:<busy poll usecs>]"
+ */
+bool parse_rx_spin(const char *str,
+		   uint64_t *spin_ns,
+		   unsigned int *busy_poll_us)
+{
+	char spin_str[32];
+	const char *colon;
+	unsigned long val;
+	char *endptr;
+
+
+	colon = strchr(str, ':');
+	if (colon == NULL) {
+		if (!parse_time_ns(str, 1000ULL, spin_ns) || (*spin_ns == 0))
+			return false;
+		*busy_poll_us = (*spin_ns / 1000 < INT_MAX) ?
+			*spin_ns / 1000 : INT_MAX;
+		return true;
+	}
+
+	if ((colon - str) >= sizeof(spin_str))
+		return false;
+
+	memcpy(spin_str, str, colon - str);
+	spin_str[colon - str] = '\0';
+
+	if (!parse_time_ns(spin_str, 1000ULL, spin_ns) || (*spin_ns == 0))
+		return false;
+
+	str = colon + 1;
+	if ((*str < '0') || (*str > '9'))
+		return false;
+
+	val = strtoul(str, &endptr, 10);
+	if ((*endptr != '\0') || (val > INT_MAX))
+		return false;
+
+	*busy_poll_us = val;
+
+	return true;
+
+}
+
+
+/*
+ * Convert a SCHED_FIFO priority
+ */
+bool parse_rt_prio(const char *str, int *prio)
+{
+	long val;
+	char *endptr;
+
+
+	if ((*str < '0') || (*str > '9'))
+		return false;
+
+	val = strtol(str, &endptr, 10);
+	if ((*endptr != '\0') ||
+	    (val < sched_get_priority_min(SCHED_FIFO)) ||
+	    (val > sched_get_priority_max(SCHED_FIFO)))
+		return false;
+
+	*prio = val;
+
+	return true;
+
+}
+
+
+/*
+ * Convert a thread CPUs option, "<tx cpus>[/<rx cpus>]". Without the rx
+ * CPUs, the rx threads share the tx CPUs.
+ */
+bool parse_thread_cpus(const char *str,
+		       cpu_set_t *tx_cpus,
+		       cpu_set_t *rx_cpus)
+{
+	char tx_str[CPULIST_STR_MAXSZ];
+	const char *slash;
+
+
+	slash = strchr(str, '/');
+	if (slash == NULL) {
+		if (!cpulist_parse(str, tx_cpus) || (CPU_COUNT(tx_cpus) == 0))
+			return false;
+		*rx_cpus = *tx_cpus;
+		return true;
+	}
+
+	if ((slash - str) >= sizeof(tx_str))
+		return false;
+
+	memcpy(tx_str, str, slash - str);
+	tx_str[slash - str] = '\0';
+
+	if (!cpulist_parse(tx_str, tx_cpus) || (CPU_COUNT(tx_cpus) == 0))
+		return false;
+
+	if (!cpulist_parse(slash + 1, rx_cpus) || (CPU_COUNT(rx_cpus) == 0))
+		return false;
+
+	return true;
+
+}
+
+
+/*
+ * Convert a comma separated list of sizes, e.g. "64,128,1518"
+ */
+bool parse_size_list(const char *str,
+		     unsigned int sizes[],
+		     const unsigned int max_sizes,
+		     unsigned int *num_sizes)
+{
+	unsigned long val;
+	char *endptr;
+
+
+	*num_sizes = 0;
+
+	while (true) {
+		if ((*str < '0') || (*str > '9'))
+			return false;
+
+		val = strtoul(str, &endptr, 10);
+		if ((val == 0) || (val > UINT_MAX))
+			return false;
+
+		if (*num_sizes == max_sizes)
+			return false;
+		sizes[(*num_sizes)++] = val;
+
+		if (*endptr == '\0')
+			break;
+		if (*endptr != ',')
+			return false;
+
+		str = endptr + 1;
+	}
+
+	return true;
+
+}
+
+
+void print_help(void)
+{
+
+
+	fprintf(stderr, "\n%s\n\n", ectpping_version);
+
+	fprintf(stderr, "ectpping [options] [<unicast MAC address>|"
+			"</etc/ethers hostname>]\n\n");
+
+	fprintf(stderr, "ECTPPING options\n");
+	fprintf(stderr, "-i <intf>\t: Network interface to use. Default is "
+			"eth0. Repeat to probe\n");
+	fprintf(stderr, "\t\t  through up to %u interfaces at once, in "
+			"ping or train mode.\n", IFACES_MAX);
+	fprintf(stderr, "-b\t\t: Use broadcast ECTP packet instead of "
+			"multicast ECTP packet.\n");
+	fprintf(stderr, "-n\t\t: Don't resolve names using /etc/ethers.\n"
+			"\t\t  See ethers(5) for details.\n");
+	fprintf(stderr, "-z\t\t: Zero output of per packet "
+				"responses.\n");
+	fprintf(stderr, "-I <time>\t: Time between packet transmits, in "
+			"milliseconds unless\n");
+	fprintf(stderr, "\t\t  suffixed with s, ms, us or ns. Default is "
+			"1000.\n");
+	fprintf(stderr, "\t\t  Need to be root i.e. getuid() == 0 to use this "
+			"option.\n");
+	fprintf(stderr, "-P <mode>\t: Transmit pacing, sleep, spin or "
+			"hybrid[:<spin usec>].\n");
+	fprintf(stderr, "\t\t  hybrid sleeps until shortly before each "
+			"transmit, then spins.\n");
+	fprintf(stderr, "\t\t  Default is sleep.\n");
+	fprintf(stderr, "-T <lead>\t: Have the kernel launch each frame at "
+			"its scheduled time\n");
+	fprintf(stderr, "\t\t  using SO_TXTIME, queueing it <lead> usec "
+			"(or suffixed time)\n");
+	fprintf(stderr, "\t\t  ahead, so a lead of several intervals keeps "
+			"that many queued.\n");
+	fprintf(stderr, "\t\t  Needs the fq qdisc on the interface.\n");
+	fprintf(stderr, "-t <frames>[:<bytes>]\n\t\t: Send a train of back "
+			"to back frames each interval, and\n");
+	fprintf(stderr, "\t\t  estimate path capacity from how spread out "
+			"the replies\n");
+	fprintf(stderr, "\t\t  arrive. Frames are padded to <bytes>, "
+			"default is -s or the MTU.\n");
+	fprintf(stderr, "-s <bytes>\t: Pad frames to <bytes>, excluding the "
+			"FCS, from %u up to\n", ETH_ZLEN);
+	fprintf(stderr, "\t\t  the interface MTU plus the Ethernet "
+			"header.\n");
+	fprintf(stderr, "-p <pattern>\t: Fill the frame payload with zeros, "
+			"prbs (PRBS-31) or\n");
+	fprintf(stderr, "\t\t  incr (incrementing bytes), instead of the "
+			"build information.\n");
+	fprintf(stderr, "-c\t\t: Carry a CRC32C of the payload in each probe, "
+			"and count\n");
+	fprintf(stderr, "\t\t  replies whose payload doesn't match as "
+			"corrupted.\n");
+	fprintf(stderr, "-m <mode>\t: Test mode, ping (default), "
+			"throughput, pmtu, hops,\n");
+	fprintf(stderr, "\t\t  matrix or daemon.\n");
+	fprintf(stderr, "\t\t  throughput is an RFC 2544 style search for "
+			"the highest\n");
+	fprintf(stderr, "\t\t  frame rate with loss under the -L "
+			"threshold, per frame size.\n");
+	fprintf(stderr, "\t\t  Need to be root i.e. getuid() == 0 to use "
+			"it.\n");
+	fprintf(stderr, "\t\t  pmtu searches for the largest frame "
+			"carried to each hop of\n");
+	fprintf(stderr, "\t\t  the unicast (-f) route and back.\n");
+	fprintf(stderr, "\t\t  hops probes each hop of the route and back "
+			"every interval,\n");
+	fprintf(stderr, "\t\t  and reports the latency and loss each hop "
+			"adds.\n");
+	fprintf(stderr, "\t\t  matrix measures the latency between every "
+			"pair of the\n");
+	fprintf(stderr, "\t\t  assistants on the unicast (-f) route, or "
+			"that answer the\n");
+	fprintf(stderr, "\t\t  multicast or broadcast destination, for -D "
+			"time.\n");
+	fprintf(stderr, "\t\t  daemon runs until stopped, probing the "
+			"targets added and\n");
+	fprintf(stderr, "\t\t  removed over its -U control socket, "
+			"starting with the\n");
+	fprintf(stderr, "\t\t  unicast (-f) route if one's given.\n");
+	fprintf(stderr, "-S <sizes>\t: Comma separated throughput frame "
+			"sizes, including FCS.\n");
+	fprintf(stderr, "\t\t  Default is %s.\n", TPUT_DEFAULT_SIZES);
+	fprintf(stderr, "-D <time>\t: Duration of each throughput trial, or "
+			"of the latency\n");
+	fprintf(stderr, "\t\t  matrix, in seconds unless suffixed. Default "
+			"is 5.\n");
+	fprintf(stderr, "-F <format>\t: Latency matrix output format, text "
+			"(default), csv or\n");
+	fprintf(stderr, "\t\t  json.\n");
+	fprintf(stderr, "-L <percent>\t: Throughput loss threshold. Default "
+			"is 0.\n");
+	fprintf(stderr, "-W <workers>[:<fanout>]\n\t\t: Receive replies with "
+			"<workers> threads (auto for one\n");
+	fprintf(stderr, "\t\t  per CPU), spread by PACKET_FANOUT cpu "
+			"(default), hash or lb.\n");
+	fprintf(stderr, "\t\t  ECTP frames hash alike, so prefer cpu on "
+			"multiqueue NICs,\n");
+	fprintf(stderr, "\t\t  or lb otherwise. Default is 1.\n");
+	fprintf(stderr, "-Y <spin>[:<busy poll>]\n\t\t: Low latency "
+			"receive. Each rx thread polls for\n");
+	fprintf(stderr, "\t\t  <spin> (usecs, or with a suffix) before "
+			"blocking, using\n");
+	fprintf(stderr, "\t\t  SO_BUSY_POLL for <busy poll> usecs, "
+			"default <spin>. A spin\n");
+	fprintf(stderr, "\t\t  of at least the interval never "
+			"blocks. rx CPU time is reported.\n");
+	fprintf(stderr, "-R <priority>\t: Real-time mode. Run the tx and rx "
+			"threads SCHED_FIFO at\n");
+	fprintf(stderr, "\t\t  <priority>, lock memory and prefault "
+			"stacks and buffers.\n");
+	fprintf(stderr, "-a <cpus>[/<rx cpus>]\n\t\t: Run the tx threads "
+			"on <cpus> and the rx threads on\n");
+	fprintf(stderr, "\t\t  <rx cpus>, as CPU lists, e.g. 2/3-5. "
+			"Default is the CPUs\n");
+	fprintf(stderr, "\t\t  local to each interface's NIC.\n");
+	fprintf(stderr, "-O <interval>\t: Report each interface's packet, "
+			"drop and error counts\n");
+	fprintf(stderr, "\t\t  every <interval>, in seconds unless "
+			"suffixed.\n");
+	fprintf(stderr, "-w <file>\t: Log every probe's outcome to <file> in "
+			"a compact binary\n");
+	fprintf(stderr, "\t\t  format, read with ectplog.\n");
+	fprintf(stderr, "-C <file>\t: Capture every probe sent and reply "
+			"received to <file>\n");
+	fprintf(stderr, "\t\t  in pcapng format, read with ectpcap or "
+			"Wireshark.\n");
+	fprintf(stderr, "-M <name>\t: Publish live statistics in the POSIX "
+			"shared memory\n");
+	fprintf(stderr, "\t\t  segment /<name>, read with ectpstat.\n");
+	fprintf(stderr, "-E <port|path>\t: Serve Prometheus metrics at "
+			"/metrics over HTTP, on\n");
+	fprintf(stderr, "\t\t  127.0.0.1:<port>, or the Unix socket "
+			"<path>.\n");
+	fprintf(stderr, "-U <path>\t: Daemon mode control socket. Default "
+			"is\n");
+	fprintf(stderr, "\t\t  " DAEMON_CTL_DEFAULT_PATH ".\n");
+	fprintf(stderr, "-f \"fwdaddr1 ... fwdaddrN\"\n\t\t: "
+			"List of forward addresses in the ECTP packet, as many\n");
+	fprintf(stderr, "\t\t  as the MTU allows.\n");
+	fprintf(stderr, "\t\t  The first forward address specified is not used"
+			" as the first\n");
+	fprintf(stderr, "\t\t  ECTP hop i.e. the destination MAC address in "
+		        "the address \n");
+        fprintf(stderr, "\t\t  the transmitted ECTP packet header. That will need to be\n");
+        fprintf(stderr, "\t\t  specified separately on the command line.\n");
+        fprintf(stderr, "\t\t  To have the ECTP packet follow a complete loop, "
+			"specify this\n");
+       	fprintf(stderr, "\t\t  host's outgoing interface MAC address as the "
+			"last hop.\n");
+	fprintf(stderr, "-H <file>\t: Read forward addresses from <file> "
+			"(- for stdin), after\n");
+	fprintf(stderr, "\t\t  any -f ones. White space or comma "
+			"separated, # comments.\n");
+	fprintf(stderr, "-r <pps>\t: Cap the total transmit rate on the "
+			"interface, shared\n");
+	fprintf(stderr, "\t\t  equally between targets. Default is no "
+			"cap.\n");
+	fprintf(stderr, "-B <frames>\t: Burst size allowed by the -r rate "
+			"cap. Default is 1.\n");
+
+	fprintf(stderr, "\n");
+
+}	
+
+
+/*
+ * Routine to convert collected program options into internal program
+ * parameters
+ */
+enum PROCESS_PROG_OPTS process_prog_opts(const struct program_options
+						*prog_opts,
+					 struct program_parameters *prog_parms,
+					 const char **errmsg)
+{
+	const uint8_t bcast_addr[ETH_ALEN] = { 0xff, 0xff, 0xff,
+					       0xff, 0xff, 0xff };
+	const uint8_t lc_mcaddr[ETH_ALEN] = ECTP_LA_MCADDR;
+	struct iface_info *ifi;
+	unsigned int i, j, min_mtu_iface = 0;
+	cpu_set_t allowed, cpus;
+
+	
+	
+
+	memset(prog_parms, 0, sizeof(struct program_parameters));
+
+	prog_parms->num_ifaces = (prog_opts->num_ifaces > 0) ?
+		prog_opts->num_ifaces : 1;
+
+	for (i = 0; i < prog_parms->num_ifaces; i++) {
+		ifi = &prog_parms->ifaces[i];
+
+		if (get_ifindex(prog_opts->ifaces[i], &ifi->ifindex)
+			!= GET_IFINDEX_GOOD) {
+			*errmsg = prog_opts->ifaces[i];
+			return PROCESS_PROG_OPTS_BAD_IFACE;
+		}
+
+		if (get_ifmac(prog_opts->ifaces[i], &ifi->srcmac)
+			!= GET_IFMAC_GOOD) {
+			*errmsg = prog_opts->ifaces[i];
+			return PROCESS_PROG_OPTS_BAD_IFMAC;
+		}
+
+		if (get_ifmtu(prog_opts->ifaces[i], &ifi->mtu) !=
+			GET_IFMTU_GOOD) {
+			*errmsg = prog_opts->ifaces[i];
+			return PROCESS_PROG_OPTS_BAD_IFMTU;
+		}
+
+		strncpy(ifi->iface, prog_opts->ifaces[i], IFNAMSIZ);
+		ifi->iface[IFNAMSIZ-1] = '\0';
+
+		for (j = 0; j < i; j++) {
+			if (prog_parms->ifaces[j].ifindex == ifi->ifindex) {
+				*errmsg = "an interface was given twice";
+				return PROCESS_PROG_OPTS_BAD_MULTI_IFACE;
+			}
+		}
+
+		if (ifi->mtu < prog_parms->ifaces[min_mtu_iface].mtu)
+			min_mtu_iface = i;
+	}
+
+	/*
+	 * Probes through each interface are built the same, so they all
+	 * have to fit in the smallest MTU
+	 */
+	strncpy(prog_parms->iface, prog_parms->ifaces[0].iface, IFNAMSIZ);
+	prog_parms->ifindex = prog_parms->ifaces[0].ifindex;
+	prog_parms->srcmac = prog_parms->ifaces[0].srcmac;
+	prog_parms->mtu = prog_parms->ifaces[min_mtu_iface].mtu;
+
+	prog_parms->dst_given = (prog_opts->dst_type == ucast);
+
+	switch (prog_opts->dst_type) {
+	case ucast:
+		prog_parms->uc_dstmac = true;
+		if (ether_hostton(prog_opts->uc_dst_str,
+			&prog_parms->dstmac) == 0) {
+			break;
+		}
+		if (enet_pton(prog_opts->uc_dst_str,
+			&prog_parms->dstmac) !=
+			ENET_PTON_GOOD) {
+			return PROCESS_PROG_OPTS_BAD_DSTMACFMT;
+		}
+		break;
+	case bcast:
+		prog_parms->uc_dstmac = false;
+		memcpy(&prog_parms->dstmac, bcast_addr,
+			sizeof(struct ether_addr));
+		break;
+	case mcast:
+	default:
+		prog_parms->uc_dstmac = false;
+		memcpy(&prog_parms->dstmac, lc_mcaddr,
+			sizeof(struct ether_addr));
+		break;
+	}
+
+	prog_parms->no_resolve = prog_opts->no_resolve;
+
+	prog_parms->zero_pkt_output = prog_opts->zero_pkt_output;
+
+	prog_parms->interval_ns = prog_opts->interval_ns;
+
+	prog_parms->pacing_mode = prog_opts->pacing_mode;
+
+	prog_parms->pacing_spin_ns = prog_opts->pacing_spin_ns;
+
+	prog_parms->txtime = prog_opts->txtime;
+
+	prog_parms->txtime_lead_ns = prog_opts->txtime_lead_ns;
+
+	if (prog_opts->mode == ECTPPING_MODE_THROUGHPUT) {
+		prog_parms->mode = ECTPPING_MODE_THROUGHPUT;
+		if (!parse_size_list(prog_opts->tput_sizes_str,
+			prog_parms->tput_sizes, TPUT_SIZES_MAX,
+			&prog_parms->num_tput_sizes)) {
+			*errmsg = prog_opts->tput_sizes_str;
+			return PROCESS_PROG_OPTS_BAD_SIZELIST;
+		}
+		prog_parms->tput_trial_ns = prog_opts->tput_trial_ns;
+		prog_parms->tput_loss_pct = prog_opts->tput_loss_pct;
+	} else if ((prog_opts->mode == ECTPPING_MODE_PMTU) ||
+		   (prog_opts->mode == ECTPPING_MODE_HOPS)) {
+		if (!prog_parms->uc_dstmac) {
+			*errmsg = (prog_opts->mode == ECTPPING_MODE_PMTU) ?
+				"pmtu" : "hops";
+			return PROCESS_PROG_OPTS_BAD_NEED_UCAST;
+		}
+		prog_parms->mode = prog_opts->mode;
+		prog_parms->frame_size = prog_opts->frame_size;
+	} else if (prog_opts->mode == ECTPPING_MODE_MATRIX) {
+		prog_parms->mode = ECTPPING_MODE_MATRIX;
+		prog_parms->frame_size = prog_opts->frame_size;
+		prog_parms->tput_trial_ns = prog_opts->tput_trial_ns;
+		prog_parms->matrix_format = prog_opts->matrix_format;
+	} else if (prog_opts->mode == ECTPPING_MODE_DAEMON) {
+		prog_parms->mode = ECTPPING_MODE_DAEMON;
+		prog_parms->frame_size = prog_opts->frame_size;
+		prog_parms->ctl_path = (prog_opts->ctl_path != NULL) ?
+			prog_opts->ctl_path : DAEMON_CTL_DEFAULT_PATH;
+	} else if (prog_opts->train_len > 0) {
+		prog_parms->mode = ECTPPING_MODE_TRAIN;
+		prog_parms->train_len = prog_opts->train_len;
+		if (prog_opts->train_frame_size > 0)
+			prog_parms->frame_size = prog_opts->train_frame_size;
+		else if (prog_opts->frame_size > 0)
+			prog_parms->frame_size = prog_opts->frame_size;
+		else
+			prog_parms->frame_size = prog_parms->mtu + ETH_HLEN;
+	} else {
+		prog_parms->mode = ECTPPING_MODE_PING;
+		prog_parms->frame_size = prog_opts->frame_size;
+	}
+
+	if (prog_parms->frame_size > (prog_parms->mtu + ETH_HLEN)) {
+		*errmsg = prog_parms->ifaces[min_mtu_iface].iface;
+		return PROCESS_PROG_OPTS_BAD_FRAMESIZE;
+	}
+
+	if ((prog_parms->num_ifaces > 1) &&
+	    (prog_parms->mode != ECTPPING_MODE_PING) &&
+	    (prog_parms->mode != ECTPPING_MODE_TRAIN)) {
+		*errmsg = "only ping and train modes use several";
+		return PROCESS_PROG_OPTS_BAD_MULTI_IFACE;
+	}
+
+	prog_parms->fill = prog_opts->fill;
+
+	prog_parms->fill_pattern = prog_opts->fill_pattern;
+
+	prog_parms->crc = prog_opts->crc;
+
+	prog_parms->rate_pps = prog_opts->rate_pps;
+
+	prog_parms->rate_burst = prog_opts->rate_burst;
+
+	prog_parms->rx_workers = prog_opts->rx_workers;
+
+	prog_parms->rx_fanout = prog_opts->rx_fanout;
+
+	prog_parms->rt = prog_opts->rt;
+
+	prog_parms->rt_prio = prog_opts->rt_prio;
+
+	prog_parms->rx_spin_ns = prog_opts->rx_spin_ns;
+
+	prog_parms->busy_poll_us = prog_opts->busy_poll_us;
+
+	prog_parms->report_interval_ns = prog_opts->report_interval_ns;
+
+	prog_parms->probe_log_file = prog_opts->probe_log_file;
+
+	prog_parms->capture_file = prog_opts->capture_file;
+
+	prog_parms->stats_shm_name = prog_opts->stats_shm_name;
+	prog_parms->metrics_addr = prog_opts->metrics_addr;
+
+	if (prog_opts->tx_cpus_set) {
+		if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0) {
+			CPU_OR(&cpus, &prog_opts->tx_cpus, &prog_opts->rx_cpus);
+			CPU_AND(&allowed, &allowed, &cpus);
+			if (!CPU_EQUAL(&allowed, &cpus)) {
+				*errmsg = "not all allowed for this process";
+				return PROCESS_PROG_OPTS_BAD_CPUS;
+			}
+		}
+		prog_parms->tx_cpus_set = true;
+		prog_parms->tx_cpus = prog_opts->tx_cpus;
+		prog_parms->rx_cpus_set = true;
+		prog_parms->rx_cpus = prog_opts->rx_cpus;
+	}
+
+	return process_fwdaddrs_opts(prog_opts, prog_parms, errmsg);
+
+}
+
+
+/*
+ * Error handler for process_prog_opts() routine
+ */
+enum PROCESS_PROG_OPTS process_prog_opts_eh(const enum PROCESS_PROG_OPTS ret,
+					    const char *errmsg)
+{
+
+
+	switch (ret) {
+	case PROCESS_PROG_OPTS_BAD_IFACE: 
+		fprintf(stderr, "Unknown interface or interface "
+				"inaccessible (got CAP_NET_RAW?) - %s.\n",
+				errmsg);
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_IFMAC:
+		fprintf(stderr, "Error retrieving interface MAC address.\n");
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_DSTMACFMT:
+		fprintf(stderr, "Bad destination MAC address format.\n");
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_IFMTU:
+		fprintf(stderr, "Error retrieving interface MTU.\n");
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_FRAMESIZE:
+		fprintf(stderr, "Frame size larger than interface MTU allows "
+				"- %s.\n", errmsg);
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_SIZELIST:
+		fprintf(stderr, "Bad frame size list - %s.\n", errmsg);
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_CPUS:
+		fprintf(stderr, "Bad CPUs - %s.\n", errmsg);
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_MULTI_IFACE:
+		fprintf(stderr, "Bad interfaces - %s.\n", errmsg);
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_FWDADDRS:
+		fprintf(stderr, "Bad forward addresses - %s.\n", errmsg);
+		exit (EXIT_FAILURE);
+		break;
+	case PROCESS_PROG_OPTS_BAD_NEED_UCAST:
+		fprintf(stderr, "%s mode needs a unicast destination.\n",
+			errmsg);
+		exit (EXIT_FAILURE);
+		break;
+	default:
+		return ret;
+	}
+
+}
+
+
+/*
+ * Routine to read forward addresses from src, appending them to the
+ * *fwdaddrs array, which is grown with realloc() as needed, so free() must
+ * be called on *fwdaddrs at some point in the future. Addresses are MAC
+ * addresses or /etc/ethers host names, separated by white space or commas.
+ * A '#' comments out the rest of the line. On failure, err holds the line
+ * and the offending token.
+ */
+enum GET_PROG_OPT_FWDADDRS get_prog_opt_fwdaddrs(FILE *src,
+						 struct ether_addr **fwdaddrs,
+						 unsigned int *num_fwdaddrs,
+						 unsigned int *alloced,
+						 struct fwdaddrs_err *err)
+{
+	char token[FWDADDR_TOKEN_MAX];
+	unsigned int token_len = 0;
+	bool in_comment = false;
+	struct ether_addr *new_fwdaddrs;
+	unsigned int new_alloced;
+	int c;
+
+
+	err->line = 1;
+	err->token[0] = '\0';
+
+	while (true) {
+		c = getc(src);
+
+		if (in_comment && (c != '\n') && (c != EOF))
+			continue;
+
+		if ((c == '#') || (c == EOF) || (c == ',') || isspace(c)) {
+			if (c == '#')
+				in_comment = true;
+
+			if (token_len > 0) {
+				token[token_len] = '\0';
+				token_len = 0;
+
+				if (*num_fwdaddrs == *alloced) {
+					new_alloced = (*alloced > 0) ?
+						*alloced * 2 : 16;
+					new_fwdaddrs = realloc(*fwdaddrs,
+						new_alloced * ETH_ALEN);
+					if (new_fwdaddrs == NULL)
+						return GET_PROG_OPT_FWDADDRS_NOMEM;
+					*fwdaddrs = new_fwdaddrs;
+					*alloced = new_alloced;
+				}
+
+				if ((enet_pton(token,
+					&(*fwdaddrs)[*num_fwdaddrs]) !=
+					ENET_PTON_GOOD) &&
+				    (ether_hostton(token,
+					&(*fwdaddrs)[*num_fwdaddrs]) != 0)) {
+					strcpy(err->token, token);
+					return GET_PROG_OPT_FWDADDRS_BADADDR;
+				}
+
+				(*num_fwdaddrs)++;
+			}
+
+			if (c == '\n') {
+				in_comment = false;
+				err->line++;
+			}
+
+			if (c == EOF)
+				break;
+
+			continue;
+		}
+
+		if (token_len == (FWDADDR_TOKEN_MAX - 1)) {
+			token[token_len] = '\0';
+			strcpy(err->token, token);
+			return GET_PROG_OPT_FWDADDRS_TOOLONG;
+		}
+
+		token[token_len++] = c;
+	}
+
+	if (ferror(src))
+		return GET_PROG_OPT_FWDADDRS_BADREAD;
+
+	return GET_PROG_OPT_FWDADDRS_GOOD;
+
+}
+
+
+/*
+ * Collect the forward addresses from the -f list and then the -H file.
+ * The number of forward addresses is only limited by the frame they must
+ * fit in.
+ */
+enum PROCESS_PROG_OPTS process_fwdaddrs_opts(const struct program_options
+						 *prog_opts,
+					     struct program_parameters
+						 *prog_parms,
+					     const char **errmsg)
+{
+	static char errbuf[FWDADDR_TOKEN_MAX + PATH_MAX + 64];
+	struct fwdaddrs_err err;
+	enum GET_PROG_OPT_FWDADDRS ret = GET_PROG_OPT_FWDADDRS_GOOD;
+	const char *src_name = NULL;
+	unsigned int alloced = 0;
+	unsigned int max_fwdaddrs;
+	unsigned int num_hops;
+	FILE *src;
+
+
+	prog_parms->fwdaddrs = NULL;
+	prog_parms->num_fwdaddrs = 0;
+
+	if (prog_opts->fwdaddrs_str != NULL) {
+		src_name = "-f";
+		src = fmemopen((void *)prog_opts->fwdaddrs_str,
+			strlen(prog_opts->fwdaddrs_str), "r");
+		if (src == NULL) {
+			ret = GET_PROG_OPT_FWDADDRS_NOMEM;
+		} else {
+			ret = get_prog_opt_fwdaddrs(src,
+				&prog_parms->fwdaddrs,
+				&prog_parms->num_fwdaddrs, &alloced, &err);
+			fclose(src);
+		}
+	}
+
+	if ((ret == GET_PROG_OPT_FWDADDRS_GOOD) &&
+	    (prog_opts->fwdaddrs_file != NULL)) {
+		src_name = prog_opts->fwdaddrs_file;
+		if (strcmp(prog_opts->fwdaddrs_file, "-") == 0)
+			src = stdin;
+		else
+			src = fopen(prog_opts->fwdaddrs_file, "r");
+		if (src == NULL) {
+			ret = GET_PROG_OPT_FWDADDRS_BADREAD;
+			err.line = 0;
+		} else {
+			ret = get_prog_opt_fwdaddrs(src,
+				&prog_parms->fwdaddrs,
+				&prog_parms->num_fwdaddrs, &alloced, &err);
+			if (src != stdin)
+				fclose(src);
+		}
+	}
+
+	switch (ret) {
+	case GET_PROG_OPT_FWDADDRS_GOOD:
+		break;
+	case GET_PROG_OPT_FWDADDRS_BADADDR:
+		snprintf(errbuf, sizeof(errbuf), "%s line %u, \"%s\" is not a "
+			"MAC address or known host", src_name, err.line,
+			err.token);
+		*errmsg = errbuf;
+		return PROCESS_PROG_OPTS_BAD_FWDADDRS;
+	case GET_PROG_OPT_FWDADDRS_TOOLONG:
+		snprintf(errbuf, sizeof(errbuf), "%s line %u, \"%s...\" is "
+			"too long", src_name, err.line, err.token);
+		*errmsg = errbuf;
+		return PROCESS_PROG_OPTS_BAD_FWDADDRS;
+	case GET_PROG_OPT_FWDADDRS_BADREAD:
+		snprintf(errbuf, sizeof(errbuf), "%s, %s", src_name,
+			strerror(errno));
+		*errmsg = errbuf;
+		return PROCESS_PROG_OPTS_BAD_FWDADDRS;
+	case GET_PROG_OPT_FWDADDRS_NOMEM:
+	default:
+		*errmsg = "out of memory";
+		return PROCESS_PROG_OPTS_BAD_FWDADDRS;
+	}
+
+	/* the reply message and ectpping payload must still fit */
+	if (ectp_calc_packet_size(prog_parms->num_fwdaddrs,
+		sizeof(struct ectpping_payload)) >
+	    (unsigned int)prog_parms->mtu) {
+		max_fwdaddrs = (prog_parms->mtu - ectp_calc_packet_size(0,
+			sizeof(struct ectpping_payload))) / ECTP_FWDMSG_SZ;
+		snprintf(errbuf, sizeof(errbuf), "%u given, MTU %d allows "
+			"%u", prog_parms->num_fwdaddrs, prog_parms->mtu,
+			max_fwdaddrs);
+		*errmsg = errbuf;
+		return PROCESS_PROG_OPTS_BAD_FWDADDRS;
+	}
+
+	/* the daemon keeps its targets' hops, as get_route_hops(), in a table */
+	if ((prog_parms->mode == ECTPPING_MODE_DAEMON) &&
+	    prog_parms->dst_given) {
+		num_hops = prog_parms->num_fwdaddrs + 1;
+		if ((prog_parms->num_fwdaddrs > 0) &&
+		    (memcmp(&prog_parms->fwdaddrs[prog_parms->num_fwdaddrs - 1],
+			&prog_parms->srcmac, ETH_ALEN) == 0))
+			num_hops--;
+		if (num_hops > DAEMON_HOPS_MAX) {
+			snprintf(errbuf, sizeof(errbuf), "the route has %u "
+				"hops, daemon mode allows %u", num_hops,
+				DAEMON_HOPS_MAX);
+			*errmsg = errbuf;
+			return PROCESS_PROG_OPTS_BAD_FWDADDRS;
+		}
+	}
+
+	return PROCESS_PROG_OPTS_GOOD;
+
+}
+
+
+/*
+ * Routine to perform the specified interface ioctl
+ */
+enum DO_IFREQ_IOCTL do_ifreq_ioctl(const int ioctl_request,
+				   const char iface[IFNAMSIZ],
+				   struct ifreq *ifr)
+{
+	int sockfd;
+	int ioctlret;
+
+
+	sockfd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (sockfd == -1)
+		return DO_IFREQ_IOCTL_BADSOCKET;
+
+	memset(ifr, 0, sizeof(struct ifreq));
+
+	strncpy(ifr->ifr_name, iface, IFNAMSIZ);
+	ifr->ifr_name[IFNAMSIZ-1] = 0;
+
+	ioctlret = ioctl(sockfd, ioctl_request, ifr);
+
+	if (close(sockfd) == -1)
+		return DO_IFREQ_IOCTL_BADSOCKET;
+
+	if (ioctlret == -1)
+		return DO_IFREQ_IOCTL_BADIOCTL;
+	else
+		return DO_IFREQ_IOCTL_GOOD;
+
+}
+
+
+/*
+ * Routine to get the ifindex of the supplied interface name
+ */
+enum GET_IFINDEX get_ifindex(const char iface[IFNAMSIZ], int *ifindex)
+{
+	struct ifreq ifr;
+
+
+	if (do_ifreq_ioctl(SIOCGIFINDEX, iface, &ifr) == DO_IFREQ_IOCTL_GOOD) {
+		*ifindex = ifr.ifr_ifindex;
+		return GET_IFINDEX_GOOD;
+	} else {
+		return GET_IFINDEX_BADIFACE;
+	}
+
+}
+
+
+/*
+ * Routine to get the mac address for an interface
+ */
+enum GET_IFMAC get_ifmac(const char iface[IFNAMSIZ],
+			 struct ether_addr *ifmac)
+{
+	struct ifreq ifr;
+
+
+	if (do_ifreq_ioctl(SIOCGIFHWADDR, iface, &ifr) == DO_IFREQ_IOCTL_GOOD) {
+		if (ifr.ifr_hwaddr.sa_family == ARPHRD_ETHER) {
+			memcpy(ifmac, ifr.ifr_hwaddr.sa_data,
+				sizeof(struct ether_addr));
+			return GET_IFMAC_GOOD;
+		} else {
+			return GET_IFMAC_BADIFACE;
+		}
+	} else {
+		return GET_IFMAC_BADIFACE;
+	}
+
+}
+
+
+/*
+ * Routine to get the MTU of an interface
+ */
+enum GET_IFMTU get_ifmtu(const char iface[IFNAMSIZ], int *ifmtu)
+{
+	struct ifreq ifr;
+
+
+	if (do_ifreq_ioctl(SIOCGIFMTU, iface, &ifr) == DO_IFREQ_IOCTL_GOOD) {
+		*ifmtu = ifr.ifr_mtu;
+		return GET_IFMTU_GOOD;
+	} else {
+		return GET_IFMTU_BADIFACE;
+	}
+
+}
+
+
+/*
+ * Routine to get the link speed of an interface in Mbit/s, or 0 if the
+ * driver doesn't know
+ */
+uint64_t get_ifspeed_mbps(const char iface[IFNAMSIZ])
+{
+	char path[64 + IFNAMSIZ];
+	FILE *f;
+	long speed = 0;
+
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/speed", iface);
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return 0;
+
+	if (fscanf(f, "%ld", &speed) != 1)
+		speed = 0;
+
+	fclose(f);
+
+	return (speed > 0) ? speed : 0;
+
+}
+
+
+/*
+ * Get the CPUs local to the interface's NIC, false if unknown, such as for
+ * virtual interfaces
+ */
+bool get_iface_cpus(const char iface[IFNAMSIZ], cpu_set_t *cpus)
+{
+	char path[64 + IFNAMSIZ];
+
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/local_cpulist",
+		iface);
+
+	return cpulist_read(path, cpus);
+
+}
+
+
+/*
+ * Routine to open the TX PF_PACKET socket and the RX ones. More than one
+ * RX socket are joined into a PACKET_FANOUT group, so the kernel spreads
+ * the replies across them.
+ */
+int open_sockets(int *tx_sockfd,
+		 int rx_sockfds[],
+		 const unsigned int num_rx_sockfds,
+		 const int ifindex,
+		 const int rx_fanout_id,
+		 const int rx_fanout)
+{
+	unsigned int i;
+
+
+	*tx_sockfd = -1;
+	for (i = 0; i < num_rx_sockfds; i++)
+		rx_sockfds[i] = -1;
+
+	if (open_tx_socket(tx_sockfd, ifindex) != OPEN_TX_SKT_GOOD)
+		return -1;
+
+	for (i = 0; i < num_rx_sockfds; i++) {
+		if (open_rx_socket(&rx_sockfds[i], ifindex) !=
+			OPEN_RX_SKT_GOOD)
+			return -1;
+
+		if ((num_rx_sockfds > 1) &&
+		    (enable_rx_fanout(&rx_sockfds[i], rx_fanout_id,
+			rx_fanout) != ENABLE_RX_FANOUT_GOOD))
+			return -1;
+	}
+
+	return 0;
+
+}
+
+
+/*
+ * Set up the state for probing through each interface, including its rx
+ * worker handles, sockets, arguments and stats shards, and find the CPUs
+ * its threads should run on
+ */
+enum SETUP_PROBE_IFACES setup_probe_ifaces(const struct program_parameters
+					       *prog_parms)
+{
+	const unsigned int n = prog_parms->rx_workers;
+	struct probe_iface *pif;
+	cpu_set_t allowed, local;
+	unsigned int i, j;
+
+
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == -1) {
+		CPU_ZERO(&allowed);
+		for (i = 0; i < sysconf(_SC_NPROCESSORS_ONLN); i++)
+			CPU_SET(i, &allowed);
+	}
+
+	probe_ifaces = calloc(prog_parms->num_ifaces,
+		sizeof(struct probe_iface));
+	if (probe_ifaces == NULL)
+		return SETUP_PROBE_IFACES_NOMEM;
+
+	num_probe_ifaces = prog_parms->num_ifaces;
+
+	for (i = 0; i < num_probe_ifaces; i++) {
+		pif = &probe_ifaces[i];
+
+		pif->parms = *prog_parms;
+		memcpy(pif->parms.iface, prog_parms->ifaces[i].iface,
+			IFNAMSIZ);
+		pif->parms.ifindex = prog_parms->ifaces[i].ifindex;
+		pif->parms.srcmac = prog_parms->ifaces[i].srcmac;
+
+		pif->tx_sockfd = -1;
+
+		pif->rx_thread_hdls = calloc(n, sizeof(pthread_t));
+		pif->rx_sockfds = calloc(n, sizeof(int));
+		pif->rx_thread_args = calloc(n,
+			sizeof(struct rx_thread_arguments));
+		pif->rx_sockstats = calloc(n, sizeof(struct sockstat_rx));
+
+		if (posix_memalign((void **)&pif->rx_stats_shards,
+			sizeof(struct rx_stats),
+			n * sizeof(struct rx_stats)) != 0)
+			pif->rx_stats_shards = NULL;
+
+		if ((pif->rx_thread_hdls == NULL) ||
+		    (pif->rx_sockfds == NULL) ||
+		    (pif->rx_thread_args == NULL) ||
+		    (pif->rx_sockstats == NULL) ||
+		    (pif->rx_stats_shards == NULL))
+			return SETUP_PROBE_IFACES_NOMEM;
+
+		for (j = 0; j < n; j++) {
+			pif->rx_sockfds[j] = -1;
+			init_rx_stats(&pif->rx_stats_shards[j]);
+			sockstat_rx_init(&pif->rx_sockstats[j]);
+		}
+
+		sockstat_txerrs_init(&pif->tx_errs);
+
+		if (seqtrack_init(&pif->probe_track, PROBE_TRACK_SIZE) !=
+			SEQTRACK_INIT_GOOD)
+			return SETUP_PROBE_IFACES_NOMEM;
+
+		dispersion_agg_init(&pif->train_agg);
+
+		quality_init(&pif->quality);
+		quality_init(&pif->interval_quality);
+
+		/* the rate cap is per interface */
+		rategov_init(&pif->rategov, prog_parms->rate_pps,
+			prog_parms->rate_burst);
+		rategov_share_attach(&pif->rategov, &pif->rategov_share);
+
+		pacer_init(&pif->pacer, prog_parms->pacing_mode,
+			prog_parms->interval_ns, prog_parms->pacing_spin_ns);
+
+		if (get_iface_cpus(pif->parms.iface, &local))
+			CPU_AND(&pif->cpus, &local, &allowed);
+		else
+			CPU_ZERO(&pif->cpus);
+
+		pif->cpus_local = (CPU_COUNT(&pif->cpus) > 0);
+		if (!pif->cpus_local)
+			pif->cpus = allowed;
+	}
+
+	return SETUP_PROBE_IFACES_GOOD;
+
+}
+
+
+/*
+ * Prepares the argument structures passed to an interface's tx and rx
+ * threads
+ */
+void prepare_thread_args(struct probe_iface *pif)
+{
+	unsigned int i;
+
+
+	pif->tx_thread_args.prog_parms = &pif->parms;
+	pif->tx_thread_args.tx_sockfd = &pif->tx_sockfd;
+	pif->tx_thread_args.pif = pif;
+
+	/* daemon mode's targets are probed with copies of these */
+	pif->target_parms = pif->parms;
+
+	for (i = 0; i < pif->parms.rx_workers; i++) {
+		pif->rx_thread_args[i].prog_parms = &pif->parms;
+		pif->rx_thread_args[i].rx_sockfd = &pif->rx_sockfds[i];
+		pif->rx_thread_args[i].stats = &pif->rx_stats_shards[i];
+		pif->rx_thread_args[i].pif = pif;
+	}
+
+}
+
+
+/*
+ * Start an interface's tx thread and rx workers, pinned to its CPUs
+ */
+int start_iface_threads(struct probe_iface *pif,
+			pthread_attr_t *threads_attrs)
+{
+	const struct program_parameters *prog_parms = &pif->parms;
+	unsigned int i;
+	int ret;
+
+
+	ret = pthread_attr_setaffinity_np(threads_attrs, sizeof(cpu_set_t),
+		prog_parms->tx_cpus_set ? &prog_parms->tx_cpus : &pif->cpus);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to set %s tx thread affinity\n",
+			prog_parms->iface);
+		return ret;
+	}
+
+	ret = create_thread(&pif->tx_thread_hdl, threads_attrs, tx_thread,
+		&pif->tx_thread_args);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to create tx thread\n");
+		return ret;
+	}
+	pif->tx_thread_started = true;
+
+	pif->threads_start_ns = pacer_now_ns();
+
+	ret = pthread_attr_setaffinity_np(threads_attrs, sizeof(cpu_set_t),
+		prog_parms->rx_cpus_set ? &prog_parms->rx_cpus : &pif->cpus);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to set %s rx thread affinity\n",
+			prog_parms->iface);
+		return ret;
+	}
+
+	for (i = 0; i < prog_parms->rx_workers; i++) {
+		ret = create_thread(&pif->rx_thread_hdls[i], threads_attrs,
+			rx_thread, &pif->rx_thread_args[i]);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to create rx thread\n");
+			return ret;
+		}
+		pif->num_rx_threads++;
+	}
+
+	return 0;
+
+}
+
+
+/*
+ * Initialise an rx stats shard
+ */
+void init_rx_stats(struct rx_stats *stats)
+{
+
+
+	memset(stats, 0, sizeof(struct rx_stats));
+
+	stats->min_rtt.tv_sec = INT_MAX;
+	stats->min_rtt.tv_usec = INT_MAX;
+
+}
+
+
+/*
+ * Total the CPU time used so far by an interface's rx threads, which must
+ * still be running
+ */
+void sample_rx_cpu_time(struct probe_iface *pif)
+{
+	clockid_t cpu_clock;
+	struct timespec cpu_ts;
+	unsigned int i;
+
+
+	pif->rx_cpu_ns = 0;
+
+	for (i = 0; i < pif->num_rx_threads; i++) {
+		if ((pthread_getcpuclockid(pif->rx_thread_hdls[i], &cpu_clock)
+			!= 0) || (clock_gettime(cpu_clock, &cpu_ts) == -1))
+			continue;
+		pif->rx_cpu_ns += ((uint64_t)cpu_ts.tv_sec * 1000000000ULL) +
+			cpu_ts.tv_nsec;
+	}
+
+	if (pif->num_rx_threads > 0)
+		pif->rx_elapsed_ns = pacer_now_ns() - pif->threads_start_ns;
+
+}
+
+
+/*
+ * Create a thread. If real-time scheduling isn't permitted, fall back to
+ * inheriting ours, for this and any later threads.
+ */
+int create_thread(pthread_t *thread_hdl,
+		  pthread_attr_t *threads_attrs,
+		  void *(*start_routine)(void *),
+		  void *arg)
+{
+	int inherit;
+	int ret;
+
+
+	ret = pthread_create(thread_hdl, threads_attrs, start_routine, arg);
+
+	if ((ret == EPERM) &&
+	    (pthread_attr_getinheritsched(threads_attrs, &inherit) == 0) &&
+	    (inherit == PTHREAD_EXPLICIT_SCHED)) {
+		pthread_attr_setinheritsched(threads_attrs,
+			PTHREAD_INHERIT_SCHED);
+		rt_status.sched_refused = true;
+		ret = pthread_create(thread_hdl, threads_attrs, start_routine,
+			arg);
+	}
+
+	return ret;
+
+}
+
+
+/*
+ * Set the thread attributes for real-time mode, an explicit SCHED_FIFO
+ * priority and a stack small enough to lock. Outside real-time mode the
+ * threads inherit our scheduling.
+ */
+enum SETUP_THREADS_ATTRS setup_threads_attrs(pthread_attr_t *threads_attrs,
+					     const struct program_parameters
+						*prog_parms)
+{
+	struct sched_param sched_param = {
+		.sched_priority = prog_parms->rt_prio,
+	};
+
+
+	if (!prog_parms->rt)
+		return SETUP_THREADS_ATTRS_GOOD;
+
+	if (pthread_attr_setinheritsched(threads_attrs,
+		PTHREAD_EXPLICIT_SCHED) != 0)
+		return SETUP_THREADS_ATTRS_BAD;
+
+	if (pthread_attr_setschedpolicy(threads_attrs, SCHED_FIFO) != 0)
+		return SETUP_THREADS_ATTRS_BAD;
+
+	if (pthread_attr_setschedparam(threads_attrs, &sched_param) != 0)
+		return SETUP_THREADS_ATTRS_BAD;
+
+	if (pthread_attr_setstacksize(threads_attrs, RT_THREAD_STACK_SZ) != 0)
+		return SETUP_THREADS_ATTRS_BAD;
+
+	return SETUP_THREADS_ATTRS_GOOD;
+
+}
+
+
+/*
+ * Lock current and future memory, so nothing is paged out or faulted in
+ * while probing. Failure is reported rather than fatal.
+ */
+void lock_memory(void)
+{
+
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+		rt_status.mlocked = true;
+	} else {
+		rt_status.mlocked = false;
+		rt_status.mlock_errno = errno;
+	}
+
+}
+
+
+/*
+ * Touch the part of the stack a real-time thread may use, so it isn't
+ * faulted in page by page while probing
+ */
+void __attribute__((noinline)) prefault_stack(void)
+{
+	volatile uint8_t stack[RT_STACK_PREFAULT_SZ];
+	const long page_sz = sysconf(_SC_PAGESIZE);
+	unsigned int i;
+
+
+	for (i = 0; i < sizeof(stack); i += page_sz)
+		stack[i] = 0;
+
+}
+
+
+/*
+ * Report what real-time mode actually applied, as read back from the
+ * running threads
+ */
+void print_rt_report(const struct program_parameters *prog_parms)
+{
+	struct probe_iface *pif;
+	char name[IFNAMSIZ + 16];
+	unsigned int i;
+
+
+	if (rt_status.mlocked)
+		printf("real-time: memory locked");
+	else
+		printf("real-time: memory not locked (%s)",
+			strerror(rt_status.mlock_errno));
+
+	printf(", stacks and buffers prefaulted");
+
+	if (rt_status.sched_refused)
+		printf(", SCHED_FIFO %d not permitted", prog_parms->rt_prio);
+
+	putchar('\n');
+
+	for (i = 0; i < num_probe_ifaces; i++) {
+		pif = &probe_ifaces[i];
+
+		snprintf(name, sizeof(name), "%s tx", pif->parms.iface);
+		print_thread_sched(name, pif->tx_thread_hdl);
+
+		if (pif->num_rx_threads > 0) {
+			snprintf(name, sizeof(name), "%s rx", pif->parms.iface);
+			print_thread_sched(name, pif->rx_thread_hdls[0]);
+		}
+	}
+
+	fflush(stdout);
+
+}
+
+
+/*
+ * Print a thread's scheduling policy, priority and CPUs
+ */
+void print_thread_sched(const char *name, const pthread_t thread_hdl)
+{
+	struct sched_param sched_param;
+	char cpus_str[CPULIST_STR_MAXSZ];
+	cpu_set_t cpus;
+	int policy;
+
+
+	printf("real-time: %s thread", name);
+
+	if (pthread_getschedparam(thread_hdl, &policy, &sched_param) == 0) {
+		if (policy == SCHED_FIFO)
+			printf(" SCHED_FIFO priority %d",
+				sched_param.sched_priority);
+		else if (policy == SCHED_RR)
+			printf(" SCHED_RR priority %d",
+				sched_param.sched_priority);
+		else
+			printf(" SCHED_OTHER");
+	}
+
+	if (pthread_getaffinity_np(thread_hdl, sizeof(cpu_set_t), &cpus) ==
+		0) {
+		cpulist_format(&cpus, cpus_str, sizeof(cpus_str));
+		printf(" on cpus %s", cpus_str);
+	}
+
+	putchar('\n');
+
+}
+
+
+/*
+ * Collect the kernel's drop counts and queue occupancy for an interface's
+ * rx sockets. The interval report and statistics threads, and then
+ * finish_ectpping(), take turns.
+ */
+void sample_rx_sockstats(struct probe_iface *pif)
+{
+	unsigned int i;
+
+
+	pthread_mutex_lock(&sockstats_mutex);
+
+	for (i = 0; i < pif->parms.rx_workers; i++) {
+		if (pif->rx_sockfds[i] != -1)
+			sockstat_rx_sample(pif->rx_sockfds[i],
+				&pif->rx_sockstats[i]);
+	}
+
+	pthread_mutex_unlock(&sockstats_mutex);
+
+}
+
+
+/*
+ * Merge the rx workers' stats shards into total, once the workers have
+ * stopped
+ */
+void merge_rx_stats(const struct rx_stats shards[],
+		    const unsigned int num_shards,
+		    struct rx_stats *total)
+{
+	unsigned int i, j;
+
+
+	for (i = 0; i < num_shards; i++) {
+		total->rxed_pkts += shards[i].rxed_pkts;
+		total->corrupted_pkts += shards[i].corrupted_pkts;
+		total->spun_pkts += shards[i].spun_pkts;
+		total->rx_errors += shards[i].rx_errors;
+
+		for (j = 0; j < RX_REJECT_REASONS; j++)
+			total->rejected[j] += shards[i].rejected[j];
+
+		timeradd(&total->sum_rtts, &shards[i].sum_rtts,
+			&total->sum_rtts);
+
+		if (shards[i].rxed_pkts == 0)
+			continue;
+
+		if (timercmp(&shards[i].min_rtt, &total->min_rtt, <))
+			total->min_rtt = shards[i].min_rtt;
+
+		if (timercmp(&shards[i].max_rtt, &total->max_rtt, >))
+			total->max_rtt = shards[i].max_rtt;
+	}
+
+}
+
+
+/*
+ * Build the ectp frame ethernet header
+ */
+void build_ectp_eth_hdr(const struct ether_addr *srcmac,
+			const struct ether_addr *dstmac,
+			struct ether_header *eth_hdr)
+{
+
+
+	memcpy(eth_hdr->ether_shost, srcmac, sizeof(struct ether_addr));
+	memcpy(eth_hdr->ether_dhost, dstmac, sizeof(struct ether_addr));
+
+	eth_hdr->ether_type = htons(ETHERTYPE_LOOPBACK);
+
+}
+
+
+enum BUILD_ECTP_FRAME build_ectp_frame(
+				   const struct program_parameters *prog_parms,
+				   uint8_t frame_buf[],
+				   const unsigned int frame_buf_sz,
+				   const uint8_t *prog_data,
+				   const unsigned int prog_data_size,
+				   unsigned int *ectp_frame_len)
+{
+	unsigned int ectp_pkt_len;
+	unsigned int frame_payload_size;
+	uint8_t *frame_payload;
+	const struct ether_addr *fwdaddrs;
+	unsigned int num_fwdaddrs;
+	unsigned int user_data_size;
+	unsigned int base_len;
+	unsigned int max_len;
+
+
+	if (sizeof(struct ether_header) > frame_buf_sz)
+		return BUILD_ECTP_FRAME_BADBUFSIZE;
+
+	build_ectp_eth_hdr(&prog_parms->srcmac, &prog_parms->dstmac,
+		(struct ether_header *)&frame_buf[0]);
+	
+	if (prog_parms->num_fwdaddrs) {
+		num_fwdaddrs = prog_parms->num_fwdaddrs;
+		fwdaddrs = prog_parms->fwdaddrs;
+	} else {
+		num_fwdaddrs = 1;
+		fwdaddrs = &prog_parms->srcmac;
+	}
+
+	user_data_size = prog_parms->ectp_user_data_size;
+
+	/*
+	 * the user data is only filler, sized for the MTU, so trim it to fit
+	 * the frame size, or without one, the MTU less the ECTP header
+	 */
+	max_len = (prog_parms->frame_size > 0) ? prog_parms->frame_size :
+		prog_parms->mtu + ETH_HLEN;
+	base_len = ETH_HLEN + ectp_calc_packet_size(num_fwdaddrs,
+		prog_data_size);
+	if ((base_len + user_data_size) > max_len)
+		user_data_size = (max_len > base_len) ? max_len - base_len : 0;
+
+	frame_payload_size = prog_data_size + user_data_size;
+
+	ectp_pkt_len = ectp_calc_packet_size(num_fwdaddrs, frame_payload_size);
+
+	/* pad out to the requested frame size */
+	if ((ETH_HLEN + ectp_pkt_len) < prog_parms->frame_size) {
+		frame_payload_size += prog_parms->frame_size -
+			(ETH_HLEN + ectp_pkt_len);
+		ectp_pkt_len = prog_parms->frame_size - ETH_HLEN;
+	}
+
+	if (ectp_pkt_len > (frame_buf_sz - ETH_HLEN))
+		return BUILD_ECTP_FRAME_BADBUFSIZE;
+
+	/*
+	 * built in place, the packet zeroed out to its length and then the
+	 * user data copied in after the program's, so the padding stays zero
+	 */
+	ectp_build_packet(0, fwdaddrs, num_fwdaddrs, ectpping_pid,
+		prog_data, prog_data_size, &frame_buf[ETH_HLEN],
+		ectp_pkt_len, 0x00);
+
+	frame_payload = &frame_buf[ETH_HLEN +
+		ectp_calc_packet_size(num_fwdaddrs, 0)];
+
+	memcpy(&frame_payload[prog_data_size], prog_parms->ectp_user_data,
+		user_data_size);
+
+	if (prog_parms->crc)
+		set_payload_crc(frame_payload, frame_payload_size);
+
+	*ectp_frame_len = ETH_HLEN + ectp_pkt_len;
+
+	return BUILD_ECTP_FRAME_GOOD;
+
+}
+
+
+/*
+ * ECTP frame sender thread
+ */
+void *tx_thread(void *arg) {
+    struct tx_thread_arguments *tx_args = (struct tx_thread_arguments *)arg;
+    const struct program_parameters *prog_parms = tx_args->prog_parms;
+    struct probe_iface *pif = tx_args->pif;
+    const unsigned int tx_frame_buf_sz = tx_frame_buf_size(prog_parms);
+    uint8_t *tx_frame_buf;
+    uint64_t launch_ns;
+    struct ectpping_payload eping_payload = {
+        .seq_num = 0,
+    };
+    sigset_t sigint_set;
+
+    /*
+     * leave SIGINT to the main thread, so its handler never runs between
+     * a probe being sent and counted
+     */
+    sigemptyset(&sigint_set);
+    sigaddset(&sigint_set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigint_set, NULL);
+
+    tx_frame_buf = malloc(tx_frame_buf_sz);
+    if (tx_frame_buf == NULL) {
+        fprintf(stderr, "Failed to allocate transmit buffer\n");
+        tx_thread_stopped(pif);
+        return NULL;
+    }
+
+    if (prog_parms->rt) {
+        prefault_stack();
+        memset(tx_frame_buf, 0, tx_frame_buf_sz);
+    }
+
+    pthread_cleanup_push(tx_thread_stopped, pif);
+    pthread_cleanup_push(free, tx_frame_buf);
+
+    while (true) {
+        if (prog_parms->txtime)
+            launch_ns = pacer_wait_lead(&pif->pacer, prog_parms->txtime_lead_ns);
+        else
+            launch_ns = pacer_wait(&pif->pacer);
+
+        switch (prog_parms->mode) {
+        case ECTPPING_MODE_THROUGHPUT:
+            run_throughput_test(tx_args, tx_frame_buf, tx_frame_buf_sz,
+                &eping_payload);
+            goto finished;
+        case ECTPPING_MODE_MATRIX:
+            run_latency_matrix(tx_args, tx_frame_buf, tx_frame_buf_sz,
+                &eping_payload);
+            goto finished;
+        case ECTPPING_MODE_PMTU:
+            run_pmtu_discovery(tx_args, tx_frame_buf, tx_frame_buf_sz,
+                &eping_payload);
+            goto finished;
+        case ECTPPING_MODE_HOPS:
+            tx_probe_hops(tx_args, tx_frame_buf, tx_frame_buf_sz,
+                &eping_payload, launch_ns);
+            break;
+        case ECTPPING_MODE_TRAIN:
+            tx_probe_train(tx_args, tx_frame_buf, tx_frame_buf_sz,
+                &eping_payload, launch_ns);
+            break;
+        case ECTPPING_MODE_DAEMON:
+            tx_probe_daemon(tx_args, tx_frame_buf, tx_frame_buf_sz,
+                &eping_payload, launch_ns);
+            break;
+        case ECTPPING_MODE_PING:
+        default:
+            rategov_wait(&pif->rategov_share, 1);
+            tx_probe(tx_args, tx_frame_buf, tx_frame_buf_sz,
+                &eping_payload, launch_ns);
+            break;
+        }
+
+        /*
+         * with SO_TXTIME the kernel holds the frame until its launch time,
+         * so what's measured is when it was handed to the kernel
+         */
+        pacer_sent(&pif->pacer, pacer_now_ns());
+    }
+
+finished:
+    pthread_cleanup_pop(1);
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+
+/*
+ * Let finish_ectpping() know the tx thread has stopped sending
+ */
+void tx_thread_stopped(void *arg)
+{
+	struct probe_iface *pif = (struct probe_iface *)arg;
+
+
+	atomic_store(&pif->tx_thread_stopped, true);
+
+}
+
+
+/*
+ * Room for one frame, or in train mode for a whole train of them, so
+ * they can all be built before the first is sent
+ */
+unsigned int tx_frame_buf_size(const struct program_parameters *prog_parms)
+{
+	const unsigned int frame_buf_sz = (prog_parms->frame_size > 0) ?
+		prog_parms->frame_size : prog_parms->mtu + ETH_HLEN;
+
+
+	if (prog_parms->mode == ECTPPING_MODE_TRAIN)
+		return frame_buf_sz * prog_parms->train_len;
+
+	return prog_parms->mtu + ETH_HLEN;
+
+}
+
+
+/*
+ * Build a probe frame carrying eping_payload, whose send time has already
+ * been set. false if it couldn't be built.
+ */
+bool build_probe(struct tx_thread_arguments *tx_args,
+		 uint8_t frame_buf[],
+		 const unsigned int frame_buf_sz,
+		 const struct ectpping_payload *eping_payload,
+		 unsigned int *frame_len,
+		 uint64_t *tx_ns)
+{
+
+
+	switch (build_ectp_frame(tx_args->prog_parms, frame_buf, frame_buf_sz,
+		(const uint8_t *)eping_payload, sizeof(struct ectpping_payload),
+		frame_len)) {
+	case BUILD_ECTP_FRAME_GOOD:
+		break;
+	case BUILD_ECTP_FRAME_BADBUFSIZE:
+	default:
+		/* not sent, but counted with the send errors */
+		sockstat_txerr(&tx_args->pif->tx_errs, EMSGSIZE);
+		return false;
+	}
+
+	*tx_ns = ((uint64_t)eping_payload->tv.tv_sec * 1000000000ULL) +
+		((uint64_t)eping_payload->tv.tv_usec * 1000ULL);
+
+	ECTPPING_PROBE(frame_build, eping_payload->seq_num, *tx_ns,
+		*frame_len);
+
+	return true;
+
+}
+
+
+/*
+ * Track a built probe frame as sent at tx_ns, just before it's sent, so
+ * it's always ahead of its reply
+ */
+void track_probe(struct tx_thread_arguments *tx_args,
+		 const uint8_t frame_buf[],
+		 const unsigned int frame_len,
+		 const struct ectpping_payload *eping_payload,
+		 const uint64_t tx_ns)
+{
+
+
+	seqtrack_sent_tag(&tx_args->pif->probe_track, eping_payload->seq_num,
+		tx_ns, frame_len, eping_payload->path_id);
+
+	if (tx_args->capture_ring != NULL)
+		pcapng_ring_put(tx_args->capture_ring,
+			tx_args->pif - probe_ifaces, tx_ns, frame_buf,
+			frame_len, NULL, 0);
+
+}
+
+
+/*
+ * Send a built probe frame, tracked as sent at tx_ns. With SO_TXTIME, the
+ * kernel sends it at launch_ns, otherwise it's sent now. Returns 0, or the
+ * errno if the send failed, which is counted with the send errors.
+ */
+int send_probe(struct tx_thread_arguments *tx_args,
+	       const uint8_t frame_buf[],
+	       const unsigned int frame_len,
+	       const uint32_t seq_num,
+	       const uint64_t tx_ns,
+	       const uint64_t launch_ns)
+{
+	int send_err = 0;
+
+
+	if (tx_args->prog_parms->txtime) {
+		if (send_txtime_frame(tx_args->tx_sockfd, frame_buf,
+			frame_len, launch_ns,
+			&tx_args->pif->txtime_stats) == SEND_TXTIME_FRAME_BAD)
+			send_err = errno;
+		process_tx_errqueue(tx_args->tx_sockfd,
+			&tx_args->pif->txtime_stats);
+	} else if (send(*tx_args->tx_sockfd, frame_buf, frame_len,
+		MSG_DONTWAIT) == -1) {
+		send_err = errno;
+	}
+
+	ECTPPING_PROBE(tx_send, seq_num, tx_ns, frame_len, send_err);
+
+	if (send_err != 0)
+		sockstat_txerr(&tx_args->pif->tx_errs, send_err);
+
+	return send_err;
+
+}
+
+
+/*
+ * Build and send a single probe, using the next sequence number. With
+ * SO_TXTIME, the kernel sends it at launch_ns, otherwise it's sent now.
+ * false if it couldn't be built or sent.
+ */
+bool tx_probe(struct tx_thread_arguments *tx_args,
+	      uint8_t tx_frame_buf[],
+	      const unsigned int tx_frame_buf_sz,
+	      struct ectpping_payload *eping_payload,
+	      const uint64_t launch_ns)
+{
+	const struct program_parameters *prog_parms = tx_args->prog_parms;
+	unsigned int ectp_frame_len;
+	uint64_t tx_ns;
+	int send_err;
+	int cancel_state;
+
+
+	if (prog_parms->txtime)
+		mono_ns_to_timeval(launch_ns, &eping_payload->tv);
+	else
+		gettimeofday(&eping_payload->tv, NULL);
+
+	if (!build_probe(tx_args, tx_frame_buf, tx_frame_buf_sz,
+		eping_payload, &ectp_frame_len, &tx_ns))
+		return false;
+
+	track_probe(tx_args, tx_frame_buf, ectp_frame_len, eping_payload,
+		tx_ns);
+
+	/* a probe that's sent is always counted, even if we're cancelled */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+	send_err = send_probe(tx_args, tx_frame_buf, ectp_frame_len,
+		eping_payload->seq_num, tx_ns, launch_ns);
+
+	pthread_mutex_lock(&stats_mutex);
+	tx_args->pif->txed_pkts++;
+	pthread_mutex_unlock(&stats_mutex);
+
+	pthread_setcancelstate(cancel_state, NULL);
+
+	eping_payload->seq_num++;
+
+	return (send_err == 0);
+
+}
+
+
+/*
+ * Evaluate the previous packet train, which has had a whole interval for
+ * its replies to come back, and then send the next one back to back. The
+ * whole train is built first, all carrying the same send time, so nothing
+ * but the sends themselves comes between its frames. A train is only ever
+ * sent whole, and always takes up train_len sequence numbers, so each
+ * train's frames are exactly the ones evaluated.
+ */
+void tx_probe_train(struct tx_thread_arguments *tx_args,
+		    uint8_t tx_frame_buf[],
+		    const unsigned int tx_frame_buf_sz,
+		    struct ectpping_payload *eping_payload,
+		    const uint64_t launch_ns)
+{
+	const struct program_parameters *prog_parms = tx_args->prog_parms;
+	struct probe_iface *pif = tx_args->pif;
+	const unsigned int frame_buf_sz = tx_frame_buf_sz /
+		prog_parms->train_len;
+	unsigned int frame_lens[TRAIN_LEN_MAX];
+	const uint32_t first_seq = eping_payload->seq_num;
+	uint64_t tx_ns;
+	int cancel_state;
+	unsigned int i;
+
+
+	if (pif->train_pending) {
+		eval_probe_train(pif, prog_parms, pif->train_first_seq,
+			prog_parms->train_len);
+		pif->train_pending = false;
+	}
+
+	rategov_wait(&pif->rategov_share, prog_parms->train_len);
+
+	if (prog_parms->txtime)
+		mono_ns_to_timeval(launch_ns, &eping_payload->tv);
+	else
+		gettimeofday(&eping_payload->tv, NULL);
+
+	for (i = 0; i < prog_parms->train_len; i++) {
+		eping_payload->seq_num = first_seq + i;
+		if (!build_probe(tx_args, &tx_frame_buf[i * frame_buf_sz],
+			frame_buf_sz, eping_payload, &frame_lens[i], &tx_ns))
+			break;
+	}
+
+	eping_payload->seq_num = first_seq + prog_parms->train_len;
+
+	if (i < prog_parms->train_len) {
+		/* skipped, but still a train, without an estimate */
+		dispersion_agg_add(&pif->train_agg,
+			DISPERSION_TRAIN_EST_TOOFEW, NULL);
+		if (!prog_parms->zero_pkt_output)
+			printf("train %u: not sent, frame %u couldn't be "
+				"built\n", first_seq / prog_parms->train_len,
+				i + 1);
+		return;
+	}
+
+	/* as tx_probe(), what's sent is counted, even if we're cancelled */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+	for (i = 0; i < prog_parms->train_len; i++) {
+		eping_payload->seq_num = first_seq + i;
+		track_probe(tx_args, &tx_frame_buf[i * frame_buf_sz],
+			frame_lens[i], eping_payload, tx_ns);
+	}
+
+	eping_payload->seq_num = first_seq + prog_parms->train_len;
+
+	for (i = 0; i < prog_parms->train_len; i++)
+		send_probe(tx_args, &tx_frame_buf[i * frame_buf_sz],
+			frame_lens[i], first_seq + i, tx_ns, launch_ns);
+
+	pthread_mutex_lock(&stats_mutex);
+	pif->txed_pkts += prog_parms->train_len;
+	pthread_mutex_unlock(&stats_mutex);
+
+	pif->train_first_seq = first_seq;
+	pif->train_pending = true;
+
+	pthread_setcancelstate(cancel_state, NULL);
+
+}
+
+
+/*
+ * The tx thread evaluates each train when it sends the next, so at exit
+ * the last train sent is still to be evaluated
+ */
+void eval_last_train(struct probe_iface *pif)
+{
+
+
+	if (!pif->train_pending)
+		return;
+
+	eval_probe_train(pif, &pif->parms, pif->train_first_seq,
+		pif->parms.train_len);
+	pif->train_pending = false;
+
+}
+
+
+/*
+ * Estimate capacity from the reply arrival times of the train starting at
+ * first_seq
+ */
+void eval_probe_train(struct probe_iface *pif,
+		      const struct program_parameters *prog_parms,
+		      const uint32_t first_seq,
+		      const unsigned int train_len)
+{
+	uint64_t rx_ns[TRAIN_LEN_MAX];
+	struct seqtrack_entry entry;
+	struct dispersion_train train;
+	enum DISPERSION_TRAIN_EST est;
+	unsigned int wire_bytes = prog_parms->frame_size +
+		DISPERSION_ETH_OVERHEAD;
+	unsigned int i;
+
+
+	for (i = 0; i < train_len; i++) {
+		rx_ns[i] = 0;
+		if (!seqtrack_lookup(&pif->probe_track, first_seq + i, &entry))
+			continue;
+		wire_bytes = entry.tx_len + DISPERSION_ETH_OVERHEAD;
+		if (entry.state == SEQTRACK_STATE_ANSWERED)
+			rx_ns[i] = entry.rx_ns;
+	}
+
+	est = dispersion_train_estimate(rx_ns, train_len, wire_bytes, &train);
+
+	dispersion_agg_add(&pif->train_agg, est, &train);
+
+	if (prog_parms->zero_pkt_output)
+		return;
+
+	if (prog_parms->num_ifaces > 1)
+		printf("%s ", prog_parms->iface);
+
+	printf("train %u: %u/%u frames of %u bytes", first_seq / train_len,
+		train.received, train.sent,
+		wire_bytes - DISPERSION_ETH_OVERHEAD);
+
+	switch (est) {
+	case DISPERSION_TRAIN_EST_GOOD:
+		printf(", dispersion %.3f usec, capacity %.3f Mbit/s, "
+			"available %.3f Mbit/s\n",
+			train.dispersion_ns / 1000.0,
+			train.capacity_bps / 1e6,
+			train.adr_bps / 1e6);
+		break;
+	case DISPERSION_TRAIN_EST_NOSPREAD:
+		printf(", replies not spread out\n");
+		break;
+	case DISPERSION_TRAIN_EST_TOOFEW:
+	default:
+		printf(", too few replies\n");
+		break;
+	}
+
+	fflush(NULL);
+
+}
+
+/*
+ * RFC 2544 throughput test. For each frame size, binary search for the
+ * highest frame rate at which the loss stays within the threshold, then
+ * print the results as a table.
+ */
+void run_throughput_test(struct tx_thread_arguments *tx_args,
+			 uint8_t tx_frame_buf[],
+			 const unsigned int tx_frame_buf_sz,
+			 struct ectpping_payload *eping_payload)
+{
+	const struct program_parameters *prog_parms = tx_args->prog_parms;
+	struct tput_result results[TPUT_SIZES_MAX];
+	unsigned int i;
+
+
+	for (i = 0; i < prog_parms->num_tput_sizes; i++)
+		throughput_search(tx_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, prog_parms->tput_sizes[i],
+			&results[i]);
+
+	print_throughput_table(prog_parms, results,
+		prog_parms->num_tput_sizes);
+
+}
+
+
+/*
+ * Binary search for the throughput rate of a single frame size. The upper
+ * bound is the -r rate if given, otherwise the interface's line rate for
+ * this frame size. The search is over the offered rate, while the rate
+ * reported is what was actually sent, which is flagged if the sender
+ * couldn't keep up with the offered rate.
+ */
+void throughput_search(struct tx_thread_arguments *tx_args,
+		       uint8_t tx_frame_buf[],
+		       const unsigned int tx_frame_buf_sz,
+		       struct ectpping_payload *eping_payload,
+		       const unsigned int size,
+		       struct tput_result *result)
+{
+	struct program_parameters trial_parms = *tx_args->prog_parms;
+	struct tx_thread_arguments trial_args = *tx_args;
+	struct tput_trial trial;
+	uint64_t ifspeed_mbps;
+	double lo = 0.0, hi, rate;
+
+
+	memset(result, 0, sizeof(struct tput_result));
+	result->size = size;
+
+	/* the lower bound first, so size - ETH_FCS_LEN can't wrap */
+	if (size < (ETH_ZLEN + ETH_FCS_LEN)) {
+		if (!trial_parms.zero_pkt_output)
+			printf("%u byte frames: skipped, the minimum is %u\n",
+				size, ETH_ZLEN + ETH_FCS_LEN);
+		return;
+	}
+
+	if ((size - ETH_FCS_LEN) > (trial_parms.mtu + ETH_HLEN)) {
+		if (!trial_parms.zero_pkt_output)
+			printf("%u byte frames: skipped, interface MTU is "
+				"%u\n", size, trial_parms.mtu);
+		return;
+	}
+
+	trial_parms.frame_size = size - ETH_FCS_LEN;
+	trial_args.prog_parms = &trial_parms;
+
+	if (trial_parms.rate_pps > 0) {
+		hi = trial_parms.rate_pps;
+	} else {
+		ifspeed_mbps = get_ifspeed_mbps(trial_parms.iface);
+		if (ifspeed_mbps > 0)
+			hi = (ifspeed_mbps * 1e6) /
+				((size + ETH_WIRE_OVERHEAD) * 8.0);
+		else
+			hi = TPUT_DEFAULT_MAX_PPS;
+	}
+
+	result->tested = true;
+	rate = hi;
+
+	while (result->trials < TPUT_TRIALS_MAX) {
+		throughput_trial(&trial_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, rate, &trial);
+		result->trials++;
+
+		if (!trial_parms.zero_pkt_output)
+			printf("%u byte frames: offered %llu fps, sent "
+				"%.0f fps, lost %llu/%llu (%.3f%%)\n", size,
+				(unsigned long long)trial.offered_pps,
+				trial.achieved_pps,
+				(unsigned long long)trial.lost,
+				(unsigned long long)trial.sent,
+				trial.loss_pct);
+
+		if (trial.loss_pct <= trial_parms.tput_loss_pct) {
+			lo = rate;
+			result->throughput_pps = trial.achieved_pps;
+			result->loss_pct = trial.loss_pct;
+			result->sender_limited =
+				(trial.achieved_pps < (0.95 * rate));
+		} else {
+			hi = rate;
+		}
+
+		if ((hi - lo) <= ((lo * 0.005) > 1.0 ? (lo * 0.005) : 1.0))
+			break;
+
+		rate = (lo + hi) / 2.0;
+	}
+
+}
+
+
+/*
+ * Send at a fixed offered rate for the trial duration, wait for the
+ * stragglers to come back, and count what didn't
+ */
+void throughput_trial(struct tx_thread_arguments *tx_args,
+		      uint8_t tx_frame_buf[],
+		      const unsigned int tx_frame_buf_sz,
+		      struct ectpping_payload *eping_payload,
+		      const uint64_t offered_pps,
+		      struct tput_trial *trial)
+{
+	const struct program_parameters *prog_parms = tx_args->prog_parms;
+	struct pacer pacer;
+	uint64_t sent_before, answered_before, answered;
+	uint64_t start_ns, end_ns, launch_ns;
+
+
+	memset(trial, 0, sizeof(struct tput_trial));
+	trial->offered_pps = (offered_pps > 0) ? offered_pps : 1;
+
+	pacer_init(&pacer, prog_parms->pacing_mode,
+		1000000000ULL / trial->offered_pps, prog_parms->pacing_spin_ns);
+
+	sent_before = atomic_load(&tx_args->pif->probe_track.sent);
+	answered_before = atomic_load(&tx_args->pif->probe_track.answered);
+
+	start_ns = pacer_now_ns();
+	pacer_start(&pacer, start_ns);
+	end_ns = start_ns + prog_parms->tput_trial_ns;
+
+	while (true) {
+		if (prog_parms->txtime)
+			launch_ns = pacer_wait_lead(&pacer,
+				prog_parms->txtime_lead_ns);
+		else
+			launch_ns = pacer_wait(&pacer);
+
+		if (launch_ns >= end_ns)
+			break;
+
+		rategov_wait(&tx_args->pif->rategov_share, 1);
+
+		tx_probe(tx_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, launch_ns);
+
+		pacer_sent(&pacer, pacer_now_ns());
+	}
+
+	usleep(TPUT_DRAIN_MS * 1000);
+
+	trial->sent = atomic_load(&tx_args->pif->probe_track.sent) - sent_before;
+	answered = atomic_load(&tx_args->pif->probe_track.answered) - answered_before;
+
+	trial->lost = (trial->sent > answered) ? trial->sent - answered : 0;
+
+	trial->achieved_pps = (trial->sent * 1e9) / prog_parms->tput_trial_ns;
+
+	if (trial->sent > 0)
+		trial->loss_pct = (trial->lost * 100.0) / trial->sent;
+
+}
+
+
+void print_throughput_table(const struct program_parameters *prog_parms,
+			    const struct tput_result results[],
+			    const unsigned int num_results)
+{
+	unsigned int i;
+
+
+	printf("--- %s ECTP throughput (RFC 2544), %llu.%03llu sec trials, "
+		"loss threshold %.3f%% ---\n", ether_ntoa(&prog_parms->dstmac),
+		(unsigned long long)(prog_parms->tput_trial_ns / 1000000000ULL),
+		(unsigned long long)((prog_parms->tput_trial_ns / 1000000ULL) %
+			1000ULL),
+		prog_parms->tput_loss_pct);
+
+	printf("%8s %12s %12s %9s %7s\n", "size", "frames/s", "Mbit/s",
+		"loss %", "trials");
+
+	for (i = 0; i < num_results; i++) {
+		if (!results[i].tested) {
+			printf("%8u %12s\n", results[i].size,
+				(results[i].size < (ETH_ZLEN + ETH_FCS_LEN)) ?
+				"too small" : "too big");
+			continue;
+		}
+		printf("%8u %12.0f %12.3f %9.3f %7u%s\n", results[i].size,
+			results[i].throughput_pps,
+			(results[i].throughput_pps *
+				(results[i].size + ETH_WIRE_OVERHEAD) * 8.0) /
+				1e6,
+			results[i].loss_pct, results[i].trials,
+			results[i].sender_limited ? " (sender limited)" : "");
+	}
+
+}
+
+
+/*
+ * Get the hops of the unicast test path, the destination followed by the
+ * forward addresses. A final forward address of our own, used to loop the
+ * -f route back, isn't a hop.
+ */
+enum GET_ROUTE_HOPS get_route_hops(const struct program_parameters *prog_parms,
+				   struct ether_addr **hops,
+				   unsigned int *num_hops)
+{
+	unsigned int num_fwdaddrs = prog_parms->num_fwdaddrs;
+
+
+	if ((num_fwdaddrs > 0) &&
+	    (memcmp(&prog_parms->fwdaddrs[num_fwdaddrs - 1],
+		&prog_parms->srcmac, ETH_ALEN) == 0))
+		num_fwdaddrs--;
+
+	*hops = calloc(num_fwdaddrs + 1, ETH_ALEN);
+	if (*hops == NULL)
+		return GET_ROUTE_HOPS_NOMEM;
+
+	memcpy(&(*hops)[0], &prog_parms->dstmac, ETH_ALEN);
+	memcpy(&(*hops)[1], prog_parms->fwdaddrs, num_fwdaddrs * ETH_ALEN);
+
+	*num_hops = num_fwdaddrs + 1;
+
+	return GET_ROUTE_HOPS_GOOD;
+
+}
+
+
+/*
+ * Set up parameters to probe the path through the first prefix_len hops
+ * and then back to us. fwdaddrs_buf needs room for prefix_len addresses.
+ */
+void set_prefix_route(struct program_parameters *prog_parms,
+		      const struct ether_addr hops[],
+		      const unsigned int prefix_len,
+		      struct ether_addr fwdaddrs_buf[])
+{
+
+
+	memcpy(&prog_parms->dstmac, &hops[0], ETH_ALEN);
+
+	memcpy(fwdaddrs_buf, &hops[1], (prefix_len - 1) * ETH_ALEN);
+	memcpy(&fwdaddrs_buf[prefix_len - 1], &prog_parms->srcmac, ETH_ALEN);
+
+	prog_parms->fwdaddrs = fwdaddrs_buf;
+	prog_parms->num_fwdaddrs = prefix_len;
+
+}
+
+
+/*
+ * Path MTU discovery. Each prefix of the route, looping back to us, is
+ * searched for the largest frame that makes it around, so where the MTU
+ * narrows along the route shows up as the hop where the size drops.
+ */
+void run_pmtu_discovery(struct tx_thread_arguments *tx_args,
+			uint8_t tx_frame_buf[],
+			const unsigned int tx_frame_buf_sz,
+			struct ectpping_payload *eping_payload)
+{
+	const struct program_parameters *prog_parms = tx_args->prog_parms;
+	struct program_parameters path_parms = *prog_parms;
+	struct tx_thread_arguments path_args = *tx_args;
+	struct ether_addr *hops, *fwdaddrs_buf;
+	unsigned int num_hops;
+	struct pmtu_result *results;
+	unsigned int i;
+
+
+	if (get_route_hops(prog_parms, &hops, &num_hops) !=
+		GET_ROUTE_HOPS_GOOD)
+		return;
+
+	fwdaddrs_buf = calloc(num_hops, ETH_ALEN);
+	results = calloc(num_hops, sizeof(struct pmtu_result));
+	if ((fwdaddrs_buf == NULL) || (results == NULL))
+		goto out;
+
+	path_args.prog_parms = &path_parms;
+
+	/* a hop that doesn't answer cuts off the ones after it */
+	for (i = 0; i < num_hops; i++) {
+		set_prefix_route(&path_parms, hops, i + 1, fwdaddrs_buf);
+		pmtu_search(&path_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, &results[i]);
+		if (!results[i].reachable)
+			break;
+	}
+
+	print_pmtu_results(prog_parms, hops, results, num_hops);
+
+out:
+	free(results);
+	free(fwdaddrs_buf);
+	free(hops);
+
+}
+
+
+/*
+ * Binary search for the largest frame size the current path carries. A
+ * size passes if any of its probes come back, so ordinary loss doesn't
+ * look like an MTU limit. The result is then probed again, along with the
+ * next size up, to catch paths whose MTU isn't consistent.
+ */
+void pmtu_search(struct tx_thread_arguments *tx_args,
+		 uint8_t tx_frame_buf[],
+		 const unsigned int tx_frame_buf_sz,
+		 struct ectpping_payload *eping_payload,
+		 struct pmtu_result *result)
+{
+	const unsigned int max_size = tx_args->prog_parms->mtu + ETH_HLEN;
+	unsigned int lo = ETH_ZLEN, hi = max_size, size;
+
+
+	memset(result, 0, sizeof(struct pmtu_result));
+
+	if (pmtu_probe_size(tx_args, tx_frame_buf, tx_frame_buf_sz,
+		eping_payload, lo, result) == 0)
+		return;
+
+	result->reachable = true;
+
+	if (pmtu_probe_size(tx_args, tx_frame_buf, tx_frame_buf_sz,
+		eping_payload, hi, result) > 0) {
+		result->max_frame_size = hi;
+		return;
+	}
+
+	/* lo always passes, hi always fails */
+	while ((hi - lo) > 1) {
+		size = lo + ((hi - lo) / 2);
+		if (pmtu_probe_size(tx_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, size, result) > 0)
+			lo = size;
+		else
+			hi = size;
+	}
+
+	result->max_frame_size = lo;
+
+	if ((pmtu_probe_size(tx_args, tx_frame_buf, tx_frame_buf_sz,
+		eping_payload, lo, result) == 0) ||
+	    (pmtu_probe_size(tx_args, tx_frame_buf, tx_frame_buf_sz,
+		eping_payload, lo + 1, result) > 0))
+		result->inconsistent = true;
+
+}
+
+
+/*
+ * Send a group of probes padded to frame_size, and return how many of them
+ * were answered before the timeout
+ */
+unsigned int pmtu_probe_size(struct tx_thread_arguments *tx_args,
+			     uint8_t tx_frame_buf[],
+			     const unsigned int tx_frame_buf_sz,
+			     struct ectpping_payload *eping_payload,
+			     const unsigned int frame_size,
+			     struct pmtu_result *result)
+{
+	struct program_parameters size_parms = *tx_args->prog_parms;
+	struct tx_thread_arguments size_args = *tx_args;
+	const uint32_t first_seq = eping_payload->seq_num;
+	struct seqtrack_entry entry;
+	uint64_t deadline_ns;
+	unsigned int answered;
+	unsigned int i;
+
+
+	size_parms.frame_size = frame_size;
+	size_args.prog_parms = &size_parms;
+
+	rategov_wait(&tx_args->pif->rategov_share, PMTU_PROBES);
+
+	for (i = 0; i < PMTU_PROBES; i++)
+		tx_probe(&size_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, pacer_now_ns() +
+			(size_parms.txtime ? size_parms.txtime_lead_ns : 0));
+
+	result->probed_sizes++;
+
+	deadline_ns = pacer_now_ns() + (PMTU_TIMEOUT_MS * 1000000ULL);
+
+	while (true) {
+		answered = 0;
+		for (i = 0; i < PMTU_PROBES; i++)
+			if (seqtrack_lookup(&tx_args->pif->probe_track,
+				first_seq + i,
+				&entry) &&
+			    (entry.state == SEQTRACK_STATE_ANSWERED))
+				answered++;
+
+		if ((answered == PMTU_PROBES) || (pacer_now_ns() > deadline_ns))
+			break;
+
+		usleep(PMTU_POLL_MS * 1000);
+	}
+
+	return answered;
+
+}
+
+
+/*
+ * Print the largest frame size of each route prefix, flagging where the
+ * MTU narrows or behaves oddly
+ */
+void print_pmtu_results(const struct program_parameters *prog_parms,
+			const struct ether_addr hops[],
+			const struct pmtu_result results[],
+			const unsigned int num_hops)
+{
+	const unsigned int if_max = prog_parms->mtu + ETH_HLEN;
+	unsigned int prev_max = if_max;
+	unsigned int i;
+
+
+	printf("--- ECTP path MTU, %s frame size %u (MTU %u) ---\n",
+		prog_parms->iface, if_max, prog_parms->mtu);
+
+	for (i = 0; i < num_hops; i++) {
+		printf("%2u ", i + 1);
+		print_ethaddr_hostname(&hops[i], !prog_parms->no_resolve);
+
+		if (!results[i].reachable) {
+			printf(": no reply, later hops not tested\n");
+			break;
+		}
+
+		printf(": max frame %u bytes (MTU %u), %u sizes probed\n",
+			results[i].max_frame_size,
+			results[i].max_frame_size - ETH_HLEN,
+			results[i].probed_sizes);
+
+		if (results[i].inconsistent)
+			printf("\t! inconsistent, replies came and went around "
+				"%u bytes\n", results[i].max_frame_size);
+
+		if ((results[i].max_frame_size < prev_max) && (i == 0))
+			printf("\t! MTU narrows to %u on the way here, or on "
+				"the way back\n",
+				results[i].max_frame_size - ETH_HLEN);
+		else if (results[i].max_frame_size < prev_max)
+			printf("\t! MTU narrows to %u between hop %u and "
+				"here, or on the way back from here\n",
+				results[i].max_frame_size - ETH_HLEN, i);
+		else if ((i > 0) && (results[i].max_frame_size > prev_max))
+			printf("\t! MTU is larger than via hop %u alone, so "
+				"the link back from hop %u is narrower than "
+				"the way on - asymmetric MTU\n", i, i);
+
+		prev_max = results[i].max_frame_size;
+	}
+
+}
+
+
+/*
+ * Set up a probe path for each prefix of the route, each looping back to
+ * us, for hop by hop mode
+ */
+enum SETUP_HOP_PATHS setup_hop_paths(const struct program_parameters
+					 *prog_parms)
+{
+	struct ether_addr *hops;
+	unsigned int num_hops;
+	unsigned int i;
+
+
+	if (get_route_hops(prog_parms, &hops, &num_hops) !=
+		GET_ROUTE_HOPS_GOOD)
+		return SETUP_HOP_PATHS_NOMEM;
+
+	hop_paths = calloc(num_hops, sizeof(struct hop_path));
+	if (hop_paths == NULL) {
+		free(hops);
+		return SETUP_HOP_PATHS_NOMEM;
+	}
+
+	for (i = 0; i < num_hops; i++) {
+		hop_paths[i].fwdaddrs = calloc(i + 1, ETH_ALEN);
+		if (hop_paths[i].fwdaddrs == NULL) {
+			while (i > 0)
+				free(hop_paths[--i].fwdaddrs);
+			free(hop_paths);
+			hop_paths = NULL;
+			free(hops);
+			return SETUP_HOP_PATHS_NOMEM;
+		}
+		memcpy(&hop_paths[i].hop, &hops[i], ETH_ALEN);
+		hop_paths[i].parms = *prog_parms;
+		set_prefix_route(&hop_paths[i].parms, hops, i + 1,
+			hop_paths[i].fwdaddrs);
+		hist_init(&hop_paths[i].rtt_ns);
+	}
+
+	num_hop_paths = num_hops;
+
+	free(hops);
+
+	return SETUP_HOP_PATHS_GOOD;
+
+}
+
+
+/*
+ * Send a probe along each prefix of the route, one after the other, so
+ * the hops are sampled under the same conditions
+ */
+void tx_probe_hops(struct tx_thread_arguments *tx_args,
+		   uint8_t tx_frame_buf[],
+		   const unsigned int tx_frame_buf_sz,
+		   struct ectpping_payload *eping_payload,
+		   const uint64_t launch_ns)
+{
+	struct tx_thread_arguments path_args = *tx_args;
+	unsigned int i;
+
+
+	rategov_wait(&tx_args->pif->rategov_share, num_hop_paths);
+
+	for (i = 0; i < num_hop_paths; i++) {
+		path_args.prog_parms = &hop_paths[i].parms;
+		eping_payload->path_id = i;
+		tx_probe(&path_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, launch_ns);
+		hop_paths[i].sent++;
+	}
+
+}
+
+
+/*
+ * Record the round trip time of a reply in hop by hop mode
+ */
+void record_hop_reply(const struct ectpping_payload *eping_payload,
+		      const struct timespec *pkt_arrived)
+{
+	int64_t rtt_ns;
+
+
+	if (eping_payload->path_id >= num_hop_paths)
+		return;
+
+	rtt_ns = (((int64_t)pkt_arrived->tv_sec - eping_payload->tv.tv_sec) *
+		1000000000LL) + (pkt_arrived->tv_nsec -
+		((int64_t)eping_payload->tv.tv_usec * 1000LL));
+
+	/* hop paths are shared by the rx workers */
+	pthread_mutex_lock(&stats_mutex);
+	hop_paths[eping_payload->path_id].answered++;
+	hist_add(&hop_paths[eping_payload->path_id].rtt_ns,
+		(rtt_ns > 0) ? rtt_ns : 0);
+	pthread_mutex_unlock(&stats_mutex);
+
+}
+
+
+/*
+ * Print per hop loss and round trip percentiles, and how much each hop
+ * adds to those of the hop before it
+ */
+void print_hop_stats(const struct program_parameters *prog_parms)
+{
+	const struct hop_path *hp;
+	char macpbuf[ENET_PADDR_MAXSZ];
+	double loss_pct, prev_loss_pct = 0.0;
+	uint64_t p50, prev_p50 = 0;
+	unsigned int i;
+
+
+	printf("--- hop by hop round trips (usec), each hop looped back "
+		"---\n");
+	printf("%-3s %-17s %7s %7s %7s %9s %9s %9s %9s %9s %9s\n", "hop",
+		"address", "sent", "loss%", "+loss%", "min", "p50", "p90",
+		"p99", "max", "+p50");
+
+	/* the rx workers record the replies under it */
+	pthread_mutex_lock(&stats_mutex);
+
+	for (i = 0; i < num_hop_paths; i++) {
+		hp = &hop_paths[i];
+
+		loss_pct = 0.0;
+		if (hp->sent > 0)
+			loss_pct = ((hp->sent - hp->answered) * 100.0) /
+				hp->sent;
+
+		enet_ntop(&hp->hop, ENET_NTOP_UNIX, macpbuf, ENET_PADDR_MAXSZ);
+
+		printf("%-3u %-17s %7llu %7.2f %+7.2f", i + 1, macpbuf,
+			(unsigned long long)hp->sent, loss_pct,
+			loss_pct - prev_loss_pct);
+
+		if (hp->rtt_ns.count == 0) {
+			printf(" %9s\n", "no replies");
+			prev_loss_pct = loss_pct;
+			continue;
+		}
+
+		p50 = hist_percentile(&hp->rtt_ns, 50.0);
+
+		printf(" %9.1f %9.1f %9.1f %9.1f %9.1f %+9.1f\n",
+			hp->rtt_ns.min / 1000.0, p50 / 1000.0,
+			hist_percentile(&hp->rtt_ns, 90.0) / 1000.0,
+			hist_percentile(&hp->rtt_ns, 99.0) / 1000.0,
+			hp->rtt_ns.max / 1000.0,
+			((int64_t)p50 - (int64_t)prev_p50) / 1000.0);
+
+		prev_loss_pct = loss_pct;
+		prev_p50 = p50;
+	}
+
+	pthread_mutex_unlock(&stats_mutex);
+
+}
+
+
+/*
+ * All pairs latency matrix. The assistants are the hops of the unicast
+ * route, or else those that answer a few probes to the (multicast or
+ * broadcast) destination. Every ordered pair A, B is then probed as
+ * us -> A -> B -> us, along with the us -> A -> us baselines, every
+ * interval for the -D duration. Each round is sent under the rate
+ * governor, so the whole matrix is measured concurrently within the rate
+ * budget.
+ */
+void run_latency_matrix(struct tx_thread_arguments *tx_args,
+			uint8_t tx_frame_buf[],
+			const unsigned int tx_frame_buf_sz,
+			struct ectpping_payload *eping_payload)
+{
+	const struct program_parameters *prog_parms = tx_args->prog_parms;
+	struct tx_thread_arguments path_args = *tx_args;
+	struct pacer pacer;
+	unsigned int n, num_paths, i;
+	uint64_t end_ns, launch_ns;
+
+
+	if (prog_parms->uc_dstmac)
+		get_route_assistants(prog_parms);
+	else
+		discover_assistants(tx_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload);
+
+	n = num_matrix_assistants;
+	if (n == 0) {
+		printf("No loopback assistants found\n");
+		return;
+	}
+
+	if (setup_matrix_paths(prog_parms) != SETUP_MATRIX_PATHS_GOOD) {
+		fprintf(stderr, "Failed to allocate latency matrix paths\n");
+		return;
+	}
+
+	num_paths = n * n;
+
+	if (!prog_parms->zero_pkt_output)
+		printf("Measuring %u paths between %u assistants\n",
+			num_paths, n);
+
+	pacer_init(&pacer, prog_parms->pacing_mode, prog_parms->interval_ns,
+		prog_parms->pacing_spin_ns);
+	pacer_start(&pacer, pacer_now_ns());
+	end_ns = pacer_now_ns() + prog_parms->tput_trial_ns;
+
+	while (true) {
+		launch_ns = pacer_wait(&pacer);
+		if (launch_ns >= end_ns)
+			break;
+
+		for (i = 0; i < num_paths; i++) {
+			rategov_wait(&tx_args->pif->rategov_share, 1);
+			path_args.prog_parms = &matrix_paths[i].parms;
+			eping_payload->path_id = i;
+			if (tx_probe(&path_args, tx_frame_buf, tx_frame_buf_sz,
+				eping_payload, pacer_now_ns() +
+				(prog_parms->txtime ?
+					prog_parms->txtime_lead_ns : 0)))
+				matrix_paths[i].sent++;
+		}
+
+		pacer_sent(&pacer, pacer_now_ns());
+	}
+
+	usleep(MATRIX_DRAIN_MS * 1000);
+
+}
+
+
+/*
+ * Take the assistants from the unicast route
+ */
+void get_route_assistants(const struct program_parameters *prog_parms)
+{
+	struct ether_addr *hops;
+	unsigned int num_hops;
+	unsigned int i;
+
+
+	if (get_route_hops(prog_parms, &hops, &num_hops) !=
+		GET_ROUTE_HOPS_GOOD)
+		return;
+
+	for (i = 0; i < num_hops; i++)
+		add_matrix_assistant(prog_parms, &hops[i]);
+
+	free(hops);
+
+}
+
+
+/*
+ * Find the assistants that answer probes to the destination. The rx
+ * threads add every one that replies while discovery is on.
+ */
+void discover_assistants(struct tx_thread_arguments *tx_args,
+			 uint8_t tx_frame_buf[],
+			 const unsigned int tx_frame_buf_sz,
+			 struct ectpping_payload *eping_payload)
+{
+	const struct program_parameters *prog_parms = tx_args->prog_parms;
+	unsigned int i;
+
+
+	atomic_store(&matrix_discovering, true);
+
+	eping_payload->path_id = UINT32_MAX;
+
+	for (i = 0; i < MATRIX_DISCOVERY_PROBES; i++) {
+		rategov_wait(&tx_args->pif->rategov_share, 1);
+		tx_probe(tx_args, tx_frame_buf, tx_frame_buf_sz,
+			eping_payload, pacer_now_ns() +
+			(prog_parms->txtime ? prog_parms->txtime_lead_ns : 0));
+		usleep((MATRIX_DISCOVERY_MS / MATRIX_DISCOVERY_PROBES) * 1000);
+	}
+
+	atomic_store(&matrix_discovering, false);
+
+}
+
+
+/*
+ * Add an assistant to the matrix, ignoring ourselves and duplicates
+ */
+void add_matrix_assistant(const struct program_parameters *prog_parms,
+			  const struct ether_addr *assistant)
+{
+	unsigned int i;
+
+
+	if (memcmp(assistant, &prog_parms->srcmac, ETH_ALEN) == 0)
+		return;
+
+	pthread_mutex_lock(&stats_mutex);
+
+	for (i = 0; i < num_matrix_assistants; i++)
+		if (memcmp(assistant, &matrix_assistants[i], ETH_ALEN) == 0)
+			break;
+
+	if ((i == num_matrix_assistants) &&
+	    (num_matrix_assistants < MATRIX_MAX_ASSISTANTS)) {
+		memcpy(&matrix_assistants[i], assistant, ETH_ALEN);
+		num_matrix_assistants++;
+	}
+
+	pthread_mutex_unlock(&stats_mutex);
+
+}
+
+
+/*
+ * Set up the path for each ordered pair of assistants. Path a * n + b goes
+ * us -> a -> b -> us, and path a * n + a is a's us -> a -> us baseline.
+ */
+enum SETUP_MATRIX_PATHS setup_matrix_paths(const struct program_parameters
+					       *prog_parms)
+{
+	const unsigned int n = num_matrix_assistants;
+	struct matrix_path *mp;
+	unsigned int a, b;
+
+
+	matrix_paths = calloc(n * n, sizeof(struct matrix_path));
+	if (matrix_paths == NULL)
+		return SETUP_MATRIX_PATHS_NOMEM;
+
+	for (a = 0; a < n; a++) {
+		for (b = 0; b < n; b++) {
+			mp = &matrix_paths[(a * n) + b];
+			mp->parms = *prog_parms;
+			memcpy(&mp->parms.dstmac, &matrix_assistants[a],
+				ETH_ALEN);
+			mp->parms.uc_dstmac = true;
+			if (a == b) {
+				memcpy(&mp->fwdaddrs[0], &prog_parms->srcmac,
+					ETH_ALEN);
+				mp->parms.num_fwdaddrs = 1;
+			} else {
+				memcpy(&mp->fwdaddrs[0], &matrix_assistants[b],
+					ETH_ALEN);
+				memcpy(&mp->fwdaddrs[1], &prog_parms->srcmac,
+					ETH_ALEN);
+				mp->parms.num_fwdaddrs = 2;
+			}
+			mp->parms.fwdaddrs = mp->fwdaddrs;
+		}
+	}
+
+	atomic_store_explicit(&num_matrix_paths, n * n, memory_order_release);
+
+	return SETUP_MATRIX_PATHS_GOOD;
+
+}
+
+
+/*
+ * Record a reply in latency matrix mode, called from the rx workers
+ */
+void record_matrix_reply(const struct ectpping_payload *eping_payload,
+			 const struct timespec *pkt_arrived)
+{
+	struct matrix_path *mp;
+	uint64_t *rtts;
+	unsigned int alloced;
+	int64_t rtt_ns;
+
+
+	if (eping_payload->path_id >= atomic_load_explicit(&num_matrix_paths,
+		memory_order_acquire))
+		return;
+
+	mp = &matrix_paths[eping_payload->path_id];
+
+	rtt_ns = (((int64_t)pkt_arrived->tv_sec - eping_payload->tv.tv_sec) *
+		1000000000LL) + (pkt_arrived->tv_nsec -
+		((int64_t)eping_payload->tv.tv_usec * 1000LL));
+
+	pthread_mutex_lock(&stats_mutex);
+
+	if (mp->num_rtts == mp->alloced_rtts) {
+		alloced = (mp->alloced_rtts > 0) ? mp->alloced_rtts * 2 : 16;
+		rtts = realloc(mp->rtt_ns, alloced * sizeof(uint64_t));
+		if (rtts == NULL) {
+			pthread_mutex_unlock(&stats_mutex);
+			return;
+		}
+		mp->rtt_ns = rtts;
+		mp->alloced_rtts = alloced;
+	}
+
+	mp->rtt_ns[mp->num_rtts++] = (rtt_ns > 0) ? rtt_ns : 0;
+	mp->answered++;
+
+	pthread_mutex_unlock(&stats_mutex);
+
+}
+
+
+int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+
+	return (*x > *y) - (*x < *y);
+
+}
+
+
+/*
+ * Median round trip of a path, false if it had no replies
+ */
+bool matrix_path_median(struct matrix_path *mp, double *median_ns)
+{
+
+
+	if (mp->num_rtts == 0)
+		return false;
+
+	qsort(mp->rtt_ns, mp->num_rtts, sizeof(uint64_t), cmp_u64);
+
+	if (mp->num_rtts % 2)
+		*median_ns = mp->rtt_ns[mp->num_rtts / 2];
+	else
+		*median_ns = (mp->rtt_ns[(mp->num_rtts / 2) - 1] +
+			mp->rtt_ns[mp->num_rtts / 2]) / 2.0;
+
+	return true;
+
+}
+
+
+/*
+ * Print the matrix of A -> B latencies. The us -> A -> B -> us round trip
+ * is d(us, A) + d(A, B) + d(B, us), so taking away half of each of the
+ * us -> A -> us and us -> B -> us baselines leaves d(A, B). Medians are
+ * used throughout, so the odd slow reply doesn't skew the result.
+ */
+void print_latency_matrix(const struct program_parameters *prog_parms)
+{
+	const unsigned int n = atomic_load(&num_matrix_paths) > 0 ?
+		num_matrix_assistants : 0;
+	double *baseline_ns, *latency_us, *loss_pct;
+	bool *have_baseline, *have_latency;
+	struct matrix_path *mp;
+	double median_ns;
+	unsigned int a, b, i;
+
+
+	if (n == 0)
+		return;
+
+	baseline_ns = calloc(n, sizeof(double));
+	have_baseline = calloc(n, sizeof(bool));
+	latency_us = calloc(n * n, sizeof(double));
+	have_latency = calloc(n * n, sizeof(bool));
+	loss_pct = calloc(n * n, sizeof(double));
+	if ((baseline_ns == NULL) || (have_baseline == NULL) ||
+	    (latency_us == NULL) || (have_latency == NULL) ||
+	    (loss_pct == NULL))
+		goto out;
+
+	/* the rx workers record the replies under it */
+	pthread_mutex_lock(&stats_mutex);
+
+	for (a = 0; a < n; a++)
+		have_baseline[a] = matrix_path_median(
+			&matrix_paths[(a * n) + a], &baseline_ns[a]);
+
+	for (i = 0; i < (n * n); i++) {
+		mp = &matrix_paths[i];
+		a = i / n;
+		b = i % n;
+		if (mp->sent > 0)
+			loss_pct[i] = ((mp->sent - mp->answered) * 100.0) /
+				mp->sent;
+		if ((a == b) || !have_baseline[a] || !have_baseline[b] ||
+		    !matrix_path_median(mp, &median_ns))
+			continue;
+		latency_us[i] = (median_ns - (baseline_ns[a] / 2.0) -
+			(baseline_ns[b] / 2.0)) / 1000.0;
+		have_latency[i] = true;
+	}
+
+	pthread_mutex_unlock(&stats_mutex);
+
+	switch (prog_parms->matrix_format) {
+	case MATRIX_FORMAT_CSV:
+		print_latency_matrix_csv(n, latency_us, have_latency);
+		break;
+	case MATRIX_FORMAT_JSON:
+		print_latency_matrix_json(n, baseline_ns, have_baseline,
+			latency_us, have_latency, loss_pct);
+		break;
+	case MATRIX_FORMAT_TEXT:
+	default:
+		print_latency_matrix_text(prog_parms, n, baseline_ns,
+			have_baseline, latency_us, have_latency, loss_pct);
+		break;
+	}
+
+out:
+	free(loss_pct);
+	free(have_latency);
+	free(latency_us);
+	free(have_baseline);
+	free(baseline_ns);
+
+}
+
+
+void print_latency_matrix_text(const struct program_parameters *prog_parms,
+			       const unsigned int n,
+			       const double baseline_ns[],
+			       const bool have_baseline[],
+			       const double latency_us[],
+			       const bool have_latency[],
+			       const double loss_pct[])
+{
+	unsigned int a, b;
+
+
+	printf("--- ECTP latency matrix (usec), %u assistants ---\n", n);
+
+	for (a = 0; a < n; a++) {
+		printf("%2u ", a + 1);
+		print_ethaddr_hostname(&matrix_assistants[a],
+			!prog_parms->no_resolve);
+		if (have_baseline[a])
+			printf(": rtt %.1f usec, %.1f%% loss\n",
+				baseline_ns[a] / 1000.0, loss_pct[(a * n) + a]);
+		else
+			printf(": no replies\n");
+	}
+
+	printf("from\\to");
+	for (b = 0; b < n; b++)
+		printf(" %9u", b + 1);
+	putchar('\n');
+
+	for (a = 0; a < n; a++) {
+		printf("%7u", a + 1);
+		for (b = 0; b < n; b++) {
+			if (have_latency[(a * n) + b])
+				printf(" %9.1f", latency_us[(a * n) + b]);
+			else
+				printf(" %9s", "-");
+		}
+		putchar('\n');
+	}
+
+}
+
+
+void print_latency_matrix_csv(const unsigned int n,
+			      const double latency_us[],
+			      const bool have_latency[])
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+	unsigned int a, b;
+
+
+	printf("from\\to");
+	for (b = 0; b < n; b++) {
+		enet_ntop(&matrix_assistants[b], ENET_NTOP_UNIX, macpbuf,
+			ENET_PADDR_MAXSZ);
+		printf(",%s", macpbuf);
+	}
+	putchar('\n');
+
+	for (a = 0; a < n; a++) {
+		enet_ntop(&matrix_assistants[a], ENET_NTOP_UNIX, macpbuf,
+			ENET_PADDR_MAXSZ);
+		printf("%s", macpbuf);
+		for (b = 0; b < n; b++) {
+			if (have_latency[(a * n) + b])
+				printf(",%.3f", latency_us[(a * n) + b]);
+			else
+				putchar(',');
+		}
+		putchar('\n');
+	}
+
+}
+
+
+void print_latency_matrix_json(const unsigned int n,
+			       const double baseline_ns[],
+			       const bool have_baseline[],
+			       const double latency_us[],
+			       const bool have_latency[],
+			       const double loss_pct[])
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+	unsigned int a, b;
+
+
+	printf("{\"assistants\":[");
+	for (a = 0; a < n; a++) {
+		enet_ntop(&matrix_assistants[a], ENET_NTOP_UNIX, macpbuf,
+			ENET_PADDR_MAXSZ);
+		printf("%s\"%s\"", (a > 0) ? "," : "", macpbuf);
+	}
+
+	printf("],\"baseline_rtt_us\":[");
+	for (a = 0; a < n; a++) {
+		if (have_baseline[a])
+			printf("%s%.3f", (a > 0) ? "," : "",
+				baseline_ns[a] / 1000.0);
+		else
+			printf("%snull", (a > 0) ? "," : "");
+	}
+
+	printf("],\"latency_us\":[");
+	for (a = 0; a < n; a++) {
+		printf("%s[", (a > 0) ? "," : "");
+		for (b = 0; b < n; b++) {
+			if (have_latency[(a * n) + b])
+				printf("%s%.3f", (b > 0) ? "," : "",
+					latency_us[(a * n) + b]);
+			else
+				printf("%snull", (b > 0) ? "," : "");
+		}
+		putchar(']');
+	}
+
+	printf("],\"loss_pct\":[");
+	for (a = 0; a < n; a++) {
+		printf("%s[", (a > 0) ? "," : "");
+		for (b = 0; b < n; b++)
+			printf("%s%.3f", (b > 0) ? "," : "",
+				loss_pct[(a * n) + b]);
+		putchar(']');
+	}
+
+	printf("]}\n");
+
+}
+
+
+/*
+ * ECTP frame receiver thread
+ */
+void *rx_thread(void *arg) {
+    struct rx_thread_arguments *rx_args = (struct rx_thread_arguments *)arg;
+    sigset_t sigint_set;
+
+    /* leave SIGINT to the other threads, as its handler joins this one */
+    sigemptyset(&sigint_set);
+    sigaddset(&sigint_set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sigint_set, NULL);
+
+    process_rxed_frames(rx_args->rx_sockfd, rx_args->prog_parms,
+        rx_args->pif, rx_args->stats, rx_args->capture_ring);
+    return NULL;
+}
+
+
+
+
+/*
+ * Opens the transmit socket used by the tx thread
+ */
+enum OPEN_TX_SKT open_tx_socket(int *tx_sockfd, const int tx_ifindex)
+{
+	struct sockaddr_ll sa_ll;
+
+
+	*tx_sockfd = socket(PF_PACKET, SOCK_RAW, 0);
+	if (*tx_sockfd == -1)
+		return OPEN_TX_SKT_BADSOCKET;
+
+	memset(&sa_ll, 0, sizeof(sa_ll));
+	sa_ll.sll_family = PF_PACKET;
+	sa_ll.sll_ifindex = tx_ifindex;
+
+	if ( bind(*tx_sockfd, (struct sockaddr *) &sa_ll, sizeof(sa_ll)) != 0) 
+		return OPEN_TX_SKT_BADIFINDEX;
+
+	/* if we get here, all's good */
+	return OPEN_TX_SKT_GOOD;
 
 }
 
 
 /*
- * Routine to get the ifindex of the supplied interface name
+ * Opens the receive socket used by the rx thread
  */
-enum GET_IFINDEX get_ifindex(const char iface[IFNAMSIZ], int *ifindex)
+enum OPEN_RX_SKT open_rx_socket(int *rx_sockfd, const int rx_ifindex)
 {
-	struct ifreq ifr;
-
+	struct sockaddr_ll sa_ll;
+	int enable = 1;
 
-	if (do_ifreq_ioctl(SIOCGIFINDEX, iface, &ifr) == DO_IFREQ_IOCTL_GOOD) {
-		*ifindex = ifr.ifr_ifindex;
-		return GET_IFINDEX_GOOD;
-	} else {
-		return GET_IFINDEX_BADIFACE;
-	}
 
-}
+	*rx_sockfd = socket(PF_PACKET, SOCK_DGRAM, htons(ETHERTYPE_LOOPBACK));
+	if (*rx_sockfd == -1)
+		return OPEN_RX_SKT_BADSOCKET;
 
+	if (setsockopt(*rx_sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+		sizeof(enable)) == -1)
+		return OPEN_RX_SKT_BADSOCKET;
 
-/*
- * Routine to get the mac address for an interface
- */
-enum GET_IFMAC get_ifmac(const char iface[IFNAMSIZ],
-			 struct ether_addr *ifmac)
-{
-	struct ifreq ifr;
+	memset(&sa_ll, 0, sizeof(sa_ll));
+	sa_ll.sll_family = PF_PACKET;
+	sa_ll.sll_ifindex = rx_ifindex;
 
+	if ( bind(*rx_sockfd, (struct sockaddr *) &sa_ll, sizeof(sa_ll)) != 0) 
+		return OPEN_RX_SKT_BADIFINDEX;
 
-	if (do_ifreq_ioctl(SIOCGIFHWADDR, iface, &ifr) == DO_IFREQ_IOCTL_GOOD) {
-		if (ifr.ifr_hwaddr.sa_family == ARPHRD_ETHER) {
-			memcpy(ifmac, ifr.ifr_hwaddr.sa_data,
-				sizeof(struct ether_addr));
-			return GET_IFMAC_GOOD;
-		} else {
-			return GET_IFMAC_BADIFACE;
-		}
-	} else {
-		return GET_IFMAC_BADIFACE;
-	}
+	/* if we get here, all's good */
+	return OPEN_RX_SKT_GOOD;
 
 }
 
 
 /*
- * Routine to open TX and RX PF_PACKET sockets
+ * Join the receive socket to the fanout group shared by the rx workers
  */
-int open_sockets(int *tx_sockfd, int *rx_sockfd, int ifindex) {
-    struct sockaddr_ll sa_ll;
+enum ENABLE_RX_FANOUT enable_rx_fanout(int *rx_sockfd,
+				       const int fanout_id,
+				       const int fanout)
+{
+	int fanout_arg = (fanout_id & 0xffff) | (fanout << 16);
 
-    // Create the transmit socket
-    *tx_sockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-    if (*tx_sockfd == -1) {
-        perror("socket");
-        return -1;
-    }
 
-    // Create the receive socket
-    *rx_sockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-    if (*rx_sockfd == -1) {
-        perror("socket");
-        close(*tx_sockfd);
-        return -1;
-    }
+	if (setsockopt(*rx_sockfd, SOL_PACKET, PACKET_FANOUT, &fanout_arg,
+		sizeof(fanout_arg)) == -1)
+		return ENABLE_RX_FANOUT_BAD;
 
-    // Bind the receive socket to the interface
-    memset(&sa_ll, 0, sizeof(sa_ll));
-    sa_ll.sll_family = AF_PACKET;
-    sa_ll.sll_ifindex = ifindex;
-    sa_ll.sll_protocol = htons(ETH_P_ALL);
-
-    if (bind(*rx_sockfd, (struct sockaddr *)&sa_ll, sizeof(sa_ll)) == -1) {
-        perror("bind");
-        close(*tx_sockfd);
-        close(*rx_sockfd);
-        return -1;
-    }
+	return ENABLE_RX_FANOUT_GOOD;
 
-    return 0;
 }
 
 
 /*
- * Prepares the argument structures passed to the tx and rx threads
+ * Have the kernel honour per frame launch times on the transmit socket.
+ * Launch times are CLOCK_MONOTONIC, as used by the fq qdisc.
  */
-void prepare_thread_args(struct tx_thread_arguments *tx_thread_args,
-			 struct rx_thread_arguments *rx_thread_args,
-			 struct program_parameters *prog_parms,
-			 int *tx_sockfd,
-			 int *rx_sockfd)
+enum ENABLE_TX_TXTIME enable_tx_txtime(int *tx_sockfd)
 {
+	struct sock_txtime txtime_cfg = {
+		.clockid = CLOCK_MONOTONIC,
+		.flags = SOF_TXTIME_REPORT_ERRORS,
+	};
 
 
-	tx_thread_args->prog_parms = prog_parms;
-	tx_thread_args->tx_sockfd = tx_sockfd;
+	if (setsockopt(*tx_sockfd, SOL_SOCKET, SO_TXTIME, &txtime_cfg,
+		sizeof(txtime_cfg)) == -1)
+		return ENABLE_TX_TXTIME_BAD;
 
-	rx_thread_args->prog_parms = prog_parms;
-	rx_thread_args->rx_sockfd = rx_sockfd;
+	return ENABLE_TX_TXTIME_GOOD;
 
 }
 
 
 /*
- * Build the ectp frame ethernet header
+ * Without a qdisc that holds frames until their launch time, they'd be
+ * sent as soon as they're queued, ahead of the send time they carry, and
+ * the round trip times would come out short or negative
  */
-void build_ectp_eth_hdr(const struct ether_addr *srcmac,
-			const struct ether_addr *dstmac,
-			struct ether_header *eth_hdr)
+bool txtime_qdisc_ok(const char *iface, const int ifindex)
 {
-
-
-	memcpy(eth_hdr->ether_shost, srcmac, sizeof(struct ether_addr));
-	memcpy(eth_hdr->ether_dhost, dstmac, sizeof(struct ether_addr));
-
-	eth_hdr->ether_type = htons(ETHERTYPE_LOOPBACK);
+	char root_kind[QDISC_KIND_SZ];
+
+
+	switch (qdisc_txtime(ifindex, root_kind)) {
+	case QDISC_TXTIME_GOOD:
+		return true;
+	case QDISC_TXTIME_UNSUPPORTED:
+		fprintf(stderr, "-T needs the fq qdisc on %s, it has %s. "
+			"Try tc qdisc replace dev %s root fq\n", iface,
+			(root_kind[0] != '\0') ? root_kind : "none", iface);
+		return false;
+	case QDISC_TXTIME_BADQUERY:
+	default:
+		fprintf(stderr, "Failed to find the qdisc on %s for -T: %s\n",
+			iface, strerror(errno));
+		return false;
+	}
 
 }
 
 
-enum BUILD_ECTP_FRAME build_ectp_frame(
-				   const struct program_parameters *prog_parms,
-				   uint8_t frame_buf[],
-				   const unsigned int frame_buf_sz,
-				   const uint8_t *prog_data,
-				   const unsigned int prog_data_size,
-				   unsigned int *ectp_frame_len)
+/*
+ * Have the kernel busy poll the device queue for up to usecs when the
+ * receive socket is empty, and prefer that over interrupts where the
+ * kernel supports it. Raising SO_BUSY_POLL above net.core.busy_read
+ * needs CAP_NET_ADMIN.
+ */
+enum ENABLE_RX_BUSY_POLL enable_rx_busy_poll(int *rx_sockfd,
+					     const unsigned int usecs)
 {
-	unsigned int ectp_pkt_len;
-	unsigned int frame_payload_size;
-	uint8_t *frame_payload;
-	const struct ether_addr *fwdaddrs;
-	unsigned int num_fwdaddrs;
-
-
-	if (sizeof(struct ether_header) > frame_buf_sz)
-		return BUILD_ECTP_FRAME_BADBUFSIZE;
+	const int busy_poll = usecs;
+	const int prefer = 1;
 
-	build_ectp_eth_hdr(&prog_parms->srcmac, &prog_parms->dstmac,
-		(struct ether_header *)&frame_buf[0]);
-	
-	frame_payload_size = prog_data_size + prog_parms->ectp_user_data_size;
 
-	ectp_pkt_len = ectp_calc_packet_size(1, frame_payload_size);
+	if (setsockopt(*rx_sockfd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll,
+		sizeof(busy_poll)) == -1)
+		return ENABLE_RX_BUSY_POLL_BAD;
 
-	if (ectp_pkt_len > (frame_buf_sz - ETH_HLEN))
-		return BUILD_ECTP_FRAME_BADBUFSIZE;
+	/* a hint only, older kernels don't have it */
+	setsockopt(*rx_sockfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer,
+		sizeof(prefer));
 
-	frame_payload = malloc(frame_payload_size);
-	if (frame_payload == NULL)
-		return BUILD_ECTP_FRAME_NOMEM;
+	return ENABLE_RX_BUSY_POLL_GOOD;
 
-	memcpy(frame_payload, prog_data, prog_data_size);
-	memcpy(&frame_payload[prog_data_size], prog_parms->ectp_user_data,
-		prog_parms->ectp_user_data_size);
+}
 
-	if (prog_parms->num_fwdaddrs) {
-		num_fwdaddrs = prog_parms->num_fwdaddrs;
-		fwdaddrs = prog_parms->fwdaddrs;
-	} else {
-		num_fwdaddrs = 1;
-		fwdaddrs = &prog_parms->srcmac;
-	}
 
-	ectp_build_packet(0, fwdaddrs, num_fwdaddrs, ectpping_pid,
-		frame_payload,
-		frame_payload_size, &frame_buf[ETH_HLEN],
-		frame_buf_sz - ETH_HLEN, 0x00);
+/*
+ * Enable busy polling on an interface's receive sockets. Without it, the
+ * rx threads still spin in user space, so failure is only a warning.
+ */
+void enable_iface_busy_poll(struct probe_iface *pif)
+{
+	unsigned int i;
 
-	*ectp_frame_len = ETH_HLEN + ectp_pkt_len;
 
-	free(frame_payload);
+	pif->busy_poll_set = true;
 
-	return BUILD_ECTP_FRAME_GOOD;
+	for (i = 0; i < pif->parms.rx_workers; i++) {
+		if (enable_rx_busy_poll(&pif->rx_sockfds[i],
+			pif->parms.busy_poll_us) != ENABLE_RX_BUSY_POLL_GOOD) {
+			fprintf(stderr, "SO_BUSY_POLL not set on %s (%s), "
+				"spinning only\n", pif->parms.iface,
+				strerror(errno));
+			pif->busy_poll_set = false;
+			break;
+		}
+	}
 
 }
 
 
 /*
- * ECTP frame sender thread
+ * Send a frame, asking the kernel to hold it until the supplied
+ * CLOCK_MONOTONIC launch time
  */
-void *tx_thread(void *arg) {
-    struct tx_thread_arguments *tx_args = (struct tx_thread_arguments *)arg;
-    uint8_t tx_frame_buf[0xffff];
-    unsigned int ectp_frame_len;
-    struct ectpping_payload eping_payload = {
-        .seq_num = 0,
-    };
-
-    while (true) {
-        gettimeofday(&eping_payload.tv, NULL);
-
-        build_ectp_frame(tx_args->prog_parms, tx_frame_buf,
-            sizeof(tx_frame_buf), (uint8_t *)&eping_payload,
-            sizeof(struct ectpping_payload),
-            &ectp_frame_len);
-
-        send(*tx_args->tx_sockfd, tx_frame_buf, ectp_frame_len,
-            MSG_DONTWAIT);
-
-        printf("Sending packet: seq_num=%u, timestamp=%ld.%06ld\n",
-            eping_payload.seq_num, (long)eping_payload.tv.tv_sec, (long)eping_payload.tv.tv_usec);
+enum SEND_TXTIME_FRAME send_txtime_frame(int *tx_sockfd,
+					 const uint8_t frame_buf[],
+					 const unsigned int frame_len,
+					 const uint64_t launch_ns,
+					 struct txtime_stats *stats)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(uint64_t))];
+		struct cmsghdr align;
+	} control;
+
+
+	iov.iov_base = (void *)frame_buf;
+	iov.iov_len = frame_len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_TXTIME;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+	memcpy(CMSG_DATA(cmsg), &launch_ns, sizeof(uint64_t));
+
+	if (sendmsg(*tx_sockfd, &msg, MSG_DONTWAIT) == -1) {
+		stats->send_errors++;
+		return SEND_TXTIME_FRAME_BAD;
+	}
 
-        txed_pkts++;
+	stats->queued++;
 
-        eping_payload.seq_num++;
+	if (pacer_now_ns() > launch_ns) {
+		stats->queued_late++;
+		return SEND_TXTIME_FRAME_LATE;
+	}
 
-        usleep(tx_args->prog_parms->interval_ms * 1000);
-    }
+	return SEND_TXTIME_FRAME_GOOD;
 
-    return NULL;
 }
 
+
 /*
- * ECTP frame receiver thread
+ * Collect any launch time errors the kernel has queued on the transmit
+ * socket's error queue, without blocking
  */
-void *rx_thread(void *arg) {
-    struct rx_thread_arguments *rx_args = (struct rx_thread_arguments *)arg;
-    process_rxed_frames(rx_args->rx_sockfd, rx_args->prog_parms);
-    return NULL;
-}
+void process_tx_errqueue(int *tx_sockfd, struct txtime_stats *stats)
+{
+	uint8_t pkt_buf[2048];
+	union {
+		char buf[512];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct sock_extended_err *serr;
 
 
+	while (true) {
 
+		iov.iov_base = pkt_buf;
+		iov.iov_len = sizeof(pkt_buf);
 
-/*
- * Opens the transmit socket used by the tx thread
- */
-enum OPEN_TX_SKT open_tx_socket(int *tx_sockfd, const int tx_ifindex)
-{
-	struct sockaddr_ll sa_ll;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
 
+		if (recvmsg(*tx_sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			break;
 
-	*tx_sockfd = socket(PF_PACKET, SOCK_RAW, 0);
-	if (*tx_sockfd == -1)
-		return OPEN_TX_SKT_BADSOCKET;
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
 
-	memset(&sa_ll, 0, sizeof(sa_ll));
-	sa_ll.sll_family = PF_PACKET;
-	sa_ll.sll_ifindex = tx_ifindex;
+			if ((cmsg->cmsg_level != SOL_PACKET) ||
+			    (cmsg->cmsg_type != PACKET_TX_TIMESTAMP))
+				continue;
 
-	if ( bind(*tx_sockfd, (struct sockaddr *) &sa_ll, sizeof(sa_ll)) != 0) 
-		return OPEN_TX_SKT_BADIFINDEX;
+			serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
 
-	/* if we get here, all's good */
-	return OPEN_TX_SKT_GOOD;
+			if (serr->ee_origin != SO_EE_ORIGIN_TXTIME)
+				continue;
+
+			switch (serr->ee_code) {
+			case SO_EE_CODE_TXTIME_MISSED:
+				stats->missed++;
+				break;
+			case SO_EE_CODE_TXTIME_INVALID_PARAM:
+				stats->invalid++;
+				break;
+			}
+
+			stats->last_err_launch_ns =
+				((uint64_t)serr->ee_data << 32) | serr->ee_info;
+		}
+	}
 
 }
 
 
 /*
- * Opens the receive socket used by the rx thread
+ * Convert a CLOCK_MONOTONIC time into the equivalent wall clock time, as
+ * used by the receive timestamps
  */
-enum OPEN_RX_SKT open_rx_socket(int *rx_sockfd, const int rx_ifindex)
+void mono_ns_to_timeval(const uint64_t mono_ns, struct timeval *tv)
 {
-	struct sockaddr_ll sa_ll;
-
+	struct timespec real_ts;
+	uint64_t now_mono_ns, real_ns;
 
-	*rx_sockfd = socket(PF_PACKET, SOCK_DGRAM, htons(ETHERTYPE_LOOPBACK));
-	if (*rx_sockfd == -1)
-		return OPEN_RX_SKT_BADSOCKET;
 
-	memset(&sa_ll, 0, sizeof(sa_ll));
-	sa_ll.sll_family = PF_PACKET;
-	sa_ll.sll_ifindex = rx_ifindex;
+	clock_gettime(CLOCK_REALTIME, &real_ts);
+	now_mono_ns = pacer_now_ns();
 
-	if ( bind(*rx_sockfd, (struct sockaddr *) &sa_ll, sizeof(sa_ll)) != 0) 
-		return OPEN_RX_SKT_BADIFINDEX;
+	real_ns = ((uint64_t)real_ts.tv_sec * 1000000000ULL) + real_ts.tv_nsec;
+	real_ns += mono_ns - now_mono_ns;	/* wraps correctly if negative */
 
-	/* if we get here, all's good */
-	return OPEN_RX_SKT_GOOD;
+	tv->tv_sec = real_ns / 1000000000ULL;
+	tv->tv_usec = (real_ns % 1000000000ULL) / 1000;
 
 }
 
@@ -1249,7 +8274,8 @@ enum ECTP_PKT_VALID ectp_pkt_valid(const struct ectp_packet *ectp_pkt,
  * Print data about received packet
  */
 void print_rxed_packet(const struct program_parameters *prog_parms,
-		       const struct timeval *pkt_arrived,
+		       struct rx_stats *stats,
+		       const struct timespec *pkt_arrived,
 		       const struct ether_addr *srcmac,
 		       const unsigned int pkt_len,
 		       const struct ectp_packet *ectp_pkt,
@@ -1257,30 +8283,63 @@ void print_rxed_packet(const struct program_parameters *prog_parms,
 		       const unsigned int ectp_data_size)
 {
 	struct ectpping_payload eping_payload;
+	struct timeval tv_arrived;
 	struct timeval tv_diff;
+	int cancel_state;
 
 
 	memcpy(&eping_payload, ectp_data, sizeof(struct ectpping_payload));
-	timersub(pkt_arrived, &eping_payload.tv, &tv_diff);
-
-	timeradd(&sum_rtts, &tv_diff, &sum_rtts);
-
-	if ((tv_diff.tv_sec < min_rtt.tv_sec) ||
-	    ((tv_diff.tv_sec == min_rtt.tv_sec) &&
-	     (tv_diff.tv_usec < min_rtt.tv_usec)))
-		min_rtt = tv_diff;
-
-	if ((tv_diff.tv_sec > max_rtt.tv_sec) ||
-	    ((tv_diff.tv_sec == max_rtt.tv_sec) &&
-	     (tv_diff.tv_usec > max_rtt.tv_usec)))
-		max_rtt = tv_diff;
-
-	if (!prog_parms->zero_pkt_output) {
+	tv_arrived.tv_sec = pkt_arrived->tv_sec;
+	tv_arrived.tv_usec = pkt_arrived->tv_nsec / 1000;
+	timersub(&tv_arrived, &eping_payload.tv, &tv_diff);
+
+	/*
+	 * a reply can't come back before its probe was sent, unless the
+	 * clock was stepped, so as the other round trip times, no less
+	 * than zero
+	 */
+	if (tv_diff.tv_sec < 0)
+		timerclear(&tv_diff);
+
+	ECTPPING_PROBE(rtt, eping_payload.seq_num,
+		((uint64_t)eping_payload.tv.tv_sec * 1000000ULL) +
+			eping_payload.tv.tv_usec,
+		((uint64_t)pkt_arrived->tv_sec * 1000000000ULL) +
+			pkt_arrived->tv_nsec,
+		((int64_t)tv_diff.tv_sec * 1000000LL) + tv_diff.tv_usec,
+		pkt_len);
+
+	__atomic_fetch_add(&stats->rxed_pkts, 1, __ATOMIC_RELAXED);
+
+	timeradd(&stats->sum_rtts, &tv_diff, &stats->sum_rtts);
+
+	if ((tv_diff.tv_sec < stats->min_rtt.tv_sec) ||
+	    ((tv_diff.tv_sec == stats->min_rtt.tv_sec) &&
+	     (tv_diff.tv_usec < stats->min_rtt.tv_usec)))
+		stats->min_rtt = tv_diff;
+
+	if ((tv_diff.tv_sec > stats->max_rtt.tv_sec) ||
+	    ((tv_diff.tv_sec == stats->max_rtt.tv_sec) &&
+	     (tv_diff.tv_usec > stats->max_rtt.tv_usec)))
+		stats->max_rtt = tv_diff;
+
+	if (!prog_parms->zero_pkt_output &&
+	    (prog_parms->mode == ECTPPING_MODE_PING)) {
+
+		/*
+		 * keep each reply's lines together when there are several
+		 * rx workers, and don't leave stdout locked if cancelled
+		 */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+		flockfile(stdout);
 
 		printf("%d bytes from ", pkt_len);
 				
 		print_ethaddr_hostname(srcmac,
 			!prog_parms->no_resolve);
+
+		if (prog_parms->num_ifaces > 1)
+			printf(" via %s", prog_parms->iface);
 				
 		printf(": ectp_seq=%d time=%ld.%06ld sec\n",
 			eping_payload.seq_num,
@@ -1290,7 +8349,10 @@ void print_rxed_packet(const struct program_parameters *prog_parms,
 		if (ectp_get_skipcount(ectp_pkt) > 8)
 			print_ectp_src_rt(ectp_pkt, !prog_parms->no_resolve);
 
-		fflush(NULL);
+		fflush(stdout);
+
+		funlockfile(stdout);
+		pthread_setcancelstate(cancel_state, NULL);
 
 	}
 
@@ -1322,76 +8384,232 @@ void print_ectp_src_rt(const struct ectp_packet *ectp_pkt, bool resolve)
 }
 
 
+/*
+ * Store the CRC32C of the whole of the ectp data in the ectpping payload.
+ * Covering the filler too means corruption is caught wherever in the
+ * frame it happens.
+ */
+void set_payload_crc(uint8_t ectp_data[], const unsigned int ectp_data_size)
+{
+	struct ectpping_payload *eping_payload =
+		(struct ectpping_payload *)ectp_data;
+	uint32_t crc;
+
+
+	eping_payload->crc32c = 0;
+
+	crc = crc32c(0, ectp_data, ectp_data_size);
+
+	eping_payload->crc32c = crc;
+
+}
+
+
+/*
+ * Check the CRC32C of received ectp data. The CRC field is zeroed in the
+ * process.
+ */
+bool payload_crc_good(uint8_t ectp_data[], const unsigned int ectp_data_size)
+{
+	struct ectpping_payload *eping_payload =
+		(struct ectpping_payload *)ectp_data;
+	uint32_t rxed_crc;
+
+
+	rxed_crc = eping_payload->crc32c;
+
+	eping_payload->crc32c = 0;
+
+	return (crc32c(0, ectp_data, ectp_data_size) == rxed_crc);
+
+}
+
+
 /*
  * Wait for incoming ECTP frames, and print their details when received
  */
-void process_rxed_frames(int *rx_sockfd, struct program_parameters *prog_parms) {
-    struct timeval tv;
-    struct msghdr msg;
-    struct iovec iov;
-    char buf[2048];
-    char control[1024];
-    struct cmsghdr *cmsg;
-    struct sockaddr_ll sa_ll;
-    unsigned int sa_ll_len;
-    unsigned char pkt_type;
-    unsigned int pkt_len;
-    struct ether_addr srcmac;
+void process_rxed_frames(int *rx_sockfd,
+			 const struct program_parameters *prog_parms,
+			 struct probe_iface *pif,
+			 struct rx_stats *stats,
+			 struct pcapng_ring *capture_ring)
+{
+	const unsigned int pkt_buf_sz = prog_parms->mtu + ETH_HLEN;
+	uint8_t *pkt_buf;
+	struct timespec pkt_arrived;
+	unsigned char pkt_type;
+	unsigned int pkt_len;
+	struct ether_addr srcmac;
+	uint8_t *ectp_data;
+	unsigned int ectp_data_size;
+	struct ectpping_payload eping_payload;
+	enum ECTP_PKT_VALID valid;
+	enum SEQTRACK_RXED rxed;
+	uint64_t rx_ns;
+	bool spun;
 
-    while (true) {
-        iov.iov_base = buf;
-        iov.iov_len = sizeof(buf);
-        msg.msg_name = &sa_ll;
-        msg.msg_namelen = sizeof(sa_ll);
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = control;
-        msg.msg_controllen = sizeof(control);
-        msg.msg_flags = 0;
-
-        pkt_len = recvmsg(*rx_sockfd, &msg, 0);
-        if (pkt_len < 0) {
-            perror("recvmsg");
-            continue;
-        }
 
-        // Extract the timestamp
-        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP) {
-                memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
-                break;
-            }
-        }
+	pkt_buf = malloc(pkt_buf_sz);
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "Failed to allocate receive buffer\n");
+		return;
+	}
+
+	if (prog_parms->rt) {
+		prefault_stack();
+		memset(pkt_buf, 0, pkt_buf_sz);
+	}
 
-        memcpy(&srcmac, sa_ll.sll_addr, sizeof(struct ether_addr));
-        pkt_type = sa_ll.sll_pkttype;
+	pthread_cleanup_push(free, pkt_buf);
 
-        printf("Received packet: src_mac=%s, length=%u, timestamp=%ld.%06ld\n",
-            ether_ntoa(&srcmac), pkt_len, (long)tv.tv_sec, (long)tv.tv_usec);
+	while (true) {
+
+		rx_new_packet(rx_sockfd, pkt_buf, pkt_buf_sz,
+			&pkt_arrived, &pkt_type, &pkt_len, &srcmac,
+			prog_parms->rx_spin_ns, &spun);
+
+		/*
+		 * replies are unicast to this interface, those for other
+		 * hosts, such as another of our interfaces on the same
+		 * segment, only turn up in promiscuous mode
+		 */
+		if (pkt_len == 0) {
+			__atomic_fetch_add(&stats->rx_errors, 1,
+				__ATOMIC_RELAXED);
+			continue;
+		}
+
+		if ((pkt_type == PACKET_OUTGOING) ||
+		    (pkt_type == PACKET_OTHERHOST))
+			continue;
+
+		rx_ns = ((uint64_t)pkt_arrived.tv_sec * 1000000000ULL) +
+			pkt_arrived.tv_nsec;
+
+		valid = ectp_pkt_valid((struct ectp_packet *)pkt_buf, pkt_len,
+			prog_parms, &ectp_data, &ectp_data_size);
+
+		ECTPPING_PROBE(rx_valid, valid, rx_ns, pkt_len,
+			(valid == ECTP_PKT_VALID_GOOD) ? ectp_data_size : 0);
+
+		if (valid != ECTP_PKT_VALID_GOOD) {
+			__atomic_fetch_add(
+				&stats->rejected[rx_reject_reason(valid)], 1,
+				__ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (ectp_data_size < sizeof(struct ectpping_payload)) {
+			__atomic_fetch_add(
+				&stats->rejected[RX_REJECT_SHORTPAYLOAD], 1,
+				__ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (capture_ring != NULL)
+			capture_rxed_frame(capture_ring, pif, &srcmac, rx_ns,
+				pkt_buf, pkt_len);
+
+		if (spun)
+			__atomic_fetch_add(&stats->spun_pkts, 1,
+				__ATOMIC_RELAXED);
+
+		/* the seq num can't be trusted either, so not a reply */
+		if (prog_parms->crc &&
+		    !payload_crc_good(ectp_data, ectp_data_size)) {
+			__atomic_fetch_add(&stats->corrupted_pkts, 1,
+				__ATOMIC_RELAXED);
+			continue;
+		}
+
+		memcpy(&eping_payload, ectp_data,
+			sizeof(struct ectpping_payload));
+
+		/* who replied is kept for the probe log */
+		rxed = seqtrack_received_tag(&pif->probe_track,
+			eping_payload.seq_num, rx_ns,
+			probelog_bytes_to_mac(srcmac.ether_addr_octet));
+
+		ECTPPING_PROBE(rx_reply, eping_payload.seq_num, rx_ns,
+			pkt_len, rxed);
+
+		/*
+		 * every assistant answers the same discovery probe, so all
+		 * but the first reply are duplicates
+		 */
+		if ((prog_parms->mode == ECTPPING_MODE_MATRIX) &&
+		    (eping_payload.path_id == UINT32_MAX) &&
+		    ((rxed == SEQTRACK_RXED_GOOD) ||
+		     (rxed == SEQTRACK_RXED_DUPLICATE)) &&
+		    atomic_load(&matrix_discovering))
+			add_matrix_assistant(prog_parms, &srcmac);
+
+		if (rxed == SEQTRACK_RXED_GOOD) {
+			if (prog_parms->mode == ECTPPING_MODE_HOPS)
+				record_hop_reply(&eping_payload, &pkt_arrived);
+			else if (prog_parms->mode == ECTPPING_MODE_MATRIX)
+				record_matrix_reply(&eping_payload,
+					&pkt_arrived);
+		}
+
+		print_rxed_packet(prog_parms, stats, &pkt_arrived, &srcmac,
+			pkt_len,
+			(struct ectp_packet *)pkt_buf, ectp_data,
+			ectp_data_size);
+
+	}
+
+	pthread_cleanup_pop(1);
+
+}
+
+
+/*
+ * The rejection reason counted for an ectp_pkt_valid() failure
+ */
+enum RX_REJECT rx_reject_reason(const enum ECTP_PKT_VALID valid)
+{
+
+
+	switch (valid) {
+	case ECTP_PKT_VALID_BADSKIPCOUNT:
+		return RX_REJECT_BADSKIPCOUNT;
+	case ECTP_PKT_VALID_BADMSGTYPE:
+		return RX_REJECT_BADMSGTYPE;
+	case ECTP_PKT_VALID_WRONGRCPTNUM:
+		return RX_REJECT_WRONGRCPTNUM;
+	case ECTP_PKT_VALID_TOOSMALL:
+	default:
+		return RX_REJECT_TOOSMALL;
+	}
 
-        // Process the received packet
-        // process_packet(buf, pkt_len);
-    }
 }
 
 
 /*
- * Receive a pending ECTP frame
+ * Receive a pending ECTP frame. With a spin time, poll the socket for up
+ * to that long before blocking, avoiding the wakeup latency of a blocked
+ * thread at the cost of the CPU spent spinning. spun says whether the
+ * frame was caught while spinning.
  */
 void rx_new_packet(int *rx_sockfd,
 		  unsigned char *pkt_buf,
 		  const unsigned int pkt_buf_sz,
-		  struct timeval *pkt_arrived,
+		  struct timespec *pkt_arrived,
 		  unsigned char *pkt_type,
 		  unsigned int *pkt_len,
-		  struct ether_addr *srcmac)
+		  struct ether_addr *srcmac,
+		  const uint64_t spin_ns,
+		  bool *spun)
 {
+	uint64_t spin_end_ns;
 	struct sockaddr_ll sa_ll;
 	unsigned int sa_ll_len;
 	struct msghdr msg;
     struct iovec iov;
     char control[1024];
     struct cmsghdr *cmsg;
+	ssize_t recvd;
 
 	memset(pkt_buf, 0, pkt_buf_sz);
 
@@ -1407,15 +8625,45 @@ void rx_new_packet(int *rx_sockfd,
     msg.msg_controllen = sizeof(control);
     msg.msg_flags = 0;
 
-	*pkt_len = recvmsg(*rx_sockfd, &msg, 0);
-    if (*pkt_len < 0) {
+	*pkt_len = 0;
+
+	*spun = false;
+
+	recvd = -1;
+
+	if (spin_ns > 0) {
+		spin_end_ns = pacer_now_ns() + spin_ns;
+		do {
+			msg.msg_namelen = sa_ll_len;
+			msg.msg_controllen = sizeof(control);
+			recvd = recvmsg(*rx_sockfd, &msg, MSG_DONTWAIT);
+			if ((recvd >= 0) ||
+			    ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+				break;
+			/* recvmsg() isn't a cancellation point when it
+			 * doesn't block */
+			pthread_testcancel();
+		} while (pacer_now_ns() < spin_end_ns);
+		*spun = (recvd >= 0);
+	}
+
+	if ((recvd < 0) && ((spin_ns == 0) || (errno == EAGAIN) ||
+	    (errno == EWOULDBLOCK))) {
+		msg.msg_namelen = sa_ll_len;
+		msg.msg_controllen = sizeof(control);
+		recvd = recvmsg(*rx_sockfd, &msg, 0);
+	}
+
+    if (recvd < 0) {
         perror("recvmsg");
         return;
     }
 
+	*pkt_len = recvd;
+
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP) {
-            memcpy(pkt_arrived, CMSG_DATA(cmsg), sizeof(struct timeval));
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(pkt_arrived, CMSG_DATA(cmsg), sizeof(struct timespec));
             break;
         }
     }
@@ -1428,14 +8676,38 @@ void rx_new_packet(int *rx_sockfd,
 
 
 /*
- * Close tx & rx sockets
+ * Close every interface's sockets
+ */
+void close_all_sockets(void)
+{
+	unsigned int i;
+
+
+	for (i = 0; i < num_probe_ifaces; i++)
+		close_sockets(&probe_ifaces[i].tx_sockfd,
+			probe_ifaces[i].rx_sockfds,
+			probe_ifaces[i].parms.rx_workers);
+
+}
+
+
+/*
+ * Close tx & rx sockets, skipping any that weren't opened
  */
-void close_sockets(int *tx_sockfd, int *rx_sockfd)
+void close_sockets(int *tx_sockfd,
+		   int rx_sockfds[],
+		   const unsigned int num_rx_sockfds)
 {
+	unsigned int i;
 
 
-	close_tx_socket(tx_sockfd);
-	close_rx_socket(rx_sockfd);
+	if (*tx_sockfd != -1)
+		close_tx_socket(tx_sockfd);
+
+	for (i = 0; i < num_rx_sockfds; i++) {
+		if (rx_sockfds[i] != -1)
+			close_rx_socket(&rx_sockfds[i]);
+	}
 
 }
 
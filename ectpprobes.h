@@ -0,0 +1,51 @@
+#ifndef __ectpprobes_h__
+#define __ectpprobes_h__
+
+/*
+ *
+ * ectpprobes.h - USDT static tracepoints on ectpping's tx and rx paths
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+/*
+ * With sys/sdt.h (systemtap-sdt-dev), each probe is a single nop plus an
+ * ELF note, until bpftrace, perf or SystemTap attaches to it, e.g.
+ *
+ *	bpftrace -e 'usdt:./ectpping:ectpping:rtt { @rtt_us = hist(arg3); }'
+ *
+ * Without it, or when built with -DECTPPING_NO_PROBES, they compile to
+ * nothing and their arguments aren't evaluated.
+ *
+ * The ectpping provider's probes and their arguments are
+ *
+ *	frame_build	seq, tx_ns, frame_len
+ *	tx_send		seq, tx_ns, frame_len, errno (0 if sent)
+ *	rx_valid	enum ECTP_PKT_VALID verdict, rx_ns, pkt_len,
+ *			ectp_data_size
+ *	rx_reply	seq, rx_ns, pkt_len, enum SEQTRACK_RXED verdict
+ *	rtt		seq, tx_us, rx_ns, rtt_us, pkt_len
+ *
+ * tx_ns and tx_us are the probe's transmit timestamp, rx_ns the kernel's
+ * receive timestamp, both wall clock.
+ */
+
+#if !defined(ECTPPING_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define ECTPPING_PROBE(name, ...) STAP_PROBEV(ectpping, name, __VA_ARGS__)
+#endif
+#endif
+
+#ifndef ECTPPING_PROBE
+#define ECTPPING_PROBE(name, ...) do { } while (0)
+#endif
+
+#endif /* __ectpprobes_h__ */
@@ -0,0 +1,301 @@
+/*
+ *	ectpresp
+ *	~~~~~~~~
+ *
+ * A minimal ECTP loopback assistant. Frames whose current message is a
+ * forward message are sent on to the forward address, with the skipcount
+ * moved past it, as a station implementing ECTP would. Used as the far end
+ * of the veth end to end harness (ectpe2e.sh).
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netpacket/packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+
+#include "libectp.h"
+
+
+/*
+ * Large enough for jumbo frames
+ */
+enum {
+	RESP_FRAME_BUF_SZ	= 65536,
+};
+
+
+/*
+ * Frame counts, printed on exit
+ */
+struct resp_stats {
+	unsigned long rxed;
+	unsigned long forwarded;
+	unsigned long not_fwd;		/* reply message, or not ours to send */
+	unsigned long invalid;
+	unsigned long tx_errors;
+};
+
+
+/*
+ * Function prototypes
+ */
+
+enum OPEN_RESP_SKT {
+	OPEN_RESP_SKT_GOOD,
+	OPEN_RESP_SKT_BADSOCKET,
+	OPEN_RESP_SKT_BADIFACE,
+	OPEN_RESP_SKT_BADBIND,
+};
+enum OPEN_RESP_SKT open_resp_socket(const char *iface,
+				    int *sockfd,
+				    struct ether_addr *ifmac);
+
+enum FORWARD_FRAME {
+	FORWARD_FRAME_GOOD,
+	FORWARD_FRAME_NOTFWD,
+	FORWARD_FRAME_INVALID,
+};
+enum FORWARD_FRAME forward_frame(uint8_t frame_buf[],
+				 const unsigned int frame_len,
+				 const struct ether_addr *ifmac);
+
+void stop_hdlr(int signum);
+
+void print_resp_stats(const char *iface, const struct resp_stats *stats);
+
+
+/*
+ * Global Variables
+ */
+
+volatile sig_atomic_t stop;
+
+
+int main(int argc, char *argv[])
+{
+	const char *iface;
+	struct ether_addr ifmac;
+	struct sigaction stop_action;
+	struct resp_stats stats;
+	struct sockaddr_ll sa_ll;
+	socklen_t sa_ll_len;
+	uint8_t *frame_buf;
+	ssize_t len;
+	int sockfd;
+
+
+	if ((argc != 2) || (strcmp(argv[1], "-h") == 0)) {
+		fprintf(stderr, "Usage: ectpresp <interface>\n");
+		return EXIT_FAILURE;
+	}
+
+	iface = argv[1];
+
+	switch (open_resp_socket(iface, &sockfd, &ifmac)) {
+	case OPEN_RESP_SKT_GOOD:
+		break;
+	case OPEN_RESP_SKT_BADIFACE:
+		fprintf(stderr, "Unknown interface - %s.\n", iface);
+		return EXIT_FAILURE;
+	default:
+		perror("Failed to open socket");
+		return EXIT_FAILURE;
+	}
+
+	frame_buf = malloc(RESP_FRAME_BUF_SZ);
+	if (frame_buf == NULL) {
+		fprintf(stderr, "Failed to allocate frame buffer\n");
+		return EXIT_FAILURE;
+	}
+
+	/* no SA_RESTART, so a blocked recvfrom() returns on a signal */
+	memset(&stop_action, 0, sizeof(stop_action));
+	stop_action.sa_handler = stop_hdlr;
+	sigemptyset(&stop_action.sa_mask);
+	sigaction(SIGINT, &stop_action, NULL);
+	sigaction(SIGTERM, &stop_action, NULL);
+
+	memset(&stats, 0, sizeof(stats));
+
+	while (!stop) {
+		sa_ll_len = sizeof(sa_ll);
+		len = recvfrom(sockfd, frame_buf, RESP_FRAME_BUF_SZ, 0,
+			(struct sockaddr *)&sa_ll, &sa_ll_len);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("recvfrom");
+			break;
+		}
+
+		if (sa_ll.sll_pkttype == PACKET_OUTGOING)
+			continue;
+
+		stats.rxed++;
+
+		switch (forward_frame(frame_buf, len, &ifmac)) {
+		case FORWARD_FRAME_GOOD:
+			if (send(sockfd, frame_buf, len, 0) == len)
+				stats.forwarded++;
+			else
+				stats.tx_errors++;
+			break;
+		case FORWARD_FRAME_NOTFWD:
+			stats.not_fwd++;
+			break;
+		case FORWARD_FRAME_INVALID:
+		default:
+			stats.invalid++;
+			break;
+		}
+	}
+
+	print_resp_stats(iface, &stats);
+
+	free(frame_buf);
+
+	close(sockfd);
+
+	return EXIT_SUCCESS;
+
+}
+
+
+/*
+ * Open a socket receiving and sending ECTP frames on the interface, and
+ * get the interface's mac address
+ */
+enum OPEN_RESP_SKT open_resp_socket(const char *iface,
+				    int *sockfd,
+				    struct ether_addr *ifmac)
+{
+	struct sockaddr_ll sa_ll;
+	struct ifreq ifr;
+
+
+	*sockfd = socket(PF_PACKET, SOCK_RAW, htons(ETHERTYPE_LOOPBACK));
+	if (*sockfd == -1)
+		return OPEN_RESP_SKT_BADSOCKET;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, iface, IFNAMSIZ - 1);
+
+	if (ioctl(*sockfd, SIOCGIFHWADDR, &ifr) == -1) {
+		close(*sockfd);
+		return OPEN_RESP_SKT_BADIFACE;
+	}
+
+	memcpy(ifmac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+	if (ioctl(*sockfd, SIOCGIFINDEX, &ifr) == -1) {
+		close(*sockfd);
+		return OPEN_RESP_SKT_BADIFACE;
+	}
+
+	memset(&sa_ll, 0, sizeof(sa_ll));
+	sa_ll.sll_family = PF_PACKET;
+	sa_ll.sll_protocol = htons(ETHERTYPE_LOOPBACK);
+	sa_ll.sll_ifindex = ifr.ifr_ifindex;
+
+	if (bind(*sockfd, (struct sockaddr *)&sa_ll, sizeof(sa_ll)) == -1) {
+		close(*sockfd);
+		return OPEN_RESP_SKT_BADBIND;
+	}
+
+	return OPEN_RESP_SKT_GOOD;
+
+}
+
+
+/*
+ * If the current message of the frame is a forward message, turn the frame
+ * around in place, addressed to its forward address from us, with the
+ * skipcount moved on to the next message
+ */
+enum FORWARD_FRAME forward_frame(uint8_t frame_buf[],
+				 const unsigned int frame_len,
+				 const struct ether_addr *ifmac)
+{
+	struct ether_header *eth_hdr = (struct ether_header *)frame_buf;
+	struct ectp_packet *ectp_pkt;
+	struct ectp_message *ectp_msg;
+	unsigned int ectp_pkt_len;
+	unsigned int skipcount;
+	uint8_t *fwdaddr;
+
+
+	if (frame_len < (ETH_HLEN + ECTP_PACKET_MIN_SZ))
+		return FORWARD_FRAME_INVALID;
+
+	ectp_pkt = (struct ectp_packet *)&frame_buf[ETH_HLEN];
+	ectp_pkt_len = frame_len - ETH_HLEN;
+
+	skipcount = ectp_get_skipcount(ectp_pkt);
+
+	if (!ectp_skipc_basicchk_ok(skipcount, ectp_pkt_len))
+		return FORWARD_FRAME_INVALID;
+
+	if ((ECTP_PACKET_HDR_SZ + skipcount + ECTP_FWDMSG_SZ) > ectp_pkt_len)
+		return FORWARD_FRAME_NOTFWD;
+
+	ectp_msg = ectp_get_curr_msg_ptr(ectp_pkt);
+
+	if (ectp_get_msg_type(ectp_msg) != ECTP_FWDMSG)
+		return FORWARD_FRAME_NOTFWD;
+
+	fwdaddr = ectp_get_fwdaddr(ectp_msg);
+
+	if (!ectp_fwdaddr_ok(fwdaddr))
+		return FORWARD_FRAME_INVALID;
+
+	memcpy(eth_hdr->ether_dhost, fwdaddr, ETH_ALEN);
+	memcpy(eth_hdr->ether_shost, ifmac, ETH_ALEN);
+
+	ectp_inc_skipcount(ectp_pkt);
+
+	return FORWARD_FRAME_GOOD;
+
+}
+
+
+void stop_hdlr(int signum)
+{
+
+
+	stop = 1;
+
+}
+
+
+void print_resp_stats(const char *iface, const struct resp_stats *stats)
+{
+
+
+	fprintf(stderr, "ectpresp %s: %lu frames received, %lu forwarded, "
+		"%lu not forward messages, %lu invalid, %lu send errors\n",
+		iface, stats->rxed, stats->forwarded, stats->not_fwd,
+		stats->invalid, stats->tx_errors);
+
+}
+
+/* EOF */
@@ -0,0 +1,342 @@
+/*
+ *	ectpstat
+ *	~~~~~~~~
+ *
+ * Reads the live statistics a running ectpping publishes with -M, once or
+ * every interval, without disturbing it. Each read copies out a
+ * consistent snapshot, trying again if ectpping was part way through
+ * updating it.
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <net/ethernet.h>
+
+#include "libenetaddr.h"
+#include "libhist.h"
+#include "libstatshm.h"
+
+
+/*
+ * Function prototypes
+ */
+
+void print_usage(void);
+
+bool parse_interval(const char *str, uint64_t *ns);
+
+void print_snapshot(const char *name, const struct statshm_stats *stats);
+
+void print_iface(const struct statshm_iface *si);
+
+void print_target(const struct statshm_stats *stats,
+		  const struct statshm_target *target);
+
+void print_path(const struct statshm_path *path);
+
+
+int main(int argc, char *argv[])
+{
+	struct statshm_reader sr;
+	struct statshm_stats *stats;
+	struct timespec interval_ts;
+	uint64_t interval_ns = 0;
+	unsigned long count = 0, i;
+	char *endptr;
+	int opt;
+
+
+	while ((opt = getopt(argc, argv, "i:c:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			if (!parse_interval(optarg, &interval_ns)) {
+				fprintf(stderr, "Bad interval - %s.\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'c':
+			count = strtoul(optarg, &endptr, 10);
+			if ((*optarg == '\0') || (*endptr != '\0') ||
+			    (count == 0)) {
+				fprintf(stderr, "Bad count - %s.\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != (argc - 1)) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	switch (statshm_attach(&sr, argv[optind])) {
+	case STATSHM_ATTACH_GOOD:
+		break;
+	case STATSHM_ATTACH_BADNAME:
+		fprintf(stderr, "Bad statistics segment name %s\n",
+			argv[optind]);
+		return EXIT_FAILURE;
+	case STATSHM_ATTACH_BADLAYOUT:
+		fprintf(stderr, "%s: not an ectpping statistics segment of "
+			"this version\n", argv[optind]);
+		return EXIT_FAILURE;
+	case STATSHM_ATTACH_BADSHM:
+	default:
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	stats = malloc(sizeof(struct statshm_stats));
+	if (stats == NULL) {
+		fprintf(stderr, "Failed to allocate statistics snapshot\n");
+		return EXIT_FAILURE;
+	}
+
+	/* once, unless an interval is given, then until the count or ^C */
+	if ((interval_ns == 0) || (count == 0))
+		count = (interval_ns == 0) ? 1 : ULONG_MAX;
+
+	interval_ts.tv_sec = interval_ns / 1000000000ULL;
+	interval_ts.tv_nsec = interval_ns % 1000000000ULL;
+
+	for (i = 0; i < count; i++) {
+		if (i > 0)
+			nanosleep(&interval_ts, NULL);
+
+		if (statshm_read(&sr, stats) != STATSHM_READ_GOOD) {
+			fprintf(stderr, "%s: snapshot kept changing, "
+				"skipped\n", argv[optind]);
+			continue;
+		}
+
+		print_snapshot(argv[optind], stats);
+
+		fflush(stdout);
+
+		if (!stats->running)
+			break;
+	}
+
+	free(stats);
+
+	statshm_detach(&sr);
+
+	return EXIT_SUCCESS;
+
+}
+
+
+void print_usage(void)
+{
+
+
+	fprintf(stderr, "Usage: ectpstat [-i <interval> [-c <count>]] "
+			"<segment name>\n");
+	fprintf(stderr, "-i <interval>\t: Print the statistics every "
+			"<interval>, in seconds\n");
+	fprintf(stderr, "\t\t  unless suffixed with s, ms, us or ns, until "
+			"ectpping\n");
+	fprintf(stderr, "\t\t  finishes.\n");
+	fprintf(stderr, "-c <count>\t: Stop after <count> intervals.\n");
+
+}
+
+
+/*
+ * Convert an interval, in seconds unless suffixed, as ectpping's times
+ */
+bool parse_interval(const char *str, uint64_t *ns)
+{
+	unsigned long long val;
+	uint64_t unit_ns;
+	char *endptr;
+
+
+	if ((*str < '0') || (*str > '9'))
+		return false;
+
+	val = strtoull(str, &endptr, 10);
+
+	if (*endptr == '\0')
+		unit_ns = 1000000000ULL;
+	else if (strcmp(endptr, "s") == 0)
+		unit_ns = 1000000000ULL;
+	else if (strcmp(endptr, "ms") == 0)
+		unit_ns = 1000000ULL;
+	else if (strcmp(endptr, "us") == 0)
+		unit_ns = 1000ULL;
+	else if (strcmp(endptr, "ns") == 0)
+		unit_ns = 1ULL;
+	else
+		return false;
+
+	if ((val == 0) || (val > (UINT64_MAX / unit_ns)))
+		return false;
+
+	*ns = val * unit_ns;
+
+	return true;
+
+}
+
+
+void print_snapshot(const char *name, const struct statshm_stats *stats)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+	unsigned int i;
+
+
+	enet_ntop((const struct ether_addr *)stats->dstmac, ENET_NTOP_UNIX,
+		macpbuf, ENET_PADDR_MAXSZ);
+
+	printf("ECTPSTAT %s: pid %llu, ECTPPING %s, interval %.6f sec, "
+		"up %.3f sec, %s, %llu updates\n", name,
+		(unsigned long long)stats->pid, macpbuf,
+		stats->interval_ns / 1e9,
+		(stats->update_ns - stats->start_ns) / 1e9,
+		stats->running ? "running" : "finished",
+		(unsigned long long)stats->updates);
+
+	for (i = 0; (i < stats->num_ifaces) && (i < STATSHM_IFACES_MAX); i++)
+		print_iface(&stats->ifaces[i]);
+
+	for (i = 0; (i < stats->num_targets) && (i < STATSHM_TARGETS_MAX);
+	     i++)
+		print_target(stats, &stats->targets[i]);
+
+	if (stats->untracked_replies > 0)
+		printf("%llu replies from targets beyond the first %u\n",
+			(unsigned long long)stats->untracked_replies,
+			STATSHM_TARGETS_MAX);
+
+	for (i = 0; (i < stats->num_paths) && (i < STATSHM_PATHS_MAX); i++)
+		print_path(&stats->paths[i]);
+
+}
+
+
+void print_iface(const struct statshm_iface *si)
+{
+	const uint64_t settled = si->answered + si->lost;
+
+
+	printf("%.*s: %llu txed, %llu rxed, %llu answered, %llu lost",
+		STATSHM_IFNAMSIZ, si->name, (unsigned long long)si->txed,
+		(unsigned long long)si->rxed,
+		(unsigned long long)si->answered,
+		(unsigned long long)si->lost);
+
+	if (settled > 0)
+		printf(" (%.3f%%)", (si->lost * 100.0) / settled);
+
+	printf(", %llu in flight, %llu duplicates, %llu corrupted, "
+		"%llu rejected, %llu tx errors, %llu rx drops, "
+		"%llu rx errors\n",
+		(unsigned long long)si->in_flight,
+		(unsigned long long)si->duplicates,
+		(unsigned long long)si->corrupted,
+		(unsigned long long)si->rejected,
+		(unsigned long long)si->tx_errors,
+		(unsigned long long)si->rx_drops,
+		(unsigned long long)si->rx_errors);
+
+	if (si->rtt_ns.count == 0)
+		return;
+
+	printf("round-trip (usec) min/avg/max = %.3f/%.3f/%.3f, "
+		"p50/p90/p99/p99.9 = %.3f/%.3f/%.3f/%.3f\n",
+		si->rtt_ns.min / 1e3, hist_mean(&si->rtt_ns) / 1e3,
+		si->rtt_ns.max / 1e3,
+		hist_percentile(&si->rtt_ns, 50.0) / 1e3,
+		hist_percentile(&si->rtt_ns, 90.0) / 1e3,
+		hist_percentile(&si->rtt_ns, 99.0) / 1e3,
+		hist_percentile(&si->rtt_ns, 99.9) / 1e3);
+
+}
+
+
+void print_target(const struct statshm_stats *stats,
+		  const struct statshm_target *target)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+
+
+	if (target->replies == 0)
+		return;
+
+	enet_ntop((const struct ether_addr *)target->mac, ENET_NTOP_UNIX,
+		macpbuf, ENET_PADDR_MAXSZ);
+
+	printf("target %s via %.*s: %llu replies, round-trip (usec) "
+		"min/avg/max = %.3f/%.3f/%.3f, last %.3f sec ago\n", macpbuf,
+		STATSHM_IFNAMSIZ,
+		(target->iface < STATSHM_IFACES_MAX) ?
+			stats->ifaces[target->iface].name : "?",
+		(unsigned long long)target->replies,
+		target->rtt_min_ns / 1e3,
+		(target->rtt_sum_ns / target->replies) / 1e3,
+		target->rtt_max_ns / 1e3,
+		(stats->update_ns > target->last_rx_ns) ?
+			(stats->update_ns - target->last_rx_ns) / 1e9 : 0.0);
+
+}
+
+
+/*
+ * A daemon mode target, its route and settled probes
+ */
+void print_path(const struct statshm_path *path)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+	const uint64_t settled = path->answered + path->lost;
+	unsigned int i;
+
+
+	printf("path %u", path->id);
+
+	for (i = 0; (i < path->num_hops) && (i < STATSHM_PATH_HOPS_MAX); i++) {
+		enet_ntop((const struct ether_addr *)path->hops[i],
+			ENET_NTOP_UNIX, macpbuf, ENET_PADDR_MAXSZ);
+		printf("%s%s", (i == 0) ? " " : ((i == 1) ? " via " : ", "),
+			macpbuf);
+	}
+
+	printf(": %llu answered, %llu lost", (unsigned long long)path->answered,
+		(unsigned long long)path->lost);
+
+	if (settled > 0)
+		printf(" (%.3f%%)", (path->lost * 100.0) / settled);
+
+	if (path->answered > 0)
+		printf(", round-trip (usec) min/avg/max = %.3f/%.3f/%.3f",
+			path->rtt_min_ns / 1e3,
+			(path->rtt_sum_ns / path->answered) / 1e3,
+			path->rtt_max_ns / 1e3);
+
+	putchar('\n');
+
+}
+
+/* EOF */
@@ -0,0 +1,130 @@
+/*
+ * libcpulist.c - Linux CPU list strings, e.g. "0-3,8,10-11"
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+
+#include "libcpulist.h"
+
+
+/*
+ * cpulist_parse()
+ *
+ * Convert a comma separated list of CPUs and CPU ranges into a CPU set.
+ * A trailing newline, as read from sysfs, is allowed.
+ */
+bool cpulist_parse(const char *str, cpu_set_t *cpus)
+{
+	unsigned long first, last, cpu;
+	char *endptr;
+
+
+	CPU_ZERO(cpus);
+
+	while (true) {
+		if ((*str < '0') || (*str > '9'))
+			return false;
+		first = strtoul(str, &endptr, 10);
+		last = first;
+
+		if (*endptr == '-') {
+			str = endptr + 1;
+			if ((*str < '0') || (*str > '9'))
+				return false;
+			last = strtoul(str, &endptr, 10);
+		}
+
+		if ((last < first) || (last >= CPU_SETSIZE))
+			return false;
+
+		for (cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, cpus);
+
+		if (*endptr != ',')
+			break;
+		str = endptr + 1;
+	}
+
+	if (*endptr == '\n')
+		endptr++;
+
+	return (*endptr == '\0');
+
+}
+
+
+/*
+ * cpulist_format()
+ *
+ * Convert a CPU set into a CPU list string, truncated if buf is too small
+ */
+void cpulist_format(const cpu_set_t *cpus, char *buf, const size_t buf_sz)
+{
+	unsigned int cpu, last;
+	size_t len = 0;
+
+
+	buf[0] = '\0';
+
+	for (cpu = 0; (cpu < CPU_SETSIZE) && (len < buf_sz); cpu++) {
+		if (!CPU_ISSET(cpu, cpus))
+			continue;
+
+		last = cpu;
+		while (((last + 1) < CPU_SETSIZE) && CPU_ISSET(last + 1, cpus))
+			last++;
+
+		if (last == cpu)
+			len += snprintf(&buf[len], buf_sz - len, "%s%u",
+				(len > 0) ? "," : "", cpu);
+		else
+			len += snprintf(&buf[len], buf_sz - len, "%s%u-%u",
+				(len > 0) ? "," : "", cpu, last);
+
+		cpu = last;
+	}
+
+}
+
+
+/*
+ * cpulist_read()
+ *
+ * Read a CPU list from a file, such as a NIC's local_cpulist in sysfs
+ */
+bool cpulist_read(const char *path, cpu_set_t *cpus)
+{
+	char buf[CPULIST_STR_MAXSZ];
+	FILE *f;
+	bool good;
+
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return false;
+
+	good = (fgets(buf, sizeof(buf), f) != NULL) &&
+		cpulist_parse(buf, cpus);
+
+	fclose(f);
+
+	return good;
+
+}
+
+/* EOF */
@@ -0,0 +1,42 @@
+#ifndef __libcpulist_h__
+#define __libcpulist_h__
+
+/*
+ *
+ * libcpulist.h - Linux CPU list strings, e.g. "0-3,8,10-11"
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+/*
+ * cpu_set_t needs _GNU_SOURCE, defined before the first system header is
+ * included
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <sched.h>
+
+
+/*
+ * Room for the list of every CPU a cpu_set_t can hold, worst case
+ * alternate CPUs
+ */
+enum {
+	CPULIST_STR_MAXSZ	= (CPU_SETSIZE / 2) * 5,
+};
+
+
+bool cpulist_parse(const char *str, cpu_set_t *cpus);
+
+void cpulist_format(const cpu_set_t *cpus, char *buf, const size_t buf_sz);
+
+bool cpulist_read(const char *path, cpu_set_t *cpus);
+
+#endif /* __libcpulist_h__ */
@@ -0,0 +1,253 @@
+/*
+ * libcrc32c.c - CRC32C (Castagnoli) checksum
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "libcrc32c.h"
+
+
+/*
+ * Reflected Castagnoli polynomial
+ */
+enum {
+	CRC32C_POLY	= 0x82f63b78,
+};
+
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *buf, size_t len);
+
+
+static uint32_t crc32c_table[8][256];
+
+static crc32c_fn crc32c_impl;
+
+static const char *crc32c_impl_str = "none";
+
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len);
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *buf, size_t len);
+#endif
+
+#if defined(__aarch64__)
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *buf, size_t len);
+#endif
+
+
+/*
+ * Slice-by-8, using the eight tables to process a 64 bit word per step
+ */
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	uint32_t lo, hi;
+
+
+	while ((len > 0) && (((uintptr_t)buf & 7) != 0)) {
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+
+	while (len >= 8) {
+		memcpy(&lo, buf, 4);
+		memcpy(&hi, buf + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		lo = __builtin_bswap32(lo);
+		hi = __builtin_bswap32(hi);
+#endif
+		lo ^= crc;
+		crc = crc32c_table[7][lo & 0xff] ^
+			crc32c_table[6][(lo >> 8) & 0xff] ^
+			crc32c_table[5][(lo >> 16) & 0xff] ^
+			crc32c_table[4][lo >> 24] ^
+			crc32c_table[3][hi & 0xff] ^
+			crc32c_table[2][(hi >> 8) & 0xff] ^
+			crc32c_table[1][(hi >> 16) & 0xff] ^
+			crc32c_table[0][hi >> 24];
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len > 0) {
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+
+	return crc;
+
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *buf, size_t len)
+{
+#if defined(__x86_64__)
+	uint64_t crc64;
+	uint64_t word;
+#endif
+	uint32_t word32;
+
+
+	while ((len > 0) && (((uintptr_t)buf & 7) != 0)) {
+		crc = _mm_crc32_u8(crc, *buf++);
+		len--;
+	}
+
+#if defined(__x86_64__)
+	crc64 = crc;
+	while (len >= 8) {
+		memcpy(&word, buf, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		buf += 8;
+		len -= 8;
+	}
+	crc = crc64;
+#endif
+
+	while (len >= 4) {
+		memcpy(&word32, buf, 4);
+		crc = _mm_crc32_u32(crc, word32);
+		buf += 4;
+		len -= 4;
+	}
+
+	while (len > 0) {
+		crc = _mm_crc32_u8(crc, *buf++);
+		len--;
+	}
+
+	return crc;
+
+}
+#endif
+
+
+#if defined(__aarch64__)
+__attribute__((target("+crc")))
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	uint64_t word;
+
+
+	while ((len > 0) && (((uintptr_t)buf & 7) != 0)) {
+		__asm__("crc32cb %w0, %w0, %w1" : "+r" (crc) : "r" (*buf));
+		buf++;
+		len--;
+	}
+
+	while (len >= 8) {
+		memcpy(&word, buf, 8);
+		__asm__("crc32cx %w0, %w0, %x1" : "+r" (crc) : "r" (word));
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len > 0) {
+		__asm__("crc32cb %w0, %w0, %w1" : "+r" (crc) : "r" (*buf));
+		buf++;
+		len--;
+	}
+
+	return crc;
+
+}
+#endif
+
+
+/*
+ * crc32c_init()
+ *
+ * Build the slice-by-8 tables and pick the fastest implementation the CPU
+ * supports
+ */
+void crc32c_init(void)
+{
+	uint32_t crc;
+	unsigned int i, j;
+
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+		crc32c_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[j][i] = crc;
+		}
+	}
+
+	crc32c_impl = crc32c_sw;
+	crc32c_impl_str = "slice-by-8";
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_impl = crc32c_sse42;
+		crc32c_impl_str = "sse4.2";
+	}
+#endif
+
+#if defined(__aarch64__) && defined(HWCAP_CRC32)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		crc32c_impl = crc32c_armv8;
+		crc32c_impl_str = "armv8 crc32";
+	}
+#endif
+
+}
+
+
+/*
+ * crc32c()
+ *
+ * Checksum len bytes of buf, continuing on from crc
+ */
+uint32_t crc32c(const uint32_t crc, const void *buf, const size_t len)
+{
+
+
+	return ~crc32c_impl(~crc, buf, len);
+
+}
+
+
+/*
+ * crc32c_impl_name()
+ *
+ * Name of the implementation in use
+ */
+const char *crc32c_impl_name(void)
+{
+
+
+	return crc32c_impl_str;
+
+}
+
+/* EOF */
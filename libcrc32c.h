@@ -0,0 +1,39 @@
+#ifndef __libcrc32c_h__
+#define __libcrc32c_h__
+
+/*
+ *
+ * libcrc32c.h - CRC32C (Castagnoli) checksum
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/*
+ * Uses the SSE4.2 crc32 instruction on x86, or the ARMv8 CRC32
+ * instructions on arm64, if the CPU has them, otherwise slice-by-8 tables.
+ * crc32c_init() must be called before any other routine, and before any
+ * threads that will use them are started.
+ */
+
+void crc32c_init(void);
+
+/*
+ * crc is the value returned for the preceding data, or 0 to start a new
+ * checksum
+ */
+uint32_t crc32c(const uint32_t crc, const void *buf, const size_t len);
+
+const char *crc32c_impl_name(void);
+
+#endif /* __libcrc32c_h__ */
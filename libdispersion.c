@@ -0,0 +1,283 @@
+/*
+ * libdispersion.c - packet train / packet pair bandwidth estimation
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdispersion.h"
+
+
+static int cmp_u64(const void *a, const void *b);
+static int cmp_double(const void *a, const void *b);
+static double quantile_sorted(const double vals[], const unsigned int n,
+			      const double q);
+static bool summarise(const double vals[], const unsigned int n,
+		      struct dispersion_summary *summary);
+static uint64_t agg_rand(struct dispersion_agg *agg);
+
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+
+	return (*x > *y) - (*x < *y);
+
+}
+
+
+static int cmp_double(const void *a, const void *b)
+{
+	const double *x = a, *y = b;
+
+
+	return (*x > *y) - (*x < *y);
+
+}
+
+
+/*
+ * Linearly interpolated quantile of an already sorted array
+ */
+static double quantile_sorted(const double vals[], const unsigned int n,
+			      const double q)
+{
+	double pos, frac;
+	unsigned int idx;
+
+
+	pos = q * (n - 1);
+	idx = (unsigned int)pos;
+	frac = pos - idx;
+
+	if ((idx + 1) >= n)
+		return vals[n - 1];
+
+	return vals[idx] + (frac * (vals[idx + 1] - vals[idx]));
+
+}
+
+
+/*
+ * Median and quartiles of a set of estimates
+ */
+static bool summarise(const double vals[], const unsigned int n,
+		      struct dispersion_summary *summary)
+{
+	double *sorted;
+
+
+	if (n == 0)
+		return false;
+
+	sorted = malloc(n * sizeof(double));
+	if (sorted == NULL)
+		return false;
+
+	memcpy(sorted, vals, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), cmp_double);
+
+	summary->median = quantile_sorted(sorted, n, 0.5);
+	summary->q1 = quantile_sorted(sorted, n, 0.25);
+	summary->q3 = quantile_sorted(sorted, n, 0.75);
+
+	free(sorted);
+
+	return true;
+
+}
+
+
+/*
+ * xorshift64*, plenty for choosing samples
+ */
+static uint64_t agg_rand(struct dispersion_agg *agg)
+{
+
+
+	agg->rand_state ^= agg->rand_state >> 12;
+	agg->rand_state ^= agg->rand_state << 25;
+	agg->rand_state ^= agg->rand_state >> 27;
+
+	return agg->rand_state * 0x2545F4914F6CDD1DULL;
+
+}
+
+
+/*
+ * dispersion_train_estimate()
+ *
+ * Estimate capacity and dispersion rate from the arrival times of a train.
+ * rx_ns[] is indexed by position in the train, with zero for frames that
+ * weren't received. wire_bytes is the size of each frame on the wire.
+ */
+enum DISPERSION_TRAIN_EST dispersion_train_estimate(const uint64_t rx_ns[],
+						    const unsigned int
+							train_len,
+						    const unsigned int
+							wire_bytes,
+						    struct dispersion_train
+							*train)
+{
+	uint64_t *gaps;
+	uint64_t first_ns = UINT64_MAX, last_ns = 0;
+	unsigned int num_gaps = 0;
+	unsigned int i;
+	const double wire_bits = wire_bytes * 8.0;
+
+
+	memset(train, 0, sizeof(struct dispersion_train));
+	train->sent = train_len;
+
+	for (i = 0; i < train_len; i++) {
+		if (rx_ns[i] == 0)
+			continue;
+		train->received++;
+		if (rx_ns[i] < first_ns)
+			first_ns = rx_ns[i];
+		if (rx_ns[i] > last_ns)
+			last_ns = rx_ns[i];
+	}
+
+	if (train->received < 2)
+		return DISPERSION_TRAIN_EST_TOOFEW;
+
+	train->dispersion_ns = last_ns - first_ns;
+	if (train->dispersion_ns == 0)
+		return DISPERSION_TRAIN_EST_NOSPREAD;
+
+	/*
+	 * The dispersion rate counts the frames after the first, as the
+	 * first frame's own serialisation time isn't part of the spread
+	 */
+	train->adr_bps = ((train->received - 1) * wire_bits * 1e9) /
+		train->dispersion_ns;
+
+	gaps = malloc(train_len * sizeof(uint64_t));
+	if (gaps == NULL)
+		return DISPERSION_TRAIN_EST_TOOFEW;
+
+	/* only pairs sent back to back and received in order are usable */
+	for (i = 1; i < train_len; i++) {
+		if ((rx_ns[i - 1] == 0) || (rx_ns[i] == 0) ||
+		    (rx_ns[i] < rx_ns[i - 1]))
+			continue;
+		gaps[num_gaps++] = rx_ns[i] - rx_ns[i - 1];
+	}
+
+	if (num_gaps > 0) {
+		qsort(gaps, num_gaps, sizeof(uint64_t), cmp_u64);
+		train->pair_gap_ns = gaps[num_gaps / 2];
+	}
+
+	free(gaps);
+
+	if (train->pair_gap_ns == 0) {
+		/* arrivals batched, fall back to the average spacing */
+		train->pair_gap_ns = train->dispersion_ns /
+			(train->received - 1);
+		if (train->pair_gap_ns == 0)
+			return DISPERSION_TRAIN_EST_NOSPREAD;
+	}
+
+	train->capacity_bps = (wire_bits * 1e9) / train->pair_gap_ns;
+
+	return DISPERSION_TRAIN_EST_GOOD;
+
+}
+
+
+/*
+ * dispersion_agg_init()
+ *
+ * Initialise an empty set of per train estimates
+ */
+void dispersion_agg_init(struct dispersion_agg *agg)
+{
+
+
+	memset(agg, 0, sizeof(struct dispersion_agg));
+
+	/* any non-zero seed */
+	agg->rand_state = 0x9E3779B97F4A7C15ULL;
+
+}
+
+
+/*
+ * dispersion_agg_add()
+ *
+ * Add the result of a train to the aggregate. train is only looked at if
+ * there was an estimate, so may be NULL for a train that wasn't sent.
+ */
+void dispersion_agg_add(struct dispersion_agg *agg,
+			const enum DISPERSION_TRAIN_EST est,
+			const struct dispersion_train *train)
+{
+	uint64_t slot;
+
+
+	agg->trains++;
+
+	if (est != DISPERSION_TRAIN_EST_GOOD)
+		return;
+
+	agg->valid++;
+
+	/* Vitter's algorithm R, the nth kept with probability samples / n */
+	if (agg->kept < DISPERSION_AGG_SAMPLES) {
+		slot = agg->kept++;
+	} else {
+		slot = agg_rand(agg) % agg->valid;
+		if (slot >= DISPERSION_AGG_SAMPLES)
+			return;
+	}
+
+	agg->capacity_bps[slot] = train->capacity_bps;
+	agg->adr_bps[slot] = train->adr_bps;
+
+}
+
+
+/*
+ * dispersion_agg_capacity()
+ *
+ * Median and quartiles of the bottleneck capacity estimates sampled
+ */
+bool dispersion_agg_capacity(const struct dispersion_agg *agg,
+			     struct dispersion_summary *summary)
+{
+
+
+	return summarise(agg->capacity_bps, agg->kept, summary);
+
+}
+
+
+/*
+ * dispersion_agg_adr()
+ *
+ * Median and quartiles of the dispersion rate estimates sampled
+ */
+bool dispersion_agg_adr(const struct dispersion_agg *agg,
+			struct dispersion_summary *summary)
+{
+
+
+	return summarise(agg->adr_bps, agg->kept, summary);
+
+}
+
+/* EOF */
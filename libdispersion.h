@@ -0,0 +1,113 @@
+#ifndef __libdispersion_h__
+#define __libdispersion_h__
+
+/*
+ *
+ * libdispersion.h - packet train / packet pair bandwidth estimation
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Frames of a train are sent back to back, so by the time they've crossed
+ * the narrowest link of the path they are spaced out by at least the time
+ * that link takes to serialise one frame. The typical spacing between
+ * adjacent frames (packet pair dispersion) gives the bottleneck capacity.
+ * The spread of the whole train also includes gaps opened up by cross
+ * traffic, so the train's dispersion rate is an estimate of the capacity
+ * that is actually available.
+ */
+
+
+/*
+ * Ethernet per frame overhead not seen by the host, FCS, preamble and
+ * start of frame delimiter, and the minimum inter frame gap
+ */
+enum {
+	DISPERSION_ETH_OVERHEAD	= 4 + 8 + 12,
+};
+
+
+/*
+ * Trains' estimates kept for the summary. Once more trains than this have
+ * given one, a uniform random sample of them all is kept (reservoir
+ * sampling), so a run of any length takes the same memory.
+ */
+enum {
+	DISPERSION_AGG_SAMPLES	= 1024,
+};
+
+
+/*
+ * Estimates from a single train
+ */
+struct dispersion_train {
+	unsigned int sent;
+	unsigned int received;
+	uint64_t dispersion_ns;		/* first to last arrival */
+	uint64_t pair_gap_ns;		/* median adjacent frame gap */
+	double capacity_bps;		/* from pair_gap_ns */
+	double adr_bps;			/* from dispersion_ns */
+};
+
+
+/*
+ * Estimates aggregated across trains
+ */
+struct dispersion_agg {
+	unsigned int trains;		/* trains evaluated */
+	unsigned int valid;		/* trains giving an estimate */
+	unsigned int kept;		/* estimates sampled */
+	uint64_t rand_state;		/* for choosing the samples */
+	double capacity_bps[DISPERSION_AGG_SAMPLES];
+	double adr_bps[DISPERSION_AGG_SAMPLES];
+};
+
+
+/*
+ * Robust summary of a set of estimates
+ */
+struct dispersion_summary {
+	double median;
+	double q1;			/* first quartile */
+	double q3;			/* third quartile */
+};
+
+
+enum DISPERSION_TRAIN_EST {
+	DISPERSION_TRAIN_EST_GOOD,
+	DISPERSION_TRAIN_EST_TOOFEW,	/* less than 2 frames received */
+	DISPERSION_TRAIN_EST_NOSPREAD,	/* arrivals not spread out */
+};
+enum DISPERSION_TRAIN_EST dispersion_train_estimate(const uint64_t rx_ns[],
+						    const unsigned int
+							train_len,
+						    const unsigned int
+							wire_bytes,
+						    struct dispersion_train
+							*train);
+
+void dispersion_agg_init(struct dispersion_agg *agg);
+
+void dispersion_agg_add(struct dispersion_agg *agg,
+			const enum DISPERSION_TRAIN_EST est,
+			const struct dispersion_train *train);
+
+bool dispersion_agg_capacity(const struct dispersion_agg *agg,
+			     struct dispersion_summary *summary);
+
+bool dispersion_agg_adr(const struct dispersion_agg *agg,
+			struct dispersion_summary *summary);
+
+#endif /* __libdispersion_h__ */
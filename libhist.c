@@ -0,0 +1,206 @@
+/*
+ * libhist.c - log-linear histograms for latency percentiles
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "libhist.h"
+
+
+static unsigned int bucket_idx(const uint64_t val);
+static uint64_t bucket_mid(const unsigned int idx);
+
+
+static unsigned int bucket_idx(const uint64_t val)
+{
+	unsigned int shift;
+
+
+	if (val < HIST_LINEAR)
+		return val;
+
+	/* leaves the top HIST_SUB_BITS + 1 bits, i.e. 32 to 63 */
+	shift = (63 - __builtin_clzll(val)) - HIST_SUB_BITS;
+
+	return HIST_LINEAR + ((shift - 1) << HIST_SUB_BITS) +
+		((val >> shift) - (HIST_LINEAR / 2));
+
+}
+
+
+static uint64_t bucket_mid(const unsigned int idx)
+{
+	unsigned int shift;
+	uint64_t lo;
+
+
+	if (idx < HIST_LINEAR)
+		return idx;
+
+	shift = ((idx - HIST_LINEAR) >> HIST_SUB_BITS) + 1;
+	lo = (uint64_t)(((idx - HIST_LINEAR) & ((HIST_LINEAR / 2) - 1)) +
+		(HIST_LINEAR / 2)) << shift;
+
+	return lo + ((1ULL << shift) / 2);
+
+}
+
+
+/*
+ * hist_init()
+ *
+ * Empty a histogram
+ */
+void hist_init(struct hist *hist)
+{
+
+
+	memset(hist, 0, sizeof(struct hist));
+	hist->min = UINT64_MAX;
+
+}
+
+
+/*
+ * hist_add()
+ *
+ * Record a value
+ */
+void hist_add(struct hist *hist, const uint64_t val)
+{
+
+
+	hist->buckets[bucket_idx(val)]++;
+	hist->count++;
+	hist->sum += val;
+
+	if (val < hist->min)
+		hist->min = val;
+	if (val > hist->max)
+		hist->max = val;
+
+}
+
+
+/*
+ * hist_merge()
+ *
+ * Add the values recorded in src to dst
+ */
+void hist_merge(struct hist *dst, const struct hist *src)
+{
+	unsigned int i;
+
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+
+}
+
+
+/*
+ * hist_percentile()
+ *
+ * The value below which pct percent of the recorded values fall, or 0 if
+ * the histogram is empty
+ */
+uint64_t hist_percentile(const struct hist *hist, const double pct)
+{
+	uint64_t rank, seen = 0;
+	uint64_t val;
+	unsigned int i;
+
+
+	if (hist->count == 0)
+		return 0;
+
+	rank = ceil((pct / 100.0) * hist->count);
+	if (rank < 1)
+		rank = 1;
+	if (rank >= hist->count)
+		return hist->max;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	val = bucket_mid(i);
+
+	/* the extremes are known exactly */
+	if (val < hist->min)
+		val = hist->min;
+	if (val > hist->max)
+		val = hist->max;
+
+	return val;
+
+}
+
+
+/*
+ * hist_count_le()
+ *
+ * Number of recorded values no greater than val, to the histogram's
+ * resolution: the values in val's own bucket all count as no greater
+ */
+uint64_t hist_count_le(const struct hist *hist, const uint64_t val)
+{
+	uint64_t count = 0;
+	unsigned int idx, i;
+
+
+	/* the extremes are known exactly */
+	if ((hist->count == 0) || (val < hist->min))
+		return 0;
+	if (val >= hist->max)
+		return hist->count;
+
+	idx = bucket_idx(val);
+
+	for (i = 0; i <= idx; i++)
+		count += hist->buckets[i];
+
+	return count;
+
+}
+
+
+/*
+ * hist_mean()
+ *
+ * Mean of the recorded values
+ */
+double hist_mean(const struct hist *hist)
+{
+
+
+	if (hist->count == 0)
+		return 0.0;
+
+	return hist->sum / hist->count;
+
+}
+
+/* EOF */
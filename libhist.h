@@ -0,0 +1,57 @@
+#ifndef __libhist_h__
+#define __libhist_h__
+
+/*
+ *
+ * libhist.h - log-linear histograms for latency percentiles
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Values below 64 have a bucket each. Above that, each power of two range
+ * is split into 32 buckets, so a percentile is within about 3% of the
+ * true value, however wide the range of values. Adding a value is
+ * constant time, and the memory used is fixed.
+ */
+enum {
+	HIST_SUB_BITS	= 5,
+	HIST_LINEAR	= 2 << HIST_SUB_BITS,
+	HIST_BUCKETS	= HIST_LINEAR + ((64 - HIST_SUB_BITS - 1) <<
+				HIST_SUB_BITS),
+};
+
+
+struct hist {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+
+void hist_init(struct hist *hist);
+
+void hist_add(struct hist *hist, const uint64_t val);
+
+void hist_merge(struct hist *dst, const struct hist *src);
+
+uint64_t hist_percentile(const struct hist *hist, const double pct);
+
+uint64_t hist_count_le(const struct hist *hist, const uint64_t val);
+
+double hist_mean(const struct hist *hist);
+
+#endif /* __libhist_h__ */
@@ -0,0 +1,893 @@
+/*
+ * libmetrics.c - Prometheus/OpenMetrics endpoint for the live statistics
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+
+#include "libenetaddr.h"
+#include "libhist.h"
+#include "libstatshm.h"
+#include "libmetrics.h"
+
+
+#define METRICS_CONTENT_TYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+
+/*
+ * What a request asked for
+ */
+enum METRICS_REQ {
+	METRICS_REQ_GET,
+	METRICS_REQ_HEAD,
+	METRICS_REQ_NOTFOUND,
+	METRICS_REQ_BADMETHOD,
+	METRICS_REQ_BAD,
+	METRICS_REQ_NONE,		/* closed or timed out */
+};
+
+
+/*
+ * RTT histogram bucket bounds, in ns
+ */
+static const uint64_t rtt_bounds_ns[] = {
+	1000ULL, 2000ULL, 5000ULL,
+	10000ULL, 20000ULL, 50000ULL,
+	100000ULL, 200000ULL, 500000ULL,
+	1000000ULL, 2000000ULL, 5000000ULL,
+	10000000ULL, 20000000ULL, 50000000ULL,
+	100000000ULL, 200000000ULL, 500000000ULL,
+	1000000000ULL, 2000000000ULL, 5000000000ULL,
+	10000000000ULL,
+};
+
+
+static void buf_printf(struct metrics_server *ms, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static void put_label_value(struct metrics_server *ms,
+			    const char *str,
+			    const size_t len);
+
+static void put_iface_label(struct metrics_server *ms,
+			    const struct statshm_iface *si);
+
+static void put_family(struct metrics_server *ms,
+		       const char *name,
+		       const char *type,
+		       const char *help);
+
+static void put_iface_counter(struct metrics_server *ms,
+			      const struct statshm_stats *stats,
+			      const char *name,
+			      const char *help,
+			      const size_t offset);
+
+static void put_iface_gauge(struct metrics_server *ms,
+			    const struct statshm_stats *stats,
+			    const char *name,
+			    const char *help,
+			    const size_t offset);
+
+static void put_loss_ratio(struct metrics_server *ms,
+			   const struct statshm_stats *stats);
+
+static void put_rtt_hists(struct metrics_server *ms,
+			  const struct statshm_stats *stats);
+
+static void put_targets(struct metrics_server *ms,
+			const struct statshm_stats *stats);
+
+static void put_target_labels(struct metrics_server *ms,
+			      const struct statshm_stats *stats,
+			      const struct statshm_target *target);
+
+static void put_paths(struct metrics_server *ms,
+		      const struct statshm_stats *stats);
+
+static void put_path_labels(struct metrics_server *ms,
+			    const struct statshm_path *path);
+
+static enum METRICS_REQ read_request(const int fd);
+
+static uint64_t mono_ms(void);
+
+static bool send_all(const int fd, const char *data, size_t len);
+
+static bool send_error(const int fd, const char *status, const char *extra);
+
+
+/*
+ * Append to the response, growing it as needed
+ */
+static void buf_printf(struct metrics_server *ms, const char *fmt, ...)
+{
+	va_list ap;
+	size_t size;
+	char *buf;
+	int len;
+
+
+	while (!ms->buf_err) {
+		va_start(ap, fmt);
+		len = vsnprintf(ms->buf + ms->buf_len,
+			ms->buf_size - ms->buf_len, fmt, ap);
+		va_end(ap);
+
+		if (len < 0) {
+			ms->buf_err = true;
+			break;
+		}
+
+		if ((size_t)len < (ms->buf_size - ms->buf_len)) {
+			ms->buf_len += len;
+			break;
+		}
+
+		size = ms->buf_size * 2;
+		buf = realloc(ms->buf, size);
+		if (buf == NULL) {
+			ms->buf_err = true;
+			break;
+		}
+		ms->buf = buf;
+		ms->buf_size = size;
+	}
+
+}
+
+
+/*
+ * A quoted label value, escaped as OpenMetrics requires
+ */
+static void put_label_value(struct metrics_server *ms,
+			    const char *str,
+			    const size_t len)
+{
+	size_t i;
+
+
+	buf_printf(ms, "\"");
+
+	for (i = 0; (i < len) && (str[i] != '\0'); i++) {
+		if (str[i] == '\\')
+			buf_printf(ms, "\\\\");
+		else if (str[i] == '"')
+			buf_printf(ms, "\\\"");
+		else if (str[i] == '\n')
+			buf_printf(ms, "\\n");
+		else
+			buf_printf(ms, "%c", str[i]);
+	}
+
+	buf_printf(ms, "\"");
+
+}
+
+
+static void put_iface_label(struct metrics_server *ms,
+			    const struct statshm_iface *si)
+{
+
+
+	buf_printf(ms, "interface=");
+	put_label_value(ms, si->name, STATSHM_IFNAMSIZ);
+
+}
+
+
+static void put_family(struct metrics_server *ms,
+		       const char *name,
+		       const char *type,
+		       const char *help)
+{
+
+
+	buf_printf(ms, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+
+}
+
+
+/*
+ * A counter with a sample per interface, the uint64_t at offset in its
+ * statshm_iface
+ */
+static void put_iface_counter(struct metrics_server *ms,
+			      const struct statshm_stats *stats,
+			      const char *name,
+			      const char *help,
+			      const size_t offset)
+{
+	const struct statshm_iface *si;
+	unsigned int i;
+
+
+	put_family(ms, name, "counter", help);
+
+	for (i = 0; i < stats->num_ifaces; i++) {
+		si = &stats->ifaces[i];
+		buf_printf(ms, "%s_total{", name);
+		put_iface_label(ms, si);
+		buf_printf(ms, "} %llu\n", (unsigned long long)
+			*(const uint64_t *)((const char *)si + offset));
+	}
+
+}
+
+
+static void put_iface_gauge(struct metrics_server *ms,
+			    const struct statshm_stats *stats,
+			    const char *name,
+			    const char *help,
+			    const size_t offset)
+{
+	const struct statshm_iface *si;
+	unsigned int i;
+
+
+	put_family(ms, name, "gauge", help);
+
+	for (i = 0; i < stats->num_ifaces; i++) {
+		si = &stats->ifaces[i];
+		buf_printf(ms, "%s{", name);
+		put_iface_label(ms, si);
+		buf_printf(ms, "} %llu\n", (unsigned long long)
+			*(const uint64_t *)((const char *)si + offset));
+	}
+
+}
+
+
+/*
+ * Loss of the settled probes, so in flight probes aren't counted as lost
+ */
+static void put_loss_ratio(struct metrics_server *ms,
+			   const struct statshm_stats *stats)
+{
+	const struct statshm_iface *si;
+	uint64_t settled;
+	unsigned int i;
+
+
+	put_family(ms, "ectpping_loss_ratio", "gauge",
+		"Lost probes as a fraction of those answered or lost.");
+
+	for (i = 0; i < stats->num_ifaces; i++) {
+		si = &stats->ifaces[i];
+		settled = si->answered + si->lost;
+		buf_printf(ms, "ectpping_loss_ratio{");
+		put_iface_label(ms, si);
+		buf_printf(ms, "} %.9g\n",
+			(settled > 0) ? (double)si->lost / settled : 0.0);
+	}
+
+}
+
+
+static void put_rtt_hists(struct metrics_server *ms,
+			  const struct statshm_stats *stats)
+{
+	const unsigned int num_bounds = sizeof(rtt_bounds_ns) /
+		sizeof(rtt_bounds_ns[0]);
+	const struct statshm_iface *si;
+	unsigned int i, j;
+
+
+	put_family(ms, "ectpping_rtt_seconds", "histogram",
+		"Round trip times of the answered probes.");
+
+	for (i = 0; i < stats->num_ifaces; i++) {
+		si = &stats->ifaces[i];
+
+		for (j = 0; j < num_bounds; j++) {
+			buf_printf(ms, "ectpping_rtt_seconds_bucket{");
+			put_iface_label(ms, si);
+			buf_printf(ms, ",le=\"%g\"} %llu\n",
+				rtt_bounds_ns[j] / 1e9, (unsigned long long)
+				hist_count_le(&si->rtt_ns, rtt_bounds_ns[j]));
+		}
+
+		buf_printf(ms, "ectpping_rtt_seconds_bucket{");
+		put_iface_label(ms, si);
+		buf_printf(ms, ",le=\"+Inf\"} %llu\n",
+			(unsigned long long)si->rtt_ns.count);
+
+		buf_printf(ms, "ectpping_rtt_seconds_count{");
+		put_iface_label(ms, si);
+		buf_printf(ms, "} %llu\n",
+			(unsigned long long)si->rtt_ns.count);
+
+		buf_printf(ms, "ectpping_rtt_seconds_sum{");
+		put_iface_label(ms, si);
+		buf_printf(ms, "} %.9f\n", si->rtt_ns.sum / 1e9);
+	}
+
+}
+
+
+static void put_target_labels(struct metrics_server *ms,
+			      const struct statshm_stats *stats,
+			      const struct statshm_target *target)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+
+
+	enet_ntop((const struct ether_addr *)target->mac, ENET_NTOP_UNIX,
+		macpbuf, ENET_PADDR_MAXSZ);
+
+	if (target->iface < stats->num_ifaces)
+		put_iface_label(ms, &stats->ifaces[target->iface]);
+	else
+		buf_printf(ms, "interface=\"?\"");
+
+	buf_printf(ms, ",target=\"%s\"", macpbuf);
+
+}
+
+
+/*
+ * Each responder's replies and round trips, a family at a time, as
+ * OpenMetrics wants a family's samples together
+ */
+static void put_targets(struct metrics_server *ms,
+			const struct statshm_stats *stats)
+{
+	const struct statshm_target *target;
+	unsigned int i;
+
+
+	put_family(ms, "ectpping_target_rtt_seconds", "summary",
+		"Round trip times of each target's replies.");
+
+	for (i = 0; i < stats->num_targets; i++) {
+		target = &stats->targets[i];
+		buf_printf(ms, "ectpping_target_rtt_seconds_count{");
+		put_target_labels(ms, stats, target);
+		buf_printf(ms, "} %llu\n", (unsigned long long)target->replies);
+		buf_printf(ms, "ectpping_target_rtt_seconds_sum{");
+		put_target_labels(ms, stats, target);
+		buf_printf(ms, "} %.9f\n", target->rtt_sum_ns / 1e9);
+	}
+
+	put_family(ms, "ectpping_target_rtt_min_seconds", "gauge",
+		"Shortest round trip time of each target's replies.");
+
+	for (i = 0; i < stats->num_targets; i++) {
+		target = &stats->targets[i];
+		if (target->replies == 0)
+			continue;
+		buf_printf(ms, "ectpping_target_rtt_min_seconds{");
+		put_target_labels(ms, stats, target);
+		buf_printf(ms, "} %.9f\n", target->rtt_min_ns / 1e9);
+	}
+
+	put_family(ms, "ectpping_target_rtt_max_seconds", "gauge",
+		"Longest round trip time of each target's replies.");
+
+	for (i = 0; i < stats->num_targets; i++) {
+		target = &stats->targets[i];
+		if (target->replies == 0)
+			continue;
+		buf_printf(ms, "ectpping_target_rtt_max_seconds{");
+		put_target_labels(ms, stats, target);
+		buf_printf(ms, "} %.9f\n", target->rtt_max_ns / 1e9);
+	}
+
+	put_family(ms, "ectpping_target_last_reply_timestamp_seconds", "gauge",
+		"When each target's latest reply arrived.");
+
+	for (i = 0; i < stats->num_targets; i++) {
+		target = &stats->targets[i];
+		if (target->replies == 0)
+			continue;
+		buf_printf(ms, "ectpping_target_last_reply_timestamp_seconds{");
+		put_target_labels(ms, stats, target);
+		buf_printf(ms, "} %.9f\n", target->last_rx_ns / 1e9);
+	}
+
+	put_family(ms, "ectpping_untracked_replies", "counter",
+		"Replies from targets beyond the per target table.");
+	buf_printf(ms, "ectpping_untracked_replies_total %llu\n",
+		(unsigned long long)stats->untracked_replies);
+
+}
+
+
+static void put_path_labels(struct metrics_server *ms,
+			    const struct statshm_path *path)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+
+
+	enet_ntop((const struct ether_addr *)path->hops[0], ENET_NTOP_UNIX,
+		macpbuf, ENET_PADDR_MAXSZ);
+
+	buf_printf(ms, "path=\"%u\",destination=\"%s\"", path->id, macpbuf);
+
+}
+
+
+/*
+ * Each daemon mode target's settled probes and round trips
+ */
+static void put_paths(struct metrics_server *ms,
+		      const struct statshm_stats *stats)
+{
+	const struct statshm_path *path;
+	unsigned int i;
+
+
+	if (stats->num_paths == 0)
+		return;
+
+	put_family(ms, "ectpping_path_probes_answered", "counter",
+		"Settled probes to each daemon target that were answered.");
+
+	for (i = 0; i < stats->num_paths; i++) {
+		path = &stats->paths[i];
+		buf_printf(ms, "ectpping_path_probes_answered_total{");
+		put_path_labels(ms, path);
+		buf_printf(ms, "} %llu\n", (unsigned long long)path->answered);
+	}
+
+	put_family(ms, "ectpping_path_probes_lost", "counter",
+		"Settled probes to each daemon target that were lost.");
+
+	for (i = 0; i < stats->num_paths; i++) {
+		path = &stats->paths[i];
+		buf_printf(ms, "ectpping_path_probes_lost_total{");
+		put_path_labels(ms, path);
+		buf_printf(ms, "} %llu\n", (unsigned long long)path->lost);
+	}
+
+	put_family(ms, "ectpping_path_rtt_seconds", "summary",
+		"Round trip times of each daemon target's answered probes.");
+
+	for (i = 0; i < stats->num_paths; i++) {
+		path = &stats->paths[i];
+		buf_printf(ms, "ectpping_path_rtt_seconds_count{");
+		put_path_labels(ms, path);
+		buf_printf(ms, "} %llu\n", (unsigned long long)path->answered);
+		buf_printf(ms, "ectpping_path_rtt_seconds_sum{");
+		put_path_labels(ms, path);
+		buf_printf(ms, "} %.9f\n", path->rtt_sum_ns / 1e9);
+	}
+
+}
+
+
+/*
+ * metrics_listen()
+ *
+ * Listen on addr, a port number for 127.0.0.1, or otherwise a Unix socket
+ * path, replacing any socket left there by an earlier run
+ */
+enum METRICS_LISTEN metrics_listen(struct metrics_server *ms,
+				   const char *addr)
+{
+	struct sockaddr_in sin;
+	struct sockaddr_un sun;
+	struct stat st;
+	unsigned long port;
+	char *endptr;
+	const int on = 1;
+	int saved_errno;
+	int ret;
+
+
+	memset(ms, 0, sizeof(struct metrics_server));
+	ms->fd = -1;
+
+	if (*addr == '\0')
+		return METRICS_LISTEN_BADADDR;
+
+	ms->buf = malloc(METRICS_BUF_INIT);
+	if (ms->buf == NULL)
+		return METRICS_LISTEN_BADSOCKET;
+	ms->buf_size = METRICS_BUF_INIT;
+
+	port = strtoul(addr, &endptr, 10);
+
+	if ((*addr >= '0') && (*addr <= '9') && (*endptr == '\0')) {
+		if ((port == 0) || (port > 65535)) {
+			metrics_close(ms);
+			return METRICS_LISTEN_BADADDR;
+		}
+
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(port);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		ms->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (ms->fd == -1) {
+			metrics_close(ms);
+			return METRICS_LISTEN_BADSOCKET;
+		}
+
+		setsockopt(ms->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		ret = bind(ms->fd, (struct sockaddr *)&sin, sizeof(sin));
+	} else {
+		if (strlen(addr) >= sizeof(sun.sun_path)) {
+			metrics_close(ms);
+			return METRICS_LISTEN_BADADDR;
+		}
+
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strcpy(sun.sun_path, addr);
+
+		if ((lstat(addr, &st) == 0) && S_ISSOCK(st.st_mode))
+			unlink(addr);
+
+		ms->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (ms->fd == -1) {
+			metrics_close(ms);
+			return METRICS_LISTEN_BADSOCKET;
+		}
+
+		ret = bind(ms->fd, (struct sockaddr *)&sun, sizeof(sun));
+		if (ret == 0)
+			strcpy(ms->path, addr);
+	}
+
+	if ((ret == -1) || (listen(ms->fd, METRICS_BACKLOG) == -1)) {
+		saved_errno = errno;
+		metrics_close(ms);
+		errno = saved_errno;
+		return METRICS_LISTEN_BADSOCKET;
+	}
+
+	return METRICS_LISTEN_GOOD;
+
+}
+
+
+/*
+ * metrics_accept()
+ *
+ * Wait for the next connection, a cancellation point. -1 on error, which
+ * may be the connection's, so is worth trying again.
+ */
+int metrics_accept(struct metrics_server *ms)
+{
+	const struct timeval timeout = {
+		.tv_sec = METRICS_IO_TIMEOUT_MS / 1000,
+		.tv_usec = (METRICS_IO_TIMEOUT_MS % 1000) * 1000,
+	};
+	int fd;
+
+
+	fd = accept4(ms->fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	return fd;
+
+}
+
+
+static uint64_t mono_ms(void)
+{
+	struct timespec now_ts;
+
+
+	clock_gettime(CLOCK_MONOTONIC, &now_ts);
+
+	return ((uint64_t)now_ts.tv_sec * 1000) + (now_ts.tv_nsec / 1000000);
+
+}
+
+
+/*
+ * Read a request's line and headers, and work out what it asked for. The
+ * headers, and any body, are otherwise ignored.
+ */
+static enum METRICS_REQ read_request(const int fd)
+{
+	const uint64_t deadline_ms = mono_ms() + METRICS_IO_TIMEOUT_MS;
+	char req[METRICS_REQ_MAX + 1];
+	size_t len = 0, path_len;
+	char *path, *version;
+	ssize_t ret;
+
+
+	while (true) {
+		ret = recv(fd, &req[len], METRICS_REQ_MAX - len, 0);
+		if ((ret == -1) && (errno == EINTR))
+			continue;
+		if (ret <= 0)
+			return METRICS_REQ_NONE;
+
+		len += ret;
+		req[len] = '\0';
+
+		if ((strstr(req, "\r\n\r\n") != NULL) ||
+		    (strstr(req, "\n\n") != NULL))
+			break;
+
+		if (len == METRICS_REQ_MAX)
+			return METRICS_REQ_BAD;
+
+		if (mono_ms() >= deadline_ms)
+			return METRICS_REQ_NONE;
+	}
+
+	path = strchr(req, ' ');
+	if (path == NULL)
+		return METRICS_REQ_BAD;
+	path++;
+
+	path_len = strcspn(path, " \r\n");
+	version = &path[path_len];
+	if ((*version != ' ') || (strncmp(&version[1], "HTTP/1.", 7) != 0))
+		return METRICS_REQ_BAD;
+
+	if ((strncmp(req, "GET ", 4) != 0) && (strncmp(req, "HEAD ", 5) != 0))
+		return METRICS_REQ_BADMETHOD;
+
+	/* any query string is ignored */
+	path_len = strcspn(path, " ?");
+	if ((path_len != strlen("/metrics")) ||
+	    (strncmp(path, "/metrics", path_len) != 0))
+		return METRICS_REQ_NOTFOUND;
+
+	return (req[0] == 'G') ? METRICS_REQ_GET : METRICS_REQ_HEAD;
+
+}
+
+
+static bool send_all(const int fd, const char *data, size_t len)
+{
+	ssize_t ret;
+
+
+	while (len > 0) {
+		ret = send(fd, data, len, MSG_NOSIGNAL);
+		if ((ret == -1) && (errno == EINTR))
+			continue;
+		if (ret <= 0)
+			return false;
+		data += ret;
+		len -= ret;
+	}
+
+	return true;
+
+}
+
+
+static bool send_error(const int fd, const char *status, const char *extra)
+{
+	char hdr[512];
+	int len;
+
+
+	len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %s\r\n"
+		"Content-Type: text/plain; charset=utf-8\r\n"
+		"Content-Length: %zu\r\n"
+		"%s"
+		"Connection: close\r\n\r\n"
+		"%s\n", status, strlen(status) + 1, extra, status);
+
+	return send_all(fd, hdr, len);
+
+}
+
+
+/*
+ * metrics_serve()
+ *
+ * Answer a connection's request, with a snapshot read into snap if it's
+ * for the metrics, then close it
+ */
+void metrics_serve(struct metrics_server *ms,
+		   const int fd,
+		   const struct statshm_reader *sr,
+		   struct statshm_stats *snap)
+{
+	enum METRICS_REQ req;
+	char hdr[256];
+	bool sent;
+	int len;
+
+
+	req = read_request(fd);
+
+	switch (req) {
+	case METRICS_REQ_GET:
+	case METRICS_REQ_HEAD:
+		if (statshm_read(sr, snap) != STATSHM_READ_GOOD) {
+			sent = send_error(fd, "503 Service Unavailable",
+				"Retry-After: 1\r\n");
+			break;
+		}
+		/* the counts mustn't walk off the end of the tables */
+		if (snap->num_ifaces > STATSHM_IFACES_MAX)
+			snap->num_ifaces = STATSHM_IFACES_MAX;
+		if (snap->num_targets > STATSHM_TARGETS_MAX)
+			snap->num_targets = STATSHM_TARGETS_MAX;
+		if (snap->num_paths > STATSHM_PATHS_MAX)
+			snap->num_paths = STATSHM_PATHS_MAX;
+		if (!metrics_format(ms, snap)) {
+			sent = send_error(fd, "500 Internal Server Error", "");
+			break;
+		}
+		len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+			"Content-Type: " METRICS_CONTENT_TYPE "\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", ms->buf_len);
+		sent = send_all(fd, hdr, len);
+		if (sent && (req == METRICS_REQ_GET))
+			sent = send_all(fd, ms->buf, ms->buf_len);
+		break;
+	case METRICS_REQ_NOTFOUND:
+		sent = send_error(fd, "404 Not Found", "");
+		break;
+	case METRICS_REQ_BADMETHOD:
+		sent = send_error(fd, "405 Method Not Allowed",
+			"Allow: GET, HEAD\r\n");
+		break;
+	case METRICS_REQ_BAD:
+		sent = send_error(fd, "400 Bad Request", "");
+		break;
+	case METRICS_REQ_NONE:
+	default:
+		sent = false;
+		break;
+	}
+
+	ms->requests++;
+	if (!sent || ((req != METRICS_REQ_GET) && (req != METRICS_REQ_HEAD)))
+		ms->errors++;
+
+	close(fd);
+
+}
+
+
+/*
+ * metrics_format()
+ *
+ * Render a snapshot into the response buffer. false if out of memory.
+ */
+bool metrics_format(struct metrics_server *ms,
+		    const struct statshm_stats *stats)
+{
+	char macpbuf[ENET_PADDR_MAXSZ];
+
+
+	ms->buf_len = 0;
+	ms->buf_err = false;
+
+	enet_ntop((const struct ether_addr *)stats->dstmac, ENET_NTOP_UNIX,
+		macpbuf, ENET_PADDR_MAXSZ);
+
+	put_family(ms, "ectpping", "info", "The ectpping run.");
+	buf_printf(ms, "ectpping_info{destination=\"%s\",pid=\"%llu\"} 1\n",
+		macpbuf, (unsigned long long)stats->pid);
+
+	put_family(ms, "ectpping_running", "gauge",
+		"1 while probing, 0 once finished.");
+	buf_printf(ms, "ectpping_running %u\n", stats->running ? 1 : 0);
+
+	put_family(ms, "ectpping_start_time_seconds", "gauge",
+		"When ectpping started.");
+	buf_printf(ms, "ectpping_start_time_seconds %.9f\n",
+		stats->start_ns / 1e9);
+
+	put_family(ms, "ectpping_update_time_seconds", "gauge",
+		"When these statistics were last brought up to date.");
+	buf_printf(ms, "ectpping_update_time_seconds %.9f\n",
+		stats->update_ns / 1e9);
+
+	put_family(ms, "ectpping_probe_interval_seconds", "gauge",
+		"Interval between probes.");
+	buf_printf(ms, "ectpping_probe_interval_seconds %.9f\n",
+		stats->interval_ns / 1e9);
+
+	put_iface_counter(ms, stats, "ectpping_probes_sent", "Probes sent.",
+		offsetof(struct statshm_iface, txed));
+	put_iface_counter(ms, stats, "ectpping_replies_received",
+		"Replies received, including duplicates.",
+		offsetof(struct statshm_iface, rxed));
+	put_iface_counter(ms, stats, "ectpping_probes_answered",
+		"Settled probes that were answered.",
+		offsetof(struct statshm_iface, answered));
+	put_iface_counter(ms, stats, "ectpping_probes_lost",
+		"Settled probes that were not answered within the loss "
+		"timeout.", offsetof(struct statshm_iface, lost));
+	put_iface_counter(ms, stats, "ectpping_replies_duplicate",
+		"Duplicate replies.",
+		offsetof(struct statshm_iface, duplicates));
+	put_iface_counter(ms, stats, "ectpping_replies_corrupted",
+		"Replies with a bad payload CRC.",
+		offsetof(struct statshm_iface, corrupted));
+	put_iface_counter(ms, stats, "ectpping_frames_rejected",
+		"Received frames that were not valid replies.",
+		offsetof(struct statshm_iface, rejected));
+	put_iface_counter(ms, stats, "ectpping_rx_errors",
+		"Receive errors.", offsetof(struct statshm_iface, rx_errors));
+	put_iface_counter(ms, stats, "ectpping_rx_drops",
+		"Frames dropped by the kernel as the rx socket was full.",
+		offsetof(struct statshm_iface, rx_drops));
+	put_iface_counter(ms, stats, "ectpping_tx_errors",
+		"Transmit errors.", offsetof(struct statshm_iface, tx_errors));
+	put_iface_counter(ms, stats, "ectpping_probes_overrun",
+		"Probes not settled before their tracking slot was reused.",
+		offsetof(struct statshm_iface, overruns));
+	put_iface_gauge(ms, stats, "ectpping_probes_in_flight",
+		"Probes sent and not yet answered.",
+		offsetof(struct statshm_iface, in_flight));
+
+	put_loss_ratio(ms, stats);
+
+	put_rtt_hists(ms, stats);
+
+	put_targets(ms, stats);
+
+	put_paths(ms, stats);
+
+	buf_printf(ms, "# EOF\n");
+
+	return !ms->buf_err;
+
+}
+
+
+/*
+ * metrics_close()
+ *
+ * Stop listening, removing the Unix socket
+ */
+void metrics_close(struct metrics_server *ms)
+{
+
+
+	if (ms->fd != -1)
+		close(ms->fd);
+	ms->fd = -1;
+
+	if (ms->path[0] != '\0')
+		unlink(ms->path);
+	ms->path[0] = '\0';
+
+	free(ms->buf);
+	ms->buf = NULL;
+	ms->buf_len = 0;
+	ms->buf_size = 0;
+
+}
+
+/* EOF */
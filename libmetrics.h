@@ -0,0 +1,76 @@
+#ifndef __libmetrics_h__
+#define __libmetrics_h__
+
+/*
+ *
+ * libmetrics.h - Prometheus/OpenMetrics endpoint for the live statistics
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/un.h>
+
+#include "libstatshm.h"
+
+
+/*
+ * A minimal HTTP/1.1 server, listening on a Unix socket or a localhost TCP
+ * port, answering GET or HEAD /metrics with a statistics snapshot in the
+ * OpenMetrics text format, then closing the connection. One request is
+ * served at a time, within METRICS_IO_TIMEOUT_MS, so a stalled client
+ * can't hold the server for long.
+ *
+ * The RTT histograms are exported with fixed 1-2-5 bucket bounds from
+ * 1us to 10s, counted from the libhist buckets, so to their resolution.
+ */
+enum {
+	METRICS_REQ_MAX		= 4096,
+	METRICS_IO_TIMEOUT_MS	= 1000,
+	METRICS_BACKLOG		= 8,
+	METRICS_BUF_INIT	= 65536,
+};
+
+
+struct metrics_server {
+	int fd;
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];	/* or "" */
+	char *buf;			/* the response, reused */
+	size_t buf_len;
+	size_t buf_size;
+	bool buf_err;			/* out of memory */
+	uint64_t requests;
+	uint64_t errors;
+};
+
+
+enum METRICS_LISTEN {
+	METRICS_LISTEN_GOOD,
+	METRICS_LISTEN_BADADDR,
+	METRICS_LISTEN_BADSOCKET,	/* see errno */
+};
+enum METRICS_LISTEN metrics_listen(struct metrics_server *ms,
+				   const char *addr);
+
+int metrics_accept(struct metrics_server *ms);
+
+void metrics_serve(struct metrics_server *ms,
+		   const int fd,
+		   const struct statshm_reader *sr,
+		   struct statshm_stats *snap);
+
+bool metrics_format(struct metrics_server *ms,
+		    const struct statshm_stats *stats);
+
+void metrics_close(struct metrics_server *ms);
+
+#endif /* __libmetrics_h__ */
@@ -0,0 +1,277 @@
+/*
+ * libpacer.c - absolute deadline transmit pacing
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+
+#include "libpacer.h"
+
+
+static void pacer_sleep_until(const uint64_t deadline_ns);
+static void pacer_spin_until(const uint64_t deadline_ns);
+
+
+/*
+ * pacer_now_ns()
+ *
+ * CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t pacer_now_ns(void)
+{
+	struct timespec ts;
+
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+
+}
+
+
+/*
+ * Sleep until the supplied absolute CLOCK_MONOTONIC time
+ */
+static void pacer_sleep_until(const uint64_t deadline_ns)
+{
+	struct timespec ts;
+
+
+	ts.tv_sec = deadline_ns / 1000000000ULL;
+	ts.tv_nsec = deadline_ns % 1000000000ULL;
+
+	/* returns the error rather than setting errno */
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+		EINTR)
+		;
+
+}
+
+
+/*
+ * Busy wait until the supplied absolute CLOCK_MONOTONIC time
+ */
+static void pacer_spin_until(const uint64_t deadline_ns)
+{
+
+
+	while (pacer_now_ns() < deadline_ns) {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		__asm__ __volatile__("yield");
+#endif
+	}
+
+}
+
+
+/*
+ * pacer_init()
+ *
+ * Initialise a pacer. spin_ns is only used by hybrid mode, zero selects
+ * the default.
+ */
+void pacer_init(struct pacer *pacer,
+		const enum PACER_MODE mode,
+		const uint64_t interval_ns,
+		const uint64_t spin_ns)
+{
+
+
+	memset(pacer, 0, sizeof(struct pacer));
+
+	pacer->mode = mode;
+	pacer->interval_ns = interval_ns;
+	pacer->spin_ns = (spin_ns > 0) ? spin_ns : PACER_DEFAULT_SPIN_NS;
+	pacer->min_ivl_ns = UINT64_MAX;
+
+}
+
+
+/*
+ * pacer_set_interval()
+ *
+ * Change the interval, from the deadline after the next one
+ */
+void pacer_set_interval(struct pacer *pacer, const uint64_t interval_ns)
+{
+
+
+	pacer->interval_ns = interval_ns;
+
+}
+
+
+/*
+ * pacer_start()
+ *
+ * Make the supplied time the first send deadline
+ */
+void pacer_start(struct pacer *pacer, const uint64_t now_ns)
+{
+
+
+	pacer->deadline_ns = now_ns;
+
+}
+
+
+/*
+ * pacer_wait()
+ *
+ * Wait for the next send deadline, and return it. If we're already more
+ * than a whole interval behind, the missed deadlines are skipped rather
+ * than sent back to back to catch up.
+ */
+uint64_t pacer_wait(struct pacer *pacer)
+{
+
+
+	return pacer_wait_lead(pacer, 0);
+
+}
+
+
+/*
+ * pacer_wait_lead()
+ *
+ * As pacer_wait(), but return lead_ns before the deadline. Used when
+ * something else, such as the kernel, will hold the frame until the
+ * deadline itself.
+ */
+uint64_t pacer_wait_lead(struct pacer *pacer, const uint64_t lead_ns)
+{
+	uint64_t now_ns, wake_ns;
+	uint64_t missed;
+
+
+	if (pacer->deadline_ns == 0)
+		pacer_start(pacer, pacer_now_ns());
+
+	now_ns = pacer_now_ns();
+
+	if ((pacer->interval_ns > 0) &&
+	    (now_ns > (pacer->deadline_ns + pacer->interval_ns))) {
+		missed = (now_ns - pacer->deadline_ns) / pacer->interval_ns;
+		pacer->deadline_ns += missed * pacer->interval_ns;
+		pacer->skipped += missed;
+	}
+
+	wake_ns = (pacer->deadline_ns > lead_ns) ?
+		pacer->deadline_ns - lead_ns : 0;
+
+	if (now_ns >= wake_ns)
+		return pacer->deadline_ns;
+
+	switch (pacer->mode) {
+	case PACER_MODE_SPIN:
+		pacer_spin_until(wake_ns);
+		break;
+	case PACER_MODE_HYBRID:
+		if ((wake_ns - now_ns) > pacer->spin_ns)
+			pacer_sleep_until(wake_ns - pacer->spin_ns);
+		pacer_spin_until(wake_ns);
+		break;
+	case PACER_MODE_SLEEP:
+	default:
+		pacer_sleep_until(wake_ns);
+		break;
+	}
+
+	return pacer->deadline_ns;
+
+}
+
+
+/*
+ * pacer_sent()
+ *
+ * Record that a send happened at the supplied time, and move on to the
+ * next deadline
+ */
+void pacer_sent(struct pacer *pacer, const uint64_t sent_ns)
+{
+	uint64_t ivl_ns, late_ns;
+	double delta;
+
+
+	late_ns = (sent_ns > pacer->deadline_ns) ?
+		sent_ns - pacer->deadline_ns : 0;
+	pacer->sum_late_ns += late_ns;
+	if (late_ns > pacer->max_late_ns)
+		pacer->max_late_ns = late_ns;
+
+	if (pacer->last_sent_ns != 0) {
+		ivl_ns = sent_ns - pacer->last_sent_ns;
+
+		if (ivl_ns < pacer->min_ivl_ns)
+			pacer->min_ivl_ns = ivl_ns;
+		if (ivl_ns > pacer->max_ivl_ns)
+			pacer->max_ivl_ns = ivl_ns;
+
+		/* Welford's running mean and variance */
+		pacer->intervals++;
+		delta = ivl_ns - pacer->mean_ivl_ns;
+		pacer->mean_ivl_ns += delta / pacer->intervals;
+		pacer->m2_ivl_ns += delta * (ivl_ns - pacer->mean_ivl_ns);
+	}
+
+	pacer->last_sent_ns = sent_ns;
+	pacer->deadline_ns += pacer->interval_ns;
+
+}
+
+
+/*
+ * pacer_ivl_mdev_ns()
+ *
+ * Standard deviation of the achieved inter-send intervals
+ */
+double pacer_ivl_mdev_ns(const struct pacer *pacer)
+{
+
+
+	if (pacer->intervals < 2)
+		return 0.0;
+
+	return sqrt(pacer->m2_ivl_ns / pacer->intervals);
+
+}
+
+
+/*
+ * pacer_mode_name()
+ *
+ * Printable name of a pacing mode
+ */
+const char *pacer_mode_name(const enum PACER_MODE mode)
+{
+
+
+	switch (mode) {
+	case PACER_MODE_HYBRID:
+		return "hybrid";
+	case PACER_MODE_SPIN:
+		return "spin";
+	case PACER_MODE_SLEEP:
+	default:
+		return "sleep";
+	}
+
+}
+
+/* EOF */
@@ -0,0 +1,85 @@
+#ifndef __libpacer_h__
+#define __libpacer_h__
+
+/*
+ *
+ * libpacer.h - absolute deadline transmit pacing
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Sends are scheduled against absolute CLOCK_MONOTONIC deadlines, spaced
+ * by the interval, so time spent building and sending a frame doesn't add
+ * to the period, and sleep overshoot doesn't accumulate.
+ */
+enum PACER_MODE {
+	PACER_MODE_SLEEP,	/* clock_nanosleep() to the deadline */
+	PACER_MODE_HYBRID,	/* sleep to spin_ns before, then spin */
+	PACER_MODE_SPIN,	/* spin all the way to the deadline */
+};
+
+
+/*
+ * Default time before the deadline at which hybrid mode stops sleeping
+ * and starts spinning
+ */
+enum {
+	PACER_DEFAULT_SPIN_NS	= 20000,
+};
+
+
+struct pacer {
+	enum PACER_MODE mode;
+	uint64_t interval_ns;
+	uint64_t spin_ns;
+	uint64_t deadline_ns;		/* next send deadline */
+	uint64_t last_sent_ns;		/* previous send, 0 if none yet */
+
+	/* achieved inter-send intervals */
+	uint64_t intervals;
+	uint64_t min_ivl_ns;
+	uint64_t max_ivl_ns;
+	double mean_ivl_ns;
+	double m2_ivl_ns;		/* sum of squared deviations */
+
+	/* lateness of sends relative to their deadline */
+	uint64_t sum_late_ns;
+	uint64_t max_late_ns;
+	uint64_t skipped;		/* deadlines given up on */
+};
+
+
+uint64_t pacer_now_ns(void);
+
+void pacer_init(struct pacer *pacer,
+		const enum PACER_MODE mode,
+		const uint64_t interval_ns,
+		const uint64_t spin_ns);
+
+void pacer_set_interval(struct pacer *pacer, const uint64_t interval_ns);
+
+void pacer_start(struct pacer *pacer, const uint64_t now_ns);
+
+uint64_t pacer_wait(struct pacer *pacer);
+
+uint64_t pacer_wait_lead(struct pacer *pacer, const uint64_t lead_ns);
+
+void pacer_sent(struct pacer *pacer, const uint64_t sent_ns);
+
+double pacer_ivl_mdev_ns(const struct pacer *pacer);
+
+const char *pacer_mode_name(const enum PACER_MODE mode);
+
+#endif /* __libpacer_h__ */
@@ -0,0 +1,132 @@
+/*
+ * libpattern.c - probe payload fill patterns
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "libpattern.h"
+
+
+/*
+ * Seed for the PRBS generator, any non zero 31 bit value will do
+ */
+enum {
+	PATTERN_PRBS_SEED	= 0x7fffffff,
+};
+
+
+static void fill_prbs(uint8_t buf[], const unsigned int len);
+
+
+/*
+ * Fill buf with a PRBS-31 bit sequence, most significant bit first. The
+ * long run lengths and flat spectrum make it a good test of links that
+ * are sensitive to the data being carried.
+ */
+static void fill_prbs(uint8_t buf[], const unsigned int len)
+{
+	uint32_t lfsr = PATTERN_PRBS_SEED;
+	uint32_t bit;
+	unsigned int i, j;
+	uint8_t byte;
+
+
+	for (i = 0; i < len; i++) {
+		byte = 0;
+		for (j = 0; j < 8; j++) {
+			bit = ((lfsr >> 30) ^ (lfsr >> 27)) & 1;
+			lfsr = ((lfsr << 1) | bit) & 0x7fffffff;
+			byte = (byte << 1) | bit;
+		}
+		buf[i] = byte;
+	}
+
+}
+
+
+/*
+ * pattern_parse()
+ *
+ * Convert a pattern name, "zeros", "prbs" or "incr"
+ */
+bool pattern_parse(const char *str, enum PATTERN *pattern)
+{
+
+
+	if (strcmp(str, "zeros") == 0)
+		*pattern = PATTERN_ZEROS;
+	else if (strcmp(str, "prbs") == 0)
+		*pattern = PATTERN_PRBS;
+	else if (strcmp(str, "incr") == 0)
+		*pattern = PATTERN_INCR;
+	else
+		return false;
+
+	return true;
+
+}
+
+
+/*
+ * pattern_fill()
+ *
+ * Fill len bytes of buf with the supplied pattern. The pattern always
+ * starts from the beginning, so equal sized buffers are identical.
+ */
+void pattern_fill(uint8_t buf[],
+		  const unsigned int len,
+		  const enum PATTERN pattern)
+{
+	unsigned int i;
+
+
+	switch (pattern) {
+	case PATTERN_PRBS:
+		fill_prbs(buf, len);
+		break;
+	case PATTERN_INCR:
+		for (i = 0; i < len; i++)
+			buf[i] = i & 0xff;
+		break;
+	case PATTERN_ZEROS:
+	default:
+		memset(buf, 0, len);
+		break;
+	}
+
+}
+
+
+/*
+ * pattern_name()
+ *
+ * Name of the supplied pattern
+ */
+const char *pattern_name(const enum PATTERN pattern)
+{
+
+
+	switch (pattern) {
+	case PATTERN_PRBS:
+		return "prbs";
+	case PATTERN_INCR:
+		return "incr";
+	case PATTERN_ZEROS:
+	default:
+		return "zeros";
+	}
+
+}
+
+/* EOF */
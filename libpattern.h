@@ -0,0 +1,37 @@
+#ifndef __libpattern_h__
+#define __libpattern_h__
+
+/*
+ *
+ * libpattern.h - probe payload fill patterns
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+enum PATTERN {
+	PATTERN_ZEROS,
+	PATTERN_PRBS,		/* PRBS-31, x^31 + x^28 + 1 */
+	PATTERN_INCR,		/* 0x00, 0x01 ... 0xff, 0x00 ... */
+};
+
+
+bool pattern_parse(const char *str, enum PATTERN *pattern);
+
+void pattern_fill(uint8_t buf[],
+		  const unsigned int len,
+		  const enum PATTERN pattern);
+
+const char *pattern_name(const enum PATTERN pattern);
+
+#endif /* __libpattern_h__ */
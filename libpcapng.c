@@ -0,0 +1,795 @@
+/*
+ * libpcapng.c - pcapng capture writing, and pcap/pcapng capture reading
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libpcapng.h"
+
+
+/*
+ * Blocks are gathered into a buffer this big before being written out
+ */
+enum {
+	PCAPNG_BUF_SZ		= 1024 * 1024,
+};
+
+
+/*
+ * pcapng block types and options, and classic pcap's sizes
+ */
+enum {
+	PCAPNG_BLK_IDB		= 1,
+	PCAPNG_BLK_PB		= 2,	/* obsolete packet block */
+	PCAPNG_BLK_SPB		= 3,
+	PCAPNG_BLK_EPB		= 6,
+	PCAPNG_BLK_MINSZ	= 12,	/* type, length and trailing length */
+	PCAPNG_SHB_BODYSZ	= 16,
+	PCAPNG_IDB_BODYSZ	= 8,
+	PCAPNG_EPB_BODYSZ	= 20,
+	PCAPNG_OPT_ENDOFOPT	= 0,
+	PCAPNG_OPT_IF_NAME	= 2,
+	PCAPNG_OPT_IF_TSRESOL	= 9,
+	PCAP_HDR_SZ		= 24,
+	PCAP_REC_HDR_SZ		= 16,
+	PCAP_TSRESOL_USEC	= 6,
+	PCAP_TSRESOL_NSEC	= 9,
+};
+
+
+/*
+ * In place of a block at the end of a ring, the rest of it is unused and
+ * the next block is at its start. Blocks are multiples of 4 bytes, so
+ * there's always room for it.
+ */
+enum {
+	PCAPNG_RING_PAD		= 0,
+	PCAPNG_RING_MINSZ	= 2 * (PCAPNG_BLK_MINSZ + PCAPNG_EPB_BODYSZ +
+				       PCAPNG_SNAPLEN + 1),
+};
+
+
+#define PCAPNG_BLK_SHB		0x0a0d0d0aU	/* the same either way round */
+#define PCAPNG_BYTE_ORDER_MAGIC	0x1a2b3c4dU
+#define PCAP_MAGIC_USEC		0xa1b2c3d4U
+#define PCAP_MAGIC_NSEC		0xa1b23c4dU
+
+
+static uint8_t *put16(uint8_t *p, const uint16_t val);
+static uint8_t *put32(uint8_t *p, const uint32_t val);
+static uint8_t *put_opt(uint8_t *p, const uint16_t code, const void *val,
+			const uint16_t len);
+static uint16_t get16(const struct pcap_reader *pr, const uint8_t *p);
+static uint32_t get32(const struct pcap_reader *pr, const uint8_t *p);
+static uint64_t ts_to_ns(const uint64_t ts, const uint8_t tsresol);
+static void write_all(struct pcapng_writer *pw, const void *buf,
+		      size_t len);
+static unsigned int epb_len(const unsigned int hdr_len,
+			    const unsigned int data_len);
+static void put_epb(uint8_t *blk,
+		    const unsigned int blk_len,
+		    const unsigned int iface,
+		    const uint64_t ts_ns,
+		    const void *hdr,
+		    const unsigned int hdr_len,
+		    const void *data,
+		    const unsigned int data_len);
+static enum PCAP_NEXT next_pcap(struct pcap_reader *pr,
+				struct pcap_frame *frame);
+static enum PCAP_NEXT next_pcapng(struct pcap_reader *pr,
+				  struct pcap_frame *frame);
+static void read_idb(struct pcap_reader *pr, const uint8_t *body,
+		     const uint32_t body_len);
+
+
+static uint8_t *put16(uint8_t *p, const uint16_t val)
+{
+
+
+	memcpy(p, &val, sizeof(val));
+
+	return p + sizeof(val);
+
+}
+
+
+static uint8_t *put32(uint8_t *p, const uint32_t val)
+{
+
+
+	memcpy(p, &val, sizeof(val));
+
+	return p + sizeof(val);
+
+}
+
+
+/*
+ * An option, padded to 32 bits
+ */
+static uint8_t *put_opt(uint8_t *p, const uint16_t code, const void *val,
+			const uint16_t len)
+{
+	const unsigned int padded = (len + 3) & ~3U;
+
+
+	p = put16(p, code);
+	p = put16(p, len);
+
+	if (len > 0)
+		memcpy(p, val, len);
+	memset(p + len, 0, padded - len);
+
+	return p + padded;
+
+}
+
+
+static uint16_t get16(const struct pcap_reader *pr, const uint8_t *p)
+{
+	uint16_t val;
+
+
+	memcpy(&val, p, sizeof(val));
+
+	return pr->swapped ? __builtin_bswap16(val) : val;
+
+}
+
+
+static uint32_t get32(const struct pcap_reader *pr, const uint8_t *p)
+{
+	uint32_t val;
+
+
+	memcpy(&val, p, sizeof(val));
+
+	return pr->swapped ? __builtin_bswap32(val) : val;
+
+}
+
+
+/*
+ * Convert a timestamp in if_tsresol units, a negative power of 10, or of
+ * 2 if the top bit is set, to nanoseconds
+ */
+static uint64_t ts_to_ns(const uint64_t ts, const uint8_t tsresol)
+{
+	const unsigned int exp = tsresol & 0x7f;
+	uint64_t scale = 1;
+	unsigned int i;
+
+
+	if (tsresol & 0x80)
+		return ((unsigned __int128)ts * 1000000000ULL) >> exp;
+
+	if (exp <= 9) {
+		for (i = exp; i < 9; i++)
+			scale *= 10;
+		return ts * scale;
+	}
+
+	/* finer than 10^-19 sec can't be told from 0 */
+	if (exp > (9 + 19))
+		return 0;
+
+	for (i = 9; i < exp; i++)
+		scale *= 10;
+
+	return ts / scale;
+
+}
+
+
+static void write_all(struct pcapng_writer *pw, const void *buf,
+		      size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t ret;
+
+
+	while ((len > 0) && (pw->err == 0)) {
+		ret = write(pw->fd, p, len);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			pw->err = errno;
+			return;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+}
+
+
+/*
+ * Length of the enhanced packet block for a frame of hdr_len and then
+ * data_len bytes, cut short to the snap length
+ */
+static unsigned int epb_len(const unsigned int hdr_len,
+			    const unsigned int data_len)
+{
+	const unsigned int len = hdr_len + data_len;
+	const unsigned int caplen = (len < PCAPNG_SNAPLEN) ? len :
+		PCAPNG_SNAPLEN;
+
+
+	return PCAPNG_BLK_MINSZ + PCAPNG_EPB_BODYSZ + ((caplen + 3) & ~3U);
+
+}
+
+
+static void put_epb(uint8_t *blk,
+		    const unsigned int blk_len,
+		    const unsigned int iface,
+		    const uint64_t ts_ns,
+		    const void *hdr,
+		    const unsigned int hdr_len,
+		    const void *data,
+		    const unsigned int data_len)
+{
+	unsigned int hdr_cap, data_cap, caplen, padded;
+	uint8_t *p;
+
+
+	hdr_cap = (hdr_len < PCAPNG_SNAPLEN) ? hdr_len : PCAPNG_SNAPLEN;
+	data_cap = ((hdr_cap + data_len) <= PCAPNG_SNAPLEN) ? data_len :
+		PCAPNG_SNAPLEN - hdr_cap;
+	caplen = hdr_cap + data_cap;
+	padded = (caplen + 3) & ~3U;
+
+	p = put32(blk, PCAPNG_BLK_EPB);
+	p = put32(p, blk_len);
+	p = put32(p, iface);
+	p = put32(p, ts_ns >> 32);
+	p = put32(p, ts_ns);
+	p = put32(p, caplen);
+	p = put32(p, hdr_len + data_len);
+	if (hdr_cap > 0)
+		memcpy(p, hdr, hdr_cap);
+	if (data_cap > 0)
+		memcpy(p + hdr_cap, data, data_cap);
+	memset(p + caplen, 0, padded - caplen);
+	put32(p + padded, blk_len);
+
+}
+
+
+/*
+ * pcapng_open()
+ *
+ * Create the capture file, replacing any existing one, and write its
+ * section header and an interface description per named interface
+ */
+enum PCAPNG_OPEN pcapng_open(struct pcapng_writer *pw,
+			     const char *path,
+			     const char *const ifaces[],
+			     const unsigned int num_ifaces)
+{
+	const char userappl[] = "ectpping";
+	const uint8_t tsresol = PCAP_TSRESOL_NSEC;
+	uint8_t *p, *blk;
+	unsigned int i;
+
+
+	memset(pw, 0, sizeof(struct pcapng_writer));
+
+	pw->buf = malloc(PCAPNG_BUF_SZ);
+	if (pw->buf == NULL)
+		return PCAPNG_OPEN_NOMEM;
+	pw->buf_size = PCAPNG_BUF_SZ;
+
+	pw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (pw->fd == -1) {
+		free(pw->buf);
+		return PCAPNG_OPEN_BADFILE;
+	}
+
+	/* section header, of unknown length */
+	blk = pw->buf;
+	p = put32(blk + 8, PCAPNG_BYTE_ORDER_MAGIC);
+	p = put16(p, 1);
+	p = put16(p, 0);
+	p = put32(p, UINT32_MAX);
+	p = put32(p, UINT32_MAX);
+	p = put_opt(p, 4, userappl, sizeof(userappl) - 1);
+	p = put_opt(p, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+	put32(blk, PCAPNG_BLK_SHB);
+	put32(blk + 4, (p - blk) + 4);
+	p = put32(p, (p - blk) + 4);
+
+	for (i = 0; (i < num_ifaces) && (i < PCAPNG_IFACES_MAX); i++) {
+		blk = p;
+		p = put16(blk + 8, PCAPNG_LINKTYPE_ETHERNET);
+		p = put16(p, 0);
+		p = put32(p, PCAPNG_SNAPLEN);
+		p = put_opt(p, PCAPNG_OPT_IF_NAME, ifaces[i],
+			strnlen(ifaces[i], 256));
+		p = put_opt(p, PCAPNG_OPT_IF_TSRESOL, &tsresol,
+			sizeof(tsresol));
+		p = put_opt(p, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+		put32(blk, PCAPNG_BLK_IDB);
+		put32(blk + 4, (p - blk) + 4);
+		p = put32(p, (p - blk) + 4);
+	}
+
+	pw->buf_len = p - pw->buf;
+	pw->bytes = pw->buf_len;
+
+	return PCAPNG_OPEN_GOOD;
+
+}
+
+
+/*
+ * pcapng_ring_init()
+ *
+ * Allocate an empty ring of at least min_size bytes, and always enough
+ * for the largest frame
+ */
+enum PCAPNG_RING_INIT pcapng_ring_init(struct pcapng_ring *ring,
+				       const size_t min_size)
+{
+	size_t size = 1;
+
+
+	memset(ring, 0, sizeof(struct pcapng_ring));
+
+	/* a power of two, so offsets are the counts masked */
+	while ((size < PCAPNG_RING_MINSZ) || (size < min_size))
+		size *= 2;
+
+	ring->buf = malloc(size);
+	if (ring->buf == NULL)
+		return PCAPNG_RING_INIT_NOMEM;
+
+	ring->size = size;
+
+	return PCAPNG_RING_INIT_GOOD;
+
+}
+
+
+/*
+ * pcapng_ring_free()
+ *
+ * Release a ring, once it's been drained for the last time
+ */
+void pcapng_ring_free(struct pcapng_ring *ring)
+{
+
+
+	free(ring->buf);
+	ring->buf = NULL;
+
+}
+
+
+/*
+ * pcapng_ring_put()
+ *
+ * Add a frame, made of hdr followed by data, either of which may be
+ * empty, captured on the interface at the wall clock time ts_ns. Frames
+ * larger than the snap length are cut short. Only the ring's own thread
+ * may call it. false if the ring was too full, and the frame dropped.
+ */
+bool pcapng_ring_put(struct pcapng_ring *ring,
+		     const unsigned int iface,
+		     const uint64_t ts_ns,
+		     const void *hdr,
+		     const unsigned int hdr_len,
+		     const void *data,
+		     const unsigned int data_len)
+{
+	const unsigned int blk_len = epb_len(hdr_len, data_len);
+	uint64_t head, tail;
+	size_t pos, skip;
+
+
+	head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	pos = head & (ring->size - 1);
+	skip = (blk_len > (ring->size - pos)) ? ring->size - pos : 0;
+
+	if (((head - tail) + skip + blk_len) > ring->size) {
+		atomic_fetch_add_explicit(&ring->dropped, 1,
+			memory_order_relaxed);
+		return false;
+	}
+
+	if (skip > 0) {
+		put32(&ring->buf[pos], PCAPNG_RING_PAD);
+		pos = 0;
+	}
+
+	put_epb(&ring->buf[pos], blk_len, iface, ts_ns, hdr, hdr_len, data,
+		data_len);
+
+	atomic_store_explicit(&ring->head, head + skip + blk_len,
+		memory_order_release);
+
+	return true;
+
+}
+
+
+/*
+ * pcapng_drain()
+ *
+ * Move the frames in a ring into the writer's buffer, writing it out as
+ * it fills. Only the writer's thread may call it.
+ */
+void pcapng_drain(struct pcapng_writer *pw, struct pcapng_ring *ring)
+{
+	uint64_t head, tail;
+	uint32_t type, blk_len;
+	size_t pos;
+
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	while (tail != head) {
+		pos = tail & (ring->size - 1);
+
+		memcpy(&type, &ring->buf[pos], sizeof(type));
+		if (type == PCAPNG_RING_PAD) {
+			tail += ring->size - pos;
+			continue;
+		}
+
+		memcpy(&blk_len, &ring->buf[pos + 4], sizeof(blk_len));
+
+		if ((pw->buf_len + blk_len) > pw->buf_size)
+			pcapng_flush(pw);
+
+		memcpy(pw->buf + pw->buf_len, &ring->buf[pos], blk_len);
+		pw->buf_len += blk_len;
+		pw->frames++;
+		pw->bytes += blk_len;
+
+		tail += blk_len;
+
+		/* the space is free again as soon as it's copied */
+		atomic_store_explicit(&ring->tail, tail,
+			memory_order_release);
+	}
+
+	atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+}
+
+
+/*
+ * pcapng_flush()
+ *
+ * Write out the frames gathered so far
+ */
+void pcapng_flush(struct pcapng_writer *pw)
+{
+
+
+	write_all(pw, pw->buf, pw->buf_len);
+
+	pw->buf_len = 0;
+
+}
+
+
+/*
+ * pcapng_close()
+ *
+ * Write out the remaining frames and close the capture file
+ */
+void pcapng_close(struct pcapng_writer *pw)
+{
+
+
+	pcapng_flush(pw);
+
+	if ((close(pw->fd) == -1) && (pw->err == 0))
+		pw->err = errno;
+
+	free(pw->buf);
+	pw->buf = NULL;
+
+}
+
+
+/*
+ * pcap_map()
+ *
+ * Map a pcap or pcapng capture file for reading, telling them apart, and
+ * their byte order, by their first 4 bytes
+ */
+enum PCAP_MAP pcap_map(struct pcap_reader *pr, const char *path)
+{
+	struct stat st;
+	void *map;
+	uint32_t magic;
+	int fd;
+
+
+	memset(pr, 0, sizeof(struct pcap_reader));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return PCAP_MAP_BADFILE;
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return PCAP_MAP_BADFILE;
+	}
+
+	if (st.st_size < PCAP_HDR_SZ) {
+		close(fd);
+		return PCAP_MAP_BADHDR;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return PCAP_MAP_BADFILE;
+
+	/* read once, front to back */
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	pr->map = map;
+	pr->size = st.st_size;
+
+	memcpy(&magic, pr->map, sizeof(magic));
+
+	/* the section header sets the byte order of each pcapng section */
+	if (magic == PCAPNG_BLK_SHB) {
+		pr->pcapng = true;
+		return PCAP_MAP_GOOD;
+	}
+
+	if ((magic == __builtin_bswap32(PCAP_MAGIC_USEC)) ||
+	    (magic == __builtin_bswap32(PCAP_MAGIC_NSEC))) {
+		pr->swapped = true;
+		magic = __builtin_bswap32(magic);
+	}
+
+	if (magic == PCAP_MAGIC_USEC) {
+		pr->ifaces[0].tsresol = PCAP_TSRESOL_USEC;
+	} else if (magic == PCAP_MAGIC_NSEC) {
+		pr->ifaces[0].tsresol = PCAP_TSRESOL_NSEC;
+	} else {
+		pcap_unmap(pr);
+		return PCAP_MAP_BADHDR;
+	}
+
+	/* the top bits of the link type are the frames' FCS length */
+	pr->ifaces[0].linktype = get32(pr, pr->map + 20) & 0x0fffffff;
+	pr->num_ifaces = 1;
+	pr->pos = PCAP_HDR_SZ;
+
+	return PCAP_MAP_GOOD;
+
+}
+
+
+/*
+ * pcap_next()
+ *
+ * Read the capture's next frame
+ */
+enum PCAP_NEXT pcap_next(struct pcap_reader *pr, struct pcap_frame *frame)
+{
+
+
+	if (pr->pcapng)
+		return next_pcapng(pr, frame);
+	else
+		return next_pcap(pr, frame);
+
+}
+
+
+static enum PCAP_NEXT next_pcap(struct pcap_reader *pr,
+				struct pcap_frame *frame)
+{
+	const uint8_t *p = pr->map + pr->pos;
+	uint32_t secs, frac;
+
+
+	if (pr->pos == pr->size)
+		return PCAP_NEXT_END;
+
+	if ((pr->size - pr->pos) < PCAP_REC_HDR_SZ)
+		return PCAP_NEXT_BAD;
+
+	secs = get32(pr, p);
+	frac = get32(pr, p + 4);
+	frame->caplen = get32(pr, p + 8);
+	frame->len = get32(pr, p + 12);
+
+	if (frame->caplen > (pr->size - pr->pos - PCAP_REC_HDR_SZ))
+		return PCAP_NEXT_BAD;
+
+	frame->iface = 0;
+	frame->linktype = pr->ifaces[0].linktype;
+	frame->ts_ns = ((uint64_t)secs * 1000000000ULL) +
+		ts_to_ns(frac, pr->ifaces[0].tsresol);
+	frame->data = p + PCAP_REC_HDR_SZ;
+
+	pr->pos += PCAP_REC_HDR_SZ + frame->caplen;
+
+	return PCAP_NEXT_GOOD;
+
+}
+
+
+static enum PCAP_NEXT next_pcapng(struct pcap_reader *pr,
+				  struct pcap_frame *frame)
+{
+	const uint8_t *p, *body;
+	uint32_t type, blk_len, body_len, magic, iface;
+	uint64_t ts;
+
+
+	while (true) {
+
+		if (pr->pos == pr->size)
+			return PCAP_NEXT_END;
+
+		if ((pr->size - pr->pos) < PCAPNG_BLK_MINSZ)
+			return PCAP_NEXT_BAD;
+
+		p = pr->map + pr->pos;
+
+		memcpy(&type, p, sizeof(type));
+
+		/* a new section, with its own byte order and interfaces */
+		if (type == PCAPNG_BLK_SHB) {
+			memcpy(&magic, p + 8, sizeof(magic));
+			if (magic == PCAPNG_BYTE_ORDER_MAGIC)
+				pr->swapped = false;
+			else if (magic == __builtin_bswap32(
+				PCAPNG_BYTE_ORDER_MAGIC))
+				pr->swapped = true;
+			else
+				return PCAP_NEXT_BAD;
+			pr->num_ifaces = 0;
+		}
+
+		type = get32(pr, p);
+		blk_len = get32(pr, p + 4);
+
+		if ((blk_len < PCAPNG_BLK_MINSZ) || ((blk_len % 4) != 0) ||
+		    (blk_len > (pr->size - pr->pos)))
+			return PCAP_NEXT_BAD;
+
+		body = p + 8;
+		body_len = blk_len - PCAPNG_BLK_MINSZ;
+
+		pr->pos += blk_len;
+
+		switch (type) {
+		case PCAPNG_BLK_SHB:
+			if (body_len < PCAPNG_SHB_BODYSZ)
+				return PCAP_NEXT_BAD;
+			continue;
+		case PCAPNG_BLK_IDB:
+			if (body_len < PCAPNG_IDB_BODYSZ)
+				return PCAP_NEXT_BAD;
+			read_idb(pr, body, body_len);
+			continue;
+		case PCAPNG_BLK_EPB:
+		case PCAPNG_BLK_PB:
+			if (body_len < PCAPNG_EPB_BODYSZ)
+				return PCAP_NEXT_BAD;
+			iface = (type == PCAPNG_BLK_EPB) ? get32(pr, body) :
+				get16(pr, body);
+			ts = ((uint64_t)get32(pr, body + 4) << 32) |
+				get32(pr, body + 8);
+			frame->caplen = get32(pr, body + 12);
+			frame->len = get32(pr, body + 16);
+			if (frame->caplen > (body_len - PCAPNG_EPB_BODYSZ))
+				return PCAP_NEXT_BAD;
+			frame->data = body + PCAPNG_EPB_BODYSZ;
+			break;
+		case PCAPNG_BLK_SPB:
+			if (body_len < 4)
+				return PCAP_NEXT_BAD;
+			iface = 0;
+			ts = 0;
+			frame->len = get32(pr, body);
+			frame->caplen = (frame->len < (body_len - 4)) ?
+				frame->len : body_len - 4;
+			frame->data = body + 4;
+			break;
+		default:
+			continue;
+		}
+
+		/* interfaces beyond those kept are skipped */
+		if ((iface >= pr->num_ifaces) || (iface >= PCAPNG_IFACES_MAX))
+			continue;
+
+		frame->iface = iface;
+		frame->linktype = pr->ifaces[iface].linktype;
+		frame->ts_ns = (type == PCAPNG_BLK_SPB) ? 0 :
+			ts_to_ns(ts, pr->ifaces[iface].tsresol);
+
+		return PCAP_NEXT_GOOD;
+	}
+
+}
+
+
+/*
+ * Add an interface description's link type and timestamp resolution
+ */
+static void read_idb(struct pcap_reader *pr, const uint8_t *body,
+		     const uint32_t body_len)
+{
+	struct pcap_iface *pif;
+	const uint8_t *opt = body + PCAPNG_IDB_BODYSZ;
+	uint32_t left = body_len - PCAPNG_IDB_BODYSZ;
+	uint16_t code, len;
+
+
+	if (pr->num_ifaces >= PCAPNG_IFACES_MAX) {
+		pr->num_ifaces++;
+		return;
+	}
+
+	pif = &pr->ifaces[pr->num_ifaces++];
+
+	pif->linktype = get16(pr, body);
+	pif->tsresol = PCAP_TSRESOL_USEC;
+
+	while (left >= 4) {
+		code = get16(pr, opt);
+		len = get16(pr, opt + 2);
+		if ((code == PCAPNG_OPT_ENDOFOPT) ||
+		    (((len + 3U) & ~3U) > (left - 4)))
+			break;
+		if ((code == PCAPNG_OPT_IF_TSRESOL) && (len >= 1))
+			pif->tsresol = opt[4];
+		opt += 4 + ((len + 3U) & ~3U);
+		left -= 4 + ((len + 3U) & ~3U);
+	}
+
+}
+
+
+/*
+ * pcap_unmap()
+ *
+ * Release a mapped capture
+ */
+void pcap_unmap(struct pcap_reader *pr)
+{
+
+
+	if (pr->map != NULL)
+		munmap((void *)pr->map, pr->size);
+	pr->map = NULL;
+
+}
+
+/* EOF */
@@ -0,0 +1,153 @@
+#ifndef __libpcapng_h__
+#define __libpcapng_h__
+
+/*
+ *
+ * libpcapng.h - pcapng capture writing, and pcap/pcapng capture reading
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+
+/*
+ * A written capture is a single pcapng section, in host byte order, with
+ * an Ethernet interface description per interface, each with nanosecond
+ * timestamps, followed by an enhanced packet block per frame. Wireshark
+ * and tcpdump read it as is.
+ *
+ * Each thread capturing frames puts them in a ring of its own, lock free
+ * and without ever blocking, and a frame that doesn't fit is dropped and
+ * counted. A single writer thread drains the rings into the writer's
+ * buffer and writes that out, so no capturing thread waits for the file.
+ *
+ * Either classic pcap, in either byte order with microsecond or
+ * nanosecond timestamps, or pcapng, with any number of sections,
+ * interfaces and timestamp resolutions, can be read back.
+ */
+enum {
+	PCAPNG_IFACES_MAX	= 64,
+	PCAPNG_SNAPLEN		= 65535,
+	PCAPNG_LINKTYPE_ETHERNET = 1,
+};
+
+
+struct pcapng_writer {
+	int fd;
+	uint8_t *buf;
+	size_t buf_len;
+	size_t buf_size;
+	uint64_t frames;
+	uint64_t bytes;
+	int err;			/* first write errno, 0 if none */
+};
+
+
+/*
+ * A single producer, single consumer ring of finished enhanced packet
+ * blocks, a power of two bytes in size. head and tail count the bytes
+ * ever added and taken.
+ */
+struct pcapng_ring {
+	uint8_t *buf;
+	size_t size;
+	_Atomic uint64_t head;		/* producer's */
+	_Atomic uint64_t tail;		/* consumer's */
+	_Atomic uint64_t dropped;	/* frames that didn't fit */
+};
+
+
+/*
+ * An interface a capture's frames were read from
+ */
+struct pcap_iface {
+	uint32_t linktype;
+	uint8_t tsresol;		/* as pcapng's if_tsresol */
+};
+
+
+struct pcap_reader {
+	const uint8_t *map;
+	size_t size;
+	size_t pos;
+	bool pcapng;
+	bool swapped;			/* other byte order than the host's */
+	unsigned int num_ifaces;	/* in the current pcapng section */
+	struct pcap_iface ifaces[PCAPNG_IFACES_MAX];
+};
+
+
+/*
+ * A frame read from a capture, pointing into the mapped file
+ */
+struct pcap_frame {
+	unsigned int iface;
+	uint32_t linktype;
+	uint64_t ts_ns;			/* 0 if the capture hasn't any */
+	const uint8_t *data;
+	uint32_t caplen;
+	uint32_t len;			/* on the wire */
+};
+
+
+enum PCAPNG_OPEN {
+	PCAPNG_OPEN_GOOD,
+	PCAPNG_OPEN_NOMEM,
+	PCAPNG_OPEN_BADFILE,		/* see errno */
+};
+enum PCAPNG_OPEN pcapng_open(struct pcapng_writer *pw,
+			     const char *path,
+			     const char *const ifaces[],
+			     const unsigned int num_ifaces);
+
+enum PCAPNG_RING_INIT {
+	PCAPNG_RING_INIT_GOOD,
+	PCAPNG_RING_INIT_NOMEM,
+};
+enum PCAPNG_RING_INIT pcapng_ring_init(struct pcapng_ring *ring,
+				       const size_t min_size);
+
+void pcapng_ring_free(struct pcapng_ring *ring);
+
+bool pcapng_ring_put(struct pcapng_ring *ring,
+		     const unsigned int iface,
+		     const uint64_t ts_ns,
+		     const void *hdr,
+		     const unsigned int hdr_len,
+		     const void *data,
+		     const unsigned int data_len);
+
+void pcapng_drain(struct pcapng_writer *pw, struct pcapng_ring *ring);
+
+void pcapng_flush(struct pcapng_writer *pw);
+
+void pcapng_close(struct pcapng_writer *pw);
+
+enum PCAP_MAP {
+	PCAP_MAP_GOOD,
+	PCAP_MAP_BADFILE,		/* see errno */
+	PCAP_MAP_BADHDR,
+};
+enum PCAP_MAP pcap_map(struct pcap_reader *pr, const char *path);
+
+enum PCAP_NEXT {
+	PCAP_NEXT_GOOD,
+	PCAP_NEXT_END,
+	PCAP_NEXT_BAD,			/* truncated or corrupt block */
+};
+enum PCAP_NEXT pcap_next(struct pcap_reader *pr, struct pcap_frame *frame);
+
+void pcap_unmap(struct pcap_reader *pr);
+
+#endif /* __libpcapng_h__ */
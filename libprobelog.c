@@ -0,0 +1,517 @@
+/*
+ * libprobelog.c - compact binary log of every probe's outcome
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libprobelog.h"
+
+
+/*
+ * Records are gathered into a buffer this big before being written out
+ */
+enum {
+	PROBELOG_BUF_SZ		= 1024 * 1024,
+};
+
+
+static uint8_t *put_varint(uint8_t *p, uint64_t val);
+static uint64_t zigzag(const int64_t val);
+static int64_t unzigzag(const uint64_t val);
+static bool get_varint(struct probelog_reader *plr, uint64_t *val);
+static unsigned int find_responder(struct probelog_writer *plw,
+				   const uint64_t mac,
+				   bool *new_responder);
+static void write_all(struct probelog_writer *plw, const void *buf,
+		      size_t len);
+
+
+static uint8_t *put_varint(uint8_t *p, uint64_t val)
+{
+
+
+	while (val >= 0x80) {
+		*p++ = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+
+	*p++ = val;
+
+	return p;
+
+}
+
+
+static uint64_t zigzag(const int64_t val)
+{
+
+
+	return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+
+}
+
+
+static int64_t unzigzag(const uint64_t val)
+{
+
+
+	return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+
+}
+
+
+static bool get_varint(struct probelog_reader *plr, uint64_t *val)
+{
+	unsigned int shift = 0;
+	uint8_t byte;
+
+
+	*val = 0;
+
+	do {
+		if ((plr->pos >= plr->size) || (shift > 63))
+			return false;
+		byte = plr->map[plr->pos++];
+		*val |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return true;
+
+}
+
+
+/*
+ * The index of a responder, adding it to the table if it's new. When the
+ * table is full, responders not in it are PROBELOG_RESPONDER_UNKNOWN.
+ */
+static unsigned int find_responder(struct probelog_writer *plw,
+				   const uint64_t mac,
+				   bool *new_responder)
+{
+	unsigned int i;
+
+
+	*new_responder = false;
+
+	if ((plw->num_responders > 0) &&
+	    (plw->responders[plw->last_responder] == mac))
+		return plw->last_responder;
+
+	for (i = 0; i < plw->num_responders; i++) {
+		if (plw->responders[i] == mac) {
+			plw->last_responder = i;
+			return i;
+		}
+	}
+
+	if (plw->num_responders == PROBELOG_RESPONDERS_MAX)
+		return PROBELOG_RESPONDER_UNKNOWN;
+
+	plw->responders[plw->num_responders] = mac;
+	plw->last_responder = plw->num_responders++;
+	*new_responder = true;
+
+	return plw->last_responder;
+
+}
+
+
+static void write_all(struct probelog_writer *plw, const void *buf,
+		      size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t ret;
+
+
+	while ((len > 0) && (plw->err == 0)) {
+		ret = write(plw->fd, p, len);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			plw->err = errno;
+			return;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+}
+
+
+/*
+ * probelog_open()
+ *
+ * Create the log file, replacing any existing one, and write its header
+ */
+enum PROBELOG_OPEN probelog_open(struct probelog_writer *plw,
+				 const char *path,
+				 const struct probelog_hdr *hdr)
+{
+	struct probelog_hdr h = *hdr;
+	unsigned int i;
+
+
+	memset(plw, 0, sizeof(struct probelog_writer));
+
+	plw->buf = malloc(PROBELOG_BUF_SZ);
+	plw->responders = malloc(PROBELOG_RESPONDERS_MAX * sizeof(uint64_t));
+	if ((plw->buf == NULL) || (plw->responders == NULL)) {
+		free(plw->buf);
+		free(plw->responders);
+		return PROBELOG_OPEN_NOMEM;
+	}
+	plw->buf_size = PROBELOG_BUF_SZ;
+
+	plw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (plw->fd == -1) {
+		free(plw->buf);
+		free(plw->responders);
+		return PROBELOG_OPEN_BADFILE;
+	}
+
+	memcpy(h.magic, PROBELOG_MAGIC, sizeof(h.magic));
+	h.version = PROBELOG_VERSION;
+	h.hdr_size = sizeof(struct probelog_hdr);
+
+	plw->num_ifaces = h.num_ifaces;
+	memset(plw->prev, 0, sizeof(plw->prev));
+	for (i = 0; i < PROBELOG_IFACES_MAX; i++)
+		plw->prev[i].seq = UINT32_MAX;
+
+	write_all(plw, &h, sizeof(h));
+	plw->bytes = sizeof(h);
+
+	return PROBELOG_OPEN_GOOD;
+
+}
+
+
+/*
+ * probelog_write()
+ *
+ * Add a probe's outcome to the log, writing the buffer out when it fills.
+ * rtt_ns and responder_mac are ignored for unanswered probes.
+ */
+void probelog_write(struct probelog_writer *plw,
+		    const unsigned int iface,
+		    const uint32_t seq,
+		    const uint64_t tx_ns,
+		    const bool answered,
+		    const int64_t rtt_ns,
+		    const uint64_t responder_mac)
+{
+	struct probelog_prev *prev = &plw->prev[iface];
+	uint8_t *start, *p;
+	unsigned int responder = 0;
+	bool new_responder = false;
+
+
+	if ((plw->buf_len + PROBELOG_REC_MAXSZ) > plw->buf_size)
+		probelog_flush(plw);
+
+	start = p = &plw->buf[plw->buf_len];
+
+	if (answered)
+		responder = find_responder(plw, responder_mac, &new_responder);
+
+	*p++ = (answered ? PROBELOG_REC_ANSWERED : 0) |
+		(new_responder ? PROBELOG_REC_NEWRESP : 0);
+
+	if (plw->num_ifaces > 1)
+		*p++ = iface;
+
+	p = put_varint(p, (uint32_t)(seq - prev->seq));
+	p = put_varint(p, zigzag((int64_t)(tx_ns - prev->tx_ns)));
+
+	if (answered) {
+		p = put_varint(p, zigzag(rtt_ns));
+		if (new_responder) {
+			probelog_mac_to_bytes(responder_mac, p);
+			p += 6;
+		} else {
+			p = put_varint(p, responder);
+		}
+	}
+
+	prev->seq = seq;
+	prev->tx_ns = tx_ns;
+
+	plw->buf_len += p - start;
+	plw->records++;
+	plw->bytes += p - start;
+
+}
+
+
+/*
+ * probelog_flush()
+ *
+ * Write out the buffered records
+ */
+void probelog_flush(struct probelog_writer *plw)
+{
+
+
+	write_all(plw, plw->buf, plw->buf_len);
+
+	plw->buf_len = 0;
+
+}
+
+
+/*
+ * probelog_close()
+ *
+ * Flush and close the log
+ */
+void probelog_close(struct probelog_writer *plw)
+{
+
+
+	probelog_flush(plw);
+
+	if ((close(plw->fd) == -1) && (plw->err == 0))
+		plw->err = errno;
+
+	free(plw->buf);
+	plw->buf = NULL;
+	free(plw->responders);
+	plw->responders = NULL;
+
+}
+
+
+/*
+ * probelog_map()
+ *
+ * Map a log for reading, and check its header
+ */
+enum PROBELOG_MAP probelog_map(struct probelog_reader *plr, const char *path)
+{
+	struct stat st;
+	void *map;
+	unsigned int i;
+	int fd;
+
+
+	memset(plr, 0, sizeof(struct probelog_reader));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return PROBELOG_MAP_BADFILE;
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return PROBELOG_MAP_BADFILE;
+	}
+
+	if ((size_t)st.st_size < sizeof(struct probelog_hdr)) {
+		close(fd);
+		return PROBELOG_MAP_BADHDR;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return PROBELOG_MAP_BADFILE;
+
+	/* read once, front to back */
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	plr->map = map;
+	plr->size = st.st_size;
+
+	memcpy(&plr->hdr, plr->map, sizeof(struct probelog_hdr));
+
+	if ((memcmp(plr->hdr.magic, PROBELOG_MAGIC, sizeof(PROBELOG_MAGIC)) !=
+		0) || (plr->hdr.version != PROBELOG_VERSION) ||
+	    (plr->hdr.hdr_size < sizeof(struct probelog_hdr)) ||
+	    (plr->hdr.hdr_size > plr->size) ||
+	    (plr->hdr.num_ifaces == 0) ||
+	    (plr->hdr.num_ifaces > PROBELOG_IFACES_MAX)) {
+		probelog_unmap(plr);
+		return PROBELOG_MAP_BADHDR;
+	}
+
+	plr->responders = malloc(PROBELOG_RESPONDERS_MAX * sizeof(uint64_t));
+	if (plr->responders == NULL) {
+		probelog_unmap(plr);
+		return PROBELOG_MAP_NOMEM;
+	}
+
+	plr->pos = plr->hdr.hdr_size;
+
+	for (i = 0; i < PROBELOG_IFACES_MAX; i++)
+		plr->prev[i].seq = UINT32_MAX;
+
+	return PROBELOG_MAP_GOOD;
+
+}
+
+
+/*
+ * probelog_next()
+ *
+ * Decode the next record
+ */
+enum PROBELOG_NEXT probelog_next(struct probelog_reader *plr,
+				 struct probelog_rec *rec)
+{
+	struct probelog_prev *prev;
+	uint64_t val;
+	uint8_t flags;
+
+
+	if (plr->pos >= plr->size)
+		return PROBELOG_NEXT_END;
+
+	flags = plr->map[plr->pos++];
+
+	rec->iface = 0;
+	if (plr->hdr.num_ifaces > 1) {
+		if (plr->pos >= plr->size)
+			return PROBELOG_NEXT_BAD;
+		rec->iface = plr->map[plr->pos++];
+		if (rec->iface >= plr->hdr.num_ifaces)
+			return PROBELOG_NEXT_BAD;
+	}
+
+	prev = &plr->prev[rec->iface];
+
+	if (!get_varint(plr, &val))
+		return PROBELOG_NEXT_BAD;
+	rec->seq = prev->seq + (uint32_t)val;
+
+	if (!get_varint(plr, &val))
+		return PROBELOG_NEXT_BAD;
+	rec->tx_ns = prev->tx_ns + unzigzag(val);
+
+	prev->seq = rec->seq;
+	prev->tx_ns = rec->tx_ns;
+
+	rec->answered = (flags & PROBELOG_REC_ANSWERED);
+	rec->rtt_ns = 0;
+	rec->responder = 0;
+
+	if (!rec->answered)
+		return PROBELOG_NEXT_GOOD;
+
+	if (!get_varint(plr, &val))
+		return PROBELOG_NEXT_BAD;
+	rec->rtt_ns = unzigzag(val);
+
+	if (flags & PROBELOG_REC_NEWRESP) {
+		if (((plr->pos + 6) > plr->size) ||
+		    (plr->num_responders == PROBELOG_RESPONDERS_MAX))
+			return PROBELOG_NEXT_BAD;
+		plr->responders[plr->num_responders] =
+			probelog_bytes_to_mac(&plr->map[plr->pos]);
+		plr->pos += 6;
+		rec->responder = plr->num_responders++;
+	} else {
+		if (!get_varint(plr, &val))
+			return PROBELOG_NEXT_BAD;
+		/* unknown is only logged once the table is full */
+		if ((val == PROBELOG_RESPONDER_UNKNOWN) ?
+		    (plr->num_responders < PROBELOG_RESPONDERS_MAX) :
+		    (val >= plr->num_responders))
+			return PROBELOG_NEXT_BAD;
+		rec->responder = val;
+	}
+
+	return PROBELOG_NEXT_GOOD;
+
+}
+
+
+/*
+ * probelog_responder()
+ *
+ * The mac address of a responder seen so far, 0 if it's unknown
+ */
+uint64_t probelog_responder(const struct probelog_reader *plr,
+			    const unsigned int responder)
+{
+
+
+	if (responder >= plr->num_responders)
+		return 0;
+
+	return plr->responders[responder];
+
+}
+
+
+/*
+ * probelog_unmap()
+ *
+ * Release a mapped log
+ */
+void probelog_unmap(struct probelog_reader *plr)
+{
+
+
+	if (plr->map != NULL)
+		munmap((void *)plr->map, plr->size);
+	plr->map = NULL;
+
+	free(plr->responders);
+	plr->responders = NULL;
+
+}
+
+
+/*
+ * probelog_mac_to_bytes()
+ *
+ * Unpack a mac address held in the low 48 bits, first octet lowest
+ */
+void probelog_mac_to_bytes(const uint64_t mac, uint8_t bytes[6])
+{
+	unsigned int i;
+
+
+	for (i = 0; i < 6; i++)
+		bytes[i] = mac >> (i * 8);
+
+}
+
+
+/*
+ * probelog_bytes_to_mac()
+ *
+ * Pack a mac address into the low 48 bits, first octet lowest
+ */
+uint64_t probelog_bytes_to_mac(const uint8_t bytes[6])
+{
+	uint64_t mac = 0;
+	unsigned int i;
+
+
+	for (i = 0; i < 6; i++)
+		mac |= (uint64_t)bytes[i] << (i * 8);
+
+	return mac;
+
+}
+
+/* EOF */
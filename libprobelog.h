@@ -0,0 +1,171 @@
+#ifndef __libprobelog_h__
+#define __libprobelog_h__
+
+/*
+ *
+ * libprobelog.h - compact binary log of every probe's outcome
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/*
+ * A log is a fixed size header followed by variable length records, one
+ * per probe, in host byte order. Each interface's records are in sequence
+ * number order, and their fields are delta encoded against that
+ * interface's previous record as LEB128 varints:
+ *
+ *	flags			1 byte, PROBELOG_REC_*
+ *	iface			1 byte, only if the log has several interfaces
+ *	seq			seq - previous seq, unsigned
+ *	tx_ns			tx_ns - previous tx_ns, zigzag signed
+ *	rtt_ns			zigzag signed, if answered
+ *	responder		index, if answered and not a new responder
+ *	responder mac		6 bytes, if a new responder
+ *
+ * Responders are numbered in the order they first appear, so a reader
+ * rebuilds the same table as it goes. Once the table is full, responders
+ * not in it are logged as PROBELOG_RESPONDER_UNKNOWN. A probe typically
+ * takes 8 to 10 bytes.
+ */
+enum {
+	PROBELOG_VERSION	= 1,
+	PROBELOG_IFACES_MAX	= 16,
+	PROBELOG_IFNAMSIZ	= 16,
+	PROBELOG_RESPONDERS_MAX	= 65536,
+	PROBELOG_RESPONDER_UNKNOWN = PROBELOG_RESPONDERS_MAX,
+	PROBELOG_REC_MAXSZ	= 1 + 1 + 5 + 10 + 10 + 6,
+};
+
+
+enum {
+	PROBELOG_REC_ANSWERED	= 0x01,
+	PROBELOG_REC_NEWRESP	= 0x02,	/* responder mac follows */
+};
+
+
+#define PROBELOG_MAGIC "ECTPLOG"
+
+
+struct probelog_hdr {
+	char magic[8];
+	uint16_t version;
+	uint16_t hdr_size;
+	uint16_t num_ifaces;
+	uint16_t reserved;
+	uint64_t start_ns;		/* wall clock, when the log was opened */
+	uint64_t interval_ns;
+	uint8_t dstmac[6];
+	uint8_t pad[2];
+	char ifaces[PROBELOG_IFACES_MAX][PROBELOG_IFNAMSIZ];
+};
+
+
+/*
+ * A decoded record
+ */
+struct probelog_rec {
+	unsigned int iface;
+	uint32_t seq;
+	uint64_t tx_ns;			/* wall clock */
+	bool answered;
+	int64_t rtt_ns;
+	unsigned int responder;		/* index into the responders, or
+					   PROBELOG_RESPONDER_UNKNOWN */
+};
+
+
+/*
+ * Each interface's previous record, the base for the next one's deltas
+ */
+struct probelog_prev {
+	uint32_t seq;
+	uint64_t tx_ns;
+};
+
+
+struct probelog_writer {
+	int fd;
+	uint8_t *buf;
+	size_t buf_len;
+	size_t buf_size;
+	unsigned int num_ifaces;
+	struct probelog_prev prev[PROBELOG_IFACES_MAX];
+	uint64_t *responders;		/* macs, in 48 bits */
+	unsigned int num_responders;
+	unsigned int last_responder;	/* most likely to answer next */
+	uint64_t records;
+	uint64_t bytes;
+	int err;			/* first write errno, 0 if none */
+};
+
+
+struct probelog_reader {
+	const uint8_t *map;
+	size_t size;
+	size_t pos;
+	struct probelog_hdr hdr;
+	struct probelog_prev prev[PROBELOG_IFACES_MAX];
+	uint64_t *responders;
+	unsigned int num_responders;
+};
+
+
+enum PROBELOG_OPEN {
+	PROBELOG_OPEN_GOOD,
+	PROBELOG_OPEN_NOMEM,
+	PROBELOG_OPEN_BADFILE,		/* see errno */
+};
+enum PROBELOG_OPEN probelog_open(struct probelog_writer *plw,
+				 const char *path,
+				 const struct probelog_hdr *hdr);
+
+void probelog_write(struct probelog_writer *plw,
+		    const unsigned int iface,
+		    const uint32_t seq,
+		    const uint64_t tx_ns,
+		    const bool answered,
+		    const int64_t rtt_ns,
+		    const uint64_t responder_mac);
+
+void probelog_flush(struct probelog_writer *plw);
+
+void probelog_close(struct probelog_writer *plw);
+
+enum PROBELOG_MAP {
+	PROBELOG_MAP_GOOD,
+	PROBELOG_MAP_BADFILE,		/* see errno */
+	PROBELOG_MAP_BADHDR,
+	PROBELOG_MAP_NOMEM,
+};
+enum PROBELOG_MAP probelog_map(struct probelog_reader *plr, const char *path);
+
+enum PROBELOG_NEXT {
+	PROBELOG_NEXT_GOOD,
+	PROBELOG_NEXT_END,
+	PROBELOG_NEXT_BAD,		/* truncated or corrupt record */
+};
+enum PROBELOG_NEXT probelog_next(struct probelog_reader *plr,
+				 struct probelog_rec *rec);
+
+uint64_t probelog_responder(const struct probelog_reader *plr,
+			    const unsigned int responder);
+
+void probelog_unmap(struct probelog_reader *plr);
+
+void probelog_mac_to_bytes(const uint64_t mac, uint8_t bytes[6]);
+
+uint64_t probelog_bytes_to_mac(const uint8_t bytes[6]);
+
+#endif /* __libprobelog_h__ */
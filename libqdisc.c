@@ -0,0 +1,210 @@
+/*
+ * libqdisc.c - interface transmit queueing discipline queries
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+
+#include "libqdisc.h"
+
+
+/*
+ * What the dump says about the interface's qdiscs
+ */
+struct qdisc_walk {
+	int ifindex;
+	char root_kind[QDISC_KIND_SZ];
+	uint32_t root_handle;
+	bool have_root;
+	unsigned int children;		/* directly below the root */
+	unsigned int fq_children;
+};
+
+
+static bool qdisc_dump_request(const int nl_sockfd);
+
+static void qdisc_walk_msg(struct qdisc_walk *walk,
+			   const struct nlmsghdr *nlh);
+
+static int qdisc_dump_read(const int nl_sockfd, struct qdisc_walk *walk);
+
+
+static bool qdisc_dump_request(const int nl_sockfd)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct tcmsg tcm;
+	} req;
+
+
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req.nlh.nlmsg_type = RTM_GETQDISC;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nlh.nlmsg_seq = 1;
+	req.tcm.tcm_family = AF_UNSPEC;
+
+	return (send(nl_sockfd, &req, req.nlh.nlmsg_len, 0) ==
+		(ssize_t)req.nlh.nlmsg_len);
+
+}
+
+
+static void qdisc_walk_msg(struct qdisc_walk *walk,
+			   const struct nlmsghdr *nlh)
+{
+	const struct tcmsg *tcm = NLMSG_DATA(nlh);
+	const struct rtattr *rta;
+	int rta_len;
+	char kind[QDISC_KIND_SZ] = "";
+
+
+	if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct tcmsg)))
+		return;
+
+	/* the dump is of every interface's */
+	if (tcm->tcm_ifindex != walk->ifindex)
+		return;
+
+	rta = (const struct rtattr *)((const char *)tcm +
+		NLMSG_ALIGN(sizeof(struct tcmsg)));
+	rta_len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct tcmsg));
+
+	for ( ; RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+		if (rta->rta_type == TCA_KIND) {
+			strncpy(kind, RTA_DATA(rta), QDISC_KIND_SZ - 1);
+			break;
+		}
+	}
+
+	if (tcm->tcm_parent == TC_H_ROOT) {
+		memcpy(walk->root_kind, kind, QDISC_KIND_SZ);
+		walk->root_handle = tcm->tcm_handle;
+		walk->have_root = true;
+	} else if (walk->have_root &&
+		   (TC_H_MAJ(tcm->tcm_parent) == walk->root_handle)) {
+		/* the kernel dumps an interface's root qdisc first */
+		walk->children++;
+		if (strcmp(kind, "fq") == 0)
+			walk->fq_children++;
+	}
+
+}
+
+
+/*
+ * Read the dump's replies through to its end. 0 when done, otherwise the
+ * errno.
+ */
+static int qdisc_dump_read(const int nl_sockfd, struct qdisc_walk *walk)
+{
+	union {
+		char buf[16384];
+		struct nlmsghdr align;
+	} resp;
+	const struct nlmsghdr *nlh;
+	const struct nlmsgerr *nlerr;
+	ssize_t len;
+
+
+	while (true) {
+		len = recv(nl_sockfd, resp.buf, sizeof(resp.buf), 0);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		for (nlh = &resp.align; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			switch (nlh->nlmsg_type) {
+			case NLMSG_DONE:
+				return 0;
+			case NLMSG_ERROR:
+				nlerr = NLMSG_DATA(nlh);
+				return (nlerr->error != 0) ? -nlerr->error :
+					EPROTO;
+			case RTM_NEWQDISC:
+				qdisc_walk_msg(walk, nlh);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+}
+
+
+/*
+ * qdisc_txtime()
+ *
+ * Whether the interface's transmit qdisc holds SO_TXTIME frames until
+ * their CLOCK_MONOTONIC launch time. root_kind is set to the root qdisc's
+ * name, empty if it couldn't be found.
+ */
+enum QDISC_TXTIME qdisc_txtime(const int ifindex,
+			       char root_kind[QDISC_KIND_SZ])
+{
+	struct qdisc_walk walk;
+	int nl_sockfd;
+	int err;
+
+
+	memset(&walk, 0, sizeof(walk));
+	walk.ifindex = ifindex;
+	root_kind[0] = '\0';
+
+	nl_sockfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (nl_sockfd == -1)
+		return QDISC_TXTIME_BADQUERY;
+
+	if (!qdisc_dump_request(nl_sockfd)) {
+		close(nl_sockfd);
+		return QDISC_TXTIME_BADQUERY;
+	}
+
+	err = qdisc_dump_read(nl_sockfd, &walk);
+
+	close(nl_sockfd);
+
+	if (err != 0) {
+		errno = err;
+		return QDISC_TXTIME_BADQUERY;
+	}
+
+	if (!walk.have_root)
+		return QDISC_TXTIME_UNSUPPORTED;
+
+	memcpy(root_kind, walk.root_kind, QDISC_KIND_SZ);
+
+	if (strcmp(walk.root_kind, "fq") == 0)
+		return QDISC_TXTIME_GOOD;
+
+	/* mq only ever has its per queue children below it */
+	if ((strcmp(walk.root_kind, "mq") == 0) && (walk.children > 0) &&
+	    (walk.fq_children == walk.children))
+		return QDISC_TXTIME_GOOD;
+
+	return QDISC_TXTIME_UNSUPPORTED;
+
+}
+
+/* EOF */
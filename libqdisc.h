@@ -0,0 +1,41 @@
+#ifndef __libqdisc_h__
+#define __libqdisc_h__
+
+/*
+ *
+ * libqdisc.h - interface transmit queueing discipline queries
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+
+enum {
+	QDISC_KIND_SZ		= 16,	/* IFNAMSIZ, as the kernel's */
+};
+
+
+/*
+ * Frames given an SO_TXTIME launch time are only held until then by a
+ * qdisc that honours it. Any other sends them straight away, earlier than
+ * their launch time. etf does, but only for sockets using its own clock,
+ * normally CLOCK_TAI, and drops the rest, so for CLOCK_MONOTONIC launch
+ * times that leaves fq, either as the root qdisc or under every queue of
+ * an mq root.
+ */
+enum QDISC_TXTIME {
+	QDISC_TXTIME_GOOD,
+	QDISC_TXTIME_UNSUPPORTED,	/* root qdisc doesn't honour it */
+	QDISC_TXTIME_BADQUERY,		/* couldn't ask the kernel */
+};
+
+enum QDISC_TXTIME qdisc_txtime(const int ifindex,
+			       char root_kind[QDISC_KIND_SZ]);
+
+#endif /* __libqdisc_h__ */
@@ -0,0 +1,211 @@
+/*
+ * libquality.c - jitter, RTT deviation and loss burst statistics
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "libquality.h"
+
+
+static unsigned int burst_bucket(const uint64_t len);
+
+static void end_burst(struct quality *q);
+
+
+static unsigned int burst_bucket(const uint64_t len)
+{
+	unsigned int bucket;
+
+
+	/* 1 -> 0, 2 -> 1, 3-4 -> 2, 5-8 -> 3, ... */
+	bucket = (len == 1) ? 0 : (64 - __builtin_clzll(len - 1));
+
+	if (bucket >= QUALITY_BURST_BUCKETS)
+		bucket = QUALITY_BURST_BUCKETS - 1;
+
+	return bucket;
+
+}
+
+
+static void end_burst(struct quality *q)
+{
+
+
+	q->bursts++;
+	q->burst_lost += q->burst_len;
+	if (q->burst_len > q->max_burst)
+		q->max_burst = q->burst_len;
+	q->burst_hist[burst_bucket(q->burst_len)]++;
+	q->burst_len = 0;
+
+}
+
+
+/*
+ * quality_init()
+ *
+ * Start with no probes
+ */
+void quality_init(struct quality *q)
+{
+
+
+	memset(q, 0, sizeof(struct quality));
+
+}
+
+
+/*
+ * quality_add()
+ *
+ * Add the next probe in sequence order, with its round trip time if it
+ * was answered
+ */
+void quality_add(struct quality *q,
+		 const bool answered,
+		 const int64_t rtt_ns)
+{
+	const unsigned int prev_lost = (q->burst_len > 0) ? 1 : 0;
+	int64_t d_ns;
+	double delta_ns;
+
+
+	if (q->have_last)
+		q->trans[prev_lost][answered ? 0 : 1]++;
+	q->have_last = true;
+
+	if (!answered) {
+		q->lost++;
+		q->burst_len++;
+		return;
+	}
+
+	if (q->burst_len > 0)
+		end_burst(q);
+
+	/* RFC 3550 6.4.1, J += (|D| - J) / 16 */
+	if (q->have_last_rtt) {
+		d_ns = rtt_ns - q->last_rtt_ns;
+		if (d_ns < 0)
+			d_ns = -d_ns;
+		q->jitter_ns += (d_ns - q->jitter_ns) / 16.0;
+	}
+	q->last_rtt_ns = rtt_ns;
+	q->have_last_rtt = true;
+
+	q->answered++;
+
+	/* Welford's running mean and variance */
+	delta_ns = rtt_ns - q->rtt_mean_ns;
+	q->rtt_mean_ns += delta_ns / q->answered;
+	q->rtt_m2_ns += delta_ns * (rtt_ns - q->rtt_mean_ns);
+
+}
+
+
+/*
+ * quality_end()
+ *
+ * After the last probe, count a burst of losses it ended with
+ */
+void quality_end(struct quality *q)
+{
+
+
+	if (q->burst_len > 0)
+		end_burst(q);
+
+}
+
+
+/*
+ * quality_next_interval()
+ *
+ * Start the next interval's statistics. What carries on from the probes
+ * before is kept: the jitter, the last round trip time, whether the last
+ * probe was lost, and a burst of losses still going, which is counted in
+ * the interval it ends.
+ */
+void quality_next_interval(struct quality *q)
+{
+	const struct quality prev = *q;
+
+
+	quality_init(q);
+
+	q->jitter_ns = prev.jitter_ns;
+	q->have_last = prev.have_last;
+	q->have_last_rtt = prev.have_last_rtt;
+	q->last_rtt_ns = prev.last_rtt_ns;
+	q->burst_len = prev.burst_len;
+
+}
+
+
+/*
+ * quality_mdev_ns()
+ *
+ * Standard deviation of the round trip times, as ping's mdev
+ */
+double quality_mdev_ns(const struct quality *q)
+{
+
+
+	if (q->answered == 0)
+		return 0.0;
+
+	return sqrt(q->rtt_m2_ns / q->answered);
+
+}
+
+
+/*
+ * quality_gilbert()
+ *
+ * Gilbert-Elliott transition probabilities. false until there has been a
+ * probe after both an answered and a lost one.
+ */
+bool quality_gilbert(const struct quality *q, double *p, double *r)
+{
+	const uint64_t from_good = q->trans[0][0] + q->trans[0][1];
+	const uint64_t from_bad = q->trans[1][0] + q->trans[1][1];
+
+
+	if ((from_good == 0) || (from_bad == 0))
+		return false;
+
+	*p = (double)q->trans[0][1] / from_good;
+	*r = (double)q->trans[1][0] / from_bad;
+
+	return true;
+
+}
+
+
+/*
+ * quality_burst_bucket_min()
+ *
+ * Shortest burst counted in a bucket
+ */
+uint64_t quality_burst_bucket_min(const unsigned int bucket)
+{
+
+
+	return (bucket == 0) ? 1 : ((1ULL << (bucket - 1)) + 1);
+
+}
+
+/* EOF */
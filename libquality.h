@@ -0,0 +1,81 @@
+#ifndef __libquality_h__
+#define __libquality_h__
+
+/*
+ *
+ * libquality.h - jitter, RTT deviation and loss burst statistics
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Probes are added one at a time in sequence order, once their outcome is
+ * known, each in constant time, and nothing is kept but running totals.
+ * For interval reports, a second set is kept and started afresh each
+ * interval, rather than differencing the totals.
+ *
+ * The jitter is RFC 3550's interarrival jitter, a running average, with a
+ * gain of 1/16, of the difference in round trip time between consecutive
+ * answered probes. mdev is the standard deviation of the round trip times,
+ * from Welford's running mean and sum of squared deviations, which unlike
+ * a sum of squares doesn't lose its precision over a long run.
+ *
+ * A loss burst is a run of consecutive lost probes. The burst lengths are
+ * counted in power of two buckets, 1, 2, 3-4, 5-8 and so on, the last for
+ * all the longer ones. The Gilbert-Elliott estimates are for its simple
+ * Gilbert form, where every probe is lost in the bad state and none in the
+ * good: p, the chance of going from good to bad, is the fraction of the
+ * answered probes followed by a lost one, and r, from bad to good, the
+ * fraction of the lost probes followed by an answered one.
+ */
+enum {
+	QUALITY_BURST_BUCKETS	= 8,
+};
+
+
+struct quality {
+	uint64_t answered;
+	uint64_t lost;
+	double rtt_mean_ns;
+	double rtt_m2_ns;		/* sum of squared deviations */
+	double jitter_ns;
+	bool have_last;			/* a probe has been added */
+	bool have_last_rtt;
+	int64_t last_rtt_ns;		/* of the latest answered probe */
+	uint64_t bursts;		/* ended */
+	uint64_t burst_lost;		/* in the bursts ended */
+	uint64_t max_burst;
+	uint64_t burst_len;		/* of the current burst, 0 if none */
+	uint64_t burst_hist[QUALITY_BURST_BUCKETS];
+	uint64_t trans[2][2];		/* [from][to], 1 for lost */
+};
+
+
+void quality_init(struct quality *q);
+
+void quality_add(struct quality *q,
+		 const bool answered,
+		 const int64_t rtt_ns);
+
+void quality_end(struct quality *q);
+
+void quality_next_interval(struct quality *q);
+
+double quality_mdev_ns(const struct quality *q);
+
+bool quality_gilbert(const struct quality *q, double *p, double *r);
+
+uint64_t quality_burst_bucket_min(const unsigned int bucket);
+
+#endif /* __libquality_h__ */
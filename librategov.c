@@ -0,0 +1,319 @@
+/*
+ * librategov.c - lock free token bucket transmit rate governor
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "librategov.h"
+#include "libpacer.h"
+
+
+static bool gcra_take(_Atomic uint64_t *tat_ns,
+		      const uint64_t now_ns,
+		      const uint64_t increment_ns,
+		      const uint64_t limit_ns,
+		      uint64_t *old_tat_ns,
+		      uint64_t *wait_ns);
+
+static void gcra_give_back(_Atomic uint64_t *tat_ns,
+			   const uint64_t old_tat_ns,
+			   const uint64_t now_ns,
+			   const uint64_t increment_ns);
+
+
+/*
+ * rategov_init()
+ *
+ * Initialise a governor for the supplied total frame rate and burst size.
+ * A rate of zero disables the governor.
+ */
+void rategov_init(struct rategov *gov,
+		  const uint64_t rate_pps,
+		  const unsigned int burst)
+{
+
+
+	rategov_set_rate(gov, rate_pps, burst);
+
+	atomic_init(&gov->tat_ns, 0);
+	atomic_init(&gov->num_shares, 0);
+
+}
+
+
+/*
+ * rategov_set_rate()
+ *
+ * Change a governor's total frame rate and burst size, keeping its shares.
+ * Only safe from the one thread admitting frames through it.
+ */
+void rategov_set_rate(struct rategov *gov,
+		      const uint64_t rate_pps,
+		      const unsigned int burst)
+{
+
+
+	gov->rate_pps = rate_pps;
+
+	if (rate_pps > 0)
+		gov->emission_ns = 1000000000ULL / rate_pps;
+	else
+		gov->emission_ns = 0;
+
+	/* rates above 1Gpps round down to one frame per ns */
+	if ((rate_pps > 0) && (gov->emission_ns == 0))
+		gov->emission_ns = 1;
+
+	gov->burst = (burst > 0) ? burst : 1;
+
+}
+
+
+/*
+ * rategov_limited()
+ *
+ * Is the supplied governor actually limiting anything?
+ */
+bool rategov_limited(const struct rategov *gov)
+{
+
+
+	return gov->emission_ns != 0;
+
+}
+
+
+/*
+ * rategov_share_attach()
+ *
+ * Attach a target or session to a governor. The rate of all existing
+ * shares is reduced accordingly.
+ */
+void rategov_share_attach(struct rategov *gov,
+			  struct rategov_share *share)
+{
+
+
+	share->gov = gov;
+
+	atomic_init(&share->tat_ns, 0);
+	atomic_init(&share->admitted, 0);
+	atomic_init(&share->delayed, 0);
+	atomic_init(&share->wait_ns, 0);
+
+	atomic_fetch_add_explicit(&gov->num_shares, 1, memory_order_relaxed);
+
+}
+
+
+/*
+ * rategov_share_detach()
+ *
+ * Detach a share from its governor, returning its fraction of the rate to
+ * the remaining shares
+ */
+void rategov_share_detach(struct rategov_share *share)
+{
+
+
+	if (share->gov == NULL)
+		return;
+
+	atomic_fetch_sub_explicit(&share->gov->num_shares, 1,
+		memory_order_relaxed);
+
+	share->gov = NULL;
+
+}
+
+
+/*
+ * rategov_share_rate()
+ *
+ * Returns the frame rate the supplied share is currently entitled to, or
+ * zero if unlimited
+ */
+uint64_t rategov_share_rate(const struct rategov_share *share)
+{
+	unsigned int num_shares;
+
+
+	if (!rategov_limited(share->gov))
+		return 0;
+
+	num_shares = atomic_load_explicit(&share->gov->num_shares,
+		memory_order_relaxed);
+	if (num_shares == 0)
+		num_shares = 1;
+
+	return share->gov->rate_pps / num_shares;
+
+}
+
+
+/*
+ * gcra_take()
+ *
+ * Try to advance the supplied theoretical arrival time by increment_ns.
+ * Succeeds if the new TAT is no more than limit_ns beyond now, returning
+ * the TAT it replaced, otherwise returns how long to wait until it would
+ * be.
+ */
+static bool gcra_take(_Atomic uint64_t *tat_ns,
+		      const uint64_t now_ns,
+		      const uint64_t increment_ns,
+		      const uint64_t limit_ns,
+		      uint64_t *old_tat_ns,
+		      uint64_t *wait_ns)
+{
+	uint64_t old_tat, new_tat;
+
+
+	old_tat = atomic_load_explicit(tat_ns, memory_order_relaxed);
+
+	do {
+		new_tat = ((old_tat > now_ns) ? old_tat : now_ns) +
+			increment_ns;
+
+		if ((new_tat - now_ns) > limit_ns) {
+			*wait_ns = (new_tat - now_ns) - limit_ns;
+			return false;
+		}
+	} while (!atomic_compare_exchange_weak_explicit(tat_ns, &old_tat,
+			new_tat, memory_order_relaxed, memory_order_relaxed));
+
+	*old_tat_ns = old_tat;
+
+	return true;
+
+}
+
+
+/*
+ * gcra_give_back()
+ *
+ * Undo a successful gcra_take() at now_ns, putting back the TAT it
+ * replaced, including one from the past that the take moved up to now. If
+ * another take has since built on it, only the increment can be taken
+ * back out.
+ */
+static void gcra_give_back(_Atomic uint64_t *tat_ns,
+			   const uint64_t old_tat_ns,
+			   const uint64_t now_ns,
+			   const uint64_t increment_ns)
+{
+	uint64_t taken_tat;
+
+
+	taken_tat = ((old_tat_ns > now_ns) ? old_tat_ns : now_ns) +
+		increment_ns;
+
+	if (atomic_compare_exchange_strong_explicit(tat_ns, &taken_tat,
+		old_tat_ns, memory_order_relaxed, memory_order_relaxed))
+		return;
+
+	atomic_fetch_sub_explicit(tat_ns, increment_ns, memory_order_relaxed);
+
+}
+
+
+/*
+ * rategov_admit()
+ *
+ * Ask the governor to admit the supplied number of frames for transmission
+ * now. Frames must conform to both the share's fraction of the rate and
+ * the total rate. A batch larger than the burst size is only admitted when
+ * the buckets are completely full.
+ */
+enum RATEGOV_ADMIT rategov_admit(struct rategov_share *share,
+				 const unsigned int frames,
+				 const uint64_t now_ns,
+				 uint64_t *wait_ns)
+{
+	struct rategov *gov = share->gov;
+	unsigned int num_shares;
+	uint64_t share_inc, share_limit, share_old_tat;
+	uint64_t gov_inc, gov_limit, gov_old_tat;
+
+
+	if (!rategov_limited(gov))
+		goto admitted;
+
+	num_shares = atomic_load_explicit(&gov->num_shares,
+		memory_order_relaxed);
+	if (num_shares == 0)
+		num_shares = 1;
+
+	gov_inc = gov->emission_ns * frames;
+	gov_limit = gov->emission_ns * ((frames > gov->burst) ?
+		frames : gov->burst);
+
+	share_inc = gov_inc * num_shares;
+	share_limit = gov_limit * num_shares;
+
+	if (!gcra_take(&share->tat_ns, now_ns, share_inc, share_limit,
+		&share_old_tat, wait_ns))
+		return RATEGOV_ADMIT_WAIT;
+
+	if (!gcra_take(&gov->tat_ns, now_ns, gov_inc, gov_limit,
+		&gov_old_tat, wait_ns)) {
+		/* give back what the share took */
+		gcra_give_back(&share->tat_ns, share_old_tat, now_ns,
+			share_inc);
+		return RATEGOV_ADMIT_WAIT;
+	}
+
+admitted:
+	atomic_fetch_add_explicit(&share->admitted, frames,
+		memory_order_relaxed);
+
+	return RATEGOV_ADMIT_GOOD;
+
+}
+
+
+/*
+ * rategov_wait()
+ *
+ * Block until the governor admits the supplied number of frames
+ */
+void rategov_wait(struct rategov_share *share, const unsigned int frames)
+{
+	uint64_t now_ns, start_ns, wait_ns;
+	struct timespec ts;
+	bool waited = false;
+
+
+	start_ns = now_ns = pacer_now_ns();
+
+	while (rategov_admit(share, frames, now_ns, &wait_ns) ==
+		RATEGOV_ADMIT_WAIT) {
+		waited = true;
+		ts.tv_sec = wait_ns / 1000000000ULL;
+		ts.tv_nsec = wait_ns % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+		now_ns = pacer_now_ns();
+	}
+
+	if (waited) {
+		atomic_fetch_add_explicit(&share->delayed, 1,
+			memory_order_relaxed);
+		atomic_fetch_add_explicit(&share->wait_ns, now_ns - start_ns,
+			memory_order_relaxed);
+	}
+
+}
+
+/* EOF */
@@ -0,0 +1,93 @@
+#ifndef __librategov_h__
+#define __librategov_h__
+
+/*
+ *
+ * librategov.h - lock free token bucket transmit rate governor
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+
+/*
+ * The governor is a token bucket, implemented as a Generic Cell Rate
+ * Algorithm (GCRA) "virtual scheduling" bucket. Instead of a token count
+ * and a refill timer, each bucket only holds the theoretical arrival time
+ * (TAT) of the next conforming frame, in CLOCK_MONOTONIC nanoseconds. A
+ * frame conforms if admitting it doesn't push the TAT more than the burst
+ * allowance past the current time. Refill is therefore implicit and exact
+ * to the nanosecond, and since the whole bucket state is a single 64 bit
+ * value, it can be updated with a compare and swap rather than a lock.
+ *
+ * A governor caps the total frame rate of an interface. Each target or
+ * session sending through it attaches a share, and is limited to an equal
+ * fraction of the total rate, as well as to the total rate itself.
+ */
+
+
+/*
+ * Per interface governor
+ */
+struct rategov {
+	_Atomic uint64_t tat_ns;	/* theoretical arrival time */
+	uint64_t emission_ns;		/* ns per frame at the full rate */
+	uint64_t rate_pps;		/* 0 means unlimited */
+	unsigned int burst;		/* frames admitted back to back */
+	_Atomic unsigned int num_shares;
+};
+
+
+/*
+ * Per target or session share of a governor
+ */
+struct rategov_share {
+	struct rategov *gov;
+	_Atomic uint64_t tat_ns;
+	_Atomic uint64_t admitted;	/* frames admitted */
+	_Atomic uint64_t delayed;	/* admissions that had to wait */
+	_Atomic uint64_t wait_ns;	/* total time spent waiting */
+};
+
+
+enum RATEGOV_ADMIT {
+	RATEGOV_ADMIT_GOOD,
+	RATEGOV_ADMIT_WAIT,		/* try again in *wait_ns */
+};
+
+
+void rategov_init(struct rategov *gov,
+		  const uint64_t rate_pps,
+		  const unsigned int burst);
+
+void rategov_set_rate(struct rategov *gov,
+		      const uint64_t rate_pps,
+		      const unsigned int burst);
+
+bool rategov_limited(const struct rategov *gov);
+
+void rategov_share_attach(struct rategov *gov,
+			  struct rategov_share *share);
+
+void rategov_share_detach(struct rategov_share *share);
+
+uint64_t rategov_share_rate(const struct rategov_share *share);
+
+enum RATEGOV_ADMIT rategov_admit(struct rategov_share *share,
+				 const unsigned int frames,
+				 const uint64_t now_ns,
+				 uint64_t *wait_ns);
+
+void rategov_wait(struct rategov_share *share, const unsigned int frames);
+
+#endif /* __librategov_h__ */
@@ -0,0 +1,295 @@
+/*
+ * libseqtrack.c - in-flight probe accounting by sequence number
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "libseqtrack.h"
+
+
+/*
+ * Internal state of a slot whose reply is in the middle of being recorded
+ */
+enum {
+	SEQTRACK_STATE_CLAIMED	= 3,
+};
+
+
+static inline uint64_t seq_state(const uint32_t seq, const unsigned int state)
+{
+
+
+	return ((uint64_t)seq << 2) | state;
+
+}
+
+
+/*
+ * seqtrack_init()
+ *
+ * Allocate a tracker with at least min_size slots, rounded up to a power
+ * of two
+ */
+enum SEQTRACK_INIT seqtrack_init(struct seqtrack *st,
+				 const unsigned int min_size)
+{
+	unsigned int size = 1;
+	unsigned int i;
+
+
+	while (size < min_size)
+		size <<= 1;
+
+	st->slots = calloc(size, sizeof(struct seqtrack_slot));
+	if (st->slots == NULL)
+		return SEQTRACK_INIT_NOMEM;
+
+	for (i = 0; i < size; i++) {
+		atomic_init(&st->slots[i].seq_state, SEQTRACK_STATE_FREE);
+		atomic_init(&st->slots[i].rx_ns, 0);
+	}
+
+	st->size = size;
+	st->mask = size - 1;
+
+	atomic_init(&st->sent, 0);
+	atomic_init(&st->answered, 0);
+	atomic_init(&st->lost, 0);
+	atomic_init(&st->duplicates, 0);
+	atomic_init(&st->stale, 0);
+
+	return SEQTRACK_INIT_GOOD;
+
+}
+
+
+/*
+ * seqtrack_free()
+ *
+ * Release the tracker's slots
+ */
+void seqtrack_free(struct seqtrack *st)
+{
+
+
+	free(st->slots);
+	st->slots = NULL;
+
+}
+
+
+/*
+ * seqtrack_sent()
+ *
+ * Record that the supplied sequence number has been sent. Must only be
+ * called by a single transmitter.
+ */
+void seqtrack_sent(struct seqtrack *st,
+		   const uint32_t seq,
+		   const uint64_t tx_ns,
+		   const uint32_t tx_len)
+{
+
+
+	seqtrack_sent_tag(st, seq, tx_ns, tx_len, 0);
+
+}
+
+
+/*
+ * seqtrack_sent_tag()
+ *
+ * As seqtrack_sent(), also recording a tag of the transmitter's, e.g.
+ * which path the probe took
+ */
+void seqtrack_sent_tag(struct seqtrack *st,
+		       const uint32_t seq,
+		       const uint64_t tx_ns,
+		       const uint32_t tx_len,
+		       const uint32_t tx_tag)
+{
+	struct seqtrack_slot *slot = &st->slots[seq & st->mask];
+	uint64_t prev;
+
+
+	/* invalidate the slot first, so late replies for its old seq fail */
+	prev = atomic_exchange_explicit(&slot->seq_state,
+		seq_state(seq, SEQTRACK_STATE_FREE), memory_order_acq_rel);
+
+	if ((prev & 3) == SEQTRACK_STATE_SENT)
+		atomic_fetch_add_explicit(&st->lost, 1, memory_order_relaxed);
+
+	/* and before the new send's fields, for seqtrack_lookup()'s recheck */
+	atomic_thread_fence(memory_order_release);
+
+	slot->tx_ns = tx_ns;
+	slot->tx_len = tx_len;
+	slot->tx_tag = tx_tag;
+	atomic_store_explicit(&slot->rx_ns, 0, memory_order_relaxed);
+
+	atomic_store_explicit(&slot->seq_state,
+		seq_state(seq, SEQTRACK_STATE_SENT), memory_order_release);
+
+	atomic_fetch_add_explicit(&st->sent, 1, memory_order_relaxed);
+
+}
+
+
+/*
+ * seqtrack_received()
+ *
+ * Record a reply to the supplied sequence number. Safe to call from
+ * several receivers at once.
+ */
+enum SEQTRACK_RXED seqtrack_received(struct seqtrack *st,
+				     const uint32_t seq,
+				     const uint64_t rx_ns)
+{
+
+
+	return seqtrack_received_tag(st, seq, rx_ns, 0);
+
+}
+
+
+/*
+ * seqtrack_received_tag()
+ *
+ * As seqtrack_received(), also storing a tag of the receiver's with the
+ * reply, returned by seqtrack_lookup() once the slot is answered
+ */
+enum SEQTRACK_RXED seqtrack_received_tag(struct seqtrack *st,
+					 const uint32_t seq,
+					 const uint64_t rx_ns,
+					 const uint64_t rx_tag)
+{
+	struct seqtrack_slot *slot = &st->slots[seq & st->mask];
+	uint64_t expected = seq_state(seq, SEQTRACK_STATE_SENT);
+	uint64_t cur;
+
+
+	if (!atomic_compare_exchange_strong_explicit(&slot->seq_state,
+		&expected, seq_state(seq, SEQTRACK_STATE_CLAIMED),
+		memory_order_acq_rel, memory_order_acquire)) {
+
+		cur = expected;
+
+		if ((cur == seq_state(seq, SEQTRACK_STATE_CLAIMED)) ||
+		    (cur == seq_state(seq, SEQTRACK_STATE_ANSWERED))) {
+			atomic_fetch_add_explicit(&st->duplicates, 1,
+				memory_order_relaxed);
+			return SEQTRACK_RXED_DUPLICATE;
+		}
+
+		atomic_fetch_add_explicit(&st->stale, 1, memory_order_relaxed);
+		return SEQTRACK_RXED_STALE;
+	}
+
+	atomic_store_explicit(&slot->rx_ns, rx_ns, memory_order_relaxed);
+	slot->rx_tag = rx_tag;
+
+	atomic_store_explicit(&slot->seq_state,
+		seq_state(seq, SEQTRACK_STATE_ANSWERED), memory_order_release);
+
+	atomic_fetch_add_explicit(&st->answered, 1, memory_order_relaxed);
+
+	return SEQTRACK_RXED_GOOD;
+
+}
+
+
+/*
+ * seqtrack_lookup()
+ *
+ * Copy out the slot for the supplied sequence number. Returns false if the
+ * slot has been reused for a different sequence number, including while
+ * it was being copied. The copy is retried if the slot was only answered
+ * meanwhile, which can only happen as often as its state moves on.
+ */
+bool seqtrack_lookup(struct seqtrack *st,
+		     const uint32_t seq,
+		     struct seqtrack_entry *entry)
+{
+	struct seqtrack_slot *slot = &st->slots[seq & st->mask];
+	uint64_t cur, after;
+
+
+	cur = atomic_load_explicit(&slot->seq_state, memory_order_acquire);
+
+	while (true) {
+		if ((cur >> 2) != seq)
+			return false;
+
+		entry->seq = seq;
+		entry->tx_ns = slot->tx_ns;
+		entry->tx_len = slot->tx_len;
+		entry->tx_tag = slot->tx_tag;
+
+		switch (cur & 3) {
+		case SEQTRACK_STATE_ANSWERED:
+			entry->state = SEQTRACK_STATE_ANSWERED;
+			entry->rx_ns = atomic_load_explicit(&slot->rx_ns,
+				memory_order_relaxed);
+			entry->rx_tag = slot->rx_tag;
+			break;
+		case SEQTRACK_STATE_SENT:
+		case SEQTRACK_STATE_CLAIMED:
+			entry->state = SEQTRACK_STATE_SENT;
+			entry->rx_ns = 0;
+			entry->rx_tag = 0;
+			break;
+		default:
+			entry->state = SEQTRACK_STATE_FREE;
+			entry->rx_ns = 0;
+			entry->rx_tag = 0;
+			break;
+		}
+
+		/* as statshm_read(), unchanged means the copy isn't torn */
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&slot->seq_state,
+			memory_order_relaxed);
+
+		if (after == cur)
+			return true;
+
+		cur = after;
+	}
+
+}
+
+
+/*
+ * seqtrack_in_flight()
+ *
+ * Number of probes sent that have neither been answered nor given up on
+ */
+uint64_t seqtrack_in_flight(struct seqtrack *st)
+{
+	uint64_t sent, answered, lost;
+
+
+	sent = atomic_load_explicit(&st->sent, memory_order_relaxed);
+	answered = atomic_load_explicit(&st->answered, memory_order_relaxed);
+	lost = atomic_load_explicit(&st->lost, memory_order_relaxed);
+
+	if ((answered + lost) > sent)
+		return 0;
+
+	return sent - answered - lost;
+
+}
+
+/* EOF */
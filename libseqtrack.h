@@ -0,0 +1,115 @@
+#ifndef __libseqtrack_h__
+#define __libseqtrack_h__
+
+/*
+ *
+ * libseqtrack.h - in-flight probe accounting by sequence number
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+
+/*
+ * A power of two sized ring of slots, indexed by sequence number. The
+ * transmitter fills in a slot when it sends a probe, and the receiver
+ * marks it answered when the reply arrives. Each slot's sequence number
+ * and state share one atomic word, so a sender and any number of receivers
+ * can work on the ring without locks. A slot still unanswered when the
+ * transmitter wraps around to reuse it is counted as lost.
+ */
+
+enum SEQTRACK_STATE {
+	SEQTRACK_STATE_FREE	= 0,
+	SEQTRACK_STATE_SENT	= 1,
+	SEQTRACK_STATE_ANSWERED	= 2,
+};
+
+
+struct seqtrack_slot {
+	_Atomic uint64_t seq_state;	/* (seq << 2) | state */
+	uint64_t tx_ns;
+	_Atomic uint64_t rx_ns;
+	uint32_t tx_len;
+	uint32_t tx_tag;		/* transmitter's, e.g. which path */
+	uint64_t rx_tag;		/* receiver's, e.g. who replied */
+};
+
+
+struct seqtrack {
+	struct seqtrack_slot *slots;
+	unsigned int size;
+	unsigned int mask;
+	_Atomic uint64_t sent;
+	_Atomic uint64_t answered;
+	_Atomic uint64_t lost;		/* unanswered when slot was reused */
+	_Atomic uint64_t duplicates;
+	_Atomic uint64_t stale;		/* reply for an already reused slot */
+};
+
+
+/*
+ * Copy of a slot, as returned by seqtrack_lookup()
+ */
+struct seqtrack_entry {
+	uint32_t seq;
+	enum SEQTRACK_STATE state;
+	uint64_t tx_ns;
+	uint64_t rx_ns;
+	uint32_t tx_len;
+	uint32_t tx_tag;
+	uint64_t rx_tag;
+};
+
+
+enum SEQTRACK_INIT {
+	SEQTRACK_INIT_GOOD,
+	SEQTRACK_INIT_NOMEM,
+};
+enum SEQTRACK_INIT seqtrack_init(struct seqtrack *st,
+				 const unsigned int min_size);
+
+void seqtrack_free(struct seqtrack *st);
+
+void seqtrack_sent(struct seqtrack *st,
+		   const uint32_t seq,
+		   const uint64_t tx_ns,
+		   const uint32_t tx_len);
+
+void seqtrack_sent_tag(struct seqtrack *st,
+		       const uint32_t seq,
+		       const uint64_t tx_ns,
+		       const uint32_t tx_len,
+		       const uint32_t tx_tag);
+
+enum SEQTRACK_RXED {
+	SEQTRACK_RXED_GOOD,
+	SEQTRACK_RXED_DUPLICATE,
+	SEQTRACK_RXED_STALE,		/* unknown, or slot already reused */
+};
+enum SEQTRACK_RXED seqtrack_received(struct seqtrack *st,
+				     const uint32_t seq,
+				     const uint64_t rx_ns);
+
+enum SEQTRACK_RXED seqtrack_received_tag(struct seqtrack *st,
+					 const uint32_t seq,
+					 const uint64_t rx_ns,
+					 const uint64_t rx_tag);
+
+bool seqtrack_lookup(struct seqtrack *st,
+		     const uint32_t seq,
+		     struct seqtrack_entry *entry);
+
+uint64_t seqtrack_in_flight(struct seqtrack *st);
+
+#endif /* __libseqtrack_h__ */
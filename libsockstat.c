@@ -0,0 +1,202 @@
+/*
+ * libsockstat.c - packet socket drop, occupancy and send error accounting
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/sock_diag.h>
+
+#include "libsockstat.h"
+
+
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+
+
+/*
+ * sockstat_rx_init()
+ *
+ * Initialise a packet socket's accumulated receive statistics
+ */
+void sockstat_rx_init(struct sockstat_rx *rx)
+{
+
+
+	memset(rx, 0, sizeof(struct sockstat_rx));
+
+}
+
+
+/*
+ * sockstat_rx_sample()
+ *
+ * Add the kernel's receive counters for the socket since the last sample,
+ * and sample its receive queue occupancy. Queue occupancy is left alone
+ * if SO_MEMINFO isn't supported.
+ */
+enum SOCKSTAT_RX_SAMPLE sockstat_rx_sample(const int sockfd,
+					   struct sockstat_rx *rx)
+{
+	struct tpacket_stats_v3 st;
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len;
+
+
+	memset(&st, 0, sizeof(st));
+	len = sizeof(st);
+
+	/* only v3 rings fill in tp_freeze_q_cnt, and the length says so */
+	if (getsockopt(sockfd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == -1)
+		return SOCKSTAT_RX_SAMPLE_BAD;
+
+	rx->packets += st.tp_packets;
+	rx->drops += st.tp_drops;
+	if (len >= sizeof(st)) {
+		rx->freeze_q_cnt += st.tp_freeze_q_cnt;
+		rx->has_freeze_q_cnt = true;
+	}
+
+	rx->samples++;
+
+	len = sizeof(meminfo);
+
+	if (getsockopt(sockfd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == -1)
+		return SOCKSTAT_RX_SAMPLE_GOOD;
+
+	rx->rmem_alloc = meminfo[SK_MEMINFO_RMEM_ALLOC];
+	rx->rcvbuf = meminfo[SK_MEMINFO_RCVBUF];
+	if (rx->rmem_alloc > rx->rmem_peak)
+		rx->rmem_peak = rx->rmem_alloc;
+
+	return SOCKSTAT_RX_SAMPLE_GOOD;
+
+}
+
+
+/*
+ * sockstat_rx_add()
+ *
+ * Add one socket's receive statistics to a total over several sockets.
+ * The occupancies are summed, so the total peak is an upper bound.
+ */
+void sockstat_rx_add(struct sockstat_rx *total, const struct sockstat_rx *rx)
+{
+
+
+	total->packets += rx->packets;
+	total->drops += rx->drops;
+	total->freeze_q_cnt += rx->freeze_q_cnt;
+	total->has_freeze_q_cnt |= rx->has_freeze_q_cnt;
+	total->rmem_alloc += rx->rmem_alloc;
+	total->rmem_peak += rx->rmem_peak;
+	total->rcvbuf += rx->rcvbuf;
+	total->samples += rx->samples;
+
+}
+
+
+/*
+ * sockstat_txerrs_init()
+ *
+ * Initialise an empty send errno histogram
+ */
+void sockstat_txerrs_init(struct sockstat_txerrs *txerrs)
+{
+	unsigned int i;
+
+
+	atomic_init(&txerrs->total, 0);
+
+	for (i = 0; i < SOCKSTAT_ERRNO_MAX; i++)
+		atomic_init(&txerrs->counts[i], 0);
+
+}
+
+
+/*
+ * sockstat_txerr()
+ *
+ * Count a failed send, by its errno
+ */
+void sockstat_txerr(struct sockstat_txerrs *txerrs, const int err)
+{
+	unsigned int bucket;
+
+
+	bucket = ((err > 0) && (err < SOCKSTAT_ERRNO_MAX)) ?
+		err : SOCKSTAT_ERRNO_MAX - 1;
+
+	atomic_fetch_add_explicit(&txerrs->counts[bucket], 1,
+		memory_order_relaxed);
+	atomic_fetch_add_explicit(&txerrs->total, 1, memory_order_relaxed);
+
+}
+
+
+/*
+ * sockstat_txerrs_total()
+ *
+ * Number of failed sends so far
+ */
+uint64_t sockstat_txerrs_total(const struct sockstat_txerrs *txerrs)
+{
+
+
+	return atomic_load_explicit(&txerrs->total, memory_order_relaxed);
+
+}
+
+
+/*
+ * sockstat_txerrs_count()
+ *
+ * Number of failed sends so far with the errno
+ */
+uint64_t sockstat_txerrs_count(const struct sockstat_txerrs *txerrs,
+			       const int err)
+{
+
+
+	if ((err <= 0) || (err >= SOCKSTAT_ERRNO_MAX))
+		return 0;
+
+	return atomic_load_explicit(&txerrs->counts[err],
+		memory_order_relaxed);
+
+}
+
+
+/*
+ * sockstat_errno_name()
+ *
+ * The symbolic name of an errno, e.g. "ENOBUFS", for the histogram
+ */
+const char *sockstat_errno_name(const int err)
+{
+	const char *name;
+
+
+	name = strerrorname_np(err);
+
+	return (name != NULL) ? name : "unknown errno";
+
+}
+
+/* EOF */
@@ -0,0 +1,82 @@
+#ifndef __libsockstat_h__
+#define __libsockstat_h__
+
+/*
+ *
+ * libsockstat.h - packet socket drop, occupancy and send error accounting
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+
+/*
+ * errnos at or above this share the last histogram bucket
+ */
+enum {
+	SOCKSTAT_ERRNO_MAX	= 160,
+};
+
+
+/*
+ * What the kernel knows about a packet socket's receive side. Reading
+ * PACKET_STATISTICS resets the kernel's counters, so the totals are
+ * accumulated here across samples. packets includes those dropped.
+ * Queue freezes are only counted by TPACKET_V3 rings. The receive queue
+ * occupancy is as at the last sample, with the peak of all samples.
+ */
+struct sockstat_rx {
+	uint64_t packets;
+	uint64_t drops;			/* receive queue was full */
+	uint64_t freeze_q_cnt;
+	bool has_freeze_q_cnt;
+	uint32_t rmem_alloc;		/* bytes queued */
+	uint32_t rmem_peak;
+	uint32_t rcvbuf;		/* queue limit */
+	unsigned int samples;
+};
+
+
+/*
+ * Histogram of the errnos of failed sends. Updated by the sender while
+ * others may be reading it.
+ */
+struct sockstat_txerrs {
+	_Atomic uint64_t total;
+	_Atomic uint64_t counts[SOCKSTAT_ERRNO_MAX];
+};
+
+
+void sockstat_rx_init(struct sockstat_rx *rx);
+
+enum SOCKSTAT_RX_SAMPLE {
+	SOCKSTAT_RX_SAMPLE_GOOD,
+	SOCKSTAT_RX_SAMPLE_BAD,
+};
+enum SOCKSTAT_RX_SAMPLE sockstat_rx_sample(const int sockfd,
+					   struct sockstat_rx *rx);
+
+void sockstat_rx_add(struct sockstat_rx *total, const struct sockstat_rx *rx);
+
+void sockstat_txerrs_init(struct sockstat_txerrs *txerrs);
+
+void sockstat_txerr(struct sockstat_txerrs *txerrs, const int err);
+
+uint64_t sockstat_txerrs_total(const struct sockstat_txerrs *txerrs);
+
+uint64_t sockstat_txerrs_count(const struct sockstat_txerrs *txerrs,
+			       const int err);
+
+const char *sockstat_errno_name(const int err);
+
+#endif /* __libsockstat_h__ */
@@ -0,0 +1,344 @@
+/*
+ * libstatshm.c - live statistics published in POSIX shared memory
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libstatshm.h"
+
+
+static bool shm_name(const char *name, char buf[STATSHM_NAME_MAX + 1]);
+
+
+/*
+ * POSIX shm names are a single "/name". The leading / is optional here.
+ */
+static bool shm_name(const char *name, char buf[STATSHM_NAME_MAX + 1])
+{
+
+
+	if (*name == '/')
+		name++;
+
+	if ((*name == '\0') || (strchr(name, '/') != NULL) ||
+	    (strlen(name) >= STATSHM_NAME_MAX))
+		return false;
+
+	buf[0] = '/';
+	strcpy(&buf[1], name);
+
+	return true;
+
+}
+
+
+/*
+ * statshm_create()
+ *
+ * Create the named segment, replacing any left by an earlier run, readable
+ * by anyone. Without a name, the segment is private to the process, for
+ * its own readers.
+ */
+enum STATSHM_CREATE statshm_create(struct statshm_writer *sw,
+				   const char *name)
+{
+	const size_t size = sizeof(struct statshm_segment);
+	void *map;
+	int fd;
+
+
+	memset(sw, 0, sizeof(struct statshm_writer));
+
+	if (name == NULL) {
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	} else {
+		if (!shm_name(name, sw->name))
+			return STATSHM_CREATE_BADNAME;
+
+		fd = shm_open(sw->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1)
+			return STATSHM_CREATE_BADSHM;
+
+		/* the umask mustn't keep readers out */
+		if ((fchmod(fd, 0644) == -1) || (ftruncate(fd, size) == -1)) {
+			close(fd);
+			shm_unlink(sw->name);
+			return STATSHM_CREATE_BADSHM;
+		}
+
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+		close(fd);
+	}
+
+	if (map == MAP_FAILED) {
+		if (name != NULL)
+			shm_unlink(sw->name);
+		return STATSHM_CREATE_BADSHM;
+	}
+
+	sw->seg = map;
+
+	memset(sw->seg, 0, size);
+	memcpy(sw->seg->magic, STATSHM_MAGIC, sizeof(STATSHM_MAGIC));
+	sw->seg->version = STATSHM_VERSION;
+	sw->seg->hist_sub_bits = HIST_SUB_BITS;
+	sw->seg->size = size;
+	atomic_init(&sw->seg->seq, 0);
+
+	return STATSHM_CREATE_GOOD;
+
+}
+
+
+/*
+ * statshm_publish()
+ *
+ * Replace the segment's snapshot. Only one thread may publish.
+ */
+void statshm_publish(struct statshm_writer *sw,
+		     const struct statshm_stats *stats)
+{
+	uint32_t seq;
+
+
+	seq = atomic_load_explicit(&sw->seg->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&sw->seg->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(&sw->seg->stats, stats, sizeof(struct statshm_stats));
+
+	atomic_store_explicit(&sw->seg->seq, seq + 2, memory_order_release);
+
+}
+
+
+/*
+ * statshm_close()
+ *
+ * Unmap the segment. A named one stays, with its last snapshot, until
+ * the next run replaces it or it's removed.
+ */
+void statshm_close(struct statshm_writer *sw)
+{
+
+
+	if (sw->seg != NULL)
+		munmap(sw->seg, sizeof(struct statshm_segment));
+	sw->seg = NULL;
+
+}
+
+
+/*
+ * statshm_attach()
+ *
+ * Map a named segment read only, checking it's of this layout
+ */
+enum STATSHM_ATTACH statshm_attach(struct statshm_reader *sr,
+				   const char *name)
+{
+	char nbuf[STATSHM_NAME_MAX + 1];
+	const struct statshm_segment *seg;
+	struct stat st;
+	void *map;
+	int fd;
+
+
+	memset(sr, 0, sizeof(struct statshm_reader));
+
+	if (!shm_name(name, nbuf))
+		return STATSHM_ATTACH_BADNAME;
+
+	fd = shm_open(nbuf, O_RDONLY, 0);
+	if (fd == -1)
+		return STATSHM_ATTACH_BADSHM;
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return STATSHM_ATTACH_BADSHM;
+	}
+
+	if ((size_t)st.st_size < sizeof(struct statshm_segment)) {
+		close(fd);
+		return STATSHM_ATTACH_BADLAYOUT;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return STATSHM_ATTACH_BADSHM;
+
+	sr->seg = map;
+	sr->size = st.st_size;
+
+	seg = sr->seg;
+
+	if ((memcmp(seg->magic, STATSHM_MAGIC, sizeof(STATSHM_MAGIC)) != 0) ||
+	    (seg->version != STATSHM_VERSION) ||
+	    (seg->hist_sub_bits != HIST_SUB_BITS) ||
+	    (seg->size != sizeof(struct statshm_segment))) {
+		statshm_detach(sr);
+		return STATSHM_ATTACH_BADLAYOUT;
+	}
+
+	return STATSHM_ATTACH_GOOD;
+
+}
+
+
+/*
+ * statshm_attach_local()
+ *
+ * Read the segment a writer in this process publishes to, named or not.
+ * The writer's mapping is shared, so the reader isn't detached.
+ */
+void statshm_attach_local(struct statshm_reader *sr,
+			  const struct statshm_writer *sw)
+{
+
+
+	sr->seg = sw->seg;
+	sr->size = sizeof(struct statshm_segment);
+
+}
+
+
+/*
+ * statshm_read()
+ *
+ * Copy out a consistent snapshot, without ever holding up the writer
+ */
+enum STATSHM_READ statshm_read(const struct statshm_reader *sr,
+			       struct statshm_stats *stats)
+{
+	struct statshm_segment *seg = (struct statshm_segment *)sr->seg;
+	uint32_t seq_before, seq_after;
+	unsigned int i;
+
+
+	for (i = 0; i < STATSHM_READ_TRIES; i++) {
+		seq_before = atomic_load_explicit(&seg->seq,
+			memory_order_acquire);
+		if (seq_before & 1) {
+			sched_yield();
+			continue;
+		}
+
+		memcpy(stats, &seg->stats, sizeof(struct statshm_stats));
+
+		atomic_thread_fence(memory_order_acquire);
+		seq_after = atomic_load_explicit(&seg->seq,
+			memory_order_relaxed);
+
+		if (seq_before == seq_after)
+			return STATSHM_READ_GOOD;
+
+		sched_yield();
+	}
+
+	return STATSHM_READ_BUSY;
+
+}
+
+
+/*
+ * statshm_detach()
+ *
+ * Unmap a segment
+ */
+void statshm_detach(struct statshm_reader *sr)
+{
+
+
+	if (sr->seg != NULL)
+		munmap((void *)sr->seg, sr->size);
+	sr->seg = NULL;
+
+}
+
+
+/*
+ * statshm_find_target()
+ *
+ * The target's entry, added if it's new. NULL once the table is full.
+ */
+struct statshm_target *statshm_find_target(struct statshm_stats *stats,
+					   const uint8_t mac[6],
+					   const unsigned int iface)
+{
+	struct statshm_target *target;
+	unsigned int i;
+
+
+	for (i = 0; i < stats->num_targets; i++) {
+		target = &stats->targets[i];
+		if ((target->iface == iface) &&
+		    (memcmp(target->mac, mac, sizeof(target->mac)) == 0))
+			return target;
+	}
+
+	if (stats->num_targets == STATSHM_TARGETS_MAX)
+		return NULL;
+
+	target = &stats->targets[stats->num_targets++];
+
+	memset(target, 0, sizeof(struct statshm_target));
+	memcpy(target->mac, mac, sizeof(target->mac));
+	target->iface = iface;
+	target->rtt_min_ns = UINT64_MAX;
+
+	return target;
+
+}
+
+
+/*
+ * statshm_find_path()
+ *
+ * The path with the id, or NULL. The search starts at *hint, left at the
+ * path after the one found, so looking up paths in the order they're
+ * probed in takes a single compare each.
+ */
+struct statshm_path *statshm_find_path(struct statshm_stats *stats,
+				       const uint32_t id,
+				       unsigned int *hint)
+{
+	unsigned int i, idx;
+
+
+	for (i = 0; i < stats->num_paths; i++) {
+		idx = (*hint + i) % stats->num_paths;
+		if (stats->paths[idx].id == id) {
+			*hint = idx + 1;
+			return &stats->paths[idx];
+		}
+	}
+
+	return NULL;
+
+}
+
+/* EOF */
@@ -0,0 +1,192 @@
+#ifndef __libstatshm_h__
+#define __libstatshm_h__
+
+/*
+ *
+ * libstatshm.h - live statistics published in POSIX shared memory
+ *
+ * Copyright (C) 2008-2009, Mark Smith <markzzzsmith@yahoo.com.au>
+ * All rights reserved.
+ *
+ * Licensed under the GNU General Public Licence (GPL) Version 2 only.
+ * This explicitly does not include later versions, such as revisions of 2 or
+ * Version 3, and later versions.
+ * See the accompanying LICENSE file for full terms and conditions.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "libhist.h"
+
+
+/*
+ * A segment is a header followed by a snapshot of the statistics, in host
+ * byte order. A single writer replaces the whole snapshot at a time under
+ * a seqlock: the sequence count is odd while a snapshot is being copied
+ * in, so a reader copies the snapshot out, and tries again if the count
+ * was odd or changed meanwhile. Readers never hold up the writer, and the
+ * writer never touches the tx and rx paths.
+ *
+ * The layout changes only with the version, including the RTT histograms,
+ * which are libhist's, with hist_sub_bits giving their bucket layout.
+ */
+enum {
+	STATSHM_VERSION		= 2,
+	STATSHM_IFACES_MAX	= 16,
+	STATSHM_TARGETS_MAX	= 256,
+	STATSHM_PATHS_MAX	= 256,
+	STATSHM_PATH_HOPS_MAX	= 16,
+	STATSHM_IFNAMSIZ	= 16,
+	STATSHM_NAME_MAX	= 255,
+	STATSHM_READ_TRIES	= 1000,
+};
+
+
+#define STATSHM_MAGIC "ECTPSHM"
+
+
+/*
+ * An interface's counts since ectpping started. Probes are settled, as
+ * answered or lost, once their reply arrives or the loss timeout passes.
+ */
+struct statshm_iface {
+	char name[STATSHM_IFNAMSIZ];
+	uint64_t txed;
+	uint64_t rxed;			/* replies, including duplicates */
+	uint64_t answered;		/* settled probes */
+	uint64_t lost;
+	uint64_t duplicates;
+	uint64_t corrupted;
+	uint64_t rejected;
+	uint64_t rx_errors;
+	uint64_t rx_drops;		/* by the kernel, rx socket full */
+	uint64_t tx_errors;
+	uint64_t in_flight;
+	uint64_t overruns;		/* not settled before slot reuse */
+	struct hist rtt_ns;		/* of the answered probes */
+};
+
+
+/*
+ * A target, i.e. a responder, and its replies through one interface
+ */
+struct statshm_target {
+	uint8_t mac[6];
+	uint16_t iface;
+	uint32_t pad;
+	uint64_t replies;
+	uint64_t rtt_min_ns;
+	uint64_t rtt_max_ns;
+	double rtt_sum_ns;
+	uint64_t last_rx_ns;		/* wall clock */
+};
+
+
+/*
+ * A daemon mode target, i.e. a probe path, the destination and then any
+ * forward addresses before the way back, and its probes through all the
+ * interfaces. Paths are in the order they're probed in.
+ */
+struct statshm_path {
+	uint32_t id;
+	uint16_t num_hops;
+	uint16_t pad;
+	uint8_t hops[STATSHM_PATH_HOPS_MAX][6];
+	uint64_t answered;		/* settled probes */
+	uint64_t lost;
+	uint64_t rtt_min_ns;
+	uint64_t rtt_max_ns;
+	double rtt_sum_ns;
+};
+
+
+struct statshm_stats {
+	uint64_t pid;
+	uint64_t start_ns;		/* wall clock */
+	uint64_t update_ns;		/* wall clock, of this snapshot */
+	uint64_t updates;
+	uint64_t interval_ns;		/* between probes */
+	uint8_t dstmac[6];
+	uint8_t running;		/* 0 in the final snapshot */
+	uint8_t pad;
+	uint32_t num_ifaces;
+	uint32_t num_targets;
+	uint64_t untracked_replies;	/* from targets beyond the table */
+	uint32_t num_paths;		/* 0 unless a daemon */
+	uint32_t pad2;
+	struct statshm_iface ifaces[STATSHM_IFACES_MAX];
+	struct statshm_target targets[STATSHM_TARGETS_MAX];
+	struct statshm_path paths[STATSHM_PATHS_MAX];
+};
+
+
+struct statshm_segment {
+	char magic[8];
+	uint16_t version;
+	uint16_t hist_sub_bits;
+	uint32_t size;			/* of the whole segment */
+	_Atomic uint32_t seq;		/* odd while being written */
+	uint32_t pad;
+	struct statshm_stats stats;
+};
+
+
+struct statshm_writer {
+	struct statshm_segment *seg;
+	char name[STATSHM_NAME_MAX + 1];	/* "" if not shared */
+};
+
+
+struct statshm_reader {
+	const struct statshm_segment *seg;
+	size_t size;
+};
+
+
+enum STATSHM_CREATE {
+	STATSHM_CREATE_GOOD,
+	STATSHM_CREATE_BADNAME,
+	STATSHM_CREATE_BADSHM,		/* see errno */
+};
+enum STATSHM_CREATE statshm_create(struct statshm_writer *sw,
+				   const char *name);
+
+void statshm_publish(struct statshm_writer *sw,
+		     const struct statshm_stats *stats);
+
+void statshm_close(struct statshm_writer *sw);
+
+enum STATSHM_ATTACH {
+	STATSHM_ATTACH_GOOD,
+	STATSHM_ATTACH_BADNAME,
+	STATSHM_ATTACH_BADSHM,		/* see errno */
+	STATSHM_ATTACH_BADLAYOUT,
+};
+enum STATSHM_ATTACH statshm_attach(struct statshm_reader *sr,
+				   const char *name);
+
+void statshm_attach_local(struct statshm_reader *sr,
+			  const struct statshm_writer *sw);
+
+enum STATSHM_READ {
+	STATSHM_READ_GOOD,
+	STATSHM_READ_BUSY,		/* kept changing, try again later */
+};
+enum STATSHM_READ statshm_read(const struct statshm_reader *sr,
+			       struct statshm_stats *stats);
+
+void statshm_detach(struct statshm_reader *sr);
+
+struct statshm_target *statshm_find_target(struct statshm_stats *stats,
+					   const uint8_t mac[6],
+					   const unsigned int iface);
+
+struct statshm_path *statshm_find_path(struct statshm_stats *stats,
+				       const uint32_t id,
+				       unsigned int *hint);
+
+#endif /* __libstatshm_h__ */